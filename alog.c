@@ -0,0 +1,275 @@
+/*
+ * Journalisation asynchrone pour les boucles critiques.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+#include "alog.h"
+
+#define ALOG_MESSAGE_MAX 512
+#define ALOG_SPEC_MAX 32
+
+struct alog_record {
+  const char *file;
+  const char *func;
+  const char *format;
+  long line;
+  int level;
+  int nargs;
+  struct alog_arg args[ALOG_ARGS];
+};
+
+/*
+ * Case de la file: le numéro de séquence indique si la case est libre pour
+ * la position 'seq' ou remplie pour la position 'seq - 1' (file bornée à
+ * plusieurs producteurs de D. Vyukov).
+ */
+struct alog_cell {
+  atomic_size_t seq;
+  struct alog_record record;
+};
+
+static struct {
+  atomic_size_t enqueue;
+  char pad[64 - sizeof(atomic_size_t)];
+  size_t dequeue;
+  size_t mask;
+  struct alog_cell *cells;
+  atomic_ulong drops;
+  /*
+   * File ouverte aux écritures, et écritures en cours: alog_stop ferme la
+   * file puis attend la fin des écritures commencées avant de la libérer.
+   */
+  atomic_int accepting;
+  atomic_int writers;
+  atomic_int running;
+  zlog_category_t *category;
+  pthread_t thread;
+} alog;
+
+int alog_write(int level, const char *file, const char *func, long line,
+	       const char *format, int nargs, const struct alog_arg *args) {
+  struct alog_cell *cell;
+  size_t pos, seq;
+  intptr_t diff;
+
+  atomic_fetch_add(&alog.writers, 1);
+  if (!atomic_load(&alog.accepting)) {
+    atomic_fetch_sub_explicit(&alog.writers, 1, memory_order_release);
+    atomic_fetch_add_explicit(&alog.drops, 1, memory_order_relaxed);
+    return 0;
+  }
+  pos = atomic_load_explicit(&alog.enqueue, memory_order_relaxed);
+  for (;;) {
+    cell = &alog.cells[pos & alog.mask];
+    seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    diff = (intptr_t) seq - (intptr_t) pos;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&alog.enqueue, &pos, pos + 1,
+						memory_order_relaxed,
+						memory_order_relaxed))
+	break;
+    } else if (diff < 0) {
+      // File pleine
+      atomic_fetch_sub_explicit(&alog.writers, 1, memory_order_release);
+      atomic_fetch_add_explicit(&alog.drops, 1, memory_order_relaxed);
+      return 0;
+    } else
+      pos = atomic_load_explicit(&alog.enqueue, memory_order_relaxed);
+  }
+
+  if (nargs > ALOG_ARGS)
+    nargs = ALOG_ARGS;
+  cell->record.file = file;
+  cell->record.func = func;
+  cell->record.format = format;
+  cell->record.line = line;
+  cell->record.level = level;
+  cell->record.nargs = nargs;
+  if (nargs > 0)
+    memcpy(cell->record.args, args, nargs * sizeof(*args));
+  atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+  atomic_fetch_sub_explicit(&alog.writers, 1, memory_order_release);
+
+  return 1;
+}
+
+static int alog_pop(struct alog_record *record) {
+  struct alog_cell *cell = &alog.cells[alog.dequeue & alog.mask];
+  size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+
+  if (seq != alog.dequeue + 1)
+    return 0;
+  *record = cell->record;
+  atomic_store_explicit(&cell->seq, alog.dequeue + alog.mask + 1,
+			memory_order_release);
+  alog.dequeue++;
+
+  return 1;
+}
+
+/*
+ * Formatage d'une spécification de conversion avec un argument enregistré.
+ * Les modificateurs de longueur sont remplacés selon le type conservé: les
+ * entiers sont tous stockés en long long.
+ */
+static int format_arg(char *out, size_t size, const char *spec, size_t len,
+		      char conv, const struct alog_arg *arg) {
+  char buf[ALOG_SPEC_MAX];
+  size_t n = 0, i;
+
+  for (i = 0; i < len - 1 && n < sizeof(buf) - 4; i++)
+    if (strchr("hlLqjzt", spec[i]) == NULL)
+      buf[n++] = spec[i];
+  switch (conv) {
+  case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+    buf[n++] = 'l';
+    buf[n++] = 'l';
+    buf[n++] = conv;
+    buf[n] = '\0';
+    return snprintf(out, size, buf, arg->type == ALOG_DOUBLE ?
+		    (long long) arg->v.d : arg->v.i);
+  case 'c':
+    buf[n++] = conv;
+    buf[n] = '\0';
+    return snprintf(out, size, buf, (int) arg->v.i);
+  case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+    buf[n++] = conv;
+    buf[n] = '\0';
+    return snprintf(out, size, buf, arg->type == ALOG_DOUBLE ?
+		    arg->v.d : (double) arg->v.i);
+  case 's':
+    buf[n++] = conv;
+    buf[n] = '\0';
+    return snprintf(out, size, buf, arg->type == ALOG_STRING && arg->v.p != NULL ?
+		    (const char *) arg->v.p : "(null)");
+  case 'p':
+    buf[n++] = conv;
+    buf[n] = '\0';
+    return snprintf(out, size, buf, arg->v.p);
+  default:
+    return snprintf(out, size, "%.*s", (int) len, spec);
+  }
+}
+
+static void alog_emit(const struct alog_record *record) {
+  char message[ALOG_MESSAGE_MAX];
+  const char *f = record->format, *spec;
+  size_t n = 0, len;
+  int arg = 0, rc;
+
+  while (*f != '\0' && n < sizeof(message) - 1) {
+    if (*f != '%') {
+      message[n++] = *f++;
+      continue;
+    }
+    if (f[1] == '%') {
+      message[n++] = '%';
+      f += 2;
+      continue;
+    }
+    spec = f++;
+    while (*f != '\0' && strchr("-+ #0123456789.hlLqjzt", *f) != NULL)
+      f++;
+    if (*f == '\0')
+      break;
+    len = ++f - spec;
+    if (arg >= record->nargs)
+      rc = snprintf(message + n, sizeof(message) - n, "%.*s", (int) len, spec);
+    else
+      rc = format_arg(message + n, sizeof(message) - n, spec, len, f[-1],
+		      &record->args[arg++]);
+    if (rc > 0)
+      n += (size_t) rc < sizeof(message) - n ? (size_t) rc : sizeof(message) - 1 - n;
+  }
+  message[n] = '\0';
+
+  zlog(alog.category, record->file, strlen(record->file), record->func,
+       strlen(record->func), record->line, record->level, "%s", message);
+}
+
+static void *alog_thread(void *arg) {
+  struct alog_record record;
+  struct timespec delay = { 0, ALOG_DRAIN_US * 1000L };
+  unsigned long reported = 0, drops;
+  int running;
+
+  (void) arg;
+  do {
+    running = atomic_load_explicit(&alog.running, memory_order_acquire);
+    while (alog_pop(&record))
+      alog_emit(&record);
+    drops = atomic_load_explicit(&alog.drops, memory_order_relaxed);
+    if (drops != reported) {
+      zlog_warn(alog.category, "Journal asynchrone : %lu message(s) perdu(s)",
+		drops - reported);
+      reported = drops;
+    }
+    if (running)
+      while (nanosleep(&delay, NULL) != 0 && errno == EINTR)
+	;
+  } while (running);
+
+  return NULL;
+}
+
+int alog_start(zlog_category_t *category, size_t capacity) {
+  size_t n = 1, i;
+
+  // Déjà démarré: le fil de vidage utilise encore la file
+  if (alog.cells != NULL)
+    return 0;
+  while (n < capacity)
+    n <<= 1;
+  alog.cells = malloc(n * sizeof(*alog.cells));
+  if (alog.cells == NULL)
+    return 0;
+  for (i = 0; i < n; i++)
+    atomic_init(&alog.cells[i].seq, i);
+  alog.mask = n - 1;
+  alog.dequeue = 0;
+  alog.category = category;
+  atomic_init(&alog.enqueue, 0);
+  atomic_init(&alog.drops, 0);
+  atomic_init(&alog.writers, 0);
+  atomic_init(&alog.running, 1);
+  if (pthread_create(&alog.thread, NULL, alog_thread, NULL) != 0) {
+    free(alog.cells);
+    alog.cells = NULL;
+    return 0;
+  }
+  atomic_store(&alog.accepting, 1);
+
+  return 1;
+}
+
+void alog_stop(void) {
+  struct alog_cell *cells = alog.cells;
+
+  if (cells == NULL)
+    return;
+  // Plus d'écriture acceptée, puis fin des écritures en cours
+  atomic_store(&alog.accepting, 0);
+  while (atomic_load_explicit(&alog.writers, memory_order_acquire) > 0)
+    sched_yield();
+  // Le fil vide la file une dernière fois avant de s'arrêter
+  atomic_store_explicit(&alog.running, 0, memory_order_release);
+  pthread_join(alog.thread, NULL);
+  alog.cells = NULL;
+  free(cells);
+}
+
+unsigned long alog_drops(void) {
+  return atomic_load_explicit(&alog.drops, memory_order_relaxed);
+}
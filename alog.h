@@ -0,0 +1,128 @@
+/*
+ * Journalisation asynchrone pour les boucles critiques.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Un appel alog_*() ne formate rien et ne fait aucun appel système: il copie
+ * le format, l'emplacement dans le source et les arguments typés dans un
+ * enregistrement binaire d'une file sans verrou à plusieurs producteurs. Un
+ * fil d'arrière-plan vide la file, formate les messages et les transmet à
+ * zlog avec le fichier, la fonction et la ligne d'origine. Si la file est
+ * pleine, le message est perdu et compté.
+ *
+ * Le format et les arguments '%s' ne sont pas copiés: ils doivent rester
+ * valides jusqu'à l'écriture, ce qui est le cas des chaînes littérales. Au
+ * plus ALOG_ARGS arguments sont acceptés.
+ */
+
+#ifndef ALOG_H
+#define ALOG_H
+
+#include <stddef.h>
+
+#include "zlog.h"
+
+#define ALOG_ARGS 6
+#define ALOG_CAPACITY 1024
+// Période de vidage de la file quand elle est vide
+#define ALOG_DRAIN_US 10000
+
+enum { ALOG_INT, ALOG_DOUBLE, ALOG_STRING, ALOG_POINTER };
+
+struct alog_arg {
+  int type;
+  union {
+    long long i;
+    double d;
+    const void *p;
+  } v;
+};
+
+static inline struct alog_arg alog_arg_int(long long v) {
+  struct alog_arg a = { ALOG_INT, { .i = v } };
+  return a;
+}
+
+static inline struct alog_arg alog_arg_double(double v) {
+  struct alog_arg a = { ALOG_DOUBLE, { .d = v } };
+  return a;
+}
+
+static inline struct alog_arg alog_arg_string(const char *v) {
+  struct alog_arg a = { ALOG_STRING, { .p = v } };
+  return a;
+}
+
+static inline struct alog_arg alog_arg_pointer(const void *v) {
+  struct alog_arg a = { ALOG_POINTER, { .p = v } };
+  return a;
+}
+
+#define ALOG_ARG(x) _Generic((x),					\
+			     float: alog_arg_double,			\
+			     double: alog_arg_double,			\
+			     char *: alog_arg_string,			\
+			     const char *: alog_arg_string,		\
+			     void *: alog_arg_pointer,			\
+			     const void *: alog_arg_pointer,		\
+			     default: alog_arg_int)(x)
+
+// Nombre d'arguments et tableau des arguments typés
+#define ALOG_NARGS(...) ALOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define ALOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, n, ...) n
+#define ALOG_CAT(a,b) ALOG_CAT_(a,b)
+#define ALOG_CAT_(a,b) a##b
+#define ALOG_ARGV_0() NULL
+#define ALOG_ARGV_1(a) (const struct alog_arg[]) { ALOG_ARG(a) }
+#define ALOG_ARGV_2(a,b) (const struct alog_arg[]) { ALOG_ARG(a), ALOG_ARG(b) }
+#define ALOG_ARGV_3(a,b,c)						\
+  (const struct alog_arg[]) { ALOG_ARG(a), ALOG_ARG(b), ALOG_ARG(c) }
+#define ALOG_ARGV_4(a,b,c,d)						\
+  (const struct alog_arg[]) { ALOG_ARG(a), ALOG_ARG(b), ALOG_ARG(c),	\
+      ALOG_ARG(d) }
+#define ALOG_ARGV_5(a,b,c,d,e)						\
+  (const struct alog_arg[]) { ALOG_ARG(a), ALOG_ARG(b), ALOG_ARG(c),	\
+      ALOG_ARG(d), ALOG_ARG(e) }
+#define ALOG_ARGV_6(a,b,c,d,e,f)					\
+  (const struct alog_arg[]) { ALOG_ARG(a), ALOG_ARG(b), ALOG_ARG(c),	\
+      ALOG_ARG(d), ALOG_ARG(e), ALOG_ARG(f) }
+
+#define ALOG(level, format, ...)					\
+  alog_write((level), __FILE__, __func__, __LINE__, (format),		\
+	     ALOG_NARGS(__VA_ARGS__),					\
+	     ALOG_CAT(ALOG_ARGV_, ALOG_NARGS(__VA_ARGS__))(__VA_ARGS__))
+
+#define alog_fatal(...) ALOG(ZLOG_LEVEL_FATAL, __VA_ARGS__)
+#define alog_error(...) ALOG(ZLOG_LEVEL_ERROR, __VA_ARGS__)
+#define alog_warn(...) ALOG(ZLOG_LEVEL_WARN, __VA_ARGS__)
+#define alog_notice(...) ALOG(ZLOG_LEVEL_NOTICE, __VA_ARGS__)
+#define alog_info(...) ALOG(ZLOG_LEVEL_INFO, __VA_ARGS__)
+#define alog_debug(...) ALOG(ZLOG_LEVEL_DEBUG, __VA_ARGS__)
+
+/*
+ * Démarrage du fil de vidage vers la catégorie zlog 'category' avec une file
+ * de 'capacity' messages.
+ * Retourne 1 en cas de succès, 0 sinon, notamment si le journal est déjà
+ * démarré.
+ */
+int alog_start(zlog_category_t *category, size_t capacity);
+
+/*
+ * Vidage des messages restants et arrêt du fil. Les messages écrits pendant
+ * ou après l'arrêt sont perdus et comptés; les écritures commencées avant
+ * sont terminées et écrites avant que la file soit libérée.
+ */
+void alog_stop(void);
+
+/*
+ * Ajout d'un message à la file, en temps constant. A utiliser à travers les
+ * macros alog_*. Retourne 1 si le message a été ajouté, 0 s'il a été perdu.
+ */
+int alog_write(int level, const char *file, const char *func, long line,
+	       const char *format, int nargs, const struct alog_arg *args);
+
+// Messages perdus depuis le démarrage
+unsigned long alog_drops(void);
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * Banc d'essai de la journalisation asynchrone.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Compare le coût par appel de zlog_info() et de alog_info() pour un même
+ * message de mesure, ainsi que le pire appel de chacun. Le temps de vidage
+ * de la file par le fil d'arrière-plan est mesuré séparément.
+ *
+ * Matériel demandé: aucun
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "alog.h"
+#include "zlog.h"
+
+#define BENCH_MESSAGES 10000
+
+// Variable globale spécifique à zlog
+zlog_category_t *zlog_c;
+
+static long long now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[]) {
+  long long start, t, dt, zlog_total = 0, zlog_max = 0, alog_total = 0,
+    alog_max = 0, drain;
+  int i, rc, messages = BENCH_MESSAGES;
+
+  // Variables constantes spécifique à zlog
+  const char *zlog_conf = "/etc/zlog.conf";
+  const char *zlog_cat  = "project";
+
+  if (argc > 1)
+    messages = atoi(argv[1]);
+  if (messages <= 0)
+    messages = BENCH_MESSAGES;
+
+  rc = zlog_init(zlog_conf);
+  if (rc) {
+    printf("L'initialisation de zlog avec '%s' a échoué\n", zlog_conf);
+    return EXIT_FAILURE;
+  }
+
+  zlog_c = zlog_get_category(zlog_cat);
+  if (!zlog_c) {
+    printf("zlog est incapable de retrouver la catégorie '%s'\n", zlog_cat);
+    zlog_fini();
+    return EXIT_FAILURE;
+  }
+
+  // Appels synchrones
+  for (i = 0; i < messages; i++) {
+    t = now_ns();
+    zlog_info(zlog_c, "Mesure %d : distance %d mm, vitesse %.1f mm/s",
+	      i, 500 + i % 100, i * 0.5);
+    dt = now_ns() - t;
+    zlog_total += dt;
+    if (dt > zlog_max)
+      zlog_max = dt;
+  }
+
+  // Appels asynchrones, avec une file assez grande pour ne rien perdre
+  if (!alog_start(zlog_c, messages)) {
+    zlog_fatal(zlog_c, "Impossible de démarrer la journalisation asynchrone");
+    zlog_fini();
+    return EXIT_FAILURE;
+  }
+  for (i = 0; i < messages; i++) {
+    t = now_ns();
+    alog_info("Mesure %d : distance %d mm, vitesse %.1f mm/s",
+	      i, 500 + i % 100, i * 0.5);
+    dt = now_ns() - t;
+    alog_total += dt;
+    if (dt > alog_max)
+      alog_max = dt;
+  }
+  start = now_ns();
+  alog_stop();
+  drain = now_ns() - start;
+
+  zlog_info(zlog_c, "%d messages", messages);
+  zlog_info(zlog_c, "zlog_info : %lld ns/appel en moyenne, pire %lld ns",
+	    zlog_total / messages, zlog_max);
+  zlog_info(zlog_c, "alog_info : %lld ns/appel en moyenne, pire %lld ns (x%.1f)",
+	    alog_total / messages, alog_max,
+	    alog_total > 0 ? (double) zlog_total / alog_total : 0.0);
+  zlog_info(zlog_c, "alog_info : %lu message(s) perdu(s), vidage final %lld us",
+	    alog_drops(), drain / 1000);
+
+  zlog_fini();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+/*
+ * Classification des couleurs RGB brutes par table précalculée.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "color_lut.h"
+#include "zlog.h"
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+static const char *names[COLOR_LUT_COLORS] = {
+  "aucune", "noir", "bleu", "vert", "jaune", "rouge", "blanc", "brun"
+};
+
+static long isqrt(long long v) {
+  long long r = 0, bit = 1LL << 62;
+
+  while (bit > v)
+    bit >>= 2;
+  while (bit != 0) {
+    if (v >= r + bit) {
+      v -= r + bit;
+      r = (r >> 1) + bit;
+    } else
+      r >>= 1;
+    bit >>= 2;
+  }
+
+  return (long) r;
+}
+
+static const char *lut_path(const char *path) {
+  if (path == NULL)
+    path = getenv(COLOR_LUT_ENV);
+  return path != NULL && *path != '\0' ? path : COLOR_LUT_PATH;
+}
+
+const char *color_lut_name(int color) {
+  return color >= 0 && color < COLOR_LUT_COLORS ? names[color] : "?";
+}
+
+void color_calibration_init(struct color_calibration *c) {
+  memset(c, 0, sizeof(*c));
+}
+
+void color_calibration_add(struct color_calibration *c, int color,
+			   const int rgb[3]) {
+  int i;
+
+  if (color <= 0 || color >= COLOR_LUT_COLORS)
+    return;
+  for (i = 0; i < 3; i++) {
+    c->sum[color][i] += rgb[i];
+    c->sum_sq[color][i] += (long long) rgb[i] * rgb[i];
+  }
+  c->count[color]++;
+}
+
+// Borne basse de la case 'k' d'une composante, k de 0 à COLOR_LUT_BINS
+static int bin_low(int k) {
+  return k * k * (COLOR_LUT_RAW_MAX + 1) / (COLOR_LUT_BINS * COLOR_LUT_BINS);
+}
+
+int color_lut_nearest(const struct color_lut *l, const int rgb[3]) {
+  long long d, best_d = -1;
+  int color, i, best = 0;
+
+  for (color = 1; color < COLOR_LUT_COLORS; color++) {
+    if (l->radius[color] <= 0)
+      continue;
+    d = 0;
+    for (i = 0; i < 3; i++)
+      d += (long long) (rgb[i] - l->centroid[color][i]) *
+	(rgb[i] - l->centroid[color][i]);
+    if (d <= (long long) l->radius[color] * l->radius[color] &&
+	(best_d < 0 || d < best_d)) {
+      best = color;
+      best_d = d;
+    }
+  }
+
+  return best;
+}
+
+int color_lut_build(struct color_lut *l, const struct color_calibration *c) {
+  long long variance;
+  int color, i, k, v, index, rgb[3], center[COLOR_LUT_BINS], calibrated = 0;
+
+  memset(l, 0, sizeof(*l));
+  for (k = 0; k < COLOR_LUT_BINS; k++) {
+    center[k] = (bin_low(k) + bin_low(k + 1) - 1) / 2;
+    for (v = bin_low(k); v < bin_low(k + 1); v++)
+      l->bin[v] = k;
+  }
+  for (color = 1; color < COLOR_LUT_COLORS; color++) {
+    if (c->count[color] == 0)
+      continue;
+    variance = 0;
+    for (i = 0; i < 3; i++) {
+      l->centroid[color][i] = c->sum[color][i] / c->count[color];
+      variance += c->sum_sq[color][i] / c->count[color] -
+	(long long) l->centroid[color][i] * l->centroid[color][i];
+    }
+    l->radius[color] = COLOR_LUT_SPREAD * isqrt(variance > 0 ? variance : 0) +
+      COLOR_LUT_MARGIN;
+    calibrated++;
+  }
+
+  // Couleur de référence la plus proche du centre de chaque case
+  for (index = 0; index < COLOR_LUT_SIZE; index++) {
+    for (i = 0; i < 3; i++)
+      rgb[i] = center[(index >> ((2 - i) * COLOR_LUT_BITS)) &
+		      (COLOR_LUT_BINS - 1)];
+    l->table[index] = color_lut_nearest(l, rgb);
+  }
+
+  return calibrated;
+}
+
+int color_lut_save(const struct color_lut *l, const char *path) {
+  FILE *f;
+  int ok;
+
+  path = lut_path(path);
+  f = fopen(path, "wb");
+  if (f == NULL) {
+    zlog_error(zlog_c, "Impossible d'enregistrer la table des couleurs '%s' : %s",
+	       path, strerror(errno));
+    return 0;
+  }
+  ok = fwrite(COLOR_LUT_MAGIC, 4, 1, f) == 1 && fwrite(l, sizeof(*l), 1, f) == 1;
+  if (fclose(f) != 0)
+    ok = 0;
+  if (!ok)
+    zlog_error(zlog_c, "Echec de l'écriture de la table des couleurs '%s'", path);
+
+  return ok;
+}
+
+int color_lut_load(struct color_lut *l, const char *path) {
+  char magic[4];
+  FILE *f;
+  int ok;
+
+  path = lut_path(path);
+  f = fopen(path, "rb");
+  if (f == NULL)
+    return 0;
+  ok = fread(magic, 4, 1, f) == 1 && memcmp(magic, COLOR_LUT_MAGIC, 4) == 0 &&
+    fread(l, sizeof(*l), 1, f) == 1;
+  fclose(f);
+  if (!ok)
+    zlog_warn(zlog_c, "La table des couleurs '%s' est invalide", path);
+
+  return ok;
+}
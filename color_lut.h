@@ -0,0 +1,107 @@
+/*
+ * Classification des couleurs RGB brutes par table précalculée.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * L'étalonnage accumule des mesures RGB-RAW de référence pour chaque
+ * couleur, dans l'éclairage réel. La table est ensuite construite une fois:
+ * l'espace RGB est découpé en 64x64x64 cases, et chaque case reçoit la
+ * couleur de référence la plus proche de son centre, ou aucune couleur si
+ * elle est trop loin de toutes. Classer une mesure revient alors à lire une
+ * case. La table est enregistrée sur disque pour ne pas refaire
+ * l'étalonnage à chaque lancement.
+ *
+ * Les cases ne sont pas uniformes: la borne basse de la case k de chaque
+ * composante est k² x 1024 / 64², soit des cases d'une à deux unités près
+ * du noir et de 32 unités vers le blanc. Les références sombres (noir,
+ * bleu, brun), presque toutes sous 100 unités, se partagent ainsi une
+ * dizaine de cases par composante au lieu de trois ou quatre, pour une
+ * erreur de quantification bien plus petite que leur distance de rejet. La
+ * case d'une valeur brute est lue dans une table de 1024 octets.
+ *
+ * Les couleurs sont numérotées comme les index du mode COL-COLOR (0 pour
+ * aucune, 1 noir, 2 bleu, 3 vert, 4 jaune, 5 rouge, 6 blanc, 7 brun).
+ */
+
+#ifndef COLOR_LUT_H
+#define COLOR_LUT_H
+
+#include <stdint.h>
+
+#define COLOR_LUT_COLORS 8
+// Cases par composante: 2^6, non uniformes
+#define COLOR_LUT_BITS 6
+#define COLOR_LUT_BINS (1 << COLOR_LUT_BITS)
+#define COLOR_LUT_SIZE (1 << (3 * COLOR_LUT_BITS))
+#define COLOR_LUT_RAW_MAX 1023
+// Distance de rejet: COLOR_LUT_SPREAD écarts-types plus une marge
+#define COLOR_LUT_SPREAD 4
+#define COLOR_LUT_MARGIN 30
+// "EV3C" pour l'ancienne table uniforme de 32x32x32 cases
+#define COLOR_LUT_MAGIC "EV3Q"
+#define COLOR_LUT_PATH "color.lut"
+#define COLOR_LUT_ENV "EV3_COLOR_LUT"
+
+struct color_calibration {
+  long sum[COLOR_LUT_COLORS][3];
+  long long sum_sq[COLOR_LUT_COLORS][3];
+  int count[COLOR_LUT_COLORS];
+};
+
+struct color_lut {
+  // Couleurs de référence: moyenne et distance de rejet
+  int centroid[COLOR_LUT_COLORS][3];
+  int radius[COLOR_LUT_COLORS];
+  // Case de chaque valeur brute d'une composante
+  uint8_t bin[COLOR_LUT_RAW_MAX + 1];
+  uint8_t table[COLOR_LUT_SIZE];
+};
+
+void color_calibration_init(struct color_calibration *c);
+
+// Ajout d'une mesure RGB-RAW de référence pour la couleur 'color'
+void color_calibration_add(struct color_calibration *c, int color,
+			   const int rgb[3]);
+
+/*
+ * Construction de la table à partir des mesures de référence.
+ * Retourne le nombre de couleurs étalonnées.
+ */
+int color_lut_build(struct color_lut *l, const struct color_calibration *c);
+
+static inline int color_lut_index(const struct color_lut *l, const int rgb[3]) {
+  int i, q, index = 0;
+
+  for (i = 0; i < 3; i++) {
+    q = rgb[i] < 0 ? 0 : rgb[i] > COLOR_LUT_RAW_MAX ? COLOR_LUT_RAW_MAX : rgb[i];
+    index = (index << COLOR_LUT_BITS) | l->bin[q];
+  }
+
+  return index;
+}
+
+// Couleur d'une mesure RGB-RAW
+static inline int color_lut_classify(const struct color_lut *l, const int rgb[3]) {
+  return l->table[color_lut_index(l, rgb)];
+}
+
+/*
+ * Couleur de référence la plus proche d'une mesure RGB-RAW, sans la table,
+ * ou 0 si la mesure est trop loin de toutes. C'est la classification que
+ * la table approche; elle sert à mesurer l'erreur de quantification.
+ */
+int color_lut_nearest(const struct color_lut *l, const int rgb[3]);
+
+/*
+ * Enregistrement et chargement de la table, dans 'path' ou, si nul, dans
+ * le fichier donné par EV3_COLOR_LUT ou COLOR_LUT_PATH.
+ * Retournent 1 en cas de succès, 0 sinon.
+ */
+int color_lut_save(const struct color_lut *l, const char *path);
+int color_lut_load(struct color_lut *l, const char *path);
+
+// Nom d'une couleur
+const char *color_lut_name(int color);
+
+#endif
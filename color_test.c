@@ -4,12 +4,23 @@
  * Auteur: Dorian Burihabwa
  * Auteur: Christian Göttel
  *
+ * Le test couleur classe les valeurs RGB-RAW avec une table étalonnée et
+ * compare le résultat au mode COL-COLOR du firmware. Le test lumière mesure
+ * les lumières reflétée et ambiante entrelacées, d'abord en changeant de
+ * mode à chaque mesure puis par visites (voir sensor_modes.h). 'color_test calibrate'
+ * refait l'étalonnage avant les tests: lancer le programme avec le capteur
+ * sur la surface noire, puis présenter les surfaces bleue, verte, jaune,
+ * rouge, blanche et brune dans cet ordre. Chaque surface est mesurée dès
+ * qu'elle est stable.
+ *
  * Matériel demandé:
  * - 1x EV3 Color Sensor / Capteur de couleur EV3
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <ev3.h>
@@ -17,6 +28,14 @@
 #include <ev3_port.h>
 #include <ev3_sensor.h>
 
+#include "color_lut.h"
+#include "discovery.h"
+#include "latency.h"
+#include "ready.h"
+#include "sensor_modes.h"
+#include "sensor_reader.h"
+#include "suite.h"
+#include "telemetry.h"
 #include "zlog.h"
 
 /*
@@ -24,23 +43,13 @@
  * et traitement d'erreur.
  */
 #define SET_SENSOR_MODE_INX(sn,m) do {					\
-    _bytes = set_sensor_mode_inx((sn), (m));				\
+    LATENCY_TIME(_bytes, LATENCY_SENSOR, (sn), "mode",			\
+		 set_sensor_mode_inx((sn), (m)));			\
     if (_bytes == 0) {							\
       zlog_error(zlog_c, "Impossible de changer en mode '"#m"' pour le capteur '%s'", ev3_sensor_type(ev3_sensor[(sn)].type_inx)); \
-      ev3_uninit();							\
-      return 0;								\
-    }									\
-  } while(0);
-
-#define GET_SENSOR_VALUE0(sn,v) do {					\
-    _bytes = get_sensor_value0((sn), (v));				\
-    if (_bytes == 0) {							\
-      zlog_error(zlog_c,						\
-		 "Impossible d'assigner une valeur du capteur '%s'",	\
-		 ev3_sensor_type(ev3_sensor[(sn)].type_inx));		\
-      ev3_uninit();							\
       return 0;								\
     }									\
+    telemetry_mode((sn), (m));						\
   } while(0);
 
 // Numéro de séquence du capteur de couleur
@@ -56,91 +65,253 @@
 #define SENSOR_COLOR_WHITE 6
 #define SENSOR_COLOR_BROWN 7
 
-// Drapeau pour verifier la présence des capteurs
-#define HAVE_SENSOR_COLOR 0b1
-
+/*
+ * Période de lecture et délai maximal après un changement de mode, le double
+ * de la stabilisation de COL-AMBIENT, le plus lent; pause fixe entre deux
+ * tests remplacée par l'attente du capteur.
+ */
+#define COLOR_SAMPLE_US 5000
+#define COLOR_SETTLE_US 80000
+#define COLOR_PHASE_US 1000000
+// Surface stable: mesures successives à moins de COLOR_STABLE_DIST (somme
+// des écarts RGB) de la première; nouvelle surface: au-delà de
+// COLOR_CHANGE_DIST de la précédente
+#define COLOR_STABLE_DIST 80
+#define COLOR_STABLE_SAMPLES 10
+#define COLOR_CHANGE_DIST 80
+#define COLOR_CALIBRATION_SAMPLES 30
+#define COLOR_CALIBRATION_TIMEOUT_S 30
+// Tours de comparaison avec le firmware et mesures par mode à chaque tour
+#define COLOR_TEST_ROUNDS 40
+#define COLOR_TEST_SAMPLES 5
+#define COLOR_LOOKUPS 1000000
+// Durée de chaque phase du test lumière
+#define LIGHT_TEST_MS 2000
+
+#ifdef EV3_SUITE
+// Catégorie zlog définie par le programme (voir suite.c)
+extern zlog_category_t *zlog_c;
+#else
 // Variable globale spécifique à zlog
 zlog_category_t *zlog_c;
+#endif
 
 // Tableau pour les numéros de séquence des capteurs
-uint8_t sensor_sn[SENSOR_DESC__LIMIT_];
+static uint8_t sensor_sn[SENSOR_DESC__LIMIT_];
+
+// Lecteur des valeurs du capteur de couleur et gestion de ses modes
+static struct sensor_reader color_reader;
+static struct sensor_modes color_modes;
 
 // Variable globale pour les macros
-size_t _bytes;
+static size_t _bytes;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int rgb_distance(const int a[3], const int b[3]) {
+  return abs(a[0] - b[0]) + abs(a[1] - b[1]) + abs(a[2] - b[2]);
+}
+
+static int read_rgb(int rgb[3]) {
+  if (!sensor_modes_read(&color_modes, LEGO_EV3_COLOR_RGB_RAW, rgb, 3)) {
+    zlog_error(zlog_c, "Impossible de lire les valeurs RGB du capteur de couleur");
+    return 0;
+  }
+
+  return 1;
+}
+
+// Lecture de la couleur du firmware en mode COL-COLOR
+static int read_color(int *color) {
+  if (!sensor_modes_read(&color_modes, LEGO_EV3_COLOR_COL_COLOR, color, 1)) {
+    zlog_error(zlog_c, "Impossible de lire la couleur du capteur de couleur");
+    return 0;
+  }
+
+  return 1;
+}
 
 /*
- * Initialisation de la brique EV3 et du capteur de couleur.
- * Valeurs de retour:
- * 1, si la brique intelligente EV3 et le capteur de couleur ont été
- * correctemment initialisés,
- * 0, si la brique intelligente EV3 n'a pas été trouvée (erreur grave) ou une
- * erreur des capteurs EV3,
- * <0, en cas d'erreur de la brique intelligente EV3 ou des ports EV3,
- * >1, en cas d'erreur.
+ * Changement de mode et attente de la première valeur du nouveau mode, au
+ * plus COLOR_SETTLE_US.
  */
-int init(void) {
-  int i, rc;
-  size_t bytes;
-  unsigned char sensors = 0;
+static int set_color_mode(INX_T mode, const char *name) {
+  if (sensor_modes_set(&color_modes, mode) < 0) {
+    zlog_error(zlog_c, "Impossible de changer en mode '%s' pour le capteur de couleur",
+	       name);
+    return 0;
+  }
+
+  return 1;
+}
+
+// Couleur la plus fréquente parmi 'n' couleurs
+static int majority(const int *colors, int n) {
+  int i, best = 0, votes[COLOR_LUT_COLORS] = { 0 };
+
+  for (i = 0; i < n; i++)
+    if (colors[i] >= 0 && colors[i] < COLOR_LUT_COLORS)
+      votes[colors[i]]++;
+  for (i = 1; i < COLOR_LUT_COLORS; i++)
+    if (votes[i] > votes[best])
+      best = i;
+
+  return best;
+}
+
+/*
+ * Mise en correspondance du capteur de couleur dans la table 'devices' et
+ * ouverture de son lecteur de valeurs.
+ * Retourne 1 si le capteur a été retrouvé et son lecteur ouvert, 0 sinon.
+ */
+int color_setup(struct ev3_device_map *devices) {
+  int i;
   uint8_t sn;
 
   for (i = 0; i < SENSOR_DESC__LIMIT_; i++)
     sensor_sn[i] = DESC_LIMIT;
 
-  // Initialisation de la brique intelligente EV3
-  rc = ev3_init();
-  if (rc == 1)
-    zlog_info(zlog_c, "Brique intelligente EV3 trouvée");
-  else {
-    if (rc == 0)
-      zlog_fatal(zlog_c, "Brique intelligente EV3 pas trouvée");
-    else
-      zlog_error(zlog_c, "ev3_init retourne erreur '%d'", rc);
-    return rc;
-  }
-  // Initialisation des ports EV3
-  rc = ev3_port_init();
-  if (rc == -1) {
-    zlog_error(zlog_c, "Erreur durant l'initialisation des ports EV3");
-    ev3_uninit();
-    return rc;
-  } else if (rc != 8)
-    zlog_warn(zlog_c, "'%d/8' ports EV3 retrouvé");
-  else
-    zlog_info(zlog_c, "Tous ports EV3 retrouvé");
-  // Initialisation des capteurs EV3
-  rc = ev3_sensor_init();
-  if (rc == -1) {
-    zlog_error(zlog_c, "Erreur durant l'initialisation des capteurs EV3");
-    ev3_uninit();
-    return rc;
-  } else
-    zlog_info(zlog_c, "'%d' capteur(s) EV3 retrouvé", rc);
   /*
    * Assurer que le capteur de couleur est mis dans la brique et mettre en
    * correspondance les numéros de séquence.
    */
-  for (i = 0; i < SENSOR_DESC__LIMIT_; i++)
-    if (ev3_sensor[i].type_inx == LEGO_EV3_COLOR) {
-      sensors |= HAVE_SENSOR_COLOR;
-      SENSOR_COLOR_SN = i;
-      if (ev3_search_sensor_plugged_in(ev3_sensor[i].port, ev3_sensor[i].extport, &sn, 0)) {
-	SET_SENSOR_MODE_INX(sn, LEGO_EV3_COLOR_COL_COLOR);
-      } else {
-	zlog_error(zlog_c, "Le capteur de couleur n'est pas connecté à la brique intelligente EV3");
-	return 0;
-      }
-      break;
-    }
-
-  if (sensors != HAVE_SENSOR_COLOR) {
+  sn = discovery_sensor(devices, LEGO_EV3_COLOR);
+  if (sn == DESC_LIMIT) {
     zlog_fatal(zlog_c, "Le capteur de couleur n'a pas été retrouvé");
+    return 0;
+  }
+  SENSOR_COLOR_SN = sn;
+  SET_SENSOR_MODE_INX(sn, LEGO_EV3_COLOR_COL_COLOR);
+  if (!sensor_reader_open(&color_reader, sn)) {
+    zlog_fatal(zlog_c, "Impossible d'ouvrir les valeurs du capteur de couleur");
+    return 0;
+  }
+  sensor_modes_init(&color_modes, &color_reader, COLOR_SETTLE_US / 1000);
+
+  return 1;
+}
+
+/*
+ * Attente d'une valeur lisible du capteur de couleur, au plus
+ * COLOR_PHASE_US. Valeurs de retour: voir ready_sensor.
+ */
+int color_ready(struct ready_wait *w) {
+  return ready_sensor(&color_reader, COLOR_PHASE_US / 1000, w);
+}
+
+/*
+ * Impression des changements de mode, remise du capteur de couleur en mode
+ * lumière reflétée et fermeture de son lecteur de valeurs.
+ */
+void color_teardown(void) {
+  size_t bytes;
+
+  sensor_modes_report(&color_modes, "Capteur de couleur");
+  bytes = set_sensor_mode_inx(SENSOR_COLOR_SN, LEGO_EV3_COLOR_COL_REFLECT);
+  if (bytes == 0)
+    zlog_error(zlog_c, "Impossible de changer au mode 'LEGO_EV3_COLOR_COL_REFLECT' pour le capteur de couleur");
+  sensor_reader_close(&color_reader);
+}
+
+#ifndef EV3_SUITE
+/*
+ * Initialisation de la brique intelligente EV3 et découverte des capteurs.
+ * Valeurs de retour: voir discovery_init et color_setup.
+ */
+static int init(void) {
+  static struct ev3_device_map devices;
+  int rc;
+
+  rc = discovery_init(&devices, DISCOVERY_SENSORS);
+  if (rc != 1)
+    return rc;
+  if (!color_setup(&devices)) {
     ev3_uninit();
     return 0;
   }
 
   return 1;
 }
+#endif
+
+/*
+ * Mesure de la prochaine surface stable et différente de 'previous' (si non
+ * nul) pour la couleur 'color'. La moyenne mesurée est rendue dans 'mean'.
+ * Retourne 1 si la surface a été mesurée, 0 sinon.
+ */
+static int calibrate_surface(struct color_calibration *c, int color,
+			     const int *previous, int mean[3]) {
+  int rgb[3], ref[3], samples[COLOR_CALIBRATION_SAMPLES][3];
+  int i, stable = 0, n = 0;
+  uint64_t deadline = now_ns() + COLOR_CALIBRATION_TIMEOUT_S * 1000000000ULL;
+
+  zlog_info(zlog_c, "Présentez la surface '%s'", color_lut_name(color));
+  while (n < COLOR_CALIBRATION_SAMPLES) {
+    if (now_ns() > deadline) {
+      zlog_error(zlog_c, "Aucune nouvelle surface stable pour '%s'",
+		 color_lut_name(color));
+      return 0;
+    }
+    if (!read_rgb(rgb))
+      return 0;
+    usleep(COLOR_SAMPLE_US);
+    if (previous != NULL && rgb_distance(rgb, previous) < COLOR_CHANGE_DIST) {
+      stable = n = 0;
+      continue;
+    }
+    if (stable == 0 || rgb_distance(rgb, ref) > COLOR_STABLE_DIST) {
+      // Début d'une nouvelle surface candidate
+      memcpy(ref, rgb, sizeof(ref));
+      stable = 1;
+      n = 0;
+    } else if (stable < COLOR_STABLE_SAMPLES)
+      stable++;
+    else
+      memcpy(samples[n++], rgb, sizeof(rgb));
+  }
+
+  for (i = 0; i < 3; i++)
+    mean[i] = 0;
+  for (n = 0; n < COLOR_CALIBRATION_SAMPLES; n++) {
+    color_calibration_add(c, color, samples[n]);
+    for (i = 0; i < 3; i++)
+      mean[i] += samples[n][i];
+  }
+  for (i = 0; i < 3; i++)
+    mean[i] /= COLOR_CALIBRATION_SAMPLES;
+  zlog_info(zlog_c, "Surface '%s' : R %d, V %d, B %d", color_lut_name(color),
+	    mean[0], mean[1], mean[2]);
+
+  return 1;
+}
+
+/*
+ * Etalonnage des couleurs SENSOR_COLOR_BLACK à SENSOR_COLOR_BROWN et
+ * enregistrement de la table.
+ * Retourne 1 en cas de succès, 0 sinon.
+ */
+int calibrate(void) {
+  static struct color_lut lut;
+  struct color_calibration c;
+  int color, mean[3];
+
+  if (!set_color_mode(LEGO_EV3_COLOR_RGB_RAW, "LEGO_EV3_COLOR_RGB_RAW"))
+    return 0;
+  color_calibration_init(&c);
+  for (color = SENSOR_COLOR_BLACK; color <= SENSOR_COLOR_BROWN; color++) {
+    if (!calibrate_surface(&c, color, color == SENSOR_COLOR_BLACK ? NULL : mean,
+			   mean))
+      return 0;
+  }
+  color_lut_build(&lut, &c);
+
+  return color_lut_save(&lut, NULL);
+}
 
 int ambient_light_test(void) {
 
@@ -149,10 +320,151 @@ int ambient_light_test(void) {
   return 1;
 }
 
+/*
+ * Classification RGB-RAW par la table comparée au mode COL-COLOR. Chaque
+ * tour lit la couleur du firmware, les valeurs RGB puis de nouveau la
+ * couleur du firmware; les tours où la surface a changé entre les deux
+ * lectures du firmware sont écartés. Chaque mesure est aussi classée sans
+ * la table, par le centre de référence le plus proche, pour séparer
+ * l'erreur de quantification de la table de celle de l'étalonnage.
+ */
 int color_test(void) {
+  static struct color_lut lut;
+  static int rgb[COLOR_TEST_ROUNDS * COLOR_TEST_SAMPLES][3];
+  int before[COLOR_TEST_SAMPLES], after[COLOR_TEST_SAMPLES];
+  int classes[COLOR_TEST_SAMPLES];
+  int agree[COLOR_LUT_COLORS] = { 0 }, seen[COLOR_LUT_COLORS] = { 0 };
+  int round, i, n = 0, firmware, classified, compared = 0, matches = 0;
+  int discarded = 0, rejected = 0, nearest_matches = 0;
+  // Volatile pour que le compilateur garde les classifications mesurées
+  volatile int sink = 0;
+  uint64_t start, read_ns = 0;
+
+  if (!color_lut_load(&lut, NULL)) {
+    zlog_warn(zlog_c, "Pas de table des couleurs, lancer 'color_test calibrate'");
+    return 0;
+  }
+
+  for (round = 0; round < COLOR_TEST_ROUNDS; round++) {
+    if (!set_color_mode(LEGO_EV3_COLOR_COL_COLOR, "LEGO_EV3_COLOR_COL_COLOR"))
+      return 0;
+    for (i = 0; i < COLOR_TEST_SAMPLES; i++)
+      if (!read_color(&before[i]))
+	return 0;
+
+    if (!set_color_mode(LEGO_EV3_COLOR_RGB_RAW, "LEGO_EV3_COLOR_RGB_RAW"))
+      return 0;
+    for (i = 0; i < COLOR_TEST_SAMPLES; i++, n++) {
+      start = now_ns();
+      if (!read_rgb(rgb[n]))
+	return 0;
+      classes[i] = color_lut_classify(&lut, rgb[n]);
+      read_ns += now_ns() - start;
+      if (classes[i] == SENSOR_COLOR_NONE)
+	rejected++;
+      usleep(COLOR_SAMPLE_US);
+    }
+    classified = majority(classes, COLOR_TEST_SAMPLES);
+
+    if (!set_color_mode(LEGO_EV3_COLOR_COL_COLOR, "LEGO_EV3_COLOR_COL_COLOR"))
+      return 0;
+    for (i = 0; i < COLOR_TEST_SAMPLES; i++)
+      if (!read_color(&after[i]))
+	return 0;
+
+    firmware = majority(before, COLOR_TEST_SAMPLES);
+    if (firmware != majority(after, COLOR_TEST_SAMPLES)) {
+      discarded++;
+      continue;
+    }
+    zlog_debug(zlog_c, "Firmware '%s', table '%s'", color_lut_name(firmware),
+	       color_lut_name(classified));
+    seen[firmware]++;
+    compared++;
+    if (classified == firmware) {
+      agree[firmware]++;
+      matches++;
+    }
+  }
+
+  // Table comparée à la classification directe qu'elle approche
+  for (i = 0; i < n; i++)
+    if (color_lut_classify(&lut, rgb[i]) == color_lut_nearest(&lut, rgb[i]))
+      nearest_matches++;
+
+  // Coût de la classification seule, sur les mesures du test
+  start = now_ns();
+  for (i = 0; i < COLOR_LOOKUPS; i++)
+    sink += color_lut_classify(&lut, rgb[i % n]);
+  start = now_ns() - start;
+
+  zlog_info(zlog_c, "Classification : %.1f ns, %.0f classifications/s",
+	    (double) start / COLOR_LOOKUPS, COLOR_LOOKUPS * 1e9 / start);
+  zlog_info(zlog_c, "Lecture RGB et classification : %.1f µs par mesure",
+	    read_ns / 1000.0 / n);
+  zlog_info(zlog_c, "Accord avec le firmware : %d/%d tours (%d%%), %d écartés, %d mesures sans couleur",
+	    matches, compared, compared ? 100 * matches / compared : 0,
+	    discarded, rejected);
+  for (i = 1; i < COLOR_LUT_COLORS; i++)
+    if (seen[i])
+      zlog_info(zlog_c, "  %-6s : %d/%d", color_lut_name(i), agree[i], seen[i]);
+  zlog_info(zlog_c, "Accord avec le centre le plus proche : %d/%d mesures (%d%%)",
+	    nearest_matches, n, n ? 100 * nearest_matches / n : 0);
+
+  return 1;
+}
+
+// Lumières reflétée et ambiante mesurées
+struct light_sums {
+  long sum[2];
+  unsigned long n[2];
+};
+
+static void light_sample(void *arg, INX_T mode, const int *v) {
+  struct light_sums *l = arg;
+  int i = mode == LEGO_EV3_COLOR_COL_AMBIENT;
+
+  l->sum[i] += v[0];
+  l->n[i]++;
+}
+
+static void light_report(const char *name, const struct light_sums *l) {
+  zlog_info(zlog_c, "%s : %lu mesure(s) reflétée(s) (moyenne %ld %%), %lu ambiante(s) (moyenne %ld %%), %.1f mesures/s",
+	    name, l->n[0], l->n[0] ? l->sum[0] / (long) l->n[0] : 0,
+	    l->n[1], l->n[1] ? l->sum[1] / (long) l->n[1] : 0,
+	    (l->n[0] + l->n[1]) * 1000.0 / LIGHT_TEST_MS);
+}
+
+/*
+ * Lumières reflétée et ambiante entrelacées pendant LIGHT_TEST_MS, d'abord
+ * en changeant de mode à chaque mesure, puis par visites dont la longueur
+ * amortit les durées de stabilisation mesurées pendant la première phase.
+ */
+int light_test(void) {
+  static const INX_T modes[2] = {
+    LEGO_EV3_COLOR_COL_REFLECT, LEGO_EV3_COLOR_COL_AMBIENT
+  };
+  struct light_sums each = { { 0, 0 }, { 0, 0 } };
+  struct light_sums visits = { { 0, 0 }, { 0, 0 } };
+  uint64_t end = now_ns() + LIGHT_TEST_MS * 1000000ULL;
+  int i, v;
+
+  for (i = 0; now_ns() < end; i ^= 1) {
+    if (!sensor_modes_read(&color_modes, modes[i], &v, 1)) {
+      zlog_error(zlog_c, "Impossible de lire la lumière du capteur de couleur");
+      return 0;
+    }
+    light_sample(&each, modes[i], &v);
+    usleep(COLOR_SAMPLE_US);
+  }
+  if (!sensor_modes_interleave(&color_modes, modes, 2, 1, COLOR_SAMPLE_US,
+			       LIGHT_TEST_MS, light_sample, &visits)) {
+    zlog_error(zlog_c, "Impossible de lire la lumière du capteur de couleur");
+    return 0;
+  }
+  light_report("Changement à chaque mesure", &each);
+  light_report("Visites", &visits);
 
-  // A compléter
-  
   return 1;
 }
 
@@ -163,9 +475,18 @@ int reflected_light_test(void) {
   return 1;
 }
 
+#ifndef EV3_SUITE
+// Attente du capteur avant le test 'name', au lieu d'une pause fixe
+static void phase_wait(const char *name) {
+  struct ready_wait w;
+
+  if (color_ready(&w) < 0)
+    zlog_warn(zlog_c, "Impossible de lire le capteur de couleur");
+  ready_report(&w, name, COLOR_PHASE_US);
+}
+
 int main (int argc, char *argv[]) {
   int rc;
-  size_t bytes;
 
   // Variables constantes spécifique à zlog
   const char *zlog_conf = "/etc/zlog.conf";
@@ -186,43 +507,61 @@ int main (int argc, char *argv[]) {
   
   zlog_info(zlog_c, "Hello IIUN!");
 
+  latency_start();
+
   if(!init()) {
     zlog_fini();
     return EXIT_FAILURE;
   }
+  telemetry_start_env();
+
+  if (argc > 1 && strcmp(argv[1], "calibrate") == 0) {
+    zlog_info(zlog_c, "=== Etalonnage des couleurs ===");
+    if (!calibrate()) {
+      telemetry_stop();
+      sensor_reader_close(&color_reader);
+      ev3_uninit();
+      zlog_fini();
+      return EXIT_FAILURE;
+    }
+  }
 
   // Changer la lumière à rouge
   set_light(LIT_LEFT, LIT_RED);
   set_light(LIT_RIGHT, LIT_RED);
 
   // Test lumière reflété
-  sleep(1); // Attend une seconde
+  phase_wait("Test lumière reflété");
   zlog_info(zlog_c, "=== Test lumière reflété ===");
   reflected_light_test();
   set_light(LIT_LEFT, LIT_AMBER);
   // Test lumière ambiante
-  sleep(1);
+  phase_wait("Test lumière ambiante");
   zlog_info(zlog_c, "=== Test lumière ambiante ===");
   ambient_light_test();
   set_light(LIT_RIGHT, LIT_AMBER);
   // Test couleur
-  sleep(1);
+  phase_wait("Test couleur");
   zlog_info(zlog_c, "=== Test couleur ===");
   color_test();
+  // Test lumière entrelacée
+  zlog_info(zlog_c, "=== Test lumière entrelacée ===");
+  light_test();
 
   // Changer la lumière à vert
   set_light(LIT_LEFT, LIT_GREEN);
   set_light(LIT_RIGHT, LIT_GREEN);
 
-  bytes = set_sensor_mode_inx(SENSOR_COLOR_SN, LEGO_EV3_COLOR_COL_REFLECT);
-  if (bytes == 0)
-    zlog_error(zlog_c, "Impossible de changer au mode 'LEGO_EV3_COLOR_COL_COLOR' pour le capteur de couleur");
-    
+  color_teardown();
+
   zlog_info(zlog_c, "Bye IIUN!");
 
+  latency_stop();
+  telemetry_stop();
   ev3_uninit();
 
   zlog_fini();
 
   return EXIT_SUCCESS;
 }
+#endif
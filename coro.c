@@ -0,0 +1,167 @@
+/*
+ * Ordonnanceur coopératif de tâches sans pile (protothreads).
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+
+#include "coro.h"
+#include "zlog.h"
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+void coro_sched_init(struct coro_sched *s) {
+  s->count = 0;
+  s->alive = 0;
+  s->resumes = 0;
+  s->idles = 0;
+  s->idle_ns = 0;
+  s->start_ns = s->stop_ns = 0;
+}
+
+int coro_spawn(struct coro_sched *s, struct coro *c, const char *name,
+	       int (*run)(struct coro *c, void *arg), void *arg) {
+  if (s->count == CORO_TASKS)
+    return 0;
+  c->name = name;
+  c->run = run;
+  c->arg = arg;
+  c->line = 0;
+  c->state = CORO_YIELDED;
+  c->wake_ns = 0;
+  c->fd = -1;
+  c->fd_ready = 0;
+  c->resumes = 0;
+  s->tasks[s->count++] = c;
+  s->alive++;
+
+  return 1;
+}
+
+// Sommeil jusqu'à l'instant absolu 'wake_ns'
+static void idle(struct coro_sched *s, uint64_t wake_ns) {
+  struct timespec ts;
+  uint64_t start = coro_now();
+
+  if (wake_ns <= start)
+    return;
+  ts.tv_sec = wake_ns / 1000000000ULL;
+  ts.tv_nsec = wake_ns % 1000000000ULL;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+  s->idles++;
+  s->idle_ns += coro_now() - start;
+}
+
+/*
+ * Attente des descripteurs des tâches en CORO_WAIT_FD jusqu'à l'instant
+ * absolu 'wake_ns', sans attente si 'wake_ns' est passé. Les tâches dont le
+ * descripteur est lisible sont marquées pour leur prochaine reprise.
+ */
+static void idle_fds(struct coro_sched *s, uint64_t wake_ns) {
+  struct pollfd pfd[CORO_TASKS];
+  struct coro *owner[CORO_TASKS];
+  struct timespec ts = { 0, 0 };
+  uint64_t start = coro_now();
+  int i, n = 0;
+
+  for (i = 0; i < s->count; i++)
+    if (s->tasks[i]->state == CORO_WAITING_FD && s->tasks[i]->fd >= 0) {
+      pfd[n].fd = s->tasks[i]->fd;
+      pfd[n].events = POLLIN;
+      owner[n++] = s->tasks[i];
+    }
+  if (wake_ns > start) {
+    ts.tv_sec = (wake_ns - start) / 1000000000ULL;
+    ts.tv_nsec = (wake_ns - start) % 1000000000ULL;
+  }
+  if (ppoll(pfd, n, wake_ns == UINT64_MAX ? NULL : &ts, NULL) > 0)
+    for (i = 0; i < n; i++)
+      if (pfd[i].revents != 0)
+	owner[i]->fd_ready = 1;
+  if (wake_ns > start) {
+    s->idles++;
+    s->idle_ns += coro_now() - start;
+  }
+}
+
+void coro_run(struct coro_sched *s) {
+  struct coro *c;
+  uint64_t now, wake;
+  int i, ready, waiting, fds;
+
+  s->start_ns = coro_now();
+  while (s->alive > 0) {
+    now = coro_now();
+    wake = UINT64_MAX;
+    ready = waiting = fds = 0;
+    for (i = 0; i < s->count; i++) {
+      c = s->tasks[i];
+      if (c->state == CORO_DONE)
+	continue;
+      // Tâche endormie ou en attente de son descripteur: pas de reprise
+      if ((c->state == CORO_SLEEPING ||
+	   (c->state == CORO_WAITING_FD && !c->fd_ready)) &&
+	  now < c->wake_ns) {
+	if (c->wake_ns < wake)
+	  wake = c->wake_ns;
+	fds |= c->state == CORO_WAITING_FD;
+	continue;
+      }
+      c->state = c->run(c, c->arg);
+      c->resumes++;
+      s->resumes++;
+      switch (c->state) {
+      case CORO_DONE:
+	s->alive--;
+	break;
+      case CORO_YIELDED:
+	ready = 1;
+	break;
+      case CORO_WAITING_FD:
+	fds = 1;
+	/* fallthrough */
+      case CORO_SLEEPING:
+	if (c->wake_ns < wake)
+	  wake = c->wake_ns;
+	break;
+      default:
+	waiting = 1;
+      }
+    }
+    if (s->alive == 0)
+      continue;
+    // Descripteurs consultés sans attente si une tâche est prête
+    if (ready) {
+      if (fds)
+	idle_fds(s, 0);
+      continue;
+    }
+    if (waiting && wake > coro_now() + CORO_POLL_US * 1000ULL)
+      wake = coro_now() + CORO_POLL_US * 1000ULL;
+    if (fds)
+      idle_fds(s, wake);
+    else
+      idle(s, wake);
+  }
+  s->stop_ns = coro_now();
+}
+
+void coro_sched_report(const struct coro_sched *s, const char *name) {
+  uint64_t elapsed = s->stop_ns - s->start_ns;
+  int i;
+
+  zlog_info(zlog_c, "%s : %d tâche(s), %lu reprise(s), %lu sommeil(s), endormi %.1f %% de %llu ms",
+	    name, s->count, s->resumes, s->idles,
+	    elapsed > 0 ? 100.0 * s->idle_ns / elapsed : 0.0,
+	    (unsigned long long) (elapsed / 1000000));
+  for (i = 0; i < s->count; i++)
+    zlog_debug(zlog_c, "%s : tâche %s, %lu reprise(s)", name,
+	       s->tasks[i]->name, s->tasks[i]->resumes);
+}
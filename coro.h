@@ -0,0 +1,154 @@
+/*
+ * Ordonnanceur coopératif de tâches sans pile (protothreads).
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Plusieurs tâches de périphériques s'entrelacent dans un seul fil, sans
+ * changement de contexte du noyau ni pile par tâche: une tâche est une
+ * fonction qui rend la main à l'ordonnanceur (CORO_YIELD, CORO_SLEEP_US,
+ * CORO_SLEEP_UNTIL, CORO_WAIT_UNTIL, CORO_WAIT_FD) et reprend au même endroit à l'appel
+ * suivant. Le point de reprise est le numéro de ligne gardé dans la struct
+ * coro, et le corps de la tâche est un switch sur ce numéro (voir
+ * CORO_BEGIN). Une tâche ne coûte donc que sa struct coro et son état, au
+ * lieu de la pile d'un fil.
+ *
+ * Contraintes de ce style:
+ * - les variables locales ne sont pas conservées d'une reprise à l'autre:
+ *   l'état de la tâche doit être dans la structure passée en 'arg';
+ * - les macros CORO_* ne peuvent pas être utilisées dans un switch du
+ *   corps de la tâche, ni deux fois sur une même ligne;
+ * - une tâche ne doit jamais bloquer: une lecture sysfs est courte, mais
+ *   une attente doit passer par CORO_SLEEP_US, CORO_WAIT_UNTIL ou
+ *   CORO_WAIT_FD.
+ *
+ * L'ordonnanceur reprend les tâches à tour de rôle. Quand aucune n'est
+ * prête, il dort jusqu'au réveil le plus proche, ou CORO_POLL_US si une
+ * tâche attend une condition, au lieu de tourner à vide. Les descripteurs
+ * attendus par CORO_WAIT_FD sont surveillés par un seul poll pendant ce
+ * sommeil: la tâche reprend dès que le sien est lisible, sans attendre la
+ * période CORO_POLL_US.
+ */
+
+#ifndef CORO_H
+#define CORO_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Nombre maximal de tâches d'un ordonnanceur
+#define CORO_TASKS 64
+// Période de réévaluation des conditions de CORO_WAIT_UNTIL
+#define CORO_POLL_US 1000
+
+// Valeurs rendues par une tâche à l'ordonnanceur
+enum { CORO_YIELDED, CORO_SLEEPING, CORO_WAITING, CORO_WAITING_FD,
+       CORO_DONE };
+
+struct coro {
+  const char *name;
+  int (*run)(struct coro *c, void *arg);
+  void *arg;
+  // Point de reprise, 0 au début de la tâche
+  int line;
+  int state;
+  uint64_t wake_ns;
+  // Descripteur attendu par CORO_WAIT_FD, lisible d'après le dernier poll
+  int fd;
+  int fd_ready;
+  // Nombre de reprises
+  unsigned long resumes;
+};
+
+struct coro_sched {
+  int count;
+  int alive;
+  struct coro *tasks[CORO_TASKS];
+  // Statistiques
+  unsigned long resumes;
+  unsigned long idles;
+  uint64_t idle_ns;
+  uint64_t start_ns;
+  uint64_t stop_ns;
+};
+
+static inline uint64_t coro_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define CORO_BEGIN(c) switch ((c)->line) { case 0:
+
+#define CORO_END(c) } (c)->line = 0; return CORO_DONE
+
+// Fin anticipée de la tâche, p.ex. après une erreur
+#define CORO_EXIT(c) do {						\
+    (c)->line = 0;							\
+    return CORO_DONE;							\
+  } while (0)
+
+// Reprise au prochain tour de l'ordonnanceur
+#define CORO_YIELD(c) do {						\
+    (c)->line = __LINE__;						\
+    return CORO_YIELDED;						\
+  case __LINE__:;							\
+  } while (0)
+
+// Reprise à l'instant CLOCK_MONOTONIC 'ns' au plus tôt
+#define CORO_SLEEP_UNTIL(c, ns) do {					\
+    (c)->wake_ns = (ns);						\
+    (c)->line = __LINE__;						\
+    __attribute__((fallthrough));					\
+  case __LINE__:							\
+    if (coro_now() < (c)->wake_ns)					\
+      return CORO_SLEEPING;						\
+  } while (0)
+
+// Reprise après 'us' microsecondes au moins
+#define CORO_SLEEP_US(c, us) CORO_SLEEP_UNTIL(c, coro_now() + (us) * 1000ULL)
+
+// Reprise quand 'cond' est vraie, réévaluée à chaque tour
+#define CORO_WAIT_UNTIL(c, cond) do {					\
+    (c)->line = __LINE__;						\
+    __attribute__((fallthrough));					\
+  case __LINE__:							\
+    if (!(cond))							\
+      return CORO_WAITING;						\
+  } while (0)
+
+/*
+ * Reprise quand le descripteur 'f' est lisible, ou à l'instant
+ * CLOCK_MONOTONIC 'ns' au plus tard
+ */
+#define CORO_WAIT_FD(c, f, ns) do {					\
+    (c)->fd = (f);							\
+    (c)->fd_ready = 0;							\
+    (c)->wake_ns = (ns);						\
+    (c)->line = __LINE__;						\
+    return CORO_WAITING_FD;						\
+  case __LINE__:							\
+    if (!(c)->fd_ready && coro_now() < (c)->wake_ns)			\
+      return CORO_WAITING_FD;						\
+    (c)->fd = -1;							\
+  } while (0)
+
+// Ordonnanceur sans tâche
+void coro_sched_init(struct coro_sched *s);
+
+/*
+ * Ajout de la tâche 'c' nommée 'name', de corps 'run' appelé avec 'arg'.
+ * 'name' doit rester valide, comme une chaîne littérale.
+ * Retourne 1 en cas de succès, 0 si CORO_TASKS tâches sont déjà ajoutées.
+ */
+int coro_spawn(struct coro_sched *s, struct coro *c, const char *name,
+	       int (*run)(struct coro *c, void *arg), void *arg);
+
+// Exécution des tâches jusqu'à la fin de toutes
+void coro_run(struct coro_sched *s);
+
+// Impression des reprises et du temps passé à dormir par zlog
+void coro_sched_report(const struct coro_sched *s, const char *name);
+
+#endif
@@ -0,0 +1,245 @@
+/*
+ * Banc d'essai de l'ordonnanceur coopératif.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Compare le coût d'un passage de la main entre tâches et leur coût en
+ * mémoire pour des tâches coopératives (coro.h) et pour un fil par tâche.
+ * Les N tâches se passent un jeton en anneau: chaque tâche coopérative rend
+ * la main à l'ordonnanceur par CORO_YIELD, chaque fil réveille le suivant
+ * par un sémaphore et s'endort. Le processus est fixé sur un seul coeur,
+ * comme sur la brique EV3, pour que chaque passage entre fils soit un
+ * changement de contexte. La mémoire est lue dans /proc/self/status avant et
+ * après la création des tâches.
+ *
+ * Matériel demandé: aucun
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coro.h"
+#include "zlog.h"
+
+#define BENCH_TASKS 32
+#define BENCH_SWITCHES 200000
+
+// Variable globale spécifique à zlog
+zlog_category_t *zlog_c;
+
+struct coro_task {
+  struct coro coro;
+  unsigned long *hops;
+  unsigned long switches;
+};
+
+struct thread_task {
+  pthread_t thread;
+  sem_t token;
+  struct thread_task *next;
+};
+
+// Etat partagé de l'anneau de fils, protégé par le jeton
+static unsigned long thread_hops;
+static unsigned long thread_switches;
+static atomic_int thread_stop;
+static sem_t thread_done;
+
+/*
+ * Lecture de la mémoire résidente et virtuelle du processus en ko.
+ * Retourne 1 en cas de succès, 0 sinon.
+ */
+static int memory_kb(long *rss, long *size) {
+  char line[128];
+  FILE *f = fopen("/proc/self/status", "r");
+
+  if (f == NULL)
+    return 0;
+  *rss = *size = -1;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (strncmp(line, "VmRSS:", 6) == 0)
+      *rss = atol(line + 6);
+    else if (strncmp(line, "VmSize:", 7) == 0)
+      *size = atol(line + 7);
+  }
+  fclose(f);
+
+  return *rss >= 0 && *size >= 0;
+}
+
+static int coro_task_run(struct coro *c, void *arg) {
+  struct coro_task *t = arg;
+
+  CORO_BEGIN(c);
+  while (++*t->hops < t->switches)
+    CORO_YIELD(c);
+  CORO_END(c);
+}
+
+static void *thread_task_run(void *arg) {
+  struct thread_task *t = arg;
+
+  for (;;) {
+    sem_wait(&t->token);
+    if (atomic_load(&thread_stop))
+      break;
+    if (++thread_hops == thread_switches)
+      sem_post(&thread_done);
+    else
+      sem_post(&t->next->token);
+  }
+
+  return NULL;
+}
+
+// Anneau de tâches coopératives. Retourne la durée d'un passage en ns.
+static double coro_ring(int tasks, unsigned long switches, long *rss,
+			long *size) {
+  struct coro_sched sched;
+  struct coro_task *t;
+  unsigned long hops = 0;
+  long rss0, size0;
+  uint64_t start;
+  int i;
+
+  memory_kb(&rss0, &size0);
+  t = calloc(tasks, sizeof(*t));
+  if (t == NULL)
+    return -1.0;
+  coro_sched_init(&sched);
+  for (i = 0; i < tasks; i++) {
+    t[i].hops = &hops;
+    t[i].switches = switches;
+    coro_spawn(&sched, &t[i].coro, "Anneau", coro_task_run, &t[i]);
+  }
+  memory_kb(rss, size);
+  *rss -= rss0;
+  *size -= size0;
+
+  start = coro_now();
+  coro_run(&sched);
+  start = coro_now() - start;
+  free(t);
+
+  return (double) start / sched.resumes;
+}
+
+// Anneau d'un fil par tâche. Retourne la durée d'un passage en ns.
+static double thread_ring(int tasks, unsigned long switches, long *rss,
+			  long *size) {
+  struct thread_task *t;
+  long rss0, size0;
+  uint64_t start;
+  int i, created;
+
+  memory_kb(&rss0, &size0);
+  t = calloc(tasks, sizeof(*t));
+  if (t == NULL)
+    return -1.0;
+  thread_hops = 0;
+  thread_switches = switches;
+  atomic_store(&thread_stop, 0);
+  sem_init(&thread_done, 0, 0);
+  for (i = 0; i < tasks; i++) {
+    sem_init(&t[i].token, 0, 0);
+    t[i].next = &t[(i + 1) % tasks];
+  }
+  for (created = 0; created < tasks; created++)
+    if (pthread_create(&t[created].thread, NULL, thread_task_run,
+		       &t[created]) != 0)
+      break;
+  memory_kb(rss, size);
+  *rss -= rss0;
+  *size -= size0;
+
+  start = coro_now();
+  if (created == tasks) {
+    sem_post(&t[0].token);
+    sem_wait(&thread_done);
+  }
+  start = coro_now() - start;
+
+  atomic_store(&thread_stop, 1);
+  for (i = 0; i < created; i++)
+    sem_post(&t[i].token);
+  for (i = 0; i < created; i++)
+    pthread_join(t[i].thread, NULL);
+  for (i = 0; i < tasks; i++)
+    sem_destroy(&t[i].token);
+  sem_destroy(&thread_done);
+  free(t);
+  if (created < tasks) {
+    zlog_error(zlog_c, "Seulement %d fil(s) créé(s) sur %d", created, tasks);
+    return -1.0;
+  }
+
+  return (double) start / switches;
+}
+
+int main(int argc, char *argv[]) {
+  cpu_set_t cpus;
+  double coro_ns, thread_ns;
+  long coro_rss, coro_size, thread_rss, thread_size;
+  unsigned long switches = BENCH_SWITCHES;
+  int rc, tasks = BENCH_TASKS;
+
+  // Variables constantes spécifique à zlog
+  const char *zlog_conf = "/etc/zlog.conf";
+  const char *zlog_cat  = "project";
+
+  if (argc > 1)
+    tasks = atoi(argv[1]);
+  if (tasks <= 0 || tasks > CORO_TASKS)
+    tasks = BENCH_TASKS;
+  if (argc > 2)
+    switches = strtoul(argv[2], NULL, 10);
+  if (switches == 0)
+    switches = BENCH_SWITCHES;
+
+  rc = zlog_init(zlog_conf);
+  if (rc) {
+    printf("L'initialisation de zlog avec '%s' a échoué\n", zlog_conf);
+    return EXIT_FAILURE;
+  }
+
+  zlog_c = zlog_get_category(zlog_cat);
+  if (!zlog_c) {
+    printf("zlog est incapable de retrouver la catégorie '%s'\n", zlog_cat);
+    zlog_fini();
+    return EXIT_FAILURE;
+  }
+
+  CPU_ZERO(&cpus);
+  CPU_SET(0, &cpus);
+  if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+    zlog_warn(zlog_c, "Impossible de fixer le processus sur le coeur 0");
+
+  coro_ns = coro_ring(tasks, switches, &coro_rss, &coro_size);
+  thread_ns = thread_ring(tasks, switches, &thread_rss, &thread_size);
+  if (coro_ns < 0 || thread_ns < 0) {
+    zlog_fatal(zlog_c, "Impossible de créer les tâches");
+    zlog_fini();
+    return EXIT_FAILURE;
+  }
+
+  zlog_info(zlog_c, "%d tâche(s), %lu passage(s) du jeton", tasks, switches);
+  zlog_info(zlog_c, "Coroutines : %.1f ns/passage, %zu octets par tâche, mémoire %+ld ko résidente, %+ld ko virtuelle",
+	    coro_ns, sizeof(struct coro_task), coro_rss, coro_size);
+  zlog_info(zlog_c, "Fils : %.1f ns/passage (x%.1f), mémoire %+ld ko résidente, %+ld ko virtuelle",
+	    thread_ns, coro_ns > 0 ? thread_ns / coro_ns : 0.0, thread_rss,
+	    thread_size);
+  zlog_info(zlog_c, "Fils : %.1f ko résidents et %.1f ko virtuels par tâche",
+	    (double) thread_rss / tasks, (double) thread_size / tasks);
+
+  zlog_fini();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,386 @@
+/*
+ * Découverte des capteurs et servomoteurs EV3.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "discovery.h"
+#include "zlog.h"
+
+// Identification et version du fichier cache
+#define DISCOVERY_MAGIC 0x4d335645 // "EV3M"
+#define DISCOVERY_VERSION 1
+
+struct discovery_cache {
+  uint32_t magic;
+  uint16_t version;
+  unsigned char flags;
+  uint8_t sensor_count;
+  uint8_t tacho_count;
+  long scan_us;
+  struct ev3_device sensor[DISCOVERY_DEVICE_LIMIT];
+  struct ev3_device tacho[DISCOVERY_DEVICE_LIMIT];
+};
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+static long now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000L + ts.tv_nsec / 1000L;
+}
+
+/*
+ * Lecture d'un attribut sysfs sans le retour à la ligne final. Retourne le
+ * nombre de caractères lus ou -1 en cas d'erreur.
+ */
+static int read_attr(const char *path, char *buf, size_t sz) {
+  int fd;
+  ssize_t n;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  n = read(fd, buf, sz - 1);
+  close(fd);
+  if (n <= 0)
+    return -1;
+  while (n > 0 && buf[n - 1] == '\n')
+    n--;
+  buf[n] = '\0';
+
+  return n;
+}
+
+static int read_address(const char *prefix, uint8_t sn, char *buf) {
+  char path[64];
+
+  snprintf(path, sizeof(path), "%s%u/address", prefix, sn);
+  return read_attr(path, buf, DISCOVERY_ADDRESS_LEN);
+}
+
+// Reconstruction des index à partir des listes de périphériques
+static void build_index(struct ev3_device_map *map) {
+  int i;
+  struct ev3_device *d;
+
+  memset(map->sensor_by_type, DESC_LIMIT, sizeof(map->sensor_by_type));
+  memset(map->tacho_by_type, DESC_LIMIT, sizeof(map->tacho_by_type));
+  memset(map->sensor_by_port, DESC_LIMIT, sizeof(map->sensor_by_port));
+  memset(map->tacho_by_port, DESC_LIMIT, sizeof(map->tacho_by_port));
+
+  for (i = 0; i < map->sensor_count; i++) {
+    d = &map->sensor[i];
+    if (d->type_inx < SENSOR_TYPE__COUNT_ &&
+	map->sensor_by_type[d->type_inx] == DESC_LIMIT)
+      map->sensor_by_type[d->type_inx] = d->sn;
+    if (d->port < DISCOVERY_PORT_LIMIT &&
+	map->sensor_by_port[d->port] == DESC_LIMIT)
+      map->sensor_by_port[d->port] = d->sn;
+  }
+  for (i = 0; i < map->tacho_count; i++) {
+    d = &map->tacho[i];
+    if (d->type_inx < TACHO_TYPE__COUNT_ &&
+	map->tacho_by_type[d->type_inx] == DESC_LIMIT)
+      map->tacho_by_type[d->type_inx] = d->sn;
+    if (d->port < DISCOVERY_PORT_LIMIT &&
+	map->tacho_by_port[d->port] == DESC_LIMIT)
+      map->tacho_by_port[d->port] = d->sn;
+  }
+}
+
+/*
+ * Chargement et validation du cache. Seule l'adresse de chaque périphérique
+ * est relue; un périphérique débranché ou remplacé change de numéro de
+ * séquence et invalide le cache. Les genres de périphériques présents dans
+ * le cache sont retournés dans 'cached'.
+ * Retourne 1 si le cache est valide, 0 sinon.
+ */
+static int load_cache(struct ev3_device_map *map, unsigned char flags,
+		      unsigned char *cached) {
+  struct discovery_cache cache;
+  char address[DISCOVERY_ADDRESS_LEN];
+  ssize_t n;
+  int fd, i;
+
+  fd = open(DISCOVERY_CACHE, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  n = read(fd, &cache, sizeof(cache));
+  close(fd);
+  if (n != sizeof(cache) || cache.magic != DISCOVERY_MAGIC ||
+      cache.version != DISCOVERY_VERSION)
+    return 0;
+  *cached = cache.flags;
+  if ((cache.flags & flags) != flags ||
+      cache.sensor_count > DISCOVERY_DEVICE_LIMIT ||
+      cache.tacho_count > DISCOVERY_DEVICE_LIMIT)
+    return 0;
+
+  for (i = 0; i < cache.sensor_count; i++)
+    if (read_address(SENSOR_SYSFS_PATH, cache.sensor[i].sn, address) < 0 ||
+	strcmp(address, cache.sensor[i].address) != 0)
+      return 0;
+  for (i = 0; i < cache.tacho_count; i++)
+    if (read_address(TACHO_SYSFS_PATH, cache.tacho[i].sn, address) < 0 ||
+	strcmp(address, cache.tacho[i].address) != 0)
+      return 0;
+
+  map->flags = cache.flags;
+  map->sensor_count = cache.sensor_count;
+  map->tacho_count = cache.tacho_count;
+  memcpy(map->sensor, cache.sensor, sizeof(map->sensor));
+  memcpy(map->tacho, cache.tacho, sizeof(map->tacho));
+  map->scan_us = cache.scan_us;
+
+  // Remplir les descripteurs de ev3dev-c comme l'aurait fait le parcours
+  for (i = 0; i < map->sensor_count; i++) {
+    ev3_sensor[map->sensor[i].sn].type_inx = map->sensor[i].type_inx;
+    ev3_sensor[map->sensor[i].sn].port = map->sensor[i].port;
+    ev3_sensor[map->sensor[i].sn].extport = map->sensor[i].extport;
+    ev3_sensor[map->sensor[i].sn].addr = map->sensor[i].addr;
+  }
+  for (i = 0; i < map->tacho_count; i++) {
+    ev3_tacho[map->tacho[i].sn].type_inx = map->tacho[i].type_inx;
+    ev3_tacho[map->tacho[i].sn].port = map->tacho[i].port;
+    ev3_tacho[map->tacho[i].sn].extport = map->tacho[i].extport;
+  }
+
+  return 1;
+}
+
+int discovery_cached_tachos(struct ev3_device *tacho, int limit) {
+  struct discovery_cache cache;
+  ssize_t n;
+  int fd;
+
+  fd = open(DISCOVERY_CACHE, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  n = read(fd, &cache, sizeof(cache));
+  close(fd);
+  if (n != sizeof(cache) || cache.magic != DISCOVERY_MAGIC ||
+      cache.version != DISCOVERY_VERSION || !(cache.flags & DISCOVERY_TACHOS) ||
+      cache.tacho_count > DISCOVERY_DEVICE_LIMIT)
+    return -1;
+  if (limit > cache.tacho_count)
+    limit = cache.tacho_count;
+  memcpy(tacho, cache.tacho, limit * sizeof(*tacho));
+
+  return limit;
+}
+
+static void save_cache(const struct ev3_device_map *map) {
+  struct discovery_cache cache;
+  int fd;
+
+  memset(&cache, 0, sizeof(cache));
+  cache.magic = DISCOVERY_MAGIC;
+  cache.version = DISCOVERY_VERSION;
+  cache.flags = map->flags;
+  cache.sensor_count = map->sensor_count;
+  cache.tacho_count = map->tacho_count;
+  cache.scan_us = map->scan_us;
+  memcpy(cache.sensor, map->sensor, sizeof(cache.sensor));
+  memcpy(cache.tacho, map->tacho, sizeof(cache.tacho));
+
+  fd = open(DISCOVERY_CACHE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    zlog_warn(zlog_c, "Impossible d'écrire le cache '%s'", DISCOVERY_CACHE);
+    return;
+  }
+  if (write(fd, &cache, sizeof(cache)) != sizeof(cache))
+    zlog_warn(zlog_c, "Ecriture incomplète du cache '%s'", DISCOVERY_CACHE);
+  close(fd);
+}
+
+// Parcours complet de sysfs par ev3dev-c
+static int scan(struct ev3_device_map *map, unsigned char flags) {
+  int i, rc;
+  struct ev3_device *d;
+
+  map->flags = flags;
+  map->sensor_count = 0;
+  map->tacho_count = 0;
+
+  // Initialisation des ports EV3
+  rc = ev3_port_init();
+  if (rc == -1) {
+    zlog_error(zlog_c, "Erreur durant l'initialisation des ports EV3");
+    return rc;
+  } else if (rc != 8)
+    zlog_warn(zlog_c, "'%d/8' ports EV3 retrouvé", rc);
+  else
+    zlog_info(zlog_c, "Tous ports EV3 retrouvé");
+
+  if (flags & DISCOVERY_SENSORS) {
+    // Initialisation des capteurs EV3
+    rc = ev3_sensor_init();
+    if (rc == -1) {
+      zlog_error(zlog_c, "Erreur durant l'initialisation des capteurs EV3");
+      return rc;
+    } else
+      zlog_info(zlog_c, "'%d' capteur(s) EV3 retrouvé", rc);
+    for (i = 0; i < SENSOR_DESC__LIMIT_; i++) {
+      if (ev3_sensor[i].type_inx == SENSOR_TYPE__NONE_)
+	continue;
+      if (map->sensor_count == DISCOVERY_DEVICE_LIMIT) {
+	zlog_warn(zlog_c, "Trop de capteurs, '%d' ignoré", i);
+	continue;
+      }
+      d = &map->sensor[map->sensor_count];
+      d->sn = i;
+      d->type_inx = ev3_sensor[i].type_inx;
+      d->port = ev3_sensor[i].port;
+      d->extport = ev3_sensor[i].extport;
+      d->addr = ev3_sensor[i].addr;
+      if (read_address(SENSOR_SYSFS_PATH, i, d->address) < 0)
+	d->address[0] = '\0';
+      map->sensor_count++;
+    }
+  }
+
+  if (flags & DISCOVERY_TACHOS) {
+    // Initialisation des servomoteurs
+    rc = ev3_tacho_init();
+    if (rc == -1) {
+      zlog_error(zlog_c, "Erreur durant l'initialisation des servomoteurs EV3");
+      return rc;
+    } else
+      zlog_info(zlog_c, "'%d' servomoteurs EV3 retrouvé", rc);
+    for (i = 0; i < TACHO_DESC__LIMIT_; i++) {
+      if (ev3_tacho[i].type_inx == TACHO_TYPE__NONE_)
+	continue;
+      if (map->tacho_count == DISCOVERY_DEVICE_LIMIT) {
+	zlog_warn(zlog_c, "Trop de servomoteurs, '%d' ignoré", i);
+	continue;
+      }
+      d = &map->tacho[map->tacho_count];
+      d->sn = i;
+      d->type_inx = ev3_tacho[i].type_inx;
+      d->port = ev3_tacho[i].port;
+      d->extport = ev3_tacho[i].extport;
+      d->addr = 0;
+      if (read_address(TACHO_SYSFS_PATH, i, d->address) < 0)
+	d->address[0] = '\0';
+      map->tacho_count++;
+    }
+  }
+
+  return 1;
+}
+
+int discovery_init(struct ev3_device_map *map, unsigned char flags) {
+  int rc;
+  long start;
+  unsigned char cached = 0;
+
+  memset(map, 0, sizeof(*map));
+
+  // Initialisation de la brique intelligente EV3
+  rc = ev3_init();
+  if (rc == 1)
+    zlog_info(zlog_c, "Brique intelligente EV3 trouvée");
+  else {
+    if (rc == 0)
+      zlog_fatal(zlog_c, "Brique intelligente EV3 pas trouvée");
+    else
+      zlog_error(zlog_c, "ev3_init retourne erreur '%d'", rc);
+    return rc;
+  }
+
+  start = now_us();
+  if (!(flags & DISCOVERY_NO_CACHE) &&
+      load_cache(map, flags & ~DISCOVERY_NO_CACHE, &cached)) {
+    map->cache_us = now_us() - start;
+    map->from_cache = 1;
+    zlog_info(zlog_c,
+	      "Découverte par cache : %ld us (parcours complet : %ld us)",
+	      map->cache_us, map->scan_us);
+  } else {
+    /*
+     * Les genres déjà présents dans le cache sont parcourus eux aussi afin
+     * que les programmes de capteurs et de servomoteurs partagent le cache.
+     */
+    rc = scan(map, (flags | cached) & (DISCOVERY_SENSORS | DISCOVERY_TACHOS));
+    if (rc != 1) {
+      ev3_uninit();
+      return rc;
+    }
+    map->scan_us = now_us() - start;
+    zlog_info(zlog_c, "Découverte par parcours complet : %ld us",
+	      map->scan_us);
+    save_cache(map);
+  }
+  build_index(map);
+
+  return 1;
+}
+
+int discovery_refresh(struct ev3_device_map *map) {
+  long start;
+  int rc;
+
+  if (!map->from_cache)
+    return 0;
+  zlog_info(zlog_c, "Périphérique absent du cache, nouveau parcours complet");
+  start = now_us();
+  rc = scan(map, map->flags & (DISCOVERY_SENSORS | DISCOVERY_TACHOS));
+  if (rc != 1)
+    return rc;
+  map->scan_us = now_us() - start;
+  map->from_cache = 0;
+  save_cache(map);
+  build_index(map);
+
+  return 1;
+}
+
+uint8_t discovery_sensor(struct ev3_device_map *map, INX_T type_inx) {
+  if (type_inx >= SENSOR_TYPE__COUNT_)
+    return DESC_LIMIT;
+  if (map->sensor_by_type[type_inx] == DESC_LIMIT)
+    discovery_refresh(map);
+
+  return map->sensor_by_type[type_inx];
+}
+
+uint8_t discovery_sensor_at(struct ev3_device_map *map, uint8_t port) {
+  if (port >= DISCOVERY_PORT_LIMIT)
+    return DESC_LIMIT;
+  if (map->sensor_by_port[port] == DESC_LIMIT)
+    discovery_refresh(map);
+
+  return map->sensor_by_port[port];
+}
+
+uint8_t discovery_tacho(struct ev3_device_map *map, INX_T type_inx) {
+  if (type_inx >= TACHO_TYPE__COUNT_)
+    return DESC_LIMIT;
+  if (map->tacho_by_type[type_inx] == DESC_LIMIT)
+    discovery_refresh(map);
+
+  return map->tacho_by_type[type_inx];
+}
+
+uint8_t discovery_tacho_at(struct ev3_device_map *map, uint8_t port) {
+  if (port >= DISCOVERY_PORT_LIMIT)
+    return DESC_LIMIT;
+  if (map->tacho_by_port[port] == DESC_LIMIT)
+    discovery_refresh(map);
+
+  return map->tacho_by_port[port];
+}
+
+void discovery_invalidate(void) {
+  unlink(DISCOVERY_CACHE);
+}
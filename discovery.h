@@ -0,0 +1,116 @@
+/*
+ * Découverte des capteurs et servomoteurs EV3.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Un seul parcours de sysfs construit une table des périphériques branchés,
+ * indexée par type et par port. La table est sauvegardée dans un fichier
+ * cache; au démarrage suivant il suffit de vérifier l'adresse de chaque
+ * périphérique au lieu de parcourir à nouveau tous les descripteurs.
+ * Le cache ne connaît pas les périphériques branchés après son écriture:
+ * une recherche infructueuse dans une table lue du cache refait donc le
+ * parcours complet avant de déclarer le périphérique absent.
+ */
+
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include <stdint.h>
+
+#include <ev3.h>
+#include <ev3_port.h>
+#include <ev3_sensor.h>
+#include <ev3_tacho.h>
+
+// Chemins sysfs des capteurs et servomoteurs (suivis du numéro de séquence)
+#define SENSOR_SYSFS_PATH "/sys/class/lego-sensor/sensor"
+#define TACHO_SYSFS_PATH "/sys/class/tacho-motor/motor"
+
+// Fichier cache de la table des périphériques
+#define DISCOVERY_CACHE "/tmp/ev3_devices.map"
+
+// Drapeaux pour discovery_init
+#define DISCOVERY_SENSORS 0b1
+#define DISCOVERY_TACHOS 0b10
+#define DISCOVERY_NO_CACHE 0b100
+
+// Nombre maximal de périphériques d'un genre et de ports dans la table
+#define DISCOVERY_DEVICE_LIMIT 8
+#define DISCOVERY_PORT_LIMIT 16
+#define DISCOVERY_ADDRESS_LEN 32
+
+struct ev3_device {
+  uint8_t sn;
+  INX_T type_inx;
+  uint8_t port;
+  uint8_t extport;
+  uint8_t addr;
+  // Contenu de l'attribut 'address', utilisé pour valider le cache
+  char address[DISCOVERY_ADDRESS_LEN];
+};
+
+struct ev3_device_map {
+  unsigned char flags;
+  uint8_t sensor_count;
+  uint8_t tacho_count;
+  struct ev3_device sensor[DISCOVERY_DEVICE_LIMIT];
+  struct ev3_device tacho[DISCOVERY_DEVICE_LIMIT];
+  // Index type -> numéro de séquence (premier périphérique du type)
+  uint8_t sensor_by_type[SENSOR_TYPE__COUNT_];
+  uint8_t tacho_by_type[TACHO_TYPE__COUNT_];
+  // Index port -> numéro de séquence
+  uint8_t sensor_by_port[DISCOVERY_PORT_LIMIT];
+  uint8_t tacho_by_port[DISCOVERY_PORT_LIMIT];
+  // Durées de la découverte en microsecondes
+  long scan_us;
+  long cache_us;
+  int from_cache;
+};
+
+/*
+ * Initialisation de la brique EV3 et découverte des périphériques demandés
+ * par 'flags'. Le cache est utilisé s'il est valide, sinon sysfs est parcouru
+ * et le cache réécrit.
+ * Valeurs de retour:
+ * 1, si la brique intelligente EV3 et les périphériques ont été découverts,
+ * 0, si la brique intelligente EV3 n'a pas été trouvée (erreur grave),
+ * <0, en cas d'erreur de la brique intelligente EV3, des ports ou des
+ * périphériques EV3.
+ */
+int discovery_init(struct ev3_device_map *map, unsigned char flags);
+
+/*
+ * Parcours complet de sysfs et réécriture du cache si la table 'map' a été
+ * lue du cache, p.ex. pour retrouver un périphérique branché depuis.
+ * Valeurs de retour:
+ * 1, si la table a été reconstruite par un parcours complet,
+ * 0, si la table venait déjà d'un parcours complet (rien n'est fait),
+ * <0, en cas d'erreur des ports ou des périphériques EV3.
+ */
+int discovery_refresh(struct ev3_device_map *map);
+
+/*
+ * Recherche dans la table, rafraîchie par discovery_refresh si le
+ * périphérique manque dans une table lue du cache. Retourne le numéro de
+ * séquence ou DESC_LIMIT si aucun périphérique ne correspond.
+ */
+uint8_t discovery_sensor(struct ev3_device_map *map, INX_T type_inx);
+uint8_t discovery_sensor_at(struct ev3_device_map *map, uint8_t port);
+uint8_t discovery_tacho(struct ev3_device_map *map, INX_T type_inx);
+uint8_t discovery_tacho_at(struct ev3_device_map *map, uint8_t port);
+
+/*
+ * Lecture des servomoteurs du cache, sans ev3_init ni vérification des
+ * adresses: un servomoteur rebranché change de numéro de séquence, et ses
+ * anciens attributs n'existent plus. Au plus 'limit' servomoteurs sont
+ * copiés dans 'tacho'.
+ * Retourne le nombre de servomoteurs copiés, -1 si le cache est absent ou
+ * ne contient pas les servomoteurs.
+ */
+int discovery_cached_tachos(struct ev3_device *tacho, int limit);
+
+// Suppression du fichier cache, p.ex. après un changement de branchement
+void discovery_invalidate(void);
+
+#endif
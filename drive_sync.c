@@ -0,0 +1,111 @@
+/*
+ * Synchronisation des servomoteurs gauche et droit en ligne droite.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ev3.h>
+#include <ev3_tacho.h>
+
+#include "drive_sync.h"
+#include "latency.h"
+#include "robot.h"
+#include "tacho_shadow.h"
+#include "zlog.h"
+
+// Distance parcourue par une roue pour une impulsion
+#define MM_PER_COUNT ((float) M_PI * ROBOT_WHEEL_DIAMETER_MM / ROBOT_COUNT_PER_ROT)
+
+#define CLAMP(v,lo,hi) ((v) < (lo) ? (lo) : (v) > (hi) ? (hi) : (v))
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+// Lecture des positions des deux servomoteurs, mesurée par latency_add
+static int read_positions(const struct drive_sync *d, int *left, int *right) {
+  size_t bytes;
+
+  LATENCY_TIME(bytes, LATENCY_TACHO, d->left, "position",
+	       get_tacho_position(d->left, left));
+  if (bytes == 0)
+    return 0;
+  LATENCY_TIME(bytes, LATENCY_TACHO, d->right, "position",
+	       get_tacho_position(d->right, right));
+
+  return bytes > 0;
+}
+
+int drive_sync_init(struct drive_sync *d, uint8_t left, uint8_t right,
+		    int duty, int closed_loop) {
+  memset(d, 0, sizeof(*d));
+  d->left = left;
+  d->right = right;
+  d->duty = duty;
+  d->closed_loop = closed_loop;
+  if (!read_positions(d, &d->left0, &d->right0))
+    return 0;
+  d->left_last = d->left0;
+  d->right_last = d->right0;
+
+  return 1;
+}
+
+int drive_sync_step(struct drive_sync *d) {
+  int left, right, correction, duty_left, duty_right, error;
+  float ds;
+
+  if (!read_positions(d, &left, &right))
+    return 0;
+
+  // Distances parcourues depuis le départ: un écart fait tourner le robot
+  error = (left - d->left0) - (right - d->right0);
+  ds = ((left - d->left_last) + (right - d->right_last)) * MM_PER_COUNT / 2;
+  d->left_last = left;
+  d->right_last = right;
+
+  d->steps++;
+  d->error = error;
+  if (abs(error) > d->error_max)
+    d->error_max = abs(error);
+  d->heading_rad = error * MM_PER_COUNT / ROBOT_AXLE_TRACK_MM;
+  d->distance_mm += ds;
+  d->lateral_mm += ds * sinf(d->heading_rad);
+  if (fabsf(d->lateral_mm) > d->lateral_max_mm)
+    d->lateral_max_mm = fabsf(d->lateral_mm);
+
+  if (!d->closed_loop)
+    return 1;
+
+  correction = (DRIVE_SYNC_KP * error + DRIVE_SYNC_KI * d->integral) /
+    DRIVE_SYNC_SCALE;
+  duty_left = d->duty - correction;
+  duty_right = d->duty + correction;
+  // Pas d'intégration en saturation
+  if (duty_left > -100 && duty_left < 100 &&
+      duty_right > -100 && duty_right < 100)
+    d->integral += error;
+  duty_left = CLAMP(duty_left, -100, 100);
+  duty_right = CLAMP(duty_right, -100, 100);
+
+  // Rapports cycliques inchangés non réécrits, les deux écrits ensemble
+  tacho_shadow_stage(d->left, TACHO_SHADOW_DUTY_CYCLE_SP, duty_left);
+  tacho_shadow_stage(d->right, TACHO_SHADOW_DUTY_CYCLE_SP, duty_right);
+
+  return tacho_shadow_flush();
+}
+
+void drive_sync_report(const struct drive_sync *d, const char *name) {
+  float per_m = d->distance_mm > 0 ? d->lateral_mm * 1000 / d->distance_mm : 0;
+
+  zlog_info(zlog_c, "%s : %lu périodes, distance %.0f mm",
+	    name, d->steps, d->distance_mm);
+  zlog_info(zlog_c, "%s : écart final %d impulsions (max %d), cap %.2f°",
+	    name, d->error, d->error_max, d->heading_rad * 180 / M_PI);
+  zlog_info(zlog_c, "%s : dérive latérale %.1f mm (max %.1f mm), soit %.1f mm/m",
+	    name, d->lateral_mm, d->lateral_max_mm, per_m);
+}
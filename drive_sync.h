@@ -0,0 +1,67 @@
+/*
+ * Synchronisation des servomoteurs gauche et droit en ligne droite.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * A chaque période, les positions des deux servomoteurs sont relues et la
+ * différence des distances parcourues depuis le départ est corrigée par un
+ * régulateur PI sur les rapports cycliques (mode run-direct). Sans
+ * régulation, le même rapport cyclique est appliqué aux deux servomoteurs,
+ * ce qui permet de comparer avec la commande en boucle ouverte.
+ *
+ * L'erreur de ligne droite est suivie en continu: écart d'impulsions, cap
+ * et dérive latérale en fonction de la distance parcourue.
+ */
+
+#ifndef DRIVE_SYNC_H
+#define DRIVE_SYNC_H
+
+#include <stdint.h>
+
+// Gains du régulateur en millièmes de rapport cyclique par impulsion
+#define DRIVE_SYNC_KP 1000
+#define DRIVE_SYNC_KI 50
+#define DRIVE_SYNC_SCALE 1000
+
+struct drive_sync {
+  uint8_t left;
+  uint8_t right;
+  int closed_loop;
+  int duty;
+  // Positions au départ et lors de la dernière période
+  int left0;
+  int right0;
+  int left_last;
+  int right_last;
+  int integral;
+  // Mesures de l'erreur de ligne droite
+  unsigned long steps;
+  int error;
+  int error_max;
+  float distance_mm;
+  float heading_rad;
+  float lateral_mm;
+  float lateral_max_mm;
+};
+
+/*
+ * Préparation pour les servomoteurs 'left' et 'right' avec le rapport
+ * cyclique de base 'duty'. Si 'closed_loop' est nul, aucune correction n'est
+ * appliquée. Les servomoteurs doivent être en mode run-direct.
+ * Retourne 1 en cas de succès, 0 si les positions n'ont pas pu être lues.
+ */
+int drive_sync_init(struct drive_sync *d, uint8_t left, uint8_t right,
+		    int duty, int closed_loop);
+
+/*
+ * Une période: lecture des positions, mise à jour des mesures et, en
+ * boucle fermée, écriture des rapports cycliques corrigés.
+ * Retourne 1 en cas de succès, 0 en cas d'erreur de lecture ou d'écriture.
+ */
+int drive_sync_step(struct drive_sync *d);
+
+// Impression de l'erreur de ligne droite par zlog
+void drive_sync_report(const struct drive_sync *d, const char *name);
+
+#endif
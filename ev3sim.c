@@ -0,0 +1,816 @@
+/*
+ * Simulateur de l'arborescence sysfs ev3dev.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Crée sous un répertoire temporaire une arborescence '/sys/class' avec les
+ * ports, capteurs (tactile, couleur, ultrasons) et trois grands
+ * servomoteurs (OUTPUT_A, OUTPUT_D, OUTPUT_C), puis fait évoluer les
+ * attributs 'value0..', 'position', 'speed' et 'state' selon les modes et
+ * commandes écrits par les programmes. Les écritures sont détectées par
+ * inotify.
+ *
+ * Utilisation:
+ *   ./ev3sim [-r racine] [programme [arguments]]
+ * Avec un programme, celui-ci est lancé avec EV3_SIM_ROOT et
+ * LD_PRELOAD=libev3sim.so, et le simulateur s'arrête à sa fin en retournant
+ * son code de sortie. Sans programme, le simulateur tourne jusqu'à SIGINT et
+ * affiche la racine à utiliser.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <libgen.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Période de simulation
+#define SIM_TICK_MS 1
+// Constantes de temps des servomoteurs en secondes
+#define SIM_TAU_RUN 0.05
+#define SIM_TAU_COAST 0.2
+#define SIM_TAU_BRAKE 0.02
+#define SIM_MAX_SPEED 1050
+#define SIM_COUNT_PER_ROT 360
+
+#define SIM_SENSORS 3
+#define SIM_TACHOS 3
+#define SIM_VALUES 8
+#define SIM_WATCHES 64
+
+#define SIM_SYSFS "/sys/class"
+
+/*
+ * Modes des capteurs. Après un changement de mode, les valeurs restent
+ * celles de l'ancien mode pendant 'settle_ms'.
+ */
+struct sim_mode {
+  const char *name;
+  int num_values;
+  int decimals;
+  const char *units;
+  int settle_ms;
+};
+
+static const struct sim_mode touch_modes[] = {
+  { "TOUCH", 1, 0, "none", 0 },
+  { NULL, 0, 0, NULL, 0 }
+};
+
+static const struct sim_mode color_modes[] = {
+  { "COL-REFLECT", 1, 0, "pct", 20 },
+  // Diode éteinte avant la mesure de la lumière ambiante
+  { "COL-AMBIENT", 1, 0, "pct", 40 },
+  { "COL-COLOR", 1, 0, "col", 20 },
+  { "REF-RAW", 2, 0, "none", 20 },
+  { "RGB-RAW", 3, 0, "none", 20 },
+  { "COL-CAL", 4, 0, "none", 20 },
+  { NULL, 0, 0, NULL, 0 }
+};
+
+static const struct sim_mode us_modes[] = {
+  { "US-DIST-CM", 1, 1, "cm", 30 },
+  { "US-DIST-IN", 1, 1, "in", 30 },
+  { "US-LISTEN", 1, 0, "none", 10 },
+  { "US-SI-CM", 1, 1, "cm", 30 },
+  { "US-SI-IN", 1, 1, "in", 30 },
+  { "US-DC-CM", 1, 1, "cm", 30 },
+  { "US-DC-IN", 1, 1, "in", 30 },
+  { NULL, 0, 0, NULL, 0 }
+};
+
+/*
+ * Surfaces colorées vues par le capteur de couleur: index firmware, lumière
+ * reflétée, lumière ambiante et valeurs RGB brutes.
+ */
+struct sim_color {
+  int index;
+  int reflect;
+  int ambient;
+  int rgb[3];
+};
+
+static const struct sim_color colors[] = {
+  { 1, 5, 3, { 30, 32, 25 } },       // noir
+  { 2, 12, 4, { 40, 75, 160 } },     // bleu
+  { 3, 20, 5, { 55, 170, 70 } },     // vert
+  { 4, 70, 8, { 330, 300, 90 } },    // jaune
+  { 5, 60, 7, { 320, 60, 45 } },     // rouge
+  { 6, 90, 9, { 380, 390, 360 } },   // blanc
+  { 7, 25, 5, { 120, 80, 45 } }      // brun
+};
+
+#define SIM_COLORS (sizeof(colors) / sizeof(colors[0]))
+
+enum { SIM_TOUCH, SIM_COLOR, SIM_US };
+
+struct sim_sensor {
+  int kind;
+  const char *driver;
+  const char *address;
+  const struct sim_mode *modes;
+  int mode;
+  int poll_ms;
+  double mode_time;
+  double update_time;
+  int value_fd[SIM_VALUES];
+  char dir[PATH_MAX];
+};
+
+enum {
+  CMD_NONE, CMD_RUN_FOREVER, CMD_RUN_TO_ABS_POS, CMD_RUN_TO_REL_POS,
+  CMD_RUN_TIMED, CMD_RUN_DIRECT, CMD_STOP, CMD_RESET
+};
+
+static const char *const commands[] = {
+  "", "run-forever", "run-to-abs-pos", "run-to-rel-pos", "run-timed",
+  "run-direct", "stop", "reset"
+};
+
+enum { STOP_COAST, STOP_BRAKE, STOP_HOLD };
+
+static const char *const stop_actions[] = { "coast", "brake", "hold" };
+
+struct sim_tacho {
+  const char *address;
+  // Gain de la mécanique, différent pour chaque servomoteur pour simuler la dérive
+  double gain;
+  // Zone morte en run-direct, en % de rapport cyclique (frottements)
+  double deadband;
+  int command;
+  int stop_action;
+  int speed_sp;
+  int duty_cycle_sp;
+  int position_sp;
+  int time_sp;
+  double position;
+  double speed;
+  double target;
+  double end_time;
+  int holding;
+  int fd_position;
+  int fd_speed;
+  int fd_state;
+  int fd_duty_cycle;
+  int last_position;
+  int last_speed;
+  const char *last_state;
+  char dir[PATH_MAX];
+};
+
+// Attribut surveillé par inotify
+struct sim_watch {
+  int wd;
+  struct sim_sensor *sensor;
+  struct sim_tacho *tacho;
+  const char *attr;
+};
+
+static struct sim_sensor sensors[SIM_SENSORS] = {
+  { SIM_TOUCH, "lego-ev3-touch", "ev3-ports:in1", touch_modes },
+  { SIM_COLOR, "lego-ev3-color", "ev3-ports:in2", color_modes },
+  { SIM_US, "lego-ev3-us", "ev3-ports:in3", us_modes }
+};
+
+static struct sim_tacho tachos[SIM_TACHOS] = {
+  { "ev3-ports:outA", 1.0, 8 },
+  { "ev3-ports:outD", 0.97, 11 },
+  { "ev3-ports:outC", 1.0, 6 }
+};
+
+static struct sim_watch watches[SIM_WATCHES];
+static int watch_count;
+static int inotify_fd;
+static unsigned int seed = 4242;
+static char root[PATH_MAX];
+static volatile sig_atomic_t stop;
+// Démarrage du simulateur, origine du défilement des surfaces
+static double epoch;
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Bruit uniforme dans [-a, a]
+static int noise(int a) {
+  return a ? (int) (rand_r(&seed) % (2 * a + 1)) - a : 0;
+}
+
+static void mkdirs(const char *path) {
+  char buf[PATH_MAX], *p;
+
+  snprintf(buf, sizeof(buf), "%s", path);
+  for (p = buf + 1; *p; p++)
+    if (*p == '/') {
+      *p = '\0';
+      mkdir(buf, 0755);
+      *p = '/';
+    }
+  mkdir(buf, 0755);
+}
+
+static void write_attr(const char *dir, const char *name, const char *fmt, ...) {
+  char path[PATH_MAX];
+  va_list ap;
+  FILE *f;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  f = fopen(path, "w");
+  if (f == NULL) {
+    perror(path);
+    return;
+  }
+  va_start(ap, fmt);
+  vfprintf(f, fmt, ap);
+  va_end(ap);
+  fputc('\n', f);
+  fclose(f);
+}
+
+static int read_attr(const char *dir, const char *name, char *buf, size_t sz) {
+  char path[PATH_MAX], *p;
+  ssize_t n;
+  int fd;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  n = read(fd, buf, sz - 1);
+  close(fd);
+  if (n <= 0)
+    return -1;
+  /*
+   * Comme sysfs, seule la dernière écriture compte: une écriture plus courte
+   * par pwrite laisse la fin de la précédente après le retour à la ligne.
+   */
+  if ((p = memchr(buf, '\n', n)) != NULL)
+    n = p - buf;
+  while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' '))
+    n--;
+  buf[n] = '\0';
+
+  return n;
+}
+
+static int open_attr(const char *dir, const char *name) {
+  char path[PATH_MAX];
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  return open(path, O_WRONLY);
+}
+
+/*
+ * Réécriture sur place d'un attribut. Les lecteurs gardant le fichier
+ * ouvert (pread) voient ainsi la nouvelle valeur.
+ */
+static void set_attr(int fd, const char *fmt, ...) {
+  char buf[64];
+  va_list ap;
+  int n;
+
+  va_start(ap, fmt);
+  n = vsnprintf(buf, sizeof(buf) - 1, fmt, ap);
+  va_end(ap);
+  buf[n++] = '\n';
+  if (pwrite(fd, buf, n, 0) == n)
+    ftruncate(fd, n);
+}
+
+static void watch(const char *dir, const char *attr,
+		  struct sim_sensor *sensor, struct sim_tacho *tacho) {
+  char path[PATH_MAX];
+  struct sim_watch *w;
+
+  if (watch_count == SIM_WATCHES)
+    return;
+  snprintf(path, sizeof(path), "%s/%s", dir, attr);
+  w = &watches[watch_count];
+  w->wd = inotify_add_watch(inotify_fd, path, IN_MODIFY);
+  if (w->wd < 0) {
+    perror(path);
+    return;
+  }
+  w->sensor = sensor;
+  w->tacho = tacho;
+  w->attr = attr;
+  watch_count++;
+}
+
+static void create_ports(void) {
+  static const char *const names[8] = {
+    "in1", "in2", "in3", "in4", "outA", "outB", "outC", "outD"
+  };
+  char dir[PATH_MAX];
+  int i;
+
+  for (i = 0; i < 8; i++) {
+    snprintf(dir, sizeof(dir), "%s" SIM_SYSFS "/lego-port/port%d", root, i);
+    mkdirs(dir);
+    write_attr(dir, "address", "ev3-ports:%s", names[i]);
+    if (i < 4) {
+      write_attr(dir, "driver_name", "legoev3-input-port");
+      write_attr(dir, "modes", "auto i2c other-uart other-i2c raw");
+      write_attr(dir, "mode", "auto");
+      write_attr(dir, "status", i < SIM_SENSORS ? "ev3-uart" : "no-sensor");
+    } else {
+      write_attr(dir, "driver_name", "legoev3-output-port");
+      write_attr(dir, "modes", "auto tacho-motor dc-motor led raw");
+      write_attr(dir, "mode", "auto");
+      write_attr(dir, "status", i == 5 ? "no-motor" : "tacho-motor");
+    }
+  }
+}
+
+static void create_leds(void) {
+  static const char *const names[] = {
+    "led0:red:brick-status", "led0:green:brick-status",
+    "led1:red:brick-status", "led1:green:brick-status",
+    "ev3:left:red:ev3dev", "ev3:left:green:ev3dev",
+    "ev3:right:red:ev3dev", "ev3:right:green:ev3dev"
+  };
+  char dir[PATH_MAX];
+  size_t i;
+
+  for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    snprintf(dir, sizeof(dir), "%s" SIM_SYSFS "/leds/%s", root, names[i]);
+    mkdirs(dir);
+    write_attr(dir, "brightness", "0");
+    write_attr(dir, "max_brightness", "255");
+    write_attr(dir, "trigger", "[none] timer heartbeat default-on");
+    write_attr(dir, "delay_on", "0");
+    write_attr(dir, "delay_off", "0");
+  }
+}
+
+static void set_sensor_mode(struct sim_sensor *s, int mode) {
+  const struct sim_mode *m = &s->modes[mode];
+
+  s->mode = mode;
+  s->mode_time = now();
+  write_attr(s->dir, "num_values", "%d", m->num_values);
+  write_attr(s->dir, "decimals", "%d", m->decimals);
+  write_attr(s->dir, "units", "%s", m->units);
+}
+
+static void create_sensor(struct sim_sensor *s, int sn) {
+  char name[16], modes[256] = "";
+  int i;
+
+  snprintf(s->dir, sizeof(s->dir), "%s" SIM_SYSFS "/lego-sensor/sensor%d",
+	   root, sn);
+  mkdirs(s->dir);
+  for (i = 0; s->modes[i].name; i++) {
+    strcat(modes, i ? " " : "");
+    strcat(modes, s->modes[i].name);
+  }
+  write_attr(s->dir, "address", "%s", s->address);
+  write_attr(s->dir, "driver_name", "%s", s->driver);
+  write_attr(s->dir, "modes", "%s", modes);
+  write_attr(s->dir, "commands", "");
+  write_attr(s->dir, "command", "");
+  write_attr(s->dir, "fw_version", "");
+  write_attr(s->dir, "bin_data_format", "s8");
+  write_attr(s->dir, "poll_ms", "%d", s->poll_ms);
+  /*
+   * Le mode n'est écrit qu'ici: réécrit à chaque changement, il pourrait
+   * effacer un mode écrit entre-temps par le programme.
+   */
+  write_attr(s->dir, "mode", "%s", s->modes[0].name);
+  set_sensor_mode(s, 0);
+  for (i = 0; i < SIM_VALUES; i++) {
+    snprintf(name, sizeof(name), "value%d", i);
+    write_attr(s->dir, name, "0");
+    s->value_fd[i] = open_attr(s->dir, name);
+  }
+  watch(s->dir, "mode", s, NULL);
+  watch(s->dir, "poll_ms", s, NULL);
+}
+
+static void create_tacho(struct sim_tacho *t, int sn) {
+  snprintf(t->dir, sizeof(t->dir), "%s" SIM_SYSFS "/tacho-motor/motor%d",
+	   root, sn);
+  mkdirs(t->dir);
+  write_attr(t->dir, "address", "%s", t->address);
+  write_attr(t->dir, "driver_name", "lego-ev3-l-motor");
+  write_attr(t->dir, "commands", "run-forever run-to-abs-pos run-to-rel-pos run-timed run-direct stop reset");
+  write_attr(t->dir, "stop_actions", "coast brake hold");
+  write_attr(t->dir, "count_per_rot", "%d", SIM_COUNT_PER_ROT);
+  write_attr(t->dir, "max_speed", "%d", SIM_MAX_SPEED);
+  write_attr(t->dir, "command", "");
+  write_attr(t->dir, "polarity", "normal");
+  write_attr(t->dir, "stop_action", "coast");
+  write_attr(t->dir, "speed_sp", "0");
+  write_attr(t->dir, "duty_cycle_sp", "0");
+  write_attr(t->dir, "position_sp", "0");
+  write_attr(t->dir, "time_sp", "0");
+  write_attr(t->dir, "ramp_up_sp", "0");
+  write_attr(t->dir, "ramp_down_sp", "0");
+  write_attr(t->dir, "position", "0");
+  write_attr(t->dir, "speed", "0");
+  write_attr(t->dir, "duty_cycle", "0");
+  write_attr(t->dir, "state", "");
+  t->fd_position = open_attr(t->dir, "position");
+  t->fd_speed = open_attr(t->dir, "speed");
+  t->fd_state = open_attr(t->dir, "state");
+  t->fd_duty_cycle = open_attr(t->dir, "duty_cycle");
+  t->last_state = "";
+  watch(t->dir, "command", NULL, t);
+  watch(t->dir, "stop_action", NULL, t);
+  watch(t->dir, "speed_sp", NULL, t);
+  watch(t->dir, "duty_cycle_sp", NULL, t);
+  watch(t->dir, "position_sp", NULL, t);
+  watch(t->dir, "time_sp", NULL, t);
+}
+
+static void create_zlog_conf(void) {
+  char dir[PATH_MAX];
+
+  snprintf(dir, sizeof(dir), "%s/etc", root);
+  mkdirs(dir);
+  write_attr(dir, "zlog.conf",
+	     "[formats]\nsimple = \"%%d(%%T).%%ms %%-5V %%m%%n\"\n"
+	     "[rules]\nproject.* >stdout; simple");
+}
+
+static void sensor_attr_changed(struct sim_sensor *s, const char *attr) {
+  char buf[64];
+  int i;
+
+  if (read_attr(s->dir, attr, buf, sizeof(buf)) <= 0)
+    return;
+  if (strcmp(attr, "poll_ms") == 0) {
+    s->poll_ms = atoi(buf);
+    return;
+  }
+  for (i = 0; s->modes[i].name; i++)
+    if (strcmp(buf, s->modes[i].name) == 0) {
+      if (i != s->mode)
+	set_sensor_mode(s, i);
+      return;
+    }
+}
+
+static void tacho_stop(struct sim_tacho *t) {
+  t->command = CMD_STOP;
+  t->holding = t->stop_action == STOP_HOLD;
+}
+
+/*
+ * Valeur par défaut 'value' de l'attribut 'name' après reset. Les
+ * événements sont traités avec un retard: un attribut écrit par le
+ * programme après la commande reset (date 'since') garde sa valeur, comme
+ * sur la brique où reset agit dès l'écriture.
+ */
+static void reset_attr(struct sim_tacho *t, const struct timespec *since,
+		       const char *name, const char *value) {
+  char path[PATH_MAX];
+  struct stat st;
+
+  snprintf(path, sizeof(path), "%s/%s", t->dir, name);
+  if (stat(path, &st) == 0 &&
+      (st.st_mtim.tv_sec > since->tv_sec ||
+       (st.st_mtim.tv_sec == since->tv_sec &&
+	st.st_mtim.tv_nsec > since->tv_nsec)))
+    return;
+  write_attr(t->dir, name, "%s", value);
+}
+
+static void tacho_reset(struct sim_tacho *t) {
+  static const char *const defaults[][2] = {
+    { "polarity", "normal" }, { "stop_action", "coast" },
+    { "speed_sp", "0" }, { "duty_cycle_sp", "0" }, { "position_sp", "0" },
+    { "time_sp", "0" }, { "ramp_up_sp", "0" }, { "ramp_down_sp", "0" }
+  };
+  char path[PATH_MAX];
+  struct timespec since = { 0, 0 };
+  struct stat st;
+  size_t i;
+
+  t->command = CMD_NONE;
+  t->stop_action = STOP_COAST;
+  t->speed_sp = t->duty_cycle_sp = t->position_sp = t->time_sp = 0;
+  t->position = t->speed = 0;
+  t->holding = 0;
+  snprintf(path, sizeof(path), "%s/command", t->dir);
+  if (stat(path, &st) == 0)
+    since = st.st_mtim;
+  for (i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++)
+    reset_attr(t, &since, defaults[i][0], defaults[i][1]);
+}
+
+static void tacho_command(struct sim_tacho *t, int command) {
+  t->holding = 0;
+  switch (command) {
+  case CMD_RUN_TO_ABS_POS:
+    t->target = t->position_sp;
+    break;
+  case CMD_RUN_TO_REL_POS:
+    t->target = t->position + t->position_sp;
+    command = CMD_RUN_TO_ABS_POS;
+    break;
+  case CMD_RUN_TIMED:
+    t->end_time = now() + t->time_sp / 1000.0;
+    break;
+  case CMD_STOP:
+    tacho_stop(t);
+    return;
+  case CMD_RESET:
+    tacho_reset(t);
+    return;
+  }
+  t->command = command;
+}
+
+static void tacho_attr_changed(struct sim_tacho *t, const char *attr) {
+  char buf[64];
+  int i;
+
+  if (read_attr(t->dir, attr, buf, sizeof(buf)) <= 0)
+    return;
+  if (strcmp(attr, "command") == 0) {
+    for (i = 1; i < (int) (sizeof(commands) / sizeof(commands[0])); i++)
+      if (strcmp(buf, commands[i]) == 0)
+	tacho_command(t, i);
+  } else if (strcmp(attr, "stop_action") == 0) {
+    for (i = 0; i < 3; i++)
+      if (strcmp(buf, stop_actions[i]) == 0)
+	t->stop_action = i;
+  } else if (strcmp(attr, "speed_sp") == 0)
+    t->speed_sp = atoi(buf);
+  else if (strcmp(attr, "duty_cycle_sp") == 0)
+    t->duty_cycle_sp = atoi(buf);
+  else if (strcmp(attr, "position_sp") == 0)
+    t->position_sp = atoi(buf);
+  else if (strcmp(attr, "time_sp") == 0)
+    t->time_sp = atoi(buf);
+}
+
+static void handle_events(void) {
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *e;
+  ssize_t n;
+  char *p;
+  int i;
+
+  while ((n = read(inotify_fd, buf, sizeof(buf))) > 0)
+    for (p = buf; p < buf + n; p += sizeof(*e) + e->len) {
+      e = (const struct inotify_event *) p;
+      for (i = 0; i < watch_count; i++)
+	if (watches[i].wd == e->wd) {
+	  if (watches[i].sensor)
+	    sensor_attr_changed(watches[i].sensor, watches[i].attr);
+	  else
+	    tacho_attr_changed(watches[i].tacho, watches[i].attr);
+	  break;
+	}
+    }
+}
+
+static void sensor_step(struct sim_sensor *s, double t) {
+  const struct sim_color *c;
+  const char *mode = s->modes[s->mode].name;
+  int v[SIM_VALUES] = { 0 }, i, n = s->modes[s->mode].num_values, d;
+
+  /*
+   * Mode relu avant d'écrire les valeurs: comme le pilote, aucune valeur de
+   * l'ancien mode n'est écrite après l'écriture du mode, même si
+   * l'événement n'a pas encore été traité.
+   */
+  sensor_attr_changed(s, "mode");
+  // Valeurs périmées juste après un changement de mode
+  if (t - s->mode_time < s->modes[s->mode].settle_ms / 1000.0)
+    return;
+  if (s->poll_ms > 0 && t - s->update_time < s->poll_ms / 1000.0)
+    return;
+  s->update_time = t;
+
+  switch (s->kind) {
+  case SIM_TOUCH:
+    // Appui de 300 ms toutes les 1.5 s
+    v[0] = fmod(t, 1.5) < 0.3;
+    break;
+  case SIM_COLOR:
+    // Une nouvelle surface chaque seconde, en commençant par le noir
+    c = &colors[(long) (t - epoch) % SIM_COLORS];
+    if (strcmp(mode, "COL-REFLECT") == 0)
+      v[0] = c->reflect + noise(2);
+    else if (strcmp(mode, "COL-AMBIENT") == 0)
+      v[0] = c->ambient + noise(1);
+    else if (strcmp(mode, "COL-COLOR") == 0)
+      // Le firmware se trompe parfois de couleur
+      v[0] = rand_r(&seed) % 20 ? c->index : 1 + rand_r(&seed) % 7;
+    else if (strcmp(mode, "REF-RAW") == 0) {
+      v[0] = 6 * c->reflect + noise(8);
+      v[1] = 400 + noise(8);
+    } else if (strcmp(mode, "RGB-RAW") == 0)
+      for (i = 0; i < 3; i++)
+	v[i] = c->rgb[i] + noise(12);
+    break;
+  case SIM_US:
+    if (strcmp(mode, "US-LISTEN") == 0)
+      break;
+    // Obstacle entre 20 et 80 cm, avec des échos manqués et du bruit
+    d = (int) (500 + 300 * sin(2 * M_PI * t / 4)) + noise(5);
+    if (rand_r(&seed) % 33 == 0)
+      d = 2550;
+    v[0] = strstr(mode, "-IN") ? (int) (d / 2.54) : d;
+    break;
+  }
+  for (i = 0; i < n && i < SIM_VALUES; i++)
+    set_attr(s->value_fd[i], "%d", v[i]);
+}
+
+static void tacho_step(struct sim_tacho *t, double time, double dt) {
+  const char *state;
+  double tau = SIM_TAU_RUN, remaining;
+  int position, speed, running = 1;
+
+  switch (t->command) {
+  case CMD_RUN_FOREVER:
+    t->target = t->speed_sp;
+    break;
+  case CMD_RUN_DIRECT:
+    // Sans effet dans la zone morte, puis proportionnel au-delà
+    t->target = abs(t->duty_cycle_sp) <= t->deadband ? 0 :
+      copysign((abs(t->duty_cycle_sp) - t->deadband) * SIM_MAX_SPEED /
+	       (100 - t->deadband), t->duty_cycle_sp);
+    break;
+  case CMD_RUN_TIMED:
+    if (time >= t->end_time)
+      tacho_stop(t);
+    t->target = t->speed_sp;
+    break;
+  case CMD_RUN_TO_ABS_POS:
+    remaining = t->target - t->position;
+    if (fabs(remaining) < 1) {
+      tacho_stop(t);
+      break;
+    }
+    // Décélération à l'approche de la position
+    t->speed = copysign(fmin(abs(t->speed_sp), fabs(remaining) * 10),
+			remaining);
+    t->position += t->speed * dt;
+    tau = 0;
+    break;
+  }
+  if (t->command == CMD_STOP || t->command == CMD_NONE) {
+    running = 0;
+    t->target = 0;
+    tau = t->holding ? 0 : t->stop_action == STOP_BRAKE ?
+      SIM_TAU_BRAKE : SIM_TAU_COAST;
+    if (tau == 0)
+      t->speed = 0;
+  }
+  if (tau > 0) {
+    t->speed += (t->target * t->gain - t->speed) * fmin(dt / tau, 1);
+    t->speed = fmax(fmin(t->speed, SIM_MAX_SPEED), -SIM_MAX_SPEED);
+    t->position += t->speed * dt;
+  }
+
+  position = (int) lround(t->position);
+  speed = (int) lround(t->speed);
+  state = running ? "running" : t->holding ? "holding" : "";
+  if (position != t->last_position) {
+    set_attr(t->fd_position, "%d", position);
+    t->last_position = position;
+  }
+  if (speed != t->last_speed) {
+    set_attr(t->fd_speed, "%d", speed);
+    set_attr(t->fd_duty_cycle, "%d", speed * 100 / SIM_MAX_SPEED);
+    t->last_speed = speed;
+  }
+  if (state != t->last_state) {
+    set_attr(t->fd_state, "%s", state);
+    t->last_state = state;
+  }
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+			struct FTW *ftw) {
+  return remove(path);
+}
+
+static void on_signal(int sig) {
+  stop = 1;
+}
+
+// Lancement du programme avec la bibliothèque de redirection
+static pid_t spawn(char *argv[], const char *self) {
+  char preload[PATH_MAX], exe[PATH_MAX];
+  pid_t pid;
+
+  if (getenv("EV3_SIM_PRELOAD"))
+    snprintf(preload, sizeof(preload), "%s", getenv("EV3_SIM_PRELOAD"));
+  else {
+    if (realpath(self, exe) == NULL)
+      snprintf(exe, sizeof(exe), "%s", self);
+    snprintf(preload, sizeof(preload), "%s/libev3sim.so", dirname(exe));
+  }
+
+  pid = fork();
+  if (pid == 0) {
+    setenv("EV3_SIM_ROOT", root, 1);
+    setenv("LD_PRELOAD", preload, 1);
+    execvp(argv[0], argv);
+    perror(argv[0]);
+    _exit(127);
+  }
+
+  return pid;
+}
+
+int main(int argc, char *argv[]) {
+  struct pollfd pfd;
+  double t, last;
+  int i, opt, status = 0, keep = 0;
+  pid_t child = 0;
+
+  while ((opt = getopt(argc, argv, "+r:")) != -1)
+    switch (opt) {
+    case 'r':
+      snprintf(root, sizeof(root), "%s", optarg);
+      keep = 1;
+      break;
+    default:
+      fprintf(stderr, "Utilisation: %s [-r racine] [programme [arguments]]\n",
+	      argv[0]);
+      return EXIT_FAILURE;
+    }
+  if (!keep) {
+    snprintf(root, sizeof(root), "/tmp/ev3sim.XXXXXX");
+    if (mkdtemp(root) == NULL) {
+      perror(root);
+      return EXIT_FAILURE;
+    }
+  }
+
+  inotify_fd = inotify_init1(IN_NONBLOCK);
+  if (inotify_fd < 0) {
+    perror("inotify_init1");
+    return EXIT_FAILURE;
+  }
+  create_ports();
+  create_leds();
+  for (i = 0; i < SIM_SENSORS; i++)
+    create_sensor(&sensors[i], i);
+  for (i = 0; i < SIM_TACHOS; i++)
+    create_tacho(&tachos[i], i);
+  create_zlog_conf();
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  if (optind < argc) {
+    child = spawn(&argv[optind], argv[0]);
+    if (child < 0) {
+      perror("fork");
+      stop = 1;
+    }
+  } else {
+    printf("EV3_SIM_ROOT=%s\n", root);
+    fflush(stdout);
+  }
+
+  pfd.fd = inotify_fd;
+  pfd.events = POLLIN;
+  last = now();
+  epoch = last;
+  while (!stop) {
+    if (poll(&pfd, 1, SIM_TICK_MS) > 0)
+      handle_events();
+    t = now();
+    for (i = 0; i < SIM_SENSORS; i++)
+      sensor_step(&sensors[i], t);
+    for (i = 0; i < SIM_TACHOS; i++)
+      tacho_step(&tachos[i], t, t - last);
+    last = t;
+    if (child > 0 && waitpid(child, &status, WNOHANG) == child)
+      break;
+  }
+
+  if (!keep)
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+  if (child > 0)
+    return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
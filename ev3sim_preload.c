@@ -0,0 +1,175 @@
+/*
+ * Redirection des accès sysfs vers l'arborescence simulée.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Bibliothèque chargée par LD_PRELOAD. Tout chemin commençant par
+ * '/sys/class/' est préfixé par la variable d'environnement EV3_SIM_ROOT,
+ * de sorte que ev3dev-c et les programmes de test lisent l'arborescence
+ * créée par ev3sim sans être modifiés. Le fichier '/etc/zlog.conf' est
+ * également redirigé s'il existe dans la racine simulée.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SYSFS_PREFIX "/sys/class/"
+#define ZLOG_CONF "/etc/zlog.conf"
+
+static const char *redirect(const char *path, char *buf) {
+  static const char *root;
+  static int zlog_conf = -1;
+
+  if (path == NULL)
+    return path;
+  if (root == NULL) {
+    root = getenv("EV3_SIM_ROOT");
+    if (root == NULL)
+      return path;
+  }
+  if (strncmp(path, SYSFS_PREFIX, sizeof(SYSFS_PREFIX) - 1) == 0) {
+    snprintf(buf, PATH_MAX, "%s%s", root, path);
+    return buf;
+  }
+  if (strcmp(path, ZLOG_CONF) == 0) {
+    snprintf(buf, PATH_MAX, "%s%s", root, path);
+    if (zlog_conf == -1) {
+      int (*real_access)(const char *, int) = dlsym(RTLD_NEXT, "access");
+      zlog_conf = real_access(buf, R_OK) == 0;
+    }
+    return zlog_conf ? buf : path;
+  }
+
+  return path;
+}
+
+#define REAL(name) real_##name = real_##name ? real_##name : dlsym(RTLD_NEXT, #name)
+
+int open(const char *path, int flags, ...) {
+  static int (*real_open)(const char *, int, ...);
+  char buf[PATH_MAX];
+  mode_t mode = 0;
+  va_list ap;
+
+  if (flags & (O_CREAT | O_TMPFILE)) {
+    va_start(ap, flags);
+    mode = va_arg(ap, mode_t);
+    va_end(ap);
+  }
+  REAL(open);
+  return real_open(redirect(path, buf), flags, mode);
+}
+
+int open64(const char *path, int flags, ...) {
+  static int (*real_open64)(const char *, int, ...);
+  char buf[PATH_MAX];
+  mode_t mode = 0;
+  va_list ap;
+
+  if (flags & (O_CREAT | O_TMPFILE)) {
+    va_start(ap, flags);
+    mode = va_arg(ap, mode_t);
+    va_end(ap);
+  }
+  REAL(open64);
+  return real_open64(redirect(path, buf), flags, mode);
+}
+
+int openat(int dirfd, const char *path, int flags, ...) {
+  static int (*real_openat)(int, const char *, int, ...);
+  char buf[PATH_MAX];
+  mode_t mode = 0;
+  va_list ap;
+
+  if (flags & (O_CREAT | O_TMPFILE)) {
+    va_start(ap, flags);
+    mode = va_arg(ap, mode_t);
+    va_end(ap);
+  }
+  REAL(openat);
+  return real_openat(dirfd, redirect(path, buf), flags, mode);
+}
+
+FILE *fopen(const char *path, const char *mode) {
+  static FILE *(*real_fopen)(const char *, const char *);
+  char buf[PATH_MAX];
+
+  REAL(fopen);
+  return real_fopen(redirect(path, buf), mode);
+}
+
+FILE *fopen64(const char *path, const char *mode) {
+  static FILE *(*real_fopen64)(const char *, const char *);
+  char buf[PATH_MAX];
+
+  REAL(fopen64);
+  return real_fopen64(redirect(path, buf), mode);
+}
+
+DIR *opendir(const char *path) {
+  static DIR *(*real_opendir)(const char *);
+  char buf[PATH_MAX];
+
+  REAL(opendir);
+  return real_opendir(redirect(path, buf));
+}
+
+int access(const char *path, int mode) {
+  static int (*real_access)(const char *, int);
+  char buf[PATH_MAX];
+
+  REAL(access);
+  return real_access(redirect(path, buf), mode);
+}
+
+ssize_t readlink(const char *path, char *link, size_t sz) {
+  static ssize_t (*real_readlink)(const char *, char *, size_t);
+  char buf[PATH_MAX];
+
+  REAL(readlink);
+  return real_readlink(redirect(path, buf), link, sz);
+}
+
+int stat(const char *path, struct stat *st) {
+  static int (*real_stat)(const char *, struct stat *);
+  char buf[PATH_MAX];
+
+  REAL(stat);
+  return real_stat(redirect(path, buf), st);
+}
+
+int lstat(const char *path, struct stat *st) {
+  static int (*real_lstat)(const char *, struct stat *);
+  char buf[PATH_MAX];
+
+  REAL(lstat);
+  return real_lstat(redirect(path, buf), st);
+}
+
+// Points d'entrée des anciennes glibc (< 2.33) pour stat et lstat
+int __xstat(int ver, const char *path, struct stat *st) {
+  static int (*real___xstat)(int, const char *, struct stat *);
+  char buf[PATH_MAX];
+
+  REAL(__xstat);
+  return real___xstat(ver, redirect(path, buf), st);
+}
+
+int __lxstat(int ver, const char *path, struct stat *st) {
+  static int (*real___lxstat)(int, const char *, struct stat *);
+  char buf[PATH_MAX];
+
+  REAL(__lxstat);
+  return real___lxstat(ver, redirect(path, buf), st);
+}
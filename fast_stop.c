@@ -0,0 +1,153 @@
+/*
+ * Arrêt d'urgence des servomoteurs au plus court.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "discovery.h"
+#include "fast_stop.h"
+#include "zlog.h"
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+static int open_attr(uint8_t sn, const char *attr, int flags) {
+  char path[FAST_STOP_PATH_LEN];
+
+  snprintf(path, sizeof(path), TACHO_SYSFS_PATH "%u/%s", sn, attr);
+  return open(path, flags);
+}
+
+static long now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000L + ts.tv_nsec / 1000L;
+}
+
+int fast_stop_open(struct fast_stop *s, const uint8_t *ports, int count,
+		   int discover) {
+  struct ev3_device tacho[DISCOVERY_DEVICE_LIMIT];
+  struct ev3_device_map map;
+  int i, j, n;
+
+  memset(s, 0, sizeof(*s));
+  for (i = 0; i < FAST_STOP_MOTORS; i++)
+    s->action_fd[i] = s->command_fd[i] = s->speed_fd[i] = -1;
+  if (count > FAST_STOP_MOTORS)
+    count = FAST_STOP_MOTORS;
+
+  if (discover) {
+    if (discovery_init(&map, DISCOVERY_TACHOS | DISCOVERY_NO_CACHE) != 1)
+      return 0;
+    ev3_uninit();
+  }
+  n = discovery_cached_tachos(tacho, DISCOVERY_DEVICE_LIMIT);
+  if (n < 0)
+    n = 0;
+
+  for (i = 0; i < count; i++) {
+    for (j = 0; j < n && tacho[j].port != ports[i]; j++)
+      ;
+    if (j == n)
+      continue;
+    s->port[s->count] = ports[i];
+    s->sn[s->count] = tacho[j].sn;
+    s->action_fd[s->count] = open_attr(tacho[j].sn, "stop_action", O_WRONLY);
+    s->command_fd[s->count] = open_attr(tacho[j].sn, "command", O_WRONLY);
+    if (s->command_fd[s->count] < 0) {
+      // Servomoteur rebranché ou cache périmé
+      if (s->action_fd[s->count] >= 0)
+	close(s->action_fd[s->count]);
+      s->action_fd[s->count] = -1;
+      continue;
+    }
+    s->count++;
+  }
+
+  return s->count == count;
+}
+
+int fast_stop_action_valid(const char *action) {
+  return strcmp(action, "coast") == 0 || strcmp(action, "brake") == 0 ||
+    strcmp(action, "hold") == 0;
+}
+
+int fast_stop_fire(const struct fast_stop *s, const char *action) {
+  char buf[16];
+  size_t len = 0;
+  int i, set, stopped = 0;
+
+  // sysfs ignore le retour à la ligne final
+  if (action != NULL) {
+    len = strlen(action);
+    if (len > sizeof(buf) - 1)
+      len = sizeof(buf) - 1;
+    memcpy(buf, action, len);
+    buf[len++] = '\n';
+  }
+  for (i = 0; i < s->count; i++) {
+    set = len == 0 ||
+      (s->action_fd[i] >= 0 && pwrite(s->action_fd[i], buf, len, 0) == (ssize_t) len);
+    if (pwrite(s->command_fd[i], "stop\n", 5, 0) == 5 && set)
+      stopped++;
+  }
+
+  return stopped;
+}
+
+int fast_stop_wait(struct fast_stop *s, long timeout_us) {
+  char buf[16];
+  long deadline = now_us() + timeout_us;
+  ssize_t n;
+  int i, moving;
+
+  for (i = 0; i < s->count; i++)
+    if (s->speed_fd[i] < 0)
+      s->speed_fd[i] = open_attr(s->sn[i], "speed", O_RDONLY);
+
+  for (;;) {
+    moving = 0;
+    for (i = 0; i < s->count; i++) {
+      if (s->speed_fd[i] < 0)
+	continue;
+      n = pread(s->speed_fd[i], buf, sizeof(buf) - 1, 0);
+      if (n <= 0)
+	continue;
+      buf[n] = '\0';
+      if (atoi(buf) != 0)
+	moving++;
+    }
+    if (moving == 0)
+      return 1;
+    if (now_us() > deadline) {
+      zlog_warn(zlog_c, "%d servomoteur(s) encore en mouvement après %ld us",
+		moving, timeout_us);
+      return 0;
+    }
+    usleep(FAST_STOP_POLL_US);
+  }
+}
+
+void fast_stop_close(struct fast_stop *s) {
+  int i;
+
+  for (i = 0; i < s->count; i++) {
+    if (s->action_fd[i] >= 0)
+      close(s->action_fd[i]);
+    if (s->command_fd[i] >= 0)
+      close(s->command_fd[i]);
+    if (s->speed_fd[i] >= 0)
+      close(s->speed_fd[i]);
+    s->action_fd[i] = s->command_fd[i] = s->speed_fd[i] = -1;
+  }
+  s->count = 0;
+}
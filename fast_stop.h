@@ -0,0 +1,72 @@
+/*
+ * Arrêt d'urgence des servomoteurs au plus court.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Les numéros de séquence des servomoteurs viennent du cache de la
+ * découverte, sans ev3_init ni parcours de sysfs. Les attributs
+ * 'stop_action' et 'command' de chaque servomoteur sont ouverts d'avance;
+ * l'arrêt se réduit alors à deux pwrite par servomoteur. Un cache périmé se
+ * voit à l'ouverture, puisqu'un servomoteur rebranché change de numéro de
+ * séquence: la découverte complète est alors refaite.
+ */
+
+#ifndef FAST_STOP_H
+#define FAST_STOP_H
+
+#include <stdint.h>
+
+#define FAST_STOP_MOTORS 4
+#define FAST_STOP_PATH_LEN 64
+// Action d'arrêt par défaut: 'coast', 'brake' ou 'hold'
+#define FAST_STOP_ACTION "brake"
+// Période de lecture des vitesses en attendant l'arrêt
+#define FAST_STOP_POLL_US 1000
+
+struct fast_stop {
+  int count;
+  uint8_t port[FAST_STOP_MOTORS];
+  uint8_t sn[FAST_STOP_MOTORS];
+  int action_fd[FAST_STOP_MOTORS];
+  int command_fd[FAST_STOP_MOTORS];
+  // Ouverts par fast_stop_wait seulement, pour ne pas retarder l'arrêt
+  int speed_fd[FAST_STOP_MOTORS];
+};
+
+/*
+ * Ouverture des attributs des servomoteurs branchés aux 'count' ports
+ * 'ports' (OUTPUT_A à OUTPUT_D). Si 'discover', la découverte complète des
+ * servomoteurs est refaite avant, ce qui réécrit le cache.
+ * Valeurs de retour:
+ * 1, si tous les servomoteurs ont été trouvés et leurs attributs ouverts,
+ * 0, sinon; les servomoteurs trouvés restent utilisables.
+ */
+int fast_stop_open(struct fast_stop *s, const uint8_t *ports, int count,
+		   int discover);
+
+/*
+ * Vérification d'une action d'arrêt.
+ * Retourne 1 si 'action' est 'coast', 'brake' ou 'hold', 0 sinon.
+ */
+int fast_stop_action_valid(const char *action);
+
+/*
+ * Arrêt des servomoteurs avec l'action 'action' ('coast', 'brake', 'hold'),
+ * ou avec leur action courante si 'action' est nul. Sûr dans un
+ * gestionnaire de signal.
+ * Retourne le nombre de servomoteurs qui ont accepté l'action et la
+ * commande; un servomoteur dont l'action n'a pas pu être écrite s'arrête
+ * avec son action courante et n'est pas compté.
+ */
+int fast_stop_fire(const struct fast_stop *s, const char *action);
+
+/*
+ * Attente de l'arrêt effectif: vitesse nulle pour tous les servomoteurs.
+ * Retourne 1 si tous se sont arrêtés avant 'timeout_us', 0 sinon.
+ */
+int fast_stop_wait(struct fast_stop *s, long timeout_us);
+
+void fast_stop_close(struct fast_stop *s);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * Banc d'essai du traitement des mesures en virgule flottante et fixe.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Une même trace synthétique de distances brutes en cm avec BENCH_DECIMALS
+ * décimales est traitée de deux façons: mise à l'échelle comme
+ * get_sensor_value0, moyenne exponentielle, conversion en mm et seuil
+ * d'obstacle, en float puis en entiers. Les décimales de la trace (2)
+ * diffèrent de celles des mm en cm (1), pour que sensor_fixed_rescale
+ * fasse une vraie division arrondie comme pour un mode à 2 décimales. Le coût
+ * par mesure est donné en ns, et en cycles si la fréquence du processeur
+ * est connue (EV3_CPU_MHZ, ou cpufreq; 300 MHz pour l'ARM9 de la brique).
+ *
+ * Sans brique, le programme peut être compilé pour ARMv5 sans unité de
+ * calcul flottant (-march=armv5te -mfloat-abi=soft) et lancé avec qemu-arm.
+ *
+ * Matériel demandé: aucun
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sensor_reader.h"
+#include "zlog.h"
+
+#define BENCH_SAMPLES 4096
+#define BENCH_ROUNDS 200
+#define BENCH_DECIMALS 2
+// Des mm sont des cm avec 1 décimale
+#define MM_DECIMALS 1
+// Seuil d'obstacle et coefficient de lissage 1/2^EMA_SHIFT
+#define OBSTACLE_MM 300
+#define EMA_SHIFT 3
+#define CPU_FREQ_PATH "/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq"
+
+// Variable globale spécifique à zlog
+zlog_category_t *zlog_c;
+
+// Trace brute, volatile pour que le compilateur ne précalcule rien
+static volatile int trace[BENCH_SAMPLES];
+
+static long long now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Fréquence du processeur en MHz, ou 0 si elle est inconnue
+static int cpu_mhz(void) {
+  const char *env = getenv("EV3_CPU_MHZ");
+  FILE *f;
+  long khz;
+
+  if (env != NULL && atoi(env) > 0)
+    return atoi(env);
+  f = fopen(CPU_FREQ_PATH, "r");
+  if (f != NULL) {
+    if (fscanf(f, "%ld", &khz) == 1 && khz > 0) {
+      fclose(f);
+      return khz / 1000;
+    }
+    fclose(f);
+  }
+
+  return 0;
+}
+
+// Coût en cycles de 'ns' par mesure, vide si la fréquence est inconnue
+static const char *cycles(char *buf, size_t size, double ns, int mhz) {
+  buf[0] = '\0';
+  if (mhz > 0)
+    snprintf(buf, size, ", %.0f cycles/mesure", ns * mhz / 1000);
+
+  return buf;
+}
+
+// Dents de scie entre 10 et 200 cm avec du bruit de ±2 cm, en centièmes
+static void make_trace(void) {
+  unsigned int seed = 12345;
+  int i;
+
+  for (i = 0; i < BENCH_SAMPLES; i++) {
+    seed = seed * 1103515245 + 12345;
+    trace[i] = 1000 + (i * 73) % 19000 + (int) ((seed >> 16) % 401) - 200;
+  }
+}
+
+static int run_float(int *obstacles) {
+  static const float scale[] = { 1.0f, 10.0f, 100.0f, 1000.0f };
+  float cm, ema = 0, mm;
+  int i, sink = 0;
+
+  for (i = 0; i < BENCH_SAMPLES; i++) {
+    cm = trace[i] / scale[BENCH_DECIMALS];
+    ema += (cm - ema) / (1 << EMA_SHIFT);
+    mm = ema * 10.0f;
+    if (mm < OBSTACLE_MM)
+      (*obstacles)++;
+    sink += (int) mm;
+  }
+
+  return sink;
+}
+
+static int run_fixed(int *obstacles) {
+  int i, mm, ema = 0, sink = 0;
+
+  for (i = 0; i < BENCH_SAMPLES; i++) {
+    // Dixièmes de cm, soit des mm, avec 8 bits de fraction pour le lissage
+    mm = sensor_fixed_rescale(trace[i], BENCH_DECIMALS, MM_DECIMALS);
+    ema += ((mm << 8) - ema) >> EMA_SHIFT;
+    mm = ema >> 8;
+    if (mm < OBSTACLE_MM)
+      (*obstacles)++;
+    sink += mm;
+  }
+
+  return sink;
+}
+
+int main(int argc, char *argv[]) {
+  long long start, float_ns, fixed_ns;
+  int i, rc, mhz, rounds = BENCH_ROUNDS, float_hits = 0, fixed_hits = 0;
+  char buf[32];
+  long long float_sink = 0, fixed_sink = 0;
+  double samples;
+
+  // Variables constantes spécifique à zlog
+  const char *zlog_conf = "/etc/zlog.conf";
+  const char *zlog_cat  = "project";
+
+  if (argc > 1 && atoi(argv[1]) > 0)
+    rounds = atoi(argv[1]);
+
+  rc = zlog_init(zlog_conf);
+  if (rc) {
+    printf("L'initialisation de zlog avec '%s' a échoué\n", zlog_conf);
+    return EXIT_FAILURE;
+  }
+
+  zlog_c = zlog_get_category(zlog_cat);
+  if (!zlog_c) {
+    printf("zlog est incapable de retrouver la catégorie '%s'\n", zlog_cat);
+    zlog_fini();
+    return EXIT_FAILURE;
+  }
+
+  make_trace();
+  mhz = cpu_mhz();
+  samples = (double) rounds * BENCH_SAMPLES;
+
+  start = now_ns();
+  for (i = 0; i < rounds; i++)
+    float_sink += run_float(&float_hits);
+  float_ns = now_ns() - start;
+
+  start = now_ns();
+  for (i = 0; i < rounds; i++)
+    fixed_sink += run_fixed(&fixed_hits);
+  fixed_ns = now_ns() - start;
+
+  if (mhz > 0)
+    zlog_info(zlog_c, "%.0f mesures, processeur à %d MHz", samples, mhz);
+  else
+    zlog_info(zlog_c, "%.0f mesures, fréquence du processeur inconnue (EV3_CPU_MHZ)",
+	      samples);
+  zlog_info(zlog_c, "float  : %.1f ns/mesure%s, %d obstacle(s)",
+	    float_ns / samples,
+	    cycles(buf, sizeof(buf), float_ns / samples, mhz),
+	    float_hits / rounds);
+  zlog_info(zlog_c, "fixe   : %.1f ns/mesure%s, %d obstacle(s) (x%.1f)",
+	    fixed_ns / samples,
+	    cycles(buf, sizeof(buf), fixed_ns / samples, mhz),
+	    fixed_hits / rounds, fixed_ns > 0 ? (double) float_ns / fixed_ns : 0.0);
+  zlog_info(zlog_c, "Moyenne des distances lissées : %d mm en float, %d mm en fixe",
+	    (int) (float_sink / rounds / BENCH_SAMPLES),
+	    (int) (fixed_sink / rounds / BENCH_SAMPLES));
+
+  zlog_fini();
+
+  return EXIT_SUCCESS;
+}
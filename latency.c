@@ -0,0 +1,248 @@
+/*
+ * Histogrammes de latence des accès aux attributs des périphériques.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "latency.h"
+#include "zlog.h"
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+struct latency_slot {
+  int device;
+  uint8_t sn;
+  const char *attr;
+  atomic_uint count;
+  atomic_uint max;
+  atomic_uint buckets[LATENCY_BUCKETS];
+};
+
+static struct {
+  struct latency_slot slots[LATENCY_SLOTS];
+  // Places attribuées, publiées une fois remplies
+  atomic_int used;
+  atomic_uint lost;
+  pthread_mutex_t lock;
+  atomic_int stopping;
+  int started;
+  pthread_t thread;
+} latency = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static int bucket_of(uint64_t ns) {
+  int shift;
+
+  if (ns < LATENCY_SUB)
+    return ns;
+  if (ns >> LATENCY_MAX_BITS)
+    return LATENCY_BUCKETS - 1;
+  shift = 63 - __builtin_clzll(ns) - LATENCY_SUB_BITS;
+
+  return LATENCY_SUB * (shift + 1) + (int) (ns >> shift) - LATENCY_SUB;
+}
+
+// Plus grande durée rangée dans la case 'b'
+static uint64_t bucket_high(int b) {
+  int shift = b / LATENCY_SUB - 1;
+
+  if (shift <= 0)
+    return b;
+
+  return ((uint64_t) (b % LATENCY_SUB + LATENCY_SUB + 1) << shift) - 1;
+}
+
+static int same(const struct latency_slot *s, int device, uint8_t sn,
+		const char *attr) {
+  return s->device == device && s->sn == sn &&
+    (s->attr == attr || strcmp(s->attr, attr) == 0);
+}
+
+static struct latency_slot *slot_of(int device, uint8_t sn, const char *attr) {
+  struct latency_slot *s = NULL;
+  int i, used;
+
+  used = atomic_load_explicit(&latency.used, memory_order_acquire);
+  for (i = 0; i < used; i++)
+    if (same(&latency.slots[i], device, sn, attr))
+      return &latency.slots[i];
+
+  // Nouveau couple: la recherche est refaite sous le verrou
+  pthread_mutex_lock(&latency.lock);
+  used = atomic_load_explicit(&latency.used, memory_order_relaxed);
+  for (i = 0; i < used; i++)
+    if (same(&latency.slots[i], device, sn, attr))
+      s = &latency.slots[i];
+  if (s == NULL && used < LATENCY_SLOTS) {
+    s = &latency.slots[used];
+    s->device = device;
+    s->sn = sn;
+    s->attr = attr;
+    atomic_store_explicit(&latency.used, used + 1, memory_order_release);
+  }
+  pthread_mutex_unlock(&latency.lock);
+
+  return s;
+}
+
+void latency_add(int device, uint8_t sn, const char *attr, uint64_t ns) {
+  struct latency_slot *s = slot_of(device, sn, attr);
+  unsigned int v = ns > UINT32_MAX ? UINT32_MAX : ns;
+  unsigned int max;
+
+  if (s == NULL) {
+    atomic_fetch_add_explicit(&latency.lost, 1, memory_order_relaxed);
+    return;
+  }
+  atomic_fetch_add_explicit(&s->buckets[bucket_of(ns)], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&s->count, 1, memory_order_relaxed);
+  max = atomic_load_explicit(&s->max, memory_order_relaxed);
+  while (v > max &&
+	 !atomic_compare_exchange_weak_explicit(&s->max, &max, v,
+						memory_order_relaxed,
+						memory_order_relaxed))
+    ;
+}
+
+struct latency_summary {
+  const struct latency_slot *slot;
+  unsigned int count;
+  double total_ns;
+  uint64_t p50, p90, p99, p999;
+};
+
+static int by_total(const void *a, const void *b) {
+  const struct latency_summary *x = a, *y = b;
+
+  return x->total_ns < y->total_ns ? 1 : x->total_ns > y->total_ns ? -1 : 0;
+}
+
+// Centiles d'un histogramme, relevé case par case pendant les ajouts
+static int summarize(const struct latency_slot *s, struct latency_summary *r) {
+  static unsigned int buckets[LATENCY_BUCKETS];
+  unsigned long long seen = 0;
+  unsigned int max = atomic_load_explicit(&s->max, memory_order_relaxed);
+  uint64_t high;
+  int b;
+
+  r->slot = s;
+  r->count = 0;
+  r->total_ns = 0;
+  for (b = 0; b < LATENCY_BUCKETS; b++) {
+    buckets[b] = atomic_load_explicit(&s->buckets[b], memory_order_relaxed);
+    r->count += buckets[b];
+    r->total_ns += buckets[b] * (double) ((b == 0 ? 0 : bucket_high(b - 1) + 1) +
+					  bucket_high(b)) / 2;
+  }
+  if (r->count == 0)
+    return 0;
+  r->p50 = r->p90 = r->p99 = r->p999 = 0;
+  for (b = 0; b < LATENCY_BUCKETS; b++) {
+    if (buckets[b] == 0)
+      continue;
+    seen += buckets[b];
+    high = bucket_high(b) < max ? bucket_high(b) : max;
+    if (!r->p50 && seen * 1000 >= r->count * 500ULL)
+      r->p50 = high;
+    if (!r->p90 && seen * 1000 >= r->count * 900ULL)
+      r->p90 = high;
+    if (!r->p99 && seen * 1000 >= r->count * 990ULL)
+      r->p99 = high;
+    if (!r->p999 && seen * 1000 >= r->count * 999ULL)
+      r->p999 = high;
+  }
+
+  return 1;
+}
+
+static const char *device_name(int device) {
+  switch (device) {
+  case LATENCY_SENSOR:
+    return "capteur";
+  case LATENCY_TACHO:
+    return "moteur";
+  default:
+    return "moteurs";
+  }
+}
+
+void latency_dump(void) {
+  static pthread_mutex_t dumping = PTHREAD_MUTEX_INITIALIZER;
+  static struct latency_summary summaries[LATENCY_SLOTS];
+  const struct latency_slot *s;
+  int i, n = 0, used;
+
+  // Le fil des signaux et le programme peuvent écrire en même temps
+  pthread_mutex_lock(&dumping);
+  used = atomic_load_explicit(&latency.used, memory_order_acquire);
+  for (i = 0; i < used; i++)
+    if (summarize(&latency.slots[i], &summaries[n]))
+      n++;
+  qsort(summaries, n, sizeof(summaries[0]), by_total);
+
+  zlog_info(zlog_c, "Latences en µs : appels, p50, p90, p99, p99.9, max, total");
+  for (i = 0; i < n; i++) {
+    s = summaries[i].slot;
+    zlog_info(zlog_c, "%-7s %3u %-14s : %7u %8.1f %8.1f %8.1f %8.1f %8.1f %10.1f",
+	      device_name(s->device), s->sn, s->attr, summaries[i].count,
+	      summaries[i].p50 / 1000.0, summaries[i].p90 / 1000.0,
+	      summaries[i].p99 / 1000.0, summaries[i].p999 / 1000.0,
+	      atomic_load_explicit(&s->max, memory_order_relaxed) / 1000.0,
+	      summaries[i].total_ns / 1000.0);
+  }
+  if (atomic_load_explicit(&latency.lost, memory_order_relaxed))
+    zlog_warn(zlog_c, "Latences : %u mesure(s) sans histogramme libre",
+	      atomic_load_explicit(&latency.lost, memory_order_relaxed));
+  pthread_mutex_unlock(&dumping);
+}
+
+static void *latency_thread(void *arg) {
+  sigset_t *set = arg;
+  int sig;
+
+  for (;;) {
+    if (sigwait(set, &sig) != 0)
+      continue;
+    if (atomic_load_explicit(&latency.stopping, memory_order_acquire))
+      break;
+    latency_dump();
+  }
+
+  return NULL;
+}
+
+int latency_start(void) {
+  static sigset_t set;
+
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+  if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0)
+    return 0;
+  atomic_init(&latency.stopping, 0);
+  if (pthread_create(&latency.thread, NULL, latency_thread, &set) != 0) {
+    zlog_warn(zlog_c, "Impossible de démarrer le fil des histogrammes de latence");
+    return 0;
+  }
+  latency.started = 1;
+
+  return 1;
+}
+
+void latency_stop(void) {
+  if (latency.started) {
+    atomic_store_explicit(&latency.stopping, 1, memory_order_release);
+    pthread_kill(latency.thread, SIGUSR1);
+    pthread_join(latency.thread, NULL);
+    latency.started = 0;
+  }
+  latency_dump();
+}
@@ -0,0 +1,74 @@
+/*
+ * Histogrammes de latence des accès aux attributs des périphériques.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Chaque couple (périphérique, attribut) a son histogramme à échelle
+ * log-linéaire, comme HdrHistogram: les durées sont rangées par puissance
+ * de deux, chacune coupée en LATENCY_SUB cases, ce qui garde une précision
+ * relative de 1/LATENCY_SUB de la nanoseconde à la minute dans une mémoire
+ * fixe. Un ajout est une recherche de l'histogramme et des incréments
+ * atomiques, sans verrou; seul le premier accès à un nouveau couple prend
+ * un verrou pour lui attribuer une place.
+ *
+ * latency_dump() écrit les centiles de chaque histogramme, du plus coûteux
+ * au moins coûteux en temps total. Après latency_start(), un fil dédié les
+ * écrit aussi à chaque signal SIGUSR1 (kill -USR1 <pid>).
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Cases par puissance de deux et plus grande durée distinguée (2^36 ns)
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BITS 36
+#define LATENCY_BUCKETS (LATENCY_SUB * (LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1))
+// Couples (périphérique, attribut) suivis
+#define LATENCY_SLOTS 64
+
+enum { LATENCY_SENSOR, LATENCY_TACHO, LATENCY_TACHOS };
+
+static inline uint64_t latency_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Ajout d'une durée 'ns' pour l'attribut 'attr' du périphérique 'sn' de
+ * type LATENCY_SENSOR ou LATENCY_TACHO; LATENCY_TACHOS désigne un accès
+ * multi_set_* à plusieurs moteurs, 'sn' étant le premier. 'attr' doit
+ * rester valide, comme une chaîne littérale.
+ */
+void latency_add(int device, uint8_t sn, const char *attr, uint64_t ns);
+
+/*
+ * Mesure de l'appel 'call', dont le résultat est rangé dans 'result'.
+ */
+#define LATENCY_TIME(result, device, sn, attr, call) do {		\
+    uint64_t _latency_t0 = latency_now();				\
+    (result) = (call);							\
+    latency_add((device), (sn), (attr), latency_now() - _latency_t0);	\
+  } while (0)
+
+/*
+ * Démarrage du fil qui écrit les histogrammes à chaque SIGUSR1. A appeler
+ * avant de créer d'autres fils: SIGUSR1 est bloqué dans le fil appelant et
+ * les fils qu'il crée ensuite.
+ * Retourne 1 en cas de succès, 0 sinon.
+ */
+int latency_start(void);
+
+// Arrêt du fil et écriture des histogrammes
+void latency_stop(void);
+
+// Ecriture des centiles de chaque histogramme avec zlog
+void latency_dump(void);
+
+#endif
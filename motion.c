@@ -0,0 +1,200 @@
+/*
+ * Profils de mouvement des servomoteurs: trapèze et courbe en S.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "motion.h"
+#include "zlog.h"
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#define CLAMP(v,lo,hi) ((v) < (lo) ? (lo) : (v) > (hi) ? (hi) : (v))
+
+// Itérations de la recherche de la vitesse de croisière des courts déplacements
+#define MOTION_BISECTIONS 40
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+/*
+ * Durées de la phase d'à-coup 'tj' et de l'accélération complète 'ta' pour
+ * atteindre la vitesse 'v'. Retourne la distance parcourue pendant
+ * l'accélération, la moitié de v * ta puisque la phase est symétrique.
+ */
+static double accel_phase(double v, double a, double j, double *tj,
+			  double *ta) {
+  if (j <= 0) {
+    *tj = 0;
+    *ta = v / a;
+  } else if (v * j >= a * a) {
+    // Accélération maximale atteinte et maintenue
+    *tj = a / j;
+    *ta = v / a + *tj;
+  } else {
+    // Accélération maximale jamais atteinte
+    *tj = sqrt(v / j);
+    *ta = 2 * *tj;
+  }
+
+  return v * *ta / 2;
+}
+
+int motion_plan(struct motion_profile *p, int distance,
+		const struct motion_limits *l, long period_ns) {
+  double d = abs(distance), v = l->vmax, a = l->amax, j = l->jmax;
+  double tj, ta, tv, da, lo, hi, mid, peak, t, u, dt, total;
+  double seg_t[7], seg_j[7], seg_a[7], p0, v0, a0;
+  int i, k, sign = distance < 0 ? -1 : 1;
+
+  memset(p, 0, sizeof(*p));
+  if (l->vmax <= 0 || l->amax <= 0 || l->jmax < 0 || period_ns <= 0)
+    return 0;
+
+  da = accel_phase(v, a, j, &tj, &ta);
+  if (2 * da > d) {
+    // Déplacement trop court: plus grande vitesse qui tient dans la distance
+    lo = 0;
+    hi = v;
+    for (i = 0; i < MOTION_BISECTIONS; i++) {
+      mid = (lo + hi) / 2;
+      if (2 * accel_phase(mid, a, j, &tj, &ta) > d)
+	hi = mid;
+      else
+	lo = mid;
+    }
+    v = lo;
+    da = accel_phase(v, a, j, &tj, &ta);
+  }
+  tv = v > 0 ? (d - 2 * da) / v : 0;
+  peak = j <= 0 ? a : j * tj;
+
+  // Sept phases à à-coup constant; sans à-coup, les phases 0, 2, 4 et 6 sont vides
+  seg_t[0] = seg_t[2] = seg_t[4] = seg_t[6] = tj;
+  seg_t[1] = seg_t[5] = ta - 2 * tj;
+  seg_t[3] = tv;
+  seg_j[0] = seg_j[6] = j;
+  seg_j[2] = seg_j[4] = -j;
+  seg_j[1] = seg_j[3] = seg_j[5] = 0;
+  seg_a[0] = seg_a[3] = seg_a[4] = 0;
+  seg_a[1] = seg_a[2] = peak;
+  seg_a[5] = seg_a[6] = -peak;
+  if (j <= 0)
+    seg_j[0] = seg_j[2] = seg_j[4] = seg_j[6] = 0;
+
+  total = 2 * ta + tv;
+  dt = period_ns / 1e9;
+  p->period_ns = period_ns;
+  p->distance = distance;
+  p->count = (int) ceil(total / dt) + 1;
+  p->t_jerk = tj;
+  p->t_accel = ta;
+  p->t_cruise = tv;
+  p->v_cruise = (int) lround(v) * sign;
+  p->position = malloc(p->count * sizeof(int));
+  p->velocity = malloc(p->count * sizeof(int));
+  p->acceleration = malloc(p->count * sizeof(int));
+  if (p->position == NULL || p->velocity == NULL || p->acceleration == NULL) {
+    motion_free(p);
+    return 0;
+  }
+
+  p0 = v0 = 0;
+  for (i = 0, k = 0, t = 0; i < p->count; i++) {
+    // Passage aux phases suivantes, état propagé à leurs frontières
+    while (k < 7 && i * dt >= t + seg_t[k]) {
+      a0 = seg_a[k];
+      p0 += v0 * seg_t[k] + a0 * seg_t[k] * seg_t[k] / 2 +
+	seg_j[k] * seg_t[k] * seg_t[k] * seg_t[k] / 6;
+      v0 += a0 * seg_t[k] + seg_j[k] * seg_t[k] * seg_t[k] / 2;
+      t += seg_t[k];
+      k++;
+    }
+    if (k == 7) {
+      p->position[i] = distance;
+      p->velocity[i] = p->acceleration[i] = 0;
+      continue;
+    }
+    u = i * dt - t;
+    a0 = seg_a[k];
+    p->position[i] = sign * (int) lround(p0 + v0 * u + a0 * u * u / 2 +
+					 seg_j[k] * u * u * u / 6);
+    p->velocity[i] = sign * (int) lround(v0 + a0 * u + seg_j[k] * u * u / 2);
+    p->acceleration[i] = sign * (int) lround(a0 + seg_j[k] * u);
+  }
+  p->position[p->count - 1] = distance;
+  p->velocity[p->count - 1] = p->acceleration[p->count - 1] = 0;
+
+  return 1;
+}
+
+void motion_free(struct motion_profile *p) {
+  free(p->position);
+  free(p->velocity);
+  free(p->acceleration);
+  p->position = p->velocity = p->acceleration = NULL;
+  p->count = 0;
+}
+
+int motion_duty(const struct motion_profile *p, int i, int position,
+		const struct motor_curve *curve) {
+  int ff, correction;
+
+  i = CLAMP(i, 0, p->count - 1);
+  ff = motor_curve_duty(curve, p->velocity[i] +
+			p->acceleration[i] * MOTION_TAU_MS / 1000);
+  correction = MOTION_KP * (p->position[i] - position) / MOTION_SCALE;
+
+  return CLAMP(ff + correction, -100, 100);
+}
+
+void motion_track_init(struct motion_track *t, const struct motion_profile *p,
+		       int start, int target, long period_ns) {
+  memset(t, 0, sizeof(*t));
+  t->profile = p;
+  t->start = start;
+  t->target = target;
+  t->period_ns = period_ns;
+}
+
+void motion_track_step(struct motion_track *t, int position) {
+  const struct motion_profile *p = t->profile;
+  int error, over, sign = t->target < t->start ? -1 : 1;
+
+  if (p != NULL) {
+    error = position - t->start -
+      p->position[MIN(t->steps, (unsigned long) p->count - 1)];
+    t->error_max = MAX(t->error_max, abs(error));
+    t->error_sq_sum += (long long) error * error;
+  }
+  t->steps++;
+  over = (position - t->target) * sign;
+  t->overshoot = MAX(t->overshoot, over);
+  t->final_error = position - t->target;
+  if (abs(t->final_error) > MOTION_TOLERANCE)
+    t->settled_step = t->steps;
+}
+
+long motion_track_settle_ms(const struct motion_track *t) {
+  return t->settled_step * t->period_ns / 1000000L;
+}
+
+void motion_track_report(const struct motion_track *t, const char *name) {
+  const struct motion_profile *p = t->profile;
+
+  zlog_info(zlog_c, "%s : stabilisé à %d impulsions en %ld ms, dépassement %d, erreur finale %d",
+	    name, MOTION_TOLERANCE, motion_track_settle_ms(t), t->overshoot,
+	    t->final_error);
+  if (p == NULL || t->steps == 0)
+    return;
+  zlog_info(zlog_c, "%s : planifié %ld ms (à-coup %.0f ms, accélération %.0f ms, croisière %.0f ms à %d imp/s)",
+	    name, (p->count - 1) * p->period_ns / 1000000L, p->t_jerk * 1000,
+	    p->t_accel * 1000, p->t_cruise * 1000, p->v_cruise);
+  zlog_info(zlog_c, "%s : erreur de suivi max %d, rms %.1f impulsions",
+	    name, t->error_max, sqrt((double) t->error_sq_sum / t->steps));
+}
@@ -0,0 +1,118 @@
+/*
+ * Profils de mouvement des servomoteurs: trapèze et courbe en S.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Un déplacement de 'distance' impulsions est planifié à l'avance sous
+ * vitesse, accélération et à-coup maximaux. Le profil en S comporte sept
+ * phases à à-coup constant (+j, 0, -j, 0, -j, 0, +j); sans limite d'à-coup,
+ * il se réduit au trapèze (accélération, croisière, décélération). Si la
+ * distance est trop courte pour atteindre la vitesse maximale, la vitesse
+ * de croisière est abaissée.
+ *
+ * Le profil est échantillonné à la période de la boucle de commande dans
+ * des tables de consignes (position, vitesse, accélération), lues ensuite
+ * par la boucle sans aucun calcul en virgule flottante. A chaque période, le
+ * rapport cyclique en mode run-direct est la somme d'une anticipation tirée
+ * des consignes de vitesse et d'accélération par la caractéristique du
+ * servomoteur et d'une correction proportionnelle de l'erreur de position.
+ * Cette correction seule reste sous la zone morte du servomoteur: à la fin
+ * du profil, la boucle confie le maintien de la cible au micrologiciel
+ * (run-to-abs-pos) plutôt que de continuer avec motion_duty.
+ *
+ * Le suivi compare les positions mesurées aux positions planifiées: erreur
+ * de suivi, dépassement de la cible, erreur finale et durée jusqu'à la
+ * stabilisation dans la tolérance.
+ */
+
+#ifndef MOTION_H
+#define MOTION_H
+
+#include "motor_map.h"
+
+/*
+ * Constante de temps des grands servomoteurs en run-direct, pour
+ * l'anticipation de l'accélération.
+ */
+#define MOTION_TAU_MS 50
+// Gain proportionnel en millièmes de rapport cyclique par impulsion
+#define MOTION_KP 1500
+#define MOTION_SCALE 1000
+// Tolérance de position pour la stabilisation, en impulsions
+#define MOTION_TOLERANCE 2
+
+// Limites en impulsions/s, impulsions/s² et impulsions/s³ (0: trapèze)
+struct motion_limits {
+  int vmax;
+  int amax;
+  int jmax;
+};
+
+struct motion_profile {
+  long period_ns;
+  int distance;
+  // Nombre de périodes et tables de consignes relatives au départ
+  int count;
+  int *position;
+  int *velocity;
+  int *acceleration;
+  // Durées des phases en s et vitesse de croisière atteinte
+  float t_jerk;
+  float t_accel;
+  float t_cruise;
+  int v_cruise;
+};
+
+struct motion_track {
+  const struct motion_profile *profile;
+  int start;
+  int target;
+  long period_ns;
+  // Statistiques
+  unsigned long steps;
+  unsigned long settled_step;
+  int error_max;
+  long long error_sq_sum;
+  int overshoot;
+  int final_error;
+};
+
+/*
+ * Planification d'un déplacement de 'distance' impulsions (négative pour
+ * reculer) sous les limites 'l', échantillonné toutes les 'period_ns'.
+ * Retourne 1 en cas de succès, 0 si les limites sont invalides ou si les
+ * tables n'ont pas pu être allouées.
+ */
+int motion_plan(struct motion_profile *p, int distance,
+		const struct motion_limits *l, long period_ns);
+
+// Libération des tables de consignes
+void motion_free(struct motion_profile *p);
+
+/*
+ * Rapport cyclique en run-direct pour la période 'i' (la dernière consigne
+ * au-delà du profil), avec 'position' la position mesurée relative au départ
+ * et 'curve' la caractéristique du servomoteur (voir motor_map.h).
+ */
+int motion_duty(const struct motion_profile *p, int i, int position,
+		const struct motor_curve *curve);
+
+/*
+ * Préparation du suivi d'un déplacement de 'start' à 'target' (positions
+ * absolues). 'p' peut être NULL pour un déplacement commandé par le
+ * micrologiciel; seules la cible et la stabilisation sont alors suivies.
+ */
+void motion_track_init(struct motion_track *t, const struct motion_profile *p,
+		       int start, int target, long period_ns);
+
+// Prise en compte de la position absolue 'position' mesurée à la période suivante
+void motion_track_step(struct motion_track *t, int position);
+
+// Impression du suivi planifié contre mesuré par zlog
+void motion_track_report(const struct motion_track *t, const char *name);
+
+// Durée jusqu'à la stabilisation dans la tolérance, en ms
+long motion_track_settle_ms(const struct motion_track *t);
+
+#endif
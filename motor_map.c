@@ -0,0 +1,153 @@
+/*
+ * Caractéristique rapport cyclique / vitesse des grands servomoteurs.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "motor_map.h"
+#include "zlog.h"
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+static const char *map_path(const char *path) {
+  if (path == NULL)
+    path = getenv(MOTOR_MAP_ENV);
+  return path != NULL && *path != '\0' ? path : MOTOR_MAP_PATH;
+}
+
+void motor_curve_build(struct motor_curve *c, uint8_t port,
+		       const int speed[MOTOR_MAP_POINTS]) {
+  int i;
+
+  memset(c, 0, sizeof(*c));
+  c->port = port;
+  // Courbe monotone depuis l'arrêt dans chaque sens, le bruit est écrêté
+  for (i = MOTOR_MAP_CENTER + 1; i < MOTOR_MAP_POINTS; i++)
+    c->speed[i] = speed[i] > c->speed[i - 1] ? speed[i] : c->speed[i - 1];
+  for (i = MOTOR_MAP_CENTER - 1; i >= 0; i--)
+    c->speed[i] = speed[i] < c->speed[i + 1] ? speed[i] : c->speed[i + 1];
+
+  // Dernier rapport cyclique sans mouvement dans chaque sens
+  for (i = MOTOR_MAP_CENTER; i + 1 < MOTOR_MAP_POINTS &&
+	 c->speed[i + 1] <= MOTOR_MAP_STILL; i++)
+    ;
+  c->deadband[0] = MOTOR_MAP_DUTY(i);
+  for (i = MOTOR_MAP_CENTER; i > 0 && c->speed[i - 1] >= -MOTOR_MAP_STILL; i--)
+    ;
+  c->deadband[1] = -MOTOR_MAP_DUTY(i);
+  c->max_speed[0] = c->speed[MOTOR_MAP_POINTS - 1];
+  c->max_speed[1] = -c->speed[0];
+}
+
+void motor_curve_linear(struct motor_curve *c, uint8_t port, int max_speed) {
+  int i;
+
+  memset(c, 0, sizeof(*c));
+  c->port = port;
+  for (i = 0; i < MOTOR_MAP_POINTS; i++)
+    c->speed[i] = MOTOR_MAP_DUTY(i) * max_speed / 100;
+  c->max_speed[0] = c->max_speed[1] = max_speed;
+}
+
+int motor_curve_duty(const struct motor_curve *c, int speed) {
+  int i, lo, hi;
+
+  if (speed == 0)
+    return 0;
+  if (speed > 0) {
+    for (i = MOTOR_MAP_CENTER + 1; i < MOTOR_MAP_POINTS && c->speed[i] < speed; i++)
+      ;
+    if (i == MOTOR_MAP_POINTS)
+      return 100;
+    lo = i - 1;
+    hi = i;
+  } else {
+    for (i = MOTOR_MAP_CENTER - 1; i >= 0 && c->speed[i] > speed; i--)
+      ;
+    if (i < 0)
+      return -100;
+    lo = i + 1;
+    hi = i;
+  }
+  // Interpolation entre le dernier point en deçà et le premier au-delà
+  if (c->speed[hi] == c->speed[lo])
+    return MOTOR_MAP_DUTY(hi);
+
+  return MOTOR_MAP_DUTY(lo) + (speed - c->speed[lo]) *
+    (MOTOR_MAP_DUTY(hi) - MOTOR_MAP_DUTY(lo)) / (c->speed[hi] - c->speed[lo]);
+}
+
+const struct motor_curve *motor_map_find(const struct motor_map *m,
+					 uint8_t port) {
+  int i;
+
+  for (i = 0; i < m->count; i++)
+    if (m->curve[i].port == port)
+      return &m->curve[i];
+
+  return NULL;
+}
+
+int motor_map_put(struct motor_map *m, const struct motor_curve *c) {
+  int i;
+
+  for (i = 0; i < m->count && m->curve[i].port != c->port; i++)
+    ;
+  if (i == MOTOR_MAP_MOTORS)
+    return 0;
+  m->curve[i] = *c;
+  if (i == m->count)
+    m->count++;
+
+  return 1;
+}
+
+int motor_map_save(const struct motor_map *m, const char *path) {
+  FILE *f;
+  int ok;
+
+  path = map_path(path);
+  f = fopen(path, "wb");
+  if (f == NULL) {
+    zlog_error(zlog_c, "Impossible d'enregistrer la caractéristique des servomoteurs '%s' : %s",
+	       path, strerror(errno));
+    return 0;
+  }
+  ok = fwrite(MOTOR_MAP_MAGIC, 4, 1, f) == 1 && fwrite(m, sizeof(*m), 1, f) == 1;
+  if (fclose(f) != 0)
+    ok = 0;
+  if (!ok)
+    zlog_error(zlog_c, "Echec de l'écriture de la caractéristique des servomoteurs '%s'",
+	       path);
+
+  return ok;
+}
+
+int motor_map_load(struct motor_map *m, const char *path) {
+  char magic[4];
+  FILE *f;
+  int ok;
+
+  path = map_path(path);
+  f = fopen(path, "rb");
+  if (f == NULL)
+    return 0;
+  ok = fread(magic, 4, 1, f) == 1 && memcmp(magic, MOTOR_MAP_MAGIC, 4) == 0 &&
+    fread(m, sizeof(*m), 1, f) == 1 && m->count >= 0 &&
+    m->count <= MOTOR_MAP_MOTORS;
+  fclose(f);
+  if (!ok) {
+    zlog_warn(zlog_c, "La caractéristique des servomoteurs '%s' est invalide",
+	      path);
+    m->count = 0;
+  }
+
+  return ok;
+}
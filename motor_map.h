@@ -0,0 +1,89 @@
+/*
+ * Caractéristique rapport cyclique / vitesse des grands servomoteurs.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * La caractérisation balaie le rapport cyclique de -100 à 100 % par pas de
+ * MOTOR_MAP_STEP en run-direct et relève la vitesse établie de chaque
+ * servomoteur, roues en l'air. La zone morte (plus petit rapport cyclique
+ * qui fait tourner le servomoteur) et la vitesse maximale réelle sont
+ * tirées de la courbe, pour chaque sens. Les courbes sont enregistrées sur
+ * disque, indexées par port, pour ne pas refaire la caractérisation à
+ * chaque lancement.
+ *
+ * En commande, la courbe est inversée: pour une vitesse voulue, le rapport
+ * cyclique est interpolé entre les deux points qui l'encadrent, ce qui
+ * compense la zone morte et la non-linéarité dès la première période.
+ * Sans caractérisation, une courbe linéaire est construite à partir de
+ * l'attribut max_speed.
+ */
+
+#ifndef MOTOR_MAP_H
+#define MOTOR_MAP_H
+
+#include <stdint.h>
+
+#define MOTOR_MAP_STEP 5
+// Points de -100 à 100 % de rapport cyclique
+#define MOTOR_MAP_POINTS (2 * 100 / MOTOR_MAP_STEP + 1)
+// Point du rapport cyclique nul
+#define MOTOR_MAP_CENTER (100 / MOTOR_MAP_STEP)
+#define MOTOR_MAP_MOTORS 4
+// Vitesse en dessous de laquelle le servomoteur est considéré à l'arrêt
+#define MOTOR_MAP_STILL 5
+
+#define MOTOR_MAP_MAGIC "EV3M"
+#define MOTOR_MAP_PATH "motor.map"
+#define MOTOR_MAP_ENV "EV3_MOTOR_MAP"
+
+struct motor_curve {
+  uint8_t port;
+  // Zone morte en % et vitesse maximale en impulsions/s, par sens
+  int8_t deadband[2];
+  int16_t max_speed[2];
+  // Vitesse établie pour le rapport cyclique MOTOR_MAP_DUTY(i)
+  int16_t speed[MOTOR_MAP_POINTS];
+};
+
+struct motor_map {
+  int count;
+  struct motor_curve curve[MOTOR_MAP_MOTORS];
+};
+
+// Rapport cyclique du point 'i' de la courbe
+#define MOTOR_MAP_DUTY(i) (((i) - MOTOR_MAP_CENTER) * MOTOR_MAP_STEP)
+
+/*
+ * Fin de la caractérisation du port 'port': les vitesses 'speed' sont
+ * rendues monotones, puis la zone morte et la vitesse maximale en sont
+ * tirées.
+ */
+void motor_curve_build(struct motor_curve *c, uint8_t port,
+		       const int speed[MOTOR_MAP_POINTS]);
+
+// Courbe linéaire, sans zone morte, jusqu'à 'max_speed'
+void motor_curve_linear(struct motor_curve *c, uint8_t port, int max_speed);
+
+/*
+ * Rapport cyclique pour atteindre la vitesse 'speed' (impulsions/s), borné
+ * à ±100. Une vitesse nulle donne un rapport cyclique nul.
+ */
+int motor_curve_duty(const struct motor_curve *c, int speed);
+
+// Courbe du port 'port' dans 'm', NULL si le port n'a pas été caractérisé
+const struct motor_curve *motor_map_find(const struct motor_map *m,
+					 uint8_t port);
+
+// Ajout ou remplacement de la courbe de son port. Retourne 0 si 'm' est pleine.
+int motor_map_put(struct motor_map *m, const struct motor_curve *c);
+
+/*
+ * Enregistrement et chargement, dans 'path' ou, si nul, dans le fichier
+ * donné par EV3_MOTOR_MAP ou MOTOR_MAP_PATH.
+ * Retournent 1 en cas de succès, 0 sinon.
+ */
+int motor_map_save(const struct motor_map *m, const char *path);
+int motor_map_load(struct motor_map *m, const char *path);
+
+#endif
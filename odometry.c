@@ -0,0 +1,114 @@
+/*
+ * Odométrie des roues à partir des positions des grands servomoteurs.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "odometry.h"
+#include "robot.h"
+
+/*
+ * Distance parcourue par une roue pour une impulsion, en mm avec 16 bits de
+ * fraction. Le calcul est fait par le compilateur.
+ */
+#define MM_PER_COUNT_Q16 \
+  ((int32_t) (M_PI * ROBOT_WHEEL_DIAMETER_MM / ROBOT_COUNT_PER_ROT * 65536 + 0.5))
+#define DISTANCE_SHIFT (16 - ODOMETRY_FRAC + 1)
+
+/*
+ * Rotation du robot pour une impulsion d'écart entre les roues, en angle
+ * binaire avec 16 bits de fraction: (mm/impulsion) / voie / 2π * 2^32, où π
+ * se simplifie.
+ */
+#define HEADING_PER_COUNT_Q16						\
+  ((int64_t) (4294967296.0 * 65536 * ROBOT_WHEEL_DIAMETER_MM /		\
+	      (2.0 * ROBOT_COUNT_PER_ROT * ROBOT_AXLE_TRACK_MM) + 0.5))
+
+// Bits de fraction de la table des sinus
+#define SIN_FRAC 15
+
+static int16_t sin_table[ODOMETRY_TABLE + 1];
+
+static void sin_table_init(void) {
+  int i;
+
+  if (sin_table[ODOMETRY_TABLE / 4] != 0)
+    return;
+  for (i = 0; i <= ODOMETRY_TABLE; i++)
+    sin_table[i] = (int16_t) lround(sin(2 * M_PI * i / ODOMETRY_TABLE) *
+				    ((1 << SIN_FRAC) - 1));
+}
+
+// Sinus de l'angle binaire 'a' avec SIN_FRAC bits de fraction
+static inline int32_t sin_bam(uint32_t a) {
+  uint32_t i = a >> 24, frac = (a >> 8) & 0xffff;
+
+  return sin_table[i] +
+    (((sin_table[i + 1] - sin_table[i]) * (int32_t) frac) >> 16);
+}
+
+static void publish(struct odometry *o) {
+  unsigned int seq = atomic_load_explicit(&o->seq, memory_order_relaxed);
+
+  // Compteur impair pendant l'écriture
+  atomic_store_explicit(&o->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  o->published = o->pose;
+  atomic_store_explicit(&o->seq, seq + 2, memory_order_release);
+}
+
+void odometry_init(struct odometry *o, int left, int right) {
+  sin_table_init();
+  memset(o, 0, sizeof(*o));
+  o->left_last = left;
+  o->right_last = right;
+  atomic_init(&o->seq, 0);
+  publish(o);
+}
+
+void odometry_update(struct odometry *o, int left, int right) {
+  int32_t dl, dr, ds, dh;
+  int64_t num;
+  uint32_t mid;
+
+  // Ecarts modulo 2^32: le débordement des compteurs s'annule
+  dl = (int32_t) ((uint32_t) left - (uint32_t) o->left_last);
+  dr = (int32_t) ((uint32_t) right - (uint32_t) o->right_last);
+  o->left_last = left;
+  o->right_last = right;
+
+  // Distance du centre des roues en 1/256 mm, le reste est reporté
+  num = (int64_t) (dl + dr) * MM_PER_COUNT_Q16 + o->distance_rem;
+  ds = (int32_t) (num >> DISTANCE_SHIFT);
+  o->distance_rem = (int32_t) (num - ((int64_t) ds << DISTANCE_SHIFT));
+
+  // Rotation en angle binaire, les 16 bits de fraction sont reportés
+  num = (int64_t) (dr - dl) * HEADING_PER_COUNT_Q16 + o->heading_rem;
+  dh = (int32_t) (num >> 16);
+  o->heading_rem = (uint32_t) num & 0xffff;
+
+  // Intégration au cap milieu de la période
+  mid = o->pose.heading + (uint32_t) (dh / 2);
+  o->x += (int64_t) ds * sin_bam(mid + 0x40000000u);
+  o->y += (int64_t) ds * sin_bam(mid);
+  o->pose.heading += (uint32_t) dh;
+  o->pose.x = (int32_t) (o->x >> SIN_FRAC);
+  o->pose.y = (int32_t) (o->y >> SIN_FRAC);
+  o->pose.ticks++;
+  publish(o);
+}
+
+void odometry_pose(struct odometry *o, struct odometry_pose *out) {
+  unsigned int seq;
+
+  do {
+    seq = atomic_load_explicit(&o->seq, memory_order_acquire);
+    *out = o->published;
+    atomic_thread_fence(memory_order_acquire);
+  } while ((seq & 1) ||
+	   seq != atomic_load_explicit(&o->seq, memory_order_relaxed));
+}
@@ -0,0 +1,70 @@
+/*
+ * Odométrie des roues à partir des positions des grands servomoteurs.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * A chaque période de la boucle de commande, les écarts de positions des
+ * servomoteurs gauche et droit sont intégrés en une pose du robot (x, y,
+ * cap), entièrement en entiers puisque la brique n'a pas d'unité de
+ * calcul flottant:
+ * - x et y en 1/256 mm (ODOMETRY_FRAC bits de fraction), soit ±8 km;
+ * - le cap en angle binaire sur 32 bits (2^32 pour un tour), dont le
+ *   débordement fait le modulo 2π sans calcul;
+ * - sinus et cosinus par une table de ODOMETRY_TABLE valeurs et
+ *   interpolation linéaire, au cap milieu de la période.
+ * Les écarts de positions sont calculés modulo 2^32, de sorte que le
+ * débordement des compteurs des servomoteurs est sans effet. La distance
+ * et le cap sont intégrés avec leurs restes, et x et y avec la pleine
+ * précision des produits, sans dérive d'arrondi.
+ *
+ * La pose est publiée après chaque mise à jour sous un compteur de
+ * séquence: les autres fils la lisent sans verrou et sans relire les
+ * servomoteurs; un seul fil doit mettre l'odométrie à jour.
+ */
+
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define ODOMETRY_FRAC 8
+#define ODOMETRY_TABLE 256
+
+// Conversions de la pose en unités usuelles (pour les rapports)
+#define ODOMETRY_MM(q) ((q) / (float) (1 << ODOMETRY_FRAC))
+#define ODOMETRY_DEG(a) ((a) * (360.0f / 4294967296.0f))
+
+struct odometry_pose {
+  int32_t x;
+  int32_t y;
+  uint32_t heading;
+  // Nombre de mises à jour intégrées
+  uint32_t ticks;
+};
+
+struct odometry {
+  // Etat du fil de mise à jour: x et y avec 15 bits de fraction de plus
+  int32_t left_last;
+  int32_t right_last;
+  int32_t distance_rem;
+  uint32_t heading_rem;
+  int64_t x;
+  int64_t y;
+  struct odometry_pose pose;
+  // Dernière pose publiée, protégée par un compteur de séquence
+  atomic_uint seq;
+  struct odometry_pose published;
+};
+
+// Départ à l'origine, cap nul, avec les positions courantes 'left' et 'right'
+void odometry_init(struct odometry *o, int left, int right);
+
+// Intégration des positions 'left' et 'right' de la période et publication
+void odometry_update(struct odometry *o, int left, int right);
+
+// Dernière pose publiée, lisible depuis n'importe quel fil
+void odometry_pose(struct odometry *o, struct odometry_pose *out);
+
+#endif
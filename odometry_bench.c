@@ -0,0 +1,269 @@
+/*
+ * Banc d'essai de l'odométrie en entiers.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Utilisation: odometry_bench [tours]
+ *
+ * Une trace synthétique de positions des servomoteurs gauche et droit
+ * (lignes droites, virages et demi-tours à 100 Hz) démarre juste avant le
+ * débordement des compteurs. Elle est intégrée par odometry_update, puis
+ * par la même méthode en double précision comme référence. Le coût par
+ * mise à jour est donné en ns, et en cycles si la fréquence du processeur
+ * est connue (EV3_CPU_MHZ, ou cpufreq; 300 MHz pour l'ARM9 de la brique),
+ * avec l'écart final entre les deux poses. Un fil lecteur consulte la pose
+ * publiée pendant les mises à jour: chaque pose lue doit être celle
+ * publiée après le même nombre de mises à jour lors d'un passage sans
+ * lecteur, sinon la lecture est incohérente et le programme échoue.
+ *
+ * Matériel demandé: aucun
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "odometry.h"
+#include "robot.h"
+#include "zlog.h"
+
+#define BENCH_TICKS 60000
+#define BENCH_ROUNDS 20
+// Départ à 10 s du débordement des compteurs
+#define BENCH_START (INT_MAX - 6000)
+#define CPU_FREQ_PATH "/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq"
+
+// Variable globale spécifique à zlog
+zlog_category_t *zlog_c;
+
+// Trace des positions, volatile pour que le compilateur ne précalcule rien
+static volatile int left_trace[BENCH_TICKS], right_trace[BENCH_TICKS];
+
+static struct odometry odo;
+// Pose publiée après chaque mise à jour, relevée sans lecteur concurrent
+static struct odometry_pose expected[BENCH_TICKS];
+static atomic_int reading;
+static unsigned long reads, torn;
+
+static long long now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Fréquence du processeur en MHz, ou 0 si elle est inconnue
+static int cpu_mhz(void) {
+  const char *env = getenv("EV3_CPU_MHZ");
+  FILE *f;
+  long khz;
+
+  if (env != NULL && atoi(env) > 0)
+    return atoi(env);
+  f = fopen(CPU_FREQ_PATH, "r");
+  if (f != NULL) {
+    if (fscanf(f, "%ld", &khz) == 1 && khz > 0) {
+      fclose(f);
+      return khz / 1000;
+    }
+    fclose(f);
+  }
+
+  return 0;
+}
+
+// Coût en cycles de 'ns' par mise à jour, vide si la fréquence est inconnue
+static const char *cycles(char *buf, size_t size, double ns, int mhz) {
+  buf[0] = '\0';
+  if (mhz > 0)
+    snprintf(buf, size, ", %.0f cycles/mise à jour", ns * mhz / 1000);
+
+  return buf;
+}
+
+/*
+ * Vitesses des roues en impulsions par période, changées toutes les 2 s:
+ * ligne droite, virage large, rotation sur place, recul.
+ */
+static void make_trace(void) {
+  static const int speeds[][2] = {
+    { 6, 6 }, { 6, 3 }, { -4, 4 }, { 5, 7 }, { -5, -5 }, { 2, 8 }
+  };
+  unsigned int seed = 12345, left = BENCH_START, right = BENCH_START;
+  int i, k;
+
+  for (i = 0; i < BENCH_TICKS; i++) {
+    k = (i / 200) % (int) (sizeof(speeds) / sizeof(speeds[0]));
+    seed = seed * 1103515245 + 12345;
+    // Gigue de ±1 impulsion comme les lectures réelles
+    left += speeds[k][0] + (int) ((seed >> 16) % 3) - 1;
+    right += speeds[k][1] + (int) ((seed >> 20) % 3) - 1;
+    left_trace[i] = (int) left;
+    right_trace[i] = (int) right;
+  }
+}
+
+// Référence en double précision, même intégration au cap milieu
+static void run_double(double *x, double *y, double *heading) {
+  const double mm = M_PI * ROBOT_WHEEL_DIAMETER_MM / ROBOT_COUNT_PER_ROT;
+  int i, left = BENCH_START, right = BENCH_START;
+  double dl, dr, ds, dh;
+
+  *x = *y = *heading = 0;
+  for (i = 0; i < BENCH_TICKS; i++) {
+    dl = (int) ((unsigned int) left_trace[i] - (unsigned int) left) * mm;
+    dr = (int) ((unsigned int) right_trace[i] - (unsigned int) right) * mm;
+    left = left_trace[i];
+    right = right_trace[i];
+    ds = (dl + dr) / 2;
+    dh = (dr - dl) / ROBOT_AXLE_TRACK_MM;
+    *x += ds * cos(*heading + dh / 2);
+    *y += ds * sin(*heading + dh / 2);
+    *heading += dh;
+  }
+}
+
+static void run_updates(void) {
+  int i;
+
+  for (i = 0; i < BENCH_TICKS; i++)
+    odometry_update(&odo, left_trace[i], right_trace[i]);
+}
+
+static void run_fixed(void) {
+  odometry_init(&odo, BENCH_START, BENCH_START);
+  run_updates();
+}
+
+static void record_expected(void) {
+  int i;
+
+  odometry_init(&odo, BENCH_START, BENCH_START);
+  for (i = 0; i < BENCH_TICKS; i++) {
+    odometry_update(&odo, left_trace[i], right_trace[i]);
+    odometry_pose(&odo, &expected[i]);
+  }
+}
+
+// Lectures de la pose publiée pendant les mises à jour
+static void *reader_thread(void *arg) {
+  struct odometry_pose pose;
+  const struct odometry_pose *want;
+  static const struct odometry_pose origin;
+  uint32_t last = 0;
+
+  (void) arg;
+  while (atomic_load_explicit(&reading, memory_order_relaxed)) {
+    odometry_pose(&odo, &pose);
+    // La pose lue est celle publiée après 'ticks' mises à jour, qui ne
+    // reculent jamais
+    want = pose.ticks == 0 ? &origin :
+      pose.ticks <= BENCH_TICKS ? &expected[pose.ticks - 1] : NULL;
+    if (pose.ticks < last || want == NULL || pose.x != want->x ||
+	pose.y != want->y || pose.heading != want->heading)
+      torn++;
+    last = pose.ticks;
+    reads++;
+  }
+
+  return NULL;
+}
+
+int main(int argc, char *argv[]) {
+  struct odometry_pose pose;
+  pthread_t reader;
+  long long start, fixed_ns, double_ns, read_ns;
+  int i, rc, mhz, rounds = BENCH_ROUNDS;
+  char buf[40];
+  double x, y, heading, ticks, dx, dy, dh;
+
+  // Variables constantes spécifique à zlog
+  const char *zlog_conf = "/etc/zlog.conf";
+  const char *zlog_cat  = "project";
+
+  if (argc > 1 && atoi(argv[1]) > 0)
+    rounds = atoi(argv[1]);
+
+  rc = zlog_init(zlog_conf);
+  if (rc) {
+    printf("L'initialisation de zlog avec '%s' a échoué\n", zlog_conf);
+    return EXIT_FAILURE;
+  }
+
+  zlog_c = zlog_get_category(zlog_cat);
+  if (!zlog_c) {
+    printf("zlog est incapable de retrouver la catégorie '%s'\n", zlog_cat);
+    zlog_fini();
+    return EXIT_FAILURE;
+  }
+
+  make_trace();
+  mhz = cpu_mhz();
+  ticks = (double) rounds * BENCH_TICKS;
+
+  start = now_ns();
+  for (i = 0; i < rounds; i++)
+    run_double(&x, &y, &heading);
+  double_ns = now_ns() - start;
+
+  start = now_ns();
+  for (i = 0; i < rounds; i++)
+    run_fixed();
+  fixed_ns = now_ns() - start;
+  odometry_pose(&odo, &pose);
+
+  // Lectures seules de la pose, puis lectures concurrentes des mises à jour
+  start = now_ns();
+  for (i = 0; i < BENCH_TICKS; i++)
+    odometry_pose(&odo, &pose);
+  read_ns = now_ns() - start;
+  record_expected();
+  // L'odométrie est prête avant que le lecteur ne la consulte
+  odometry_init(&odo, BENCH_START, BENCH_START);
+  atomic_store(&reading, 1);
+  pthread_create(&reader, NULL, reader_thread, NULL);
+  run_updates();
+  atomic_store(&reading, 0);
+  pthread_join(reader, NULL);
+  odometry_pose(&odo, &pose);
+
+  heading = fmod(heading, 2 * M_PI);
+  if (heading < 0)
+    heading += 2 * M_PI;
+  dx = ODOMETRY_MM(pose.x) - x;
+  dy = ODOMETRY_MM(pose.y) - y;
+  dh = ODOMETRY_DEG(pose.heading) - heading * 180 / M_PI;
+  if (dh > 180)
+    dh -= 360;
+  else if (dh < -180)
+    dh += 360;
+
+  if (mhz > 0)
+    zlog_info(zlog_c, "%.0f mises à jour, processeur à %d MHz", ticks, mhz);
+  else
+    zlog_info(zlog_c, "%.0f mises à jour, fréquence du processeur inconnue (EV3_CPU_MHZ)",
+	      ticks);
+  zlog_info(zlog_c, "double : %.1f ns/mise à jour%s", double_ns / ticks,
+	    cycles(buf, sizeof(buf), double_ns / ticks, mhz));
+  zlog_info(zlog_c, "entiers : %.1f ns/mise à jour%s (x%.1f)", fixed_ns / ticks,
+	    cycles(buf, sizeof(buf), fixed_ns / ticks, mhz),
+	    fixed_ns > 0 ? (double) double_ns / fixed_ns : 0.0);
+  zlog_info(zlog_c, "Lecture de la pose : %.1f ns, %lu lectures concurrentes, %lu incohérente(s)",
+	    (double) read_ns / BENCH_TICKS, reads, torn);
+  zlog_info(zlog_c, "Pose : x %.1f mm, y %.1f mm, cap %.2f° après %u mises à jour",
+	    ODOMETRY_MM(pose.x), ODOMETRY_MM(pose.y),
+	    ODOMETRY_DEG(pose.heading), pose.ticks);
+  zlog_info(zlog_c, "Ecart à la référence : %.2f mm, %.4f°", hypot(dx, dy), dh);
+
+  if (torn)
+    zlog_error(zlog_c, "%lu lecture(s) de pose incohérente(s)", torn);
+
+  zlog_fini();
+
+  return torn ? EXIT_FAILURE : EXIT_SUCCESS;
+}
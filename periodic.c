@@ -0,0 +1,177 @@
+/*
+ * Exécution périodique à cadence fixe pour les boucles de commande.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "periodic.h"
+#include "zlog.h"
+
+#define NSEC_PER_SEC 1000000000L
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+static void timespec_add(struct timespec *t, long ns) {
+  t->tv_nsec += ns;
+  while (t->tv_nsec >= NSEC_PER_SEC) {
+    t->tv_nsec -= NSEC_PER_SEC;
+    t->tv_sec++;
+  }
+}
+
+static long timespec_diff(const struct timespec *a, const struct timespec *b) {
+  return (a->tv_sec - b->tv_sec) * NSEC_PER_SEC + (a->tv_nsec - b->tv_nsec);
+}
+
+int periodic_setup_rt(int priority, int lock, int cpu) {
+  struct sched_param param;
+  int rc, flags = 0;
+
+  if (priority > 0) {
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (rc == 0)
+      flags |= PERIODIC_FIFO;
+    else
+      zlog_warn(zlog_c, "Impossible de passer en SCHED_FIFO de priorité '%d' : %s",
+		priority, strerror(rc));
+  }
+  if (lock) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+      flags |= PERIODIC_MLOCK;
+    else
+      zlog_warn(zlog_c, "Impossible de verrouiller la mémoire : %s",
+		strerror(errno));
+  }
+#ifdef CPU_SET
+  if (cpu >= 0) {
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc == 0)
+      flags |= PERIODIC_PINNED;
+    else
+      zlog_warn(zlog_c, "Impossible de fixer le fil au processeur '%d' : %s",
+		cpu, strerror(rc));
+  }
+#endif
+
+  return flags;
+}
+
+int periodic_enter_rt(struct periodic_rt *saved, int priority, int lock,
+		      int cpu) {
+  struct sched_param param;
+  int rc;
+
+  // Ordonnancement par défaut si la lecture échoue
+  memset(&param, 0, sizeof(param));
+  rc = pthread_getschedparam(pthread_self(), &saved->policy, &param);
+  if (rc != 0) {
+    zlog_warn(zlog_c, "Impossible de lire l'ordonnancement du fil : %s",
+	      strerror(rc));
+    saved->policy = SCHED_OTHER;
+    param.sched_priority = 0;
+    priority = 0;
+  }
+  saved->priority = param.sched_priority;
+  rc = pthread_getaffinity_np(pthread_self(), sizeof(saved->affinity),
+			      (cpu_set_t *) saved->affinity);
+  if (rc != 0) {
+    zlog_warn(zlog_c, "Impossible de lire l'affinité du fil : %s",
+	      strerror(rc));
+    cpu = -1;
+  }
+  saved->flags = periodic_setup_rt(priority, lock, cpu);
+
+  return saved->flags;
+}
+
+void periodic_leave_rt(const struct periodic_rt *saved) {
+  struct sched_param param;
+  int rc;
+
+  if (saved->flags & PERIODIC_FIFO) {
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = saved->priority;
+    rc = pthread_setschedparam(pthread_self(), saved->policy, &param);
+    if (rc != 0)
+      zlog_warn(zlog_c, "Impossible de rétablir l'ordonnancement du fil : %s",
+		strerror(rc));
+  }
+  if ((saved->flags & PERIODIC_MLOCK) && munlockall() != 0)
+    zlog_warn(zlog_c, "Impossible de déverrouiller la mémoire : %s",
+	      strerror(errno));
+  if (saved->flags & PERIODIC_PINNED) {
+    rc = pthread_setaffinity_np(pthread_self(), sizeof(saved->affinity),
+				(const cpu_set_t *) saved->affinity);
+    if (rc != 0)
+      zlog_warn(zlog_c, "Impossible de rétablir l'affinité du fil : %s",
+		strerror(rc));
+  }
+}
+
+void periodic_init(struct periodic *p, long period_ns) {
+  memset(p, 0, sizeof(*p));
+  p->period_ns = period_ns;
+  p->jitter_min_ns = LONG_MAX;
+  clock_gettime(CLOCK_MONOTONIC, &p->next);
+}
+
+int periodic_wait(struct periodic *p) {
+  struct timespec now;
+  long late, jitter;
+  int missed = 0;
+
+  timespec_add(&p->next, p->period_ns);
+
+  // Echéance dépassée: sauter les périodes manquées plutôt que les rattraper
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  late = timespec_diff(&now, &p->next);
+  if (late > 0) {
+    missed = 1 + late / p->period_ns;
+    timespec_add(&p->next, missed * p->period_ns);
+    p->overruns += missed;
+  }
+
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &p->next, NULL) == EINTR)
+    ;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  jitter = timespec_diff(&now, &p->next);
+  p->cycles++;
+  p->jitter_sum_ns += jitter;
+  if (jitter < p->jitter_min_ns)
+    p->jitter_min_ns = jitter;
+  if (jitter > p->jitter_max_ns)
+    p->jitter_max_ns = jitter;
+
+  return missed;
+}
+
+void periodic_report(const struct periodic *p, const char *name) {
+  if (p->cycles == 0) {
+    zlog_info(zlog_c, "%s : aucune période exécutée", name);
+    return;
+  }
+  zlog_info(zlog_c, "%s : %lu périodes de %ld us, %lu dépassement(s)",
+	    name, p->cycles, p->period_ns / 1000, p->overruns);
+  zlog_info(zlog_c, "%s : gigue min %ld us, moyenne %lld us, max %ld us",
+	    name, p->jitter_min_ns / 1000,
+	    p->jitter_sum_ns / (long long) p->cycles / 1000,
+	    p->jitter_max_ns / 1000);
+}
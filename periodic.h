@@ -0,0 +1,79 @@
+/*
+ * Exécution périodique à cadence fixe pour les boucles de commande.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Les réveils sont calculés en temps absolu (clock_nanosleep avec
+ * TIMER_ABSTIME), de sorte que la durée du travail d'une période ne décale
+ * pas les suivantes. Pour chaque réveil, le retard par rapport à l'instant
+ * prévu (gigue) est mesuré, et les périodes manquées sont comptées comme
+ * dépassements.
+ */
+
+#ifndef PERIODIC_H
+#define PERIODIC_H
+
+#include <time.h>
+
+// Drapeaux retournés par periodic_setup_rt selon ce qui a pu être appliqué
+#define PERIODIC_FIFO 0b1
+#define PERIODIC_MLOCK 0b10
+#define PERIODIC_PINNED 0b100
+
+struct periodic {
+  struct timespec next;
+  long period_ns;
+  // Statistiques
+  unsigned long cycles;
+  unsigned long overruns;
+  long jitter_min_ns;
+  long jitter_max_ns;
+  long long jitter_sum_ns;
+};
+
+// Réglages du fil appelant avant periodic_enter_rt, rétablis en sortie
+struct periodic_rt {
+  int flags;
+  int policy;
+  int priority;
+  // Affinité, de la taille d'un cpu_set_t
+  unsigned long affinity[1024 / (8 * sizeof(unsigned long))];
+};
+
+/*
+ * Préparation du fil appelant au temps réel: ordonnancement SCHED_FIFO de
+ * priorité 'priority' (ignoré si 0), verrouillage de la mémoire si 'lock',
+ * et affinité au processeur 'cpu' (ignorée si négatif).
+ * Retourne les drapeaux PERIODIC_* des réglages appliqués; les échecs, p.ex.
+ * faute de droits, sont signalés par zlog sans être fatals.
+ */
+int periodic_setup_rt(int priority, int lock, int cpu);
+
+/*
+ * Comme periodic_setup_rt, pour une boucle de commande seulement: les
+ * réglages du fil sont d'abord gardés dans 'saved', et periodic_leave_rt
+ * les rétablit, sans quoi les tests suivants et les fils qu'ils créent
+ * hériteraient de SCHED_FIFO et de la mémoire verrouillée.
+ * Retourne les drapeaux PERIODIC_* des réglages appliqués.
+ */
+int periodic_enter_rt(struct periodic_rt *saved, int priority, int lock,
+		      int cpu);
+
+// Retour aux réglages gardés par periodic_enter_rt et déverrouillage
+void periodic_leave_rt(const struct periodic_rt *saved);
+
+// Initialisation avec une période 'period_ns'; la première période commence maintenant
+void periodic_init(struct periodic *p, long period_ns);
+
+/*
+ * Attente du début de la période suivante. Si le travail a dépassé une ou
+ * plusieurs périodes, elles sont sautées et leur nombre est retourné.
+ * Retourne 0 si l'échéance a été tenue.
+ */
+int periodic_wait(struct periodic *p);
+
+// Impression des statistiques de gigue et de dépassements par zlog
+void periodic_report(const struct periodic *p, const char *name);
+
+#endif
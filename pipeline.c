@@ -0,0 +1,214 @@
+/*
+ * Acquisition concurrente de plusieurs périphériques par étages.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include "latency.h"
+#include "pipeline.h"
+#include "zlog.h"
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+static int queue_init(struct pipeline_queue *q, size_t capacity,
+		      size_t elem_size) {
+  atomic_init(&q->pushed, 0);
+  atomic_init(&q->high, 0);
+
+  return spsc_ring_init(&q->ring, capacity, elem_size);
+}
+
+// Côté producteur: ajout et suivi du remplissage maximal
+static void queue_push(struct pipeline_queue *q, const void *elem) {
+  size_t count;
+
+  if (!spsc_ring_push(&q->ring, elem))
+    return;
+  atomic_fetch_add_explicit(&q->pushed, 1, memory_order_relaxed);
+  // Seul le producteur écrit le maximum
+  count = spsc_ring_count(&q->ring);
+  if (count > atomic_load_explicit(&q->high, memory_order_relaxed))
+    atomic_store_explicit(&q->high, count, memory_order_relaxed);
+}
+
+static void queue_report(struct pipeline_queue *q, const char *name) {
+  zlog_info(zlog_c, "%s : file %lu ajout(s), %lu perte(s), remplie au plus à %lu/%lu",
+	    name, atomic_load(&q->pushed), atomic_load(&q->ring.drops),
+	    (unsigned long) atomic_load(&q->high),
+	    (unsigned long) spsc_ring_capacity(&q->ring));
+}
+
+static void *source_thread(void *arg) {
+  struct pipeline_source *s = arg;
+  struct pipeline_sample sample;
+
+  periodic_init(&s->timing, s->period_ns);
+  while (atomic_load_explicit(s->running, memory_order_relaxed)) {
+    if (s->read(s->arg, sample.value)) {
+      sample.t_ns = latency_now();
+      queue_push(&s->queue, &sample);
+    } else
+      atomic_fetch_add_explicit(&s->errors, 1, memory_order_relaxed);
+    periodic_wait(&s->timing);
+  }
+
+  return NULL;
+}
+
+/*
+ * Avance de la source 's' jusqu'à sa dernière mesure prise au plus tard à
+ * 't_ns'. Une mesure plus récente retirée de la file est gardée pour la
+ * trame suivante.
+ */
+static void source_advance(struct pipeline_source *s, uint64_t t_ns) {
+  for (;;) {
+    if (!s->has_next && !spsc_ring_pop(&s->queue.ring, &s->next))
+      return;
+    s->has_next = 1;
+    if (s->next.t_ns > t_ns)
+      return;
+    if (s->has_current && !s->framed)
+      s->superseded++;
+    s->current = s->next;
+    s->has_current = 1;
+    s->has_next = 0;
+    s->framed = 0;
+  }
+}
+
+static void *fusion_thread(void *arg) {
+  struct pipeline *p = arg;
+  struct pipeline_frame frame;
+  int i;
+
+  periodic_init(&p->fusion_timing, p->frame_period_ns);
+  while (atomic_load_explicit(&p->running, memory_order_relaxed)) {
+    frame.t_ns = latency_now() - p->delay_ns;
+    frame.valid = 0;
+    for (i = 0; i < p->count; i++) {
+      source_advance(&p->source[i], frame.t_ns);
+      if (!p->source[i].has_current)
+	continue;
+      frame.sample[i] = p->source[i].current;
+      frame.valid |= 1u << i;
+      p->source[i].framed = 1;
+    }
+    if (frame.valid)
+      queue_push(&p->frames, &frame);
+    periodic_wait(&p->fusion_timing);
+  }
+
+  return NULL;
+}
+
+void pipeline_init(struct pipeline *p) {
+  p->count = 0;
+  atomic_init(&p->running, 0);
+}
+
+int pipeline_add(struct pipeline *p, const char *name, unsigned int period_us,
+		 pipeline_read read, void *arg) {
+  struct pipeline_source *s;
+
+  if (p->count == PIPELINE_SOURCES)
+    return -1;
+  s = &p->source[p->count];
+  s->name = name;
+  s->read = read;
+  s->arg = arg;
+  s->period_ns = period_us * 1000L;
+  s->running = &p->running;
+
+  return p->count++;
+}
+
+// Arrêt des 'threads' premiers fils d'acquisition et libération des files
+static void stop_sources(struct pipeline *p, int threads, int queues) {
+  int i;
+
+  atomic_store(&p->running, 0);
+  for (i = 0; i < threads; i++)
+    pthread_join(p->source[i].thread, NULL);
+  for (i = 0; i < queues; i++)
+    spsc_ring_destroy(&p->source[i].queue.ring);
+}
+
+int pipeline_start(struct pipeline *p, unsigned int frame_period_us,
+		   unsigned int delay_us, size_t capacity) {
+  struct pipeline_source *s;
+  int i;
+
+  p->frame_period_ns = frame_period_us * 1000L;
+  p->delay_ns = delay_us * 1000L;
+  for (i = 0; i < p->count; i++) {
+    s = &p->source[i];
+    atomic_init(&s->errors, 0);
+    s->has_current = s->has_next = s->framed = 0;
+    s->superseded = 0;
+    if (!queue_init(&s->queue, capacity, sizeof(struct pipeline_sample))) {
+      stop_sources(p, 0, i);
+      return 0;
+    }
+  }
+  if (!queue_init(&p->frames, capacity, sizeof(struct pipeline_frame))) {
+    stop_sources(p, 0, p->count);
+    return 0;
+  }
+
+  atomic_store(&p->running, 1);
+  p->start_ns = latency_now();
+  for (i = 0; i < p->count; i++)
+    if (pthread_create(&p->source[i].thread, NULL, source_thread,
+		       &p->source[i]) != 0) {
+      stop_sources(p, i, p->count);
+      spsc_ring_destroy(&p->frames.ring);
+      return 0;
+    }
+  if (pthread_create(&p->fusion, NULL, fusion_thread, p) != 0) {
+    stop_sources(p, p->count, p->count);
+    spsc_ring_destroy(&p->frames.ring);
+    return 0;
+  }
+
+  return 1;
+}
+
+void pipeline_stop(struct pipeline *p) {
+  atomic_store(&p->running, 0);
+  pthread_join(p->fusion, NULL);
+  stop_sources(p, p->count, p->count);
+  spsc_ring_destroy(&p->frames.ring);
+  p->stop_ns = latency_now();
+}
+
+int pipeline_next(struct pipeline *p, struct pipeline_frame *f) {
+  return spsc_ring_pop(&p->frames.ring, f);
+}
+
+long pipeline_age_us(const struct pipeline_frame *f, int i) {
+  if (!(f->valid & (1u << i)))
+    return -1;
+
+  return (long) (f->t_ns - f->sample[i].t_ns) / 1000;
+}
+
+void pipeline_report(struct pipeline *p) {
+  struct pipeline_source *s;
+  double elapsed_s = (p->stop_ns - p->start_ns) / 1e9;
+  unsigned long samples;
+  int i;
+
+  for (i = 0; i < p->count; i++) {
+    s = &p->source[i];
+    samples = atomic_load(&s->queue.pushed) + atomic_load(&s->queue.ring.drops);
+    zlog_info(zlog_c, "%s : %lu mesure(s), %.1f mesures/s pour %.1f prévues, %lu erreur(s), %lu remplacée(s) avant une trame",
+	      s->name, samples, elapsed_s > 0 ? samples / elapsed_s : 0.0,
+	      1e9 / s->period_ns, atomic_load(&s->errors), s->superseded);
+    queue_report(&s->queue, s->name);
+    periodic_report(&s->timing, s->name);
+  }
+  queue_report(&p->frames, "Fusion");
+  periodic_report(&p->fusion_timing, "Fusion");
+}
@@ -0,0 +1,135 @@
+/*
+ * Acquisition concurrente de plusieurs périphériques par étages.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Au lieu de lire tous les périphériques l'un après l'autre dans une
+ * boucle, dont la période est alors la somme de leurs latences, chaque
+ * source (capteur ou servomoteurs) a son fil d'acquisition qui la lit à sa
+ * propre période et pousse des mesures horodatées dans sa file. Un fil de
+ * fusion fabrique à période fixe des trames alignées dans le temps: pour
+ * l'instant t d'une trame, la dernière mesure de chaque source prise au plus
+ * tard à t. Les trames sont en retard de 'delay_us' sur l'horloge, pour
+ * qu'une mesure lente à lire ne soit pas dépassée par la trame. Le
+ * consommateur, le fil appelant, retire les trames de la file de sortie.
+ *
+ * Les étages sont reliés par des files sans verrou bornées (spsc_ring). Les
+ * producteurs ne bloquent jamais: une mesure ou une trame qui ne trouve pas
+ * de place est perdue et comptée. Le remplissage maximal de chaque file et
+ * ses pertes mesurent la contre-pression de l'étage suivant, et les mesures
+ * remplacées avant d'entrer dans une trame l'excès de fréquence d'une source
+ * sur les trames (pipeline_report).
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "periodic.h"
+#include "spsc_ring.h"
+
+// Nombre maximal de sources et de valeurs par mesure
+#define PIPELINE_SOURCES 6
+#define PIPELINE_VALUES 2
+
+struct pipeline_sample {
+  // Horodatage CLOCK_MONOTONIC de la fin de la lecture, en nanosecondes
+  uint64_t t_ns;
+  int value[PIPELINE_VALUES];
+};
+
+/*
+ * Lecture d'une source, appelée depuis son fil d'acquisition: rangement de
+ * ses valeurs dans 'v'. Retourne 1 en cas de succès, 0 sinon.
+ */
+typedef int (*pipeline_read)(void *arg, int *v);
+
+// File entre deux étages et sa contre-pression
+struct pipeline_queue {
+  struct spsc_ring ring;
+  atomic_ulong pushed;
+  atomic_size_t high;
+};
+
+struct pipeline_source {
+  const char *name;
+  pipeline_read read;
+  void *arg;
+  long period_ns;
+  struct pipeline_queue queue;
+  pthread_t thread;
+  const atomic_int *running;
+  // Cadence du fil d'acquisition, lue après son arrêt
+  struct periodic timing;
+  atomic_ulong errors;
+  // Etat du fil de fusion: mesure courante et mesure retirée trop tôt
+  struct pipeline_sample current;
+  struct pipeline_sample next;
+  int has_current;
+  int has_next;
+  int framed;
+  unsigned long superseded;
+};
+
+struct pipeline_frame {
+  uint64_t t_ns;
+  // Bit i mis si la source i a une mesure dans la trame
+  unsigned int valid;
+  struct pipeline_sample sample[PIPELINE_SOURCES];
+};
+
+struct pipeline {
+  int count;
+  struct pipeline_source source[PIPELINE_SOURCES];
+  struct pipeline_queue frames;
+  pthread_t fusion;
+  long frame_period_ns;
+  long delay_ns;
+  struct periodic fusion_timing;
+  atomic_int running;
+  uint64_t start_ns;
+  uint64_t stop_ns;
+};
+
+// Pipeline sans source
+void pipeline_init(struct pipeline *p);
+
+/*
+ * Ajout avant le démarrage de la source 'name', lue par 'read' toutes les
+ * 'period_us'. 'name' doit rester valide, comme une chaîne littérale.
+ * Retourne l'indice de la source, -1 si PIPELINE_SOURCES sources sont déjà
+ * ajoutées.
+ */
+int pipeline_add(struct pipeline *p, const char *name, unsigned int period_us,
+		 pipeline_read read, void *arg);
+
+/*
+ * Démarrage des fils d'acquisition et du fil de fusion, avec une trame
+ * toutes les 'frame_period_us' en retard de 'delay_us', et des files de
+ * 'capacity' éléments.
+ * Retourne 1 en cas de succès, 0 sinon; aucun fil ne tourne alors.
+ */
+int pipeline_start(struct pipeline *p, unsigned int frame_period_us,
+		   unsigned int delay_us, size_t capacity);
+
+// Arrêt et attente de tous les fils, libération des files
+void pipeline_stop(struct pipeline *p);
+
+// Côté consommateur. Retourne 1 si une trame a été retirée, 0 sinon.
+int pipeline_next(struct pipeline *p, struct pipeline_frame *f);
+
+// Age en us de la mesure de la source 'i' dans la trame 'f', -1 sans mesure
+long pipeline_age_us(const struct pipeline_frame *f, int i);
+
+/*
+ * Impression par zlog, après pipeline_stop, des fréquences des sources, de
+ * la cadence des fils et de la contre-pression des files.
+ */
+void pipeline_report(struct pipeline *p);
+
+#endif
@@ -0,0 +1,464 @@
+/*
+ * Test d'acquisition concurrente des capteurs et des servomoteurs.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Le test lit d'abord tous les périphériques l'un après l'autre dans une
+ * boucle, comme les autres programmes de test, puis par le pipeline (voir
+ * pipeline.h): un fil par périphérique à sa propre période, une fusion des
+ * mesures en trames alignées dans le temps et le test comme consommateur.
+ * Le test coroutines fait les mêmes lectures par des tâches coopératives
+ * dans un seul fil (voir coro.h), pour comparer le temps processeur.
+ * Les servomoteurs ne sont pas commandés, seules leurs positions sont lues.
+ *
+ * Matériel demandé:
+ * - 1x EV3 Color Sensor / Capteur de couleur EV3
+ * - 1x EV3 Ultrasonic Sensor / Capteur à ultrasons EV3
+ * - 1x EV3 Touch Sensor / Capteur tactile EV3
+ * - 2x EV3 Large Servo Motor / Grand servomoteur EV3
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <ev3.h>
+#include <ev3_light.h>
+#include <ev3_port.h>
+#include <ev3_sensor.h>
+#include <ev3_tacho.h>
+
+#include "coro.h"
+#include "discovery.h"
+#include "latency.h"
+#include "pipeline.h"
+#include "ready.h"
+#include "sensor_reader.h"
+#include "suite.h"
+#include "telemetry.h"
+#include "zlog.h"
+
+// Périodes natives des sources
+#define PIPELINE_COLOR_US 10000
+#define PIPELINE_US_US 50000
+#define PIPELINE_TOUCH_US 10000
+#define PIPELINE_TACHO_US 10000
+// Trames: période, retard sur l'horloge et taille des files
+#define PIPELINE_FRAME_US 20000
+#define PIPELINE_DELAY_US 5000
+#define PIPELINE_CAPACITY 64
+// Durée de chaque phase et période de lecture des trames par le consommateur
+#define PIPELINE_TEST_MS 3000
+#define PIPELINE_CONSUME_MS 100
+#define PIPELINE_PRINT_MS 500
+// Délai maximal d'attente des premières valeurs après un changement de mode
+#define PIPELINE_MODE_MS 100
+
+enum { SOURCE_COLOR, SOURCE_US, SOURCE_TOUCH, SOURCE_TACHOS, SOURCES };
+
+#ifdef EV3_SUITE
+// Catégorie zlog définie par le programme (voir suite.c)
+extern zlog_category_t *zlog_c;
+#else
+// Variable globale spécifique à zlog
+zlog_category_t *zlog_c;
+#endif
+
+// Lecteurs des capteurs et numéros de séquence des grands servomoteurs
+static struct sensor_reader readers[SOURCE_TACHOS];
+static uint8_t tacho_sn[2];
+
+static const char *source_names[SOURCES] = {
+  "Couleur", "Ultrasons", "Toucher", "Servomoteurs"
+};
+
+/*
+ * Tâche coopérative de lecture d'une source à sa période, jusqu'à 'end_ns';
+ * son état est gardé ici d'une reprise à l'autre.
+ */
+struct source_task {
+  struct coro coro;
+  pipeline_read read;
+  void *arg;
+  long period_ns;
+  uint64_t next_ns;
+  uint64_t end_ns;
+  unsigned long samples;
+  unsigned long errors;
+  int value[PIPELINE_VALUES];
+};
+
+// Tâche d'impression des dernières valeurs lues par les tâches des sources
+struct print_task {
+  struct coro coro;
+  struct source_task *sources;
+  uint64_t end_ns;
+};
+
+static long process_cpu_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000L + ts.tv_nsec / 1000L;
+}
+
+/*
+ * Lecture de value0 en virgule fixe: la distance en mm (cm à une décimale),
+ * la lumière en % et l'état du toucher sans décimale.
+ */
+static int read_sensor(void *arg, int *v) {
+  static const int decimals[SOURCE_TACHOS] = { 0, 1, 0 };
+  struct sensor_reader *r = arg;
+
+  return sensor_reader_value_fixed(r, decimals[r - readers], &v[0]) > 0;
+}
+
+static int read_tachos(void *arg, int *v) {
+  size_t bytes;
+  int k;
+
+  (void) arg;
+  for (k = 0; k < 2; k++) {
+    LATENCY_TIME(bytes, LATENCY_TACHO, tacho_sn[k], "position",
+		 get_tacho_position(tacho_sn[k], &v[k]));
+    if (bytes == 0)
+      return 0;
+  }
+
+  return 1;
+}
+
+/*
+ * Mise en correspondance des capteurs et des grands servomoteurs dans la
+ * table 'devices' et ouverture des lecteurs des capteurs. Le servomoteur
+ * gauche est branché sur le port A, le droit est l'autre grand servomoteur.
+ * Retourne 1 si tous les périphériques ont été retrouvés et les lecteurs
+ * ouverts, 0 sinon.
+ */
+int pipeline_setup(struct ev3_device_map *devices) {
+  static const INX_T types[SOURCE_TACHOS] = {
+    LEGO_EV3_COLOR, LEGO_EV3_US, LEGO_EV3_TOUCH
+  };
+  uint8_t sn;
+  int i;
+
+  for (i = 0; i < SOURCE_TACHOS; i++) {
+    sn = discovery_sensor(devices, types[i]);
+    if (sn == DESC_LIMIT) {
+      zlog_fatal(zlog_c, "Le capteur '%s' n'a pas été retrouvé",
+		 ev3_sensor_type(types[i]));
+      return 0;
+    }
+    if (!sensor_reader_open(&readers[i], sn)) {
+      zlog_fatal(zlog_c, "Impossible d'ouvrir les valeurs du capteur '%s'",
+		 ev3_sensor_type(types[i]));
+      while (i-- > 0)
+	sensor_reader_close(&readers[i]);
+      return 0;
+    }
+  }
+  // Table lue du cache rafraîchie si un servomoteur manque
+  do {
+    tacho_sn[0] = tacho_sn[1] = DESC_LIMIT;
+    for (i = 0; i < devices->tacho_count; i++) {
+      if (devices->tacho[i].type_inx != LEGO_EV3_L_MOTOR)
+	continue;
+      if (devices->tacho[i].port == OUTPUT_A)
+	tacho_sn[0] = devices->tacho[i].sn;
+      else if (tacho_sn[1] == DESC_LIMIT)
+	tacho_sn[1] = devices->tacho[i].sn;
+    }
+  } while ((tacho_sn[0] == DESC_LIMIT || tacho_sn[1] == DESC_LIMIT) &&
+	   discovery_refresh(devices) == 1);
+  if (tacho_sn[0] == DESC_LIMIT || tacho_sn[1] == DESC_LIMIT) {
+    zlog_fatal(zlog_c, "Les grand servomoteurs n'ont pas été retrouvé");
+    return 0;
+  }
+
+  return 1;
+}
+
+/*
+ * Remise du capteur à ultrasons en mode US-LISTEN et du capteur de couleur
+ * en mode lumière reflétée, et fermeture des lecteurs.
+ */
+void pipeline_teardown(void) {
+  int i;
+
+  if (set_sensor_mode_inx(readers[SOURCE_US].sn, LEGO_EV3_US_US_LISTEN) == 0)
+    zlog_error(zlog_c, "Impossible de changer au mode 'LEGO_EV3_US_US_LISTEN' pour le capteur à ultrasons");
+  if (set_sensor_mode_inx(readers[SOURCE_COLOR].sn,
+			  LEGO_EV3_COLOR_COL_REFLECT) == 0)
+    zlog_error(zlog_c, "Impossible de changer au mode 'LEGO_EV3_COLOR_COL_REFLECT' pour le capteur de couleur");
+  for (i = 0; i < SOURCE_TACHOS; i++)
+    sensor_reader_close(&readers[i]);
+}
+
+#ifndef EV3_SUITE
+/*
+ * Initialisation de la brique intelligente EV3 et découverte des capteurs
+ * et des servomoteurs.
+ * Valeurs de retour: voir discovery_init et pipeline_setup.
+ */
+static int init(void) {
+  static struct ev3_device_map devices;
+  int rc;
+
+  rc = discovery_init(&devices, DISCOVERY_SENSORS | DISCOVERY_TACHOS);
+  if (rc != 1)
+    return rc;
+  if (!pipeline_setup(&devices)) {
+    ev3_uninit();
+    return 0;
+  }
+
+  return 1;
+}
+#endif
+
+// Lecture de toutes les sources l'une après l'autre, dans une seule boucle
+static int serial_loop(void) {
+  int v[PIPELINE_VALUES], i, ok;
+  unsigned long loops = 0, errors = 0;
+  uint64_t start = latency_now(), end, t, loop_ns, max_ns = 0;
+
+  end = start + PIPELINE_TEST_MS * 1000000ULL;
+  while ((t = latency_now()) < end) {
+    for (i = 0, ok = 1; i < SOURCE_TACHOS; i++)
+      ok &= read_sensor(&readers[i], v);
+    ok &= read_tachos(NULL, v);
+    errors += !ok;
+    loop_ns = latency_now() - t;
+    if (loop_ns > max_ns)
+      max_ns = loop_ns;
+    loops++;
+  }
+  t = latency_now() - start;
+  zlog_info(zlog_c, "Boucle séquentielle : %lu tour(s), %.1f tours/s, %.1f us par tour en moyenne, %.1f us au plus, %lu erreur(s)",
+	    loops, loops * 1e9 / t, t / 1000.0 / loops, max_ns / 1000.0,
+	    errors);
+
+  return errors == 0;
+}
+
+/*
+ * Lecture des capteurs de couleur, à ultrasons et tactile et des positions
+ * des grands servomoteurs, d'abord dans une seule boucle, puis par le
+ * pipeline. Les trames sont lues toutes les PIPELINE_CONSUME_MS; l'âge des
+ * mesures dans les trames est comparé au tour de la boucle séquentielle.
+ */
+int pipeline_test(void) {
+  static const unsigned int periods[SOURCES] = {
+    PIPELINE_COLOR_US, PIPELINE_US_US, PIPELINE_TOUCH_US, PIPELINE_TACHO_US
+  };
+  struct pipeline p;
+  struct pipeline_frame f;
+  unsigned long frames = 0, complete = 0;
+  long cpu;
+  long age, age_max[SOURCES] = { 0 };
+  long long age_sum[SOURCES] = { 0 };
+  unsigned long aged[SOURCES] = { 0 };
+  int i, t, printed = 0, have = 0;
+
+  // Pas de mesure de l'ancien mode dans les files
+  if (ready_sensor_mode(&readers[SOURCE_COLOR], LEGO_EV3_COLOR_COL_REFLECT,
+			PIPELINE_MODE_MS, NULL) < 0 ||
+      ready_sensor_mode(&readers[SOURCE_US], LEGO_EV3_US_US_DIST_CM,
+			PIPELINE_MODE_MS, NULL) < 0) {
+    zlog_error(zlog_c, "Impossible de changer le mode des capteurs");
+    return 0;
+  }
+
+  if (!serial_loop())
+    zlog_warn(zlog_c, "Erreurs de lecture dans la boucle séquentielle");
+
+  pipeline_init(&p);
+  for (i = 0; i < SOURCE_TACHOS; i++)
+    pipeline_add(&p, source_names[i], periods[i], read_sensor, &readers[i]);
+  pipeline_add(&p, source_names[SOURCE_TACHOS], periods[SOURCE_TACHOS],
+	       read_tachos, NULL);
+  if (!pipeline_start(&p, PIPELINE_FRAME_US, PIPELINE_DELAY_US,
+		      PIPELINE_CAPACITY)) {
+    zlog_error(zlog_c, "Impossible de démarrer le pipeline");
+    return 0;
+  }
+  cpu = process_cpu_us();
+
+  for (t = 0; t < PIPELINE_TEST_MS; t += PIPELINE_CONSUME_MS) {
+    usleep(PIPELINE_CONSUME_MS * 1000);
+    while (pipeline_next(&p, &f)) {
+      have = 1;
+      frames++;
+      complete += f.valid == (1u << SOURCES) - 1;
+      for (i = 0; i < SOURCES; i++) {
+	age = pipeline_age_us(&f, i);
+	if (age < 0)
+	  continue;
+	age_sum[i] += age;
+	aged[i]++;
+	if (age > age_max[i])
+	  age_max[i] = age;
+      }
+    }
+    if (have && t + PIPELINE_CONSUME_MS >= printed + PIPELINE_PRINT_MS) {
+      printed = t + PIPELINE_CONSUME_MS;
+      zlog_info(zlog_c, "Trame : lumière %d %%, distance %d mm, toucher %d, positions %d et %d",
+		f.sample[SOURCE_COLOR].value[0], f.sample[SOURCE_US].value[0],
+		f.sample[SOURCE_TOUCH].value[0],
+		f.sample[SOURCE_TACHOS].value[0],
+		f.sample[SOURCE_TACHOS].value[1]);
+    }
+  }
+  pipeline_stop(&p);
+  cpu = process_cpu_us() - cpu;
+
+  pipeline_report(&p);
+  zlog_info(zlog_c, "Consommateur : %lu trame(s), %lu complète(s), %ld us de processeur pour %d fils",
+	    frames, complete, cpu, SOURCES + 2);
+  for (i = 0; i < SOURCES; i++)
+    if (aged[i] > 0)
+      zlog_info(zlog_c, "%s : âge dans les trames %lld us en moyenne, %ld us au plus",
+		source_names[i], age_sum[i] / (long long) aged[i], age_max[i]);
+
+  return frames > 0;
+}
+
+static int source_task_run(struct coro *c, void *arg) {
+  struct source_task *t = arg;
+
+  CORO_BEGIN(c);
+  t->next_ns = coro_now();
+  while (t->next_ns < t->end_ns) {
+    if (t->read(t->arg, t->value))
+      t->samples++;
+    else
+      t->errors++;
+    t->next_ns += t->period_ns;
+    CORO_SLEEP_UNTIL(c, t->next_ns);
+  }
+  CORO_END(c);
+}
+
+static int print_task_run(struct coro *c, void *arg) {
+  struct print_task *t = arg;
+  struct source_task *s = t->sources;
+
+  CORO_BEGIN(c);
+  while (coro_now() + PIPELINE_PRINT_MS * 1000000ULL < t->end_ns) {
+    CORO_SLEEP_US(c, PIPELINE_PRINT_MS * 1000);
+    zlog_info(zlog_c, "Tâches : lumière %d %%, distance %d mm, toucher %d, positions %d et %d",
+	      s[SOURCE_COLOR].value[0], s[SOURCE_US].value[0],
+	      s[SOURCE_TOUCH].value[0], s[SOURCE_TACHOS].value[0],
+	      s[SOURCE_TACHOS].value[1]);
+  }
+  CORO_END(c);
+}
+
+/*
+ * Mêmes lectures que le pipeline, par une tâche coopérative par source et
+ * une tâche d'impression, toutes dans le fil appelant.
+ */
+int coroutine_test(void) {
+  static const unsigned int periods[SOURCES] = {
+    PIPELINE_COLOR_US, PIPELINE_US_US, PIPELINE_TOUCH_US, PIPELINE_TACHO_US
+  };
+  struct source_task sources[SOURCES];
+  struct print_task print;
+  struct coro_sched sched;
+  uint64_t end = coro_now() + PIPELINE_TEST_MS * 1000000ULL;
+  long cpu;
+  int i;
+
+  coro_sched_init(&sched);
+  for (i = 0; i < SOURCES; i++) {
+    sources[i].read = i == SOURCE_TACHOS ? read_tachos : read_sensor;
+    sources[i].arg = i == SOURCE_TACHOS ? NULL : &readers[i];
+    sources[i].period_ns = periods[i] * 1000L;
+    sources[i].end_ns = end;
+    sources[i].samples = sources[i].errors = 0;
+    sources[i].value[0] = sources[i].value[1] = 0;
+    coro_spawn(&sched, &sources[i].coro, source_names[i], source_task_run,
+	       &sources[i]);
+  }
+  print.sources = sources;
+  print.end_ns = end;
+  coro_spawn(&sched, &print.coro, "Impression", print_task_run, &print);
+
+  cpu = process_cpu_us();
+  coro_run(&sched);
+  cpu = process_cpu_us() - cpu;
+
+  for (i = 0; i < SOURCES; i++)
+    zlog_info(zlog_c, "%s : %lu mesure(s), %.1f mesures/s pour %.1f prévues, %lu erreur(s)",
+	      source_names[i], sources[i].samples,
+	      sources[i].samples * 1000.0 / PIPELINE_TEST_MS,
+	      1e6 / periods[i], sources[i].errors);
+  coro_sched_report(&sched, "Coroutines");
+  zlog_info(zlog_c, "Coroutines : %ld us de processeur dans un seul fil", cpu);
+
+  return 1;
+}
+
+#ifndef EV3_SUITE
+int main(int argc, char *argv[]) {
+  int rc;
+
+  // Variables constantes spécifique à zlog
+  const char *zlog_conf = "/etc/zlog.conf";
+  const char *zlog_cat  = "project";
+
+  (void) argc;
+  (void) argv;
+
+  rc = zlog_init(zlog_conf);
+  if (rc) {
+    printf("L'initialisation de zlog avec '%s' a échoué\n", zlog_conf);
+    return EXIT_FAILURE;
+  }
+
+  zlog_c = zlog_get_category(zlog_cat);
+  if (!zlog_c) {
+    printf("zlog est incapable de retrouver la catégorie '%s'\n", zlog_cat);
+    puts("Impression des messages par zlog est désactivé");
+    zlog_fini();
+  }
+
+  zlog_info(zlog_c, "Hello IIUN!");
+
+  latency_start();
+
+  if(!init()) {
+    zlog_fini();
+    return EXIT_FAILURE;
+  }
+  telemetry_start_env();
+
+  // Changer la lumière à rouge
+  set_light(LIT_LEFT, LIT_RED);
+  set_light(LIT_RIGHT, LIT_RED);
+
+  // Test pipeline
+  zlog_info(zlog_c, "=== Test pipeline ===");
+  pipeline_test();
+  // Test coroutines
+  zlog_info(zlog_c, "=== Test coroutines ===");
+  coroutine_test();
+
+  // Changer la lumière à vert
+  set_light(LIT_LEFT, LIT_GREEN);
+  set_light(LIT_RIGHT, LIT_GREEN);
+
+  pipeline_teardown();
+
+  zlog_info(zlog_c, "Bye IIUN!");
+
+  latency_stop();
+  telemetry_stop();
+  ev3_uninit();
+
+  zlog_fini();
+
+  return EXIT_SUCCESS;
+}
+#endif
@@ -87,7 +87,6 @@ int init(void) {
 
 int main (int argc, char *argv[]) {
   int condition = 0, color_idx, rc;
-  float color;
 
   // zlog specific variables
   const char *zlog_conf = "/etc/zlog.conf";
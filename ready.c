@@ -0,0 +1,189 @@
+/*
+ * Attente que les périphériques soient prêts, à la place des pauses fixes.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <ev3.h>
+#include <ev3_sensor.h>
+#include <ev3_tacho.h>
+
+#include "latency.h"
+#include "ready.h"
+#include "zlog.h"
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+// Etat d'une attente en cours
+struct poll {
+  uint64_t start;
+  uint64_t deadline;
+  struct ready_wait *w;
+};
+
+static void poll_init(struct poll *p, unsigned int timeout_ms,
+		      struct ready_wait *w) {
+  p->start = latency_now();
+  p->deadline = p->start + timeout_ms * 1000000ULL;
+  p->w = w;
+  if (w != NULL) {
+    w->elapsed_us = 0;
+    w->polls = 0;
+    w->timed_out = 0;
+  }
+}
+
+/*
+ * Prise en compte d'une lecture de résultat 'rc': 1 prêt, 0 pas encore
+ * prêt, -1 erreur. Si l'attente est finie (prêt, erreur ou délai dépassé),
+ * '*done' est mis et sa valeur de retour est rendue; sinon, pause avant la
+ * lecture suivante.
+ */
+static int poll_next(struct poll *p, int rc, int *done) {
+  uint64_t now = latency_now();
+  unsigned int sleep_us;
+
+  if (p->w != NULL) {
+    p->w->polls++;
+    p->w->elapsed_us = (now - p->start) / 1000;
+  }
+  *done = 1;
+  if (rc != 0)
+    return rc;
+  if (now >= p->deadline) {
+    if (p->w != NULL)
+      p->w->timed_out = 1;
+    return 0;
+  }
+  *done = 0;
+  // Pause d'un quart du temps déjà attendu, bornée, sans dépasser le délai
+  sleep_us = (now - p->start) / 4000;
+  if (sleep_us < READY_POLL_MIN_US)
+    sleep_us = READY_POLL_MIN_US;
+  else if (sleep_us > READY_POLL_MAX_US)
+    sleep_us = READY_POLL_MAX_US;
+  if (now + sleep_us * 1000ULL > p->deadline)
+    sleep_us = (p->deadline - now) / 1000 + 1;
+  usleep(sleep_us);
+
+  return 0;
+}
+
+// 1 si les servomoteurs 'sn' sont arrêtés, 0 sinon, -1 en cas d'erreur
+static int tachos_stopped(const uint8_t *sn) {
+  FLAGS_T flags;
+  size_t bytes;
+  int speed;
+
+  for (; *sn < DESC_LIMIT; sn++) {
+    LATENCY_TIME(bytes, LATENCY_TACHO, *sn, "state",
+		 get_tacho_state_flags(*sn, &flags));
+    if (bytes == 0)
+      return -1;
+    if (flags & TACHO_HOLDING)
+      continue;
+    if (flags & TACHO_RUNNING)
+      return 0;
+    LATENCY_TIME(bytes, LATENCY_TACHO, *sn, "speed",
+		 get_tacho_speed(*sn, &speed));
+    if (bytes == 0)
+      return -1;
+    if (abs(speed) > READY_TACHO_STILL)
+      return 0;
+  }
+
+  return 1;
+}
+
+int ready_tachos(const uint8_t *sn, unsigned int timeout_ms,
+		 struct ready_wait *w) {
+  struct poll p;
+  int rc, done;
+
+  poll_init(&p, timeout_ms, w);
+  do
+    rc = poll_next(&p, tachos_stopped(sn), &done);
+  while (!done);
+
+  return rc;
+}
+
+/*
+ * 1 si value0 est lisible et, si 'known', différente de 'old', 0 sinon.
+ * Un format lu pendant un changement de mode peut être faux: il est relu
+ * après un échec.
+ */
+static int sensor_fresh(struct sensor_reader *r, int known, int old) {
+  int value;
+
+  if (sensor_reader_value(r, 0, &value) == 0) {
+    sensor_reader_invalidate(r);
+    return 0;
+  }
+
+  return !known || value != old;
+}
+
+int ready_sensor(struct sensor_reader *r, unsigned int timeout_ms,
+		 struct ready_wait *w) {
+  struct poll p;
+  int rc, done;
+
+  poll_init(&p, timeout_ms, w);
+  do
+    rc = poll_next(&p, sensor_fresh(r, 0, 0), &done);
+  while (!done);
+
+  return rc;
+}
+
+int ready_sensor_mode(struct sensor_reader *r, INX_T mode,
+		      unsigned int timeout_ms, struct ready_wait *w) {
+  struct poll p;
+  int rc, done, old, known;
+  INX_T current;
+  size_t bytes;
+
+  // Mode déjà en place: pas de valeurs périmées
+  LATENCY_TIME(bytes, LATENCY_SENSOR, r->sn, "mode",
+	       get_sensor_mode_inx(r->sn, &current));
+  if (bytes > 0 && current == mode) {
+    poll_init(&p, 0, w);
+    return 1;
+  }
+  LATENCY_TIME(bytes, LATENCY_SENSOR, r->sn, "mode",
+	       sensor_reader_set_mode(r, mode));
+  if (bytes == 0)
+    return -1;
+  /*
+   * Valeur de l'ancien mode, qui reste lisible juste après le changement.
+   * Lue après l'écriture du mode: une valeur lue avant pourrait encore être
+   * remplacée par une autre valeur de l'ancien mode.
+   */
+  known = sensor_reader_value(r, 0, &old) > 0;
+  poll_init(&p, timeout_ms, w);
+  do
+    rc = poll_next(&p, sensor_fresh(r, known, old), &done);
+  while (!done);
+  // Le nombre de valeurs et les décimales relus avec le nouveau mode
+  sensor_reader_invalidate(r);
+
+  return rc;
+}
+
+long ready_report(const struct ready_wait *w, const char *name, long fixed_us) {
+  long saved = fixed_us - w->elapsed_us;
+
+  zlog_info(zlog_c, "%s : prêt en %ld ms (%u lecture(s)%s) au lieu de %ld ms, %ld ms gagnées",
+	    name, w->elapsed_us / 1000, w->polls,
+	    w->timed_out ? ", délai dépassé" : "", fixed_us / 1000,
+	    saved / 1000);
+
+  return saved;
+}
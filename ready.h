@@ -0,0 +1,90 @@
+/*
+ * Attente que les périphériques soient prêts, à la place des pauses fixes.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Entre deux phases d'un test, une pause fixe (sleep(1)) attend le pire
+ * cas. Ici, l'état du matériel est relu jusqu'à ce qu'il soit prêt, avec
+ * une pause entre deux lectures d'un quart du temps déjà attendu, entre
+ * READY_POLL_MIN_US et READY_POLL_MAX_US: une attente courte est vue
+ * aussitôt, une attente longue ne coûte que peu de lectures, et le retard
+ * sur l'instant où le matériel est prêt reste sous 25 %. Un délai maximal
+ * borne chaque attente.
+ *
+ * - Servomoteurs: prêts quand ils maintiennent leur position (holding), ou
+ *   quand 'running' est effacé et que la vitesse est retombée sous
+ *   READY_TACHO_STILL. Après un arrêt en roue libre, le pilote efface
+ *   'running' aussitôt alors que le servomoteur tourne encore.
+ * - Capteurs: prêts à la première valeur lue; après un changement de mode,
+ *   à la première valeur value0 différente de celle de l'ancien mode, les
+ *   valeurs restant celles de l'ancien mode pendant quelques ms. Un mode
+ *   déjà en place n'est pas réécrit.
+ *
+ * Chaque attente est décrite dans une struct ready_wait, pour comparer sa
+ * durée à celle de la pause fixe qu'elle remplace (ready_report).
+ */
+
+#ifndef READY_H
+#define READY_H
+
+#include <stdint.h>
+
+#include <ev3.h>
+
+#include "sensor_reader.h"
+
+#define READY_POLL_MIN_US 500
+#define READY_POLL_MAX_US 20000
+// Vitesse en impulsions/s en dessous de laquelle un servomoteur est arrêté
+#define READY_TACHO_STILL 10
+
+struct ready_wait {
+  // Durée de l'attente en us et nombre de lectures
+  long elapsed_us;
+  unsigned int polls;
+  int timed_out;
+};
+
+/*
+ * Attente que les servomoteurs 'sn', terminés par DESC_LIMIT, soient
+ * arrêtés, au plus 'timeout_ms'. 'w' peut être NULL.
+ * Valeurs de retour:
+ * 1, si les servomoteurs sont arrêtés,
+ * 0, si le délai est dépassé,
+ * -1, si l'état ou la vitesse n'a pas pu être lu.
+ */
+int ready_tachos(const uint8_t *sn, unsigned int timeout_ms,
+		 struct ready_wait *w);
+
+/*
+ * Attente d'une valeur lisible du capteur de 'r', au plus 'timeout_ms'.
+ * Valeurs de retour: voir ready_tachos.
+ */
+int ready_sensor(struct sensor_reader *r, unsigned int timeout_ms,
+		 struct ready_wait *w);
+
+/*
+ * Passage du capteur de 'r' en mode 'mode' et attente de la première
+ * valeur du nouveau mode, au plus 'timeout_ms'. Si la valeur ne change pas
+ * d'un mode à l'autre, l'attente va jusqu'au délai, comme la pause fixe.
+ * La première valeur est reconnue à ce qu'elle diffère de value0 lue juste
+ * après l'écriture du mode: une valeur bruitée de l'ancien mode (p.ex.
+ * COL-REFLECT qui fluctue) peut donc être prise pour la première du
+ * nouveau. Un appelant sensible à cette valeur la relit ou l'écarte; deux
+ * lectures identiques ne suffiraient pas non plus, et retarderaient un
+ * nouveau mode bruité jusqu'au délai.
+ * Valeurs de retour: voir ready_tachos; -1 aussi si le mode n'a pas pu être
+ * changé.
+ */
+int ready_sensor_mode(struct sensor_reader *r, INX_T mode,
+		      unsigned int timeout_ms, struct ready_wait *w);
+
+/*
+ * Impression de l'attente 'w' de la phase 'name' par zlog, comparée à la
+ * pause fixe de 'fixed_us'. Retourne le temps gagné en us (négatif si
+ * l'attente a été plus longue).
+ */
+long ready_report(const struct ready_wait *w, const char *name, long fixed_us);
+
+#endif
@@ -0,0 +1,643 @@
+/*
+ * Rejeu déterministe de la télémétrie enregistrée.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <ev3.h>
+#include <ev3_sensor.h>
+#include <ev3_tacho.h>
+
+#include "replay.h"
+#include "sensor_reader.h"
+#include "telemetry.h"
+#include "zlog.h"
+
+#define NSEC_PER_SEC 1000000000LL
+// Nombre maximal de fils qui attendent en même temps le temps virtuel
+#define REPLAY_THREADS 16
+// Attente réelle au-delà de laquelle le temps virtuel avance quand même
+#define REPLAY_STALL_NS 10000000LL
+#define REPLAY_NONE LLONG_MAX
+// Pas de temps virtuel entre deux consultations des descripteurs par poll
+#define REPLAY_POLL_NS 1000000LL
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+// Fonctions d'origine, résolues par l'éditeur de liens avec --wrap
+size_t __real_get_sensor_value0(uint8_t sn, float *buf);
+size_t __real_get_sensor_value(uint8_t inx, uint8_t sn, int *buf);
+size_t __real_sensor_reader_value(struct sensor_reader *r, uint8_t inx, int *v);
+size_t __real_sensor_reader_value0(struct sensor_reader *r, float *v);
+size_t __real_sensor_reader_value_fixed(struct sensor_reader *r, int decimals,
+					int *v);
+size_t __real_get_tacho_position(uint8_t sn, int *buf);
+size_t __real_get_tacho_speed(uint8_t sn, int *buf);
+size_t __real_get_tacho_state_flags(uint8_t sn, FLAGS_T *buf);
+void __real_telemetry_tacho_sample(uint8_t sn);
+int __real_clock_gettime(clockid_t clock, struct timespec *ts);
+int __real_pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+			  void *(*start)(void *), void *arg);
+unsigned int __real_sleep(unsigned int s);
+int __real_usleep(useconds_t us);
+int __real_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+int __real_sigwait(const sigset_t *set, int *sig);
+int __real_nanosleep(const struct timespec *req, struct timespec *rem);
+int __real_clock_nanosleep(clockid_t clock, int flags,
+			   const struct timespec *req, struct timespec *rem);
+
+// Mesures d'un périphérique dans l'ordre de l'enregistrement
+struct replay_stream {
+  uint32_t *index;
+  uint32_t count;
+  atomic_uint next;
+};
+
+static struct {
+  int active;
+  void *map;
+  size_t size;
+  const struct telemetry_record *records;
+  uint64_t t0_us;
+  int finished;
+  // Une série par indice de valeur des capteurs
+  struct replay_stream sensor[SENSOR_DESC__LIMIT_][SENSOR_READER_VALUES];
+  struct replay_stream tacho[TACHO_DESC__LIMIT_];
+  /*
+   * Temps virtuel de CLOCK_MONOTONIC: anchor_v + (réel - anchor_real) *
+   * rate, ou 'v' au plus vite, où il n'avance que lorsque tous les fils
+   * inscrits attendent.
+   */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int fast;
+  double rate;
+  long long anchor_v;
+  long long anchor_real;
+  long long v;
+  long long start_v;
+  int threads;
+  int used[REPLAY_THREADS];
+  long long deadline[REPLAY_THREADS];
+} replay = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static pthread_once_t replay_once = PTHREAD_ONCE_INIT;
+static pthread_key_t replay_key;
+
+static long long now_ns(void) {
+  struct timespec ts;
+
+  __real_clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void to_timespec(long long ns, struct timespec *ts) {
+  ts->tv_sec = ns / NSEC_PER_SEC;
+  ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+static uint64_t record_us(const struct telemetry_record *r) {
+  return (uint64_t) r->t_us_hi << 32 | r->t_us;
+}
+
+static struct replay_stream *stream_of(const struct telemetry_record *r) {
+  if (r->kind == TELEMETRY_TACHO)
+    return r->sn < TACHO_DESC__LIMIT_ ? &replay.tacho[r->sn] : NULL;
+  if (r->kind >= TELEMETRY_COLOR && r->kind <= TELEMETRY_SENSOR)
+    return r->sn < SENSOR_DESC__LIMIT_ && r->inx < SENSOR_READER_VALUES ?
+      &replay.sensor[r->sn][r->inx] : NULL;
+  return NULL;
+}
+
+#define SENSOR_STREAMS (SENSOR_DESC__LIMIT_ * SENSOR_READER_VALUES)
+
+// Répartition des enregistrements par périphérique et indice de valeur
+static int build_streams(size_t count) {
+  struct replay_stream *s;
+  size_t i;
+
+  for (i = 0; i < count; i++)
+    if ((s = stream_of(&replay.records[i])) != NULL)
+      s->count++;
+  for (i = 0; i < SENSOR_STREAMS + TACHO_DESC__LIMIT_; i++) {
+    s = i < SENSOR_STREAMS ? &replay.sensor[0][0] + i :
+      &replay.tacho[i - SENSOR_STREAMS];
+    if (s->count > 0 && (s->index = malloc(s->count * sizeof(uint32_t))) == NULL)
+      return 0;
+    s->count = 0;
+  }
+  for (i = 0; i < count; i++)
+    if ((s = stream_of(&replay.records[i])) != NULL)
+      s->index[s->count++] = i;
+
+  return 1;
+}
+
+static long long vnow_locked(void) {
+  if (replay.fast)
+    return replay.v;
+  return replay.anchor_v + (long long) ((now_ns() - replay.anchor_real) *
+					replay.rate);
+}
+
+static long long vnow(void) {
+  long long t;
+
+  pthread_mutex_lock(&replay.lock);
+  t = vnow_locked();
+  pthread_mutex_unlock(&replay.lock);
+
+  return t;
+}
+
+/*
+ * Fils qui attendent un instant à venir; un fil dont l'échéance est
+ * atteinte est compté comme actif même s'il n'a pas encore repris la main.
+ */
+static int waiting_locked(void) {
+  int i, n = 0;
+
+  for (i = 0; i < REPLAY_THREADS; i++)
+    if (replay.used[i] && replay.deadline[i] != REPLAY_NONE &&
+	replay.deadline[i] > replay.v)
+      n++;
+
+  return n;
+}
+
+// Avance du temps virtuel jusqu'au prochain réveil attendu
+static void advance_locked(void) {
+  long long min = REPLAY_NONE;
+  int i;
+
+  for (i = 0; i < REPLAY_THREADS; i++)
+    if (replay.used[i] && replay.deadline[i] < min)
+      min = replay.deadline[i];
+  if (min != REPLAY_NONE && min > replay.v) {
+    replay.v = min;
+    pthread_cond_broadcast(&replay.cond);
+  }
+}
+
+// Désinscription d'un fil qui se termine
+static void thread_exit(void *arg) {
+  int slot = (intptr_t) arg - 1;
+
+  pthread_mutex_lock(&replay.lock);
+  replay.used[slot] = 0;
+  replay.threads--;
+  advance_locked();
+  pthread_cond_broadcast(&replay.cond);
+  pthread_mutex_unlock(&replay.lock);
+}
+
+static void setup_clock(void) {
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&replay.cond, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_key_create(&replay_key, thread_exit);
+}
+
+// Réservation d'une case, numérotée à partir de 1, ou 0 s'il n'y en a plus
+static intptr_t reserve_slot_locked(void) {
+  int i;
+
+  for (i = 0; i < REPLAY_THREADS; i++)
+    if (!replay.used[i]) {
+      replay.used[i] = 1;
+      replay.deadline[i] = REPLAY_NONE;
+      replay.threads++;
+      return i + 1;
+    }
+
+  return 0;
+}
+
+// Case du fil appelant parmi les fils qui attendent le temps virtuel
+static int thread_slot_locked(void) {
+  intptr_t slot = (intptr_t) pthread_getspecific(replay_key);
+
+  if (slot > 0)
+    return slot - 1;
+  slot = reserve_slot_locked();
+  if (slot > 0)
+    pthread_setspecific(replay_key, (void *) slot);
+
+  return slot - 1;
+}
+
+// Fil créé pendant le rejeu, inscrit avant de démarrer
+struct replay_thread {
+  void *(*start)(void *);
+  void *arg;
+  intptr_t slot;
+};
+
+static void *thread_start(void *arg) {
+  struct replay_thread t = *(struct replay_thread *) arg;
+
+  free(arg);
+  if (t.slot > 0)
+    pthread_setspecific(replay_key, (void *) t.slot);
+
+  return t.start(t.arg);
+}
+
+/*
+ * Attente jusqu'à l'instant virtuel 'deadline'. Au plus vite, le temps
+ * virtuel passe au réveil le plus proche quand tous les fils inscrits
+ * attendent, ou après REPLAY_STALL_NS de temps réel si l'un d'eux est bloqué
+ * ailleurs. Sinon, l'attente réelle est divisée par la vitesse.
+ */
+static int sleep_until(long long deadline) {
+  struct timespec ts;
+  long long ns;
+  int slot;
+
+  pthread_mutex_lock(&replay.lock);
+  if (replay.fast && (slot = thread_slot_locked()) >= 0) {
+    replay.deadline[slot] = deadline;
+    while (replay.fast && replay.v < deadline) {
+      if (waiting_locked() >= replay.threads) {
+	advance_locked();
+	continue;
+      }
+      to_timespec(now_ns() + REPLAY_STALL_NS, &ts);
+      if (pthread_cond_timedwait(&replay.cond, &replay.lock, &ts) == ETIMEDOUT)
+	advance_locked();
+    }
+    replay.deadline[slot] = REPLAY_NONE;
+  }
+  ns = replay.fast ? 0 : (long long) ((deadline - vnow_locked()) / replay.rate);
+  pthread_mutex_unlock(&replay.lock);
+  if (ns <= 0)
+    return 0;
+  to_timespec(ns, &ts);
+
+  return __real_nanosleep(&ts, NULL);
+}
+
+// Fin des séries: le temps virtuel continue à la vitesse réelle
+static void finish(void) {
+  pthread_mutex_lock(&replay.lock);
+  if (replay.finished) {
+    pthread_mutex_unlock(&replay.lock);
+    return;
+  }
+  replay.anchor_v = vnow_locked();
+  replay.anchor_real = now_ns();
+  replay.rate = 1;
+  replay.fast = 0;
+  replay.finished = 1;
+  pthread_cond_broadcast(&replay.cond);
+  pthread_mutex_unlock(&replay.lock);
+  zlog_info(zlog_c, "Fin du rejeu : les dernières mesures sont conservées");
+}
+
+// Attente de l'instant virtuel de la mesure
+static void pace(const struct telemetry_record *r) {
+  sleep_until(replay.start_v + (long long) (record_us(r) - replay.t0_us) * 1000);
+}
+
+static void replay_load(void) {
+  const struct telemetry_header *h;
+  const char *path = getenv(REPLAY_ENV);
+  const char *speed = getenv(REPLAY_ENV_SPEED);
+  struct stat st;
+  size_t count;
+  int fd;
+
+  if (path == NULL || *path == '\0')
+    return;
+  fd = open(path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    zlog_error(zlog_c, "Impossible d'ouvrir l'enregistrement '%s' : %s",
+	       path, strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return;
+  }
+  replay.size = st.st_size;
+  if (replay.size < sizeof(*h)) {
+    zlog_error(zlog_c, "L'enregistrement '%s' est trop court", path);
+    close(fd);
+    return;
+  }
+  replay.map = mmap(NULL, replay.size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (replay.map == MAP_FAILED) {
+    zlog_error(zlog_c, "Impossible de projeter '%s' en mémoire : %s",
+	       path, strerror(errno));
+    return;
+  }
+  h = replay.map;
+  if (memcmp(h->magic, TELEMETRY_MAGIC, 4) != 0 ||
+      h->version < 1 || h->version > TELEMETRY_VERSION ||
+      h->record_size != sizeof(struct telemetry_record)) {
+    zlog_error(zlog_c, "'%s' n'est pas un enregistrement de télémétrie", path);
+    munmap(replay.map, replay.size);
+    return;
+  }
+  // Le nombre de l'en-tête manque si le programme enregistré a été interrompu
+  count = (replay.size - sizeof(*h)) / sizeof(struct telemetry_record);
+  if (h->count > 0 && h->count < count)
+    count = h->count;
+  replay.records = (const struct telemetry_record *) (h + 1);
+  while (count > 0 && replay.records[count - 1].kind == 0)
+    count--;
+  if (count == 0 || !build_streams(count)) {
+    zlog_error(zlog_c, "Aucune mesure à rejouer dans '%s'", path);
+    munmap(replay.map, replay.size);
+    return;
+  }
+
+  replay.rate = speed != NULL ? atof(speed) : 1.0;
+  if (replay.rate < 0)
+    replay.rate = 1.0;
+  replay.fast = replay.rate == 0;
+  replay.t0_us = record_us(&replay.records[0]);
+  replay.anchor_real = replay.anchor_v = replay.v = replay.start_v = now_ns();
+  setup_clock();
+  replay.active = 1;
+  zlog_info(zlog_c, "Rejeu de '%s' : %lu mesures sur %.1f s, %s",
+	    path, (unsigned long) count,
+	    (record_us(&replay.records[count - 1]) - replay.t0_us) / 1e6,
+	    replay.fast ? "aussi vite que possible" :
+	    replay.rate == 1 ? "en temps réel" : "accéléré");
+}
+
+int replay_active(void) {
+  pthread_once(&replay_once, replay_load);
+  return replay.active;
+}
+
+// Mesure suivante, ou la dernière si la série est épuisée
+static const struct telemetry_record *next(struct replay_stream *s) {
+  const struct telemetry_record *r;
+  unsigned int i;
+
+  if (!replay_active() || s->count == 0)
+    return NULL;
+  i = atomic_fetch_add_explicit(&s->next, 1, memory_order_relaxed);
+  if (i >= s->count) {
+    atomic_store_explicit(&s->next, s->count, memory_order_relaxed);
+    finish();
+    i = s->count - 1;
+  }
+  r = &replay.records[s->index[i]];
+  pace(r);
+
+  return r;
+}
+
+// Dernière mesure rendue, ou la première si aucune ne l'a été
+static const struct telemetry_record *current(struct replay_stream *s) {
+  unsigned int i;
+
+  if (!replay_active() || s->count == 0)
+    return NULL;
+  i = atomic_load_explicit(&s->next, memory_order_relaxed);
+
+  return &replay.records[s->index[i > 0 ? i - 1 : 0]];
+}
+
+size_t __wrap_get_sensor_value0(uint8_t sn, float *buf) {
+  static const float scale[] = { 1.0f, 10.0f, 100.0f, 1000.0f, 10000.0f };
+  const struct telemetry_record *r;
+
+  if (sn >= SENSOR_DESC__LIMIT_ || (r = next(&replay.sensor[sn][0])) == NULL)
+    return __real_get_sensor_value0(sn, buf);
+  if (r->extra > 0 && r->extra < (int) (sizeof(scale) / sizeof(scale[0])))
+    *buf = r->value / scale[r->extra];
+  else
+    *buf = r->value;
+
+  return sizeof(*buf);
+}
+
+size_t __wrap_get_sensor_value(uint8_t inx, uint8_t sn, int *buf) {
+  const struct telemetry_record *r;
+
+  if (inx >= SENSOR_READER_VALUES || sn >= SENSOR_DESC__LIMIT_ ||
+      (r = next(&replay.sensor[sn][inx])) == NULL)
+    return __real_get_sensor_value(inx, sn, buf);
+  *buf = r->value;
+
+  return sizeof(*buf);
+}
+
+size_t __wrap_sensor_reader_value(struct sensor_reader *reader, uint8_t inx,
+				  int *v) {
+  const struct telemetry_record *r;
+
+  if (inx >= SENSOR_READER_VALUES || reader->sn >= SENSOR_DESC__LIMIT_ ||
+      (r = next(&replay.sensor[reader->sn][inx])) == NULL)
+    return __real_sensor_reader_value(reader, inx, v);
+  *v = r->value;
+  telemetry_sensor_value(reader->sn, inx, *v);
+
+  return sizeof(*v);
+}
+
+/*
+ * sensor_reader_value0 et sensor_reader_value_fixed appellent
+ * sensor_reader_value dans sensor_reader.c, un appel que --wrap n'intercepte
+ * pas: elles sont donc interceptées elles aussi.
+ */
+size_t __wrap_sensor_reader_value0(struct sensor_reader *reader, float *v) {
+  static const float scale[] = { 1.0f, 10.0f, 100.0f, 1000.0f, 10000.0f };
+  const struct telemetry_record *r;
+
+  if (reader->sn >= SENSOR_DESC__LIMIT_ ||
+      (r = next(&replay.sensor[reader->sn][0])) == NULL)
+    return __real_sensor_reader_value0(reader, v);
+  if (r->extra > 0 && r->extra < (int) (sizeof(scale) / sizeof(scale[0])))
+    *v = r->value / scale[r->extra];
+  else
+    *v = r->value;
+  telemetry_sensor(reader->sn, r->value);
+
+  return sizeof(*v);
+}
+
+size_t __wrap_sensor_reader_value_fixed(struct sensor_reader *reader,
+					int decimals, int *v) {
+  const struct telemetry_record *r;
+
+  if (reader->sn >= SENSOR_DESC__LIMIT_ ||
+      (r = next(&replay.sensor[reader->sn][0])) == NULL)
+    return __real_sensor_reader_value_fixed(reader, decimals, v);
+  *v = sensor_fixed_rescale(r->value, r->extra > 0 ? r->extra : 0, decimals);
+  telemetry_sensor(reader->sn, r->value);
+
+  return sizeof(*v);
+}
+
+size_t __wrap_get_tacho_position(uint8_t sn, int *buf) {
+  const struct telemetry_record *r;
+
+  if (sn >= TACHO_DESC__LIMIT_ || (r = next(&replay.tacho[sn])) == NULL)
+    return __real_get_tacho_position(sn, buf);
+  *buf = r->value;
+
+  return sizeof(*buf);
+}
+
+size_t __wrap_get_tacho_speed(uint8_t sn, int *buf) {
+  const struct telemetry_record *r;
+
+  if (sn >= TACHO_DESC__LIMIT_ || (r = current(&replay.tacho[sn])) == NULL)
+    return __real_get_tacho_speed(sn, buf);
+  *buf = r->extra;
+
+  return sizeof(*buf);
+}
+
+size_t __wrap_get_tacho_state_flags(uint8_t sn, FLAGS_T *buf) {
+  const struct telemetry_record *r;
+
+  if (sn >= TACHO_DESC__LIMIT_ || (r = current(&replay.tacho[sn])) == NULL)
+    return __real_get_tacho_state_flags(sn, buf);
+  *buf = r->aux;
+
+  return sizeof(*buf);
+}
+
+// Réenregistrement de l'état rejoué sans passer à la mesure suivante
+void __wrap_telemetry_tacho_sample(uint8_t sn) {
+  const struct telemetry_record *r;
+
+  if (sn >= TACHO_DESC__LIMIT_ || (r = current(&replay.tacho[sn])) == NULL) {
+    __real_telemetry_tacho_sample(sn);
+    return;
+  }
+  telemetry_tacho(sn, r->value, r->extra, r->aux);
+}
+
+int __wrap_clock_gettime(clockid_t clock, struct timespec *ts) {
+  if (clock != CLOCK_MONOTONIC || !replay_active())
+    return __real_clock_gettime(clock, ts);
+  to_timespec(vnow(), ts);
+
+  return 0;
+}
+
+/*
+ * Les fils sont inscrits dès leur création, ainsi que leur créateur, pour
+ * que le temps virtuel n'avance pas avant leur première attente.
+ */
+int __wrap_pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+			  void *(*start)(void *), void *arg) {
+  struct replay_thread *t;
+  int rc;
+
+  if (!replay_active() || (t = malloc(sizeof(*t))) == NULL)
+    return __real_pthread_create(thread, attr, start, arg);
+  t->start = start;
+  t->arg = arg;
+  t->slot = 0;
+  pthread_mutex_lock(&replay.lock);
+  // Le fil créateur participe aussi, même s'il n'a pas encore attendu
+  thread_slot_locked();
+  t->slot = reserve_slot_locked();
+  pthread_mutex_unlock(&replay.lock);
+  rc = __real_pthread_create(thread, attr, thread_start, t);
+  if (rc != 0) {
+    if (t->slot > 0)
+      thread_exit((void *) t->slot);
+    free(t);
+  }
+
+  return rc;
+}
+
+unsigned int __wrap_sleep(unsigned int s) {
+  if (!replay_active())
+    return __real_sleep(s);
+  sleep_until(vnow() + s * NSEC_PER_SEC);
+
+  return 0;
+}
+
+int __wrap_usleep(useconds_t us) {
+  if (!replay_active())
+    return __real_usleep(us);
+
+  return sleep_until(vnow() + us * 1000LL);
+}
+
+int __wrap_nanosleep(const struct timespec *req, struct timespec *rem) {
+  if (!replay_active())
+    return __real_nanosleep(req, rem);
+
+  return sleep_until(vnow() + req->tv_sec * NSEC_PER_SEC + req->tv_nsec);
+}
+
+int __wrap_clock_nanosleep(clockid_t clock, int flags,
+			   const struct timespec *req, struct timespec *rem) {
+  long long ns;
+
+  if (clock != CLOCK_MONOTONIC || !replay_active())
+    return __real_clock_nanosleep(clock, flags, req, rem);
+  ns = req->tv_sec * NSEC_PER_SEC + req->tv_nsec;
+  if (!(flags & TIMER_ABSTIME))
+    ns += vnow();
+
+  // clock_nanosleep retourne le code d'erreur au lieu de errno
+  return sleep_until(ns) == 0 ? 0 : errno;
+}
+
+/*
+ * Attente de descripteurs en temps virtuel: les descripteurs sont consultés
+ * sans attendre, puis le fil attend REPLAY_POLL_NS de temps virtuel.
+ */
+int __wrap_poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+  long long deadline, t;
+  int rc;
+
+  if (!replay_active())
+    return __real_poll(fds, nfds, timeout);
+  deadline = timeout < 0 ? REPLAY_NONE : vnow() + timeout * 1000000LL;
+  for (;;) {
+    rc = __real_poll(fds, nfds, 0);
+    if (rc != 0 || (t = vnow()) >= deadline)
+      return rc;
+    sleep_until(t + REPLAY_POLL_NS < deadline ? t + REPLAY_POLL_NS : deadline);
+  }
+}
+
+/*
+ * Un fil qui attend un signal ne retient pas le temps virtuel: sa case est
+ * libérée et il en reprendra une à sa prochaine attente.
+ */
+int __wrap_sigwait(const sigset_t *set, int *sig) {
+  intptr_t slot;
+
+  if (replay_active() && (slot = (intptr_t) pthread_getspecific(replay_key)) > 0) {
+    pthread_setspecific(replay_key, NULL);
+    thread_exit((void *) slot);
+  }
+
+  return __real_sigwait(set, sig);
+}
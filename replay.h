@@ -0,0 +1,56 @@
+/*
+ * Rejeu déterministe de la télémétrie enregistrée.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Les programmes *_replay sont liés avec -Wl,--wrap: les lectures des
+ * capteurs (get_sensor_value0, get_sensor_value, sensor_reader_value,
+ * sensor_reader_value0, sensor_reader_value_fixed) et des servomoteurs
+ * (get_tacho_position, get_tacho_speed, get_tacho_state_flags) sont servies
+ * depuis un fichier de telemetry.h au lieu de sysfs. --wrap n'intercepte pas
+ * les appels entre fonctions d'un même fichier source: chaque point d'entrée
+ * qui lit un capteur sans passer par un autre fichier est intercepté.
+ *
+ * Chaque périphérique rejoue ses mesures dans l'ordre de l'enregistrement,
+ * une série par indice de valeur pour les capteurs (RGB-RAW en a trois): la
+ * n-ième lecture d'une valeur retourne la n-ième mesure enregistrée de cette
+ * valeur, ce qui donne des entrées identiques au bit près quel que soit le
+ * rythme du rejeu. Les lectures d'une valeur d'indice 8 ou plus ne sont pas
+ * rejouées. Pour les
+ * servomoteurs, seule la lecture de la position passe à la mesure suivante.
+ * Les périphériques absents de l'enregistrement sont lus normalement; les
+ * commandes ne sont pas interceptées, de sorte que le rejeu peut tourner
+ * sur la brique ou sous ev3sim.
+ *
+ * Variables d'environnement:
+ * - EV3_REPLAY: fichier enregistré; sans elle, le programme fonctionne
+ *   normalement,
+ * - EV3_REPLAY_SPEED: 1 pour le temps réel (par défaut), >1 pour un rejeu
+ *   accéléré d'autant, 0 pour un rejeu aussi rapide que possible.
+ *
+ * Le programme rejoué vit dans un temps virtuel: CLOCK_MONOTONIC (par
+ * clock_gettime) et les attentes (sleep, usleep, nanosleep, clock_nanosleep,
+ * poll) sont interceptées, et chaque mesure est rendue au plus tôt à son
+ * instant d'enregistrement. En temps réel ou accéléré, le temps virtuel
+ * avance à la vitesse demandée. Au plus vite, il n'avance que lorsque tous
+ * les fils du programme attendent, jusqu'au réveil le plus proche, de sorte
+ * que les fils d'échantillonnage et de consommation restent dans le même
+ * ordre qu'en temps réel. Quand une des séries est épuisée, le rejeu se
+ * termine: chaque périphérique garde sa dernière mesure et le temps virtuel
+ * continue à la vitesse réelle.
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#define REPLAY_ENV "EV3_REPLAY"
+#define REPLAY_ENV_SPEED "EV3_REPLAY_SPEED"
+
+/*
+ * Rejeu en cours. Le fichier est chargé au premier appel d'une fonction
+ * interceptée.
+ */
+int replay_active(void);
+
+#endif
@@ -0,0 +1,21 @@
+/*
+ * Géométrie du robot à entraînement différentiel.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Valeurs pour les roues standard EV3 (56 x 28 mm) montées sur les deux
+ * grands servomoteurs. A ajuster si le robot est modifié.
+ */
+
+#ifndef ROBOT_H
+#define ROBOT_H
+
+// Diamètre des roues et distance entre les points de contact des roues
+#define ROBOT_WHEEL_DIAMETER_MM 56
+#define ROBOT_AXLE_TRACK_MM 120
+
+// Impulsions par tour des grands servomoteurs (attribut count_per_rot)
+#define ROBOT_COUNT_PER_ROT 360
+
+#endif
@@ -0,0 +1,239 @@
+/*
+ * Gestion des changements de mode d'un capteur EV3.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <unistd.h>
+
+#include <ev3.h>
+#include <ev3_sensor.h>
+
+#include "latency.h"
+#include "ready.h"
+#include "sensor_modes.h"
+#include "zlog.h"
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+// Indice du mode 'mode', -1 s'il n'est pas suivi
+static int find(const struct sensor_modes *m, INX_T mode) {
+  int i;
+
+  for (i = 0; i < m->count; i++)
+    if (m->stats[i].mode == mode)
+      return i;
+
+  return -1;
+}
+
+// Indice du mode 'mode', ajouté s'il n'est pas suivi; -1 si la table est pleine
+static int slot(struct sensor_modes *m, INX_T mode) {
+  int i = find(m, mode);
+
+  if (i >= 0)
+    return i;
+  if (m->count == SENSOR_MODES_MAX) {
+    zlog_error(zlog_c, "Plus de %d modes suivis pour le capteur %u",
+	       SENSOR_MODES_MAX, m->r->sn);
+    return -1;
+  }
+  m->stats[m->count].mode = mode;
+
+  return m->count++;
+}
+
+// Fin de la visite du mode courant à l'instant 'now'
+static void leave(struct sensor_modes *m, uint64_t now) {
+  if (m->current >= 0)
+    m->stats[m->current].time_ns += now - m->since;
+  m->since = now;
+}
+
+void sensor_modes_init(struct sensor_modes *m, struct sensor_reader *r,
+		       unsigned int timeout_ms) {
+  INX_T mode;
+  int i, j;
+
+  m->r = r;
+  m->timeout_ms = timeout_ms;
+  m->count = 0;
+  m->current = -1;
+  m->start = m->since = latency_now();
+  for (i = 0; i < SENSOR_MODES_MAX; i++) {
+    m->stats[i].samples = 0;
+    m->stats[i].stale = 0;
+    m->stats[i].visits = 0;
+    m->stats[i].time_ns = 0;
+    for (j = 0; j < SENSOR_MODES_MAX; j++) {
+      m->settle[i][j].count = 0;
+      m->settle[i][j].timeouts = 0;
+      m->settle[i][j].sum_us = 0;
+      m->settle[i][j].max_us = 0;
+    }
+  }
+  if (get_sensor_mode_inx(r->sn, &mode) > 0) {
+    m->current = slot(m, mode);
+    if (m->current >= 0)
+      m->stats[m->current].visits++;
+  }
+}
+
+int sensor_modes_set(struct sensor_modes *m, INX_T mode) {
+  struct sensor_mode_settle *s;
+  struct ready_wait w;
+  int from = m->current, to, rc;
+
+  to = slot(m, mode);
+  if (to < 0)
+    return -1;
+  if (to == from)
+    return 1;
+  leave(m, latency_now());
+  rc = ready_sensor_mode(m->r, mode, m->timeout_ms, &w);
+  if (rc < 0) {
+    m->current = -1;
+    return -1;
+  }
+  m->current = to;
+  m->stats[to].visits++;
+  // Toutes les lectures sauf la dernière ont rendu une valeur de l'ancien mode
+  if (w.polls > 1)
+    m->stats[to].stale += w.polls - 1;
+  if (from >= 0) {
+    s = &m->settle[from][to];
+    s->count++;
+    s->timeouts += w.timed_out;
+    s->sum_us += w.elapsed_us;
+    if (w.elapsed_us > s->max_us)
+      s->max_us = w.elapsed_us;
+  }
+
+  return rc;
+}
+
+int sensor_modes_read(struct sensor_modes *m, INX_T mode, int *v, int n) {
+  int i;
+
+  if (n > SENSOR_READER_VALUES || sensor_modes_set(m, mode) < 0)
+    return 0;
+  // Lectures mesurées par le lecteur (voir sensor_reader.h)
+  for (i = 0; i < n; i++)
+    if (sensor_reader_value(m->r, i, &v[i]) == 0)
+      return 0;
+  m->stats[m->current].samples++;
+
+  return 1;
+}
+
+int sensor_modes_burst(const struct sensor_modes *m, INX_T from, INX_T to,
+		       unsigned int period_us) {
+  const struct sensor_mode_settle *s;
+  int i = find(m, from), j = find(m, to);
+  long burst;
+
+  if (i < 0 || j < 0 || i == j || period_us == 0)
+    return 1;
+  s = &m->settle[i][j];
+  if (s->count == 0)
+    return 1;
+  // Attente moyenne rapportée au temps de mesure qu'elle doit amortir
+  burst = s->sum_us / s->count * (100 - SENSOR_MODES_SWITCH_SHARE) /
+    (SENSOR_MODES_SWITCH_SHARE * (long) period_us);
+  if (burst < 1)
+    return 1;
+
+  return burst < SENSOR_MODES_BURST_MAX ? burst : SENSOR_MODES_BURST_MAX;
+}
+
+/*
+ * Nombre de mesures par visite pour les 'n' modes 'modes' visités en
+ * aller-retour: le plus grand des couples voisins, pour que chaque mode
+ * ait la même part des mesures.
+ */
+static int interleave_burst(const struct sensor_modes *m, const INX_T *modes,
+			    int n, unsigned int period_us) {
+  int i, b, burst = 1;
+
+  for (i = 0; i + 1 < n; i++) {
+    b = sensor_modes_burst(m, modes[i], modes[i + 1], period_us);
+    if (b > burst)
+      burst = b;
+    b = sensor_modes_burst(m, modes[i + 1], modes[i], period_us);
+    if (b > burst)
+      burst = b;
+  }
+
+  return burst;
+}
+
+int sensor_modes_interleave(struct sensor_modes *m, const INX_T *modes, int n,
+			    int count, unsigned int period_us,
+			    unsigned int duration_ms,
+			    void (*sample)(void *arg, INX_T mode, const int *v),
+			    void *arg) {
+  int v[SENSOR_READER_VALUES];
+  int i, k, burst, dir = 1;
+  uint64_t end = latency_now() + duration_ms * 1000000ULL;
+
+  if (n <= 0)
+    return 1;
+  // Départ du mode courant s'il fait partie des modes, sans changement
+  for (i = n - 1; i > 0; i--)
+    if (m->current >= 0 && modes[i] == m->stats[m->current].mode)
+      break;
+  if (i == n - 1)
+    dir = -1;
+  while (latency_now() < end) {
+    if (sensor_modes_set(m, modes[i]) < 0)
+      return 0;
+    burst = interleave_burst(m, modes, n, period_us);
+    // Les extrémités ne sont visitées qu'une fois par aller-retour
+    if (n > 2 && (i == 0 || i == n - 1))
+      burst *= 2;
+    for (k = 0; k < burst && latency_now() < end; k++) {
+      if (!sensor_modes_read(m, modes[i], v, count))
+	return 0;
+      sample(arg, modes[i], v);
+      usleep(period_us);
+    }
+    if (n == 1)
+      continue;
+    if (i + dir < 0 || i + dir >= n)
+      dir = -dir;
+    i += dir;
+  }
+
+  return 1;
+}
+
+void sensor_modes_report(const struct sensor_modes *m, const char *name) {
+  const struct sensor_mode_settle *s;
+  const struct sensor_mode_stats *st;
+  uint64_t now = latency_now(), time_ns;
+  double total_s = (now - m->start) / 1e9;
+  int i, j;
+
+  for (i = 0; i < m->count; i++)
+    for (j = 0; j < m->count; j++) {
+      s = &m->settle[i][j];
+      if (s->count == 0)
+	continue;
+      zlog_info(zlog_c, "%s : %s -> %s : %u changement(s), prêt en %ld us en moyenne, %ld us au plus, %u délai(s) dépassé(s)",
+		name, ev3_sensor_mode(m->stats[i].mode),
+		ev3_sensor_mode(m->stats[j].mode), s->count,
+		s->sum_us / s->count, s->max_us, s->timeouts);
+    }
+  for (i = 0; i < m->count; i++) {
+    st = &m->stats[i];
+    if (st->samples == 0)
+      continue;
+    time_ns = st->time_ns + (i == m->current ? now - m->since : 0);
+    zlog_info(zlog_c, "%s : %s : %lu mesure(s) en %u visite(s), %lu lecture(s) périmée(s) écartée(s), %.1f mesures/s dans le mode, %.1f mesures/s en tout",
+	      name, ev3_sensor_mode(st->mode), st->samples, st->visits,
+	      st->stale, time_ns > 0 ? st->samples * 1e9 / time_ns : 0.0,
+	      total_s > 0 ? st->samples / total_s : 0.0);
+  }
+}
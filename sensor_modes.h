@@ -0,0 +1,123 @@
+/*
+ * Gestion des changements de mode d'un capteur EV3.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Après un changement de mode, value0 garde quelques ms la valeur de
+ * l'ancien mode. Le gestionnaire fait chaque changement par
+ * ready_sensor_mode, qui écarte ces valeurs périmées, et mesure la durée
+ * de stabilisation par couple (ancien mode, nouveau mode). Un mode déjà en
+ * place n'est pas réécrit.
+ *
+ * Pour échantillonner plusieurs modes (lumière reflétée et ambiante par
+ * exemple), sensor_modes_interleave visite les modes en aller-retour
+ * (A B C B A ...): un passage sur n modes coûte n - 1 changements au lieu
+ * de n, les modes aux extrémités, visités une fois par aller-retour, faisant
+ * deux fois plus de mesures par visite. Le nombre de mesures par visite est
+ * choisi pour que l'attente du changement le plus lent ne dépasse pas
+ * SENSOR_MODES_SWITCH_SHARE pour cent de la visite, d'après les durées déjà
+ * mesurées; il est le même pour tous les modes.
+ *
+ * Le temps passé dans chaque mode, attente d'entrée comprise, donne la
+ * fréquence effective des mesures par mode (sensor_modes_report).
+ */
+
+#ifndef SENSOR_MODES_H
+#define SENSOR_MODES_H
+
+#include <stdint.h>
+
+#include <ev3.h>
+
+#include "sensor_reader.h"
+
+// Modes suivis par capteur
+#define SENSOR_MODES_MAX 8
+// Part du temps d'une visite laissée à l'attente du mode, en %
+#define SENSOR_MODES_SWITCH_SHARE 20
+// Nombre maximal de mesures par visite
+#define SENSOR_MODES_BURST_MAX 32
+
+// Durées de stabilisation d'un couple de modes
+struct sensor_mode_settle {
+  unsigned int count;
+  unsigned int timeouts;
+  long sum_us;
+  long max_us;
+};
+
+struct sensor_mode_stats {
+  INX_T mode;
+  // Mesures rendues et lectures périmées écartées
+  unsigned long samples;
+  unsigned long stale;
+  unsigned int visits;
+  // Temps passé dans le mode, attentes d'entrée comprises
+  uint64_t time_ns;
+};
+
+struct sensor_modes {
+  struct sensor_reader *r;
+  unsigned int timeout_ms;
+  // Modes vus et indice du mode courant, -1 s'il est inconnu
+  int count;
+  int current;
+  uint64_t start;
+  uint64_t since;
+  struct sensor_mode_stats stats[SENSOR_MODES_MAX];
+  struct sensor_mode_settle settle[SENSOR_MODES_MAX][SENSOR_MODES_MAX];
+};
+
+/*
+ * Préparation du gestionnaire des modes du capteur de 'r', avec
+ * 'timeout_ms' le délai maximal de stabilisation d'un mode.
+ */
+void sensor_modes_init(struct sensor_modes *m, struct sensor_reader *r,
+		       unsigned int timeout_ms);
+
+/*
+ * Passage en mode 'mode' et attente de ses premières valeurs.
+ * Valeurs de retour:
+ * 1, si une valeur du nouveau mode a été lue,
+ * 0, si le délai est dépassé (les valeurs sont peut-être périmées),
+ * -1, si le mode n'a pas pu être changé ou si SENSOR_MODES_MAX modes sont
+ *  déjà suivis.
+ */
+int sensor_modes_set(struct sensor_modes *m, INX_T mode);
+
+/*
+ * Lecture des valeurs 0 à 'n' - 1 dans le mode 'mode', après un changement
+ * de mode si besoin. Retourne 1 en cas de succès, 0 sinon.
+ */
+int sensor_modes_read(struct sensor_modes *m, INX_T mode, int *v, int n);
+
+/*
+ * Nombre de mesures à faire à la période 'period_us' après un passage de
+ * 'from' à 'to', pour que l'attente mesurée du changement reste sous
+ * SENSOR_MODES_SWITCH_SHARE pour cent de la visite. 1 si le couple n'a pas
+ * encore été mesuré.
+ */
+int sensor_modes_burst(const struct sensor_modes *m, INX_T from, INX_T to,
+		       unsigned int period_us);
+
+/*
+ * Echantillonnage entrelacé des 'n' modes 'modes' pendant 'duration_ms', à
+ * la période 'period_us'. 'sample' reçoit chaque mesure: son mode, ses
+ * 'count' premières valeurs et 'arg'.
+ * Retourne 1 en cas de succès, 0 si un changement de mode ou une lecture a
+ * échoué.
+ */
+int sensor_modes_interleave(struct sensor_modes *m, const INX_T *modes, int n,
+			    int count, unsigned int period_us,
+			    unsigned int duration_ms,
+			    void (*sample)(void *arg, INX_T mode, const int *v),
+			    void *arg);
+
+/*
+ * Impression par zlog des durées de stabilisation par couple de modes et
+ * de la fréquence effective des mesures par mode, pour le capteur 'name'.
+ */
+void sensor_modes_report(const struct sensor_modes *m, const char *name);
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Lecture rapide des valeurs d'un capteur EV3.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "discovery.h"
+#include "latency.h"
+#include "sensor_reader.h"
+#include "telemetry.h"
+
+// Relecture du nombre de valeurs et des décimales après une invalidation
+static int load_format(struct sensor_reader *r) {
+  dword num_values, decimals;
+
+  if (get_sensor_num_values(r->sn, &num_values) == 0 ||
+      get_sensor_decimals(r->sn, &decimals) == 0) {
+    r->num_values = -1;
+    r->decimals = -1;
+    return 0;
+  }
+  r->num_values = num_values < SENSOR_READER_VALUES ?
+    (int) num_values : SENSOR_READER_VALUES;
+  r->decimals = decimals;
+  telemetry_decimals(r->sn, r->decimals);
+
+  return 1;
+}
+
+int sensor_reader_open(struct sensor_reader *r, uint8_t sn) {
+  int i;
+
+  r->sn = sn;
+  for (i = 0; i < SENSOR_READER_VALUES; i++)
+    r->fd[i] = -1;
+
+  return load_format(r);
+}
+
+void sensor_reader_invalidate(struct sensor_reader *r) {
+  int i;
+
+  for (i = 0; i < SENSOR_READER_VALUES; i++)
+    if (r->fd[i] >= 0) {
+      close(r->fd[i]);
+      r->fd[i] = -1;
+    }
+  r->num_values = -1;
+  r->decimals = -1;
+}
+
+void sensor_reader_close(struct sensor_reader *r) {
+  sensor_reader_invalidate(r);
+}
+
+size_t sensor_reader_value(struct sensor_reader *r, uint8_t inx, int *v) {
+  static const char *attrs[SENSOR_READER_VALUES] = {
+    "value0", "value1", "value2", "value3",
+    "value4", "value5", "value6", "value7"
+  };
+  char buf[16], path[64];
+  ssize_t n;
+  int i, neg = 0, value = 0;
+
+  if (r->num_values < 0 && !load_format(r))
+    return 0;
+  if (inx >= r->num_values)
+    return 0;
+  if (r->fd[inx] < 0) {
+    snprintf(path, sizeof(path), SENSOR_SYSFS_PATH "%u/value%u", r->sn, inx);
+    r->fd[inx] = open(path, O_RDONLY);
+    if (r->fd[inx] < 0)
+      return 0;
+  }
+
+  LATENCY_TIME(n, LATENCY_SENSOR, r->sn, attrs[inx],
+	       pread(r->fd[inx], buf, sizeof(buf), 0));
+  if (n <= 0)
+    return 0;
+  i = 0;
+  if (buf[0] == '-') {
+    neg = 1;
+    i++;
+  }
+  for (; i < n && buf[i] >= '0' && buf[i] <= '9'; i++)
+    value = value * 10 + buf[i] - '0';
+  *v = neg ? -value : value;
+  telemetry_sensor_value(r->sn, inx, *v);
+
+  return n;
+}
+
+size_t sensor_reader_value0(struct sensor_reader *r, float *v) {
+  static const float scale[] = { 1.0f, 10.0f, 100.0f, 1000.0f, 10000.0f };
+  size_t bytes;
+  int value;
+
+  bytes = sensor_reader_value(r, 0, &value);
+  if (bytes == 0)
+    return 0;
+  if (r->decimals > 0 && r->decimals < (int) (sizeof(scale) / sizeof(scale[0])))
+    *v = value / scale[r->decimals];
+  else
+    *v = value;
+
+  return bytes;
+}
+
+size_t sensor_reader_value_fixed(struct sensor_reader *r, int decimals, int *v) {
+  size_t bytes;
+  int value;
+
+  bytes = sensor_reader_value(r, 0, &value);
+  if (bytes == 0)
+    return 0;
+  *v = sensor_fixed_rescale(value, r->decimals > 0 ? r->decimals : 0, decimals);
+
+  return bytes;
+}
+
+size_t sensor_reader_set_mode(struct sensor_reader *r, INX_T mode) {
+  size_t bytes;
+
+  sensor_reader_invalidate(r);
+  bytes = set_sensor_mode_inx(r->sn, mode);
+  if (bytes > 0)
+    telemetry_mode(r->sn, mode);
+
+  return bytes;
+}
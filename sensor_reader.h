@@ -0,0 +1,101 @@
+/*
+ * Lecture rapide des valeurs d'un capteur EV3.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * get_sensor_value0() ouvre, lit et ferme l'attribut sysfs à chaque
+ * mesure. Le lecteur garde les attributs 'value0..valueN' ouverts et les
+ * relit avec pread à la position 0, ce qui réduit chaque mesure à un seul
+ * appel système. Un changement de mode invalide les descripteurs, puisque
+ * le nombre de valeurs et les décimales dépendent du mode. Chaque lecture
+ * est ajoutée aux histogrammes de latence (voir latency.h).
+ */
+
+#ifndef SENSOR_READER_H
+#define SENSOR_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ev3.h>
+#include <ev3_sensor.h>
+
+// Nombre maximal de valeurs d'un capteur (value0 à value7)
+#define SENSOR_READER_VALUES 8
+
+struct sensor_reader {
+  uint8_t sn;
+  // Nombre de valeurs et décimales du mode courant, -1 si inconnus
+  int num_values;
+  int decimals;
+  // Descripteurs des attributs 'valueN', -1 s'ils ne sont pas ouverts
+  int fd[SENSOR_READER_VALUES];
+};
+
+/*
+ * Préparation du lecteur pour le capteur 'sn'. Les attributs sont ouverts
+ * à la première lecture.
+ * Valeurs de retour:
+ * 1, si le nombre de valeurs et les décimales du mode courant ont été lus,
+ * 0, sinon.
+ */
+int sensor_reader_open(struct sensor_reader *r, uint8_t sn);
+void sensor_reader_close(struct sensor_reader *r);
+
+/*
+ * Lecture de la valeur 'inx' sans mise à l'échelle, comme get_sensor_value.
+ * Retourne le nombre d'octets lus, 0 en cas d'erreur.
+ */
+size_t sensor_reader_value(struct sensor_reader *r, uint8_t inx, int *v);
+
+/*
+ * Lecture de value0 mise à l'échelle par les décimales, comme
+ * get_sensor_value0. Retourne le nombre d'octets lus, 0 en cas d'erreur.
+ * Sur la brique, sans unité de calcul flottant, sensor_reader_value_fixed
+ * évite l'émulation logicielle.
+ */
+size_t sensor_reader_value0(struct sensor_reader *r, float *v);
+
+/*
+ * Lecture de value0 en virgule fixe avec 'decimals' décimales: 50.3 cm lus
+ * avec 1 décimale donnent 503, avec 0 décimale 50. Retourne le nombre
+ * d'octets lus, 0 en cas d'erreur.
+ */
+size_t sensor_reader_value_fixed(struct sensor_reader *r, int decimals, int *v);
+
+/*
+ * Passage d'une valeur entière de 'from' à 'to' décimales, arrondie au plus
+ * près. Les décimales sont limitées à SENSOR_FIXED_DECIMALS_MAX.
+ */
+#define SENSOR_FIXED_DECIMALS_MAX 9
+
+static inline int sensor_fixed_rescale(int value, int from, int to) {
+  static const int pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000,
+			       10000000, 100000000, 1000000000 };
+  int d;
+
+  if (from == to)
+    return value;
+  if (to > from) {
+    d = to - from > SENSOR_FIXED_DECIMALS_MAX ? SENSOR_FIXED_DECIMALS_MAX : to - from;
+    return value * pow10[d];
+  }
+  d = from - to > SENSOR_FIXED_DECIMALS_MAX ? SENSOR_FIXED_DECIMALS_MAX : from - to;
+  return value >= 0 ? (value + pow10[d] / 2) / pow10[d] :
+    -((-value + pow10[d] / 2) / pow10[d]);
+}
+
+/*
+ * Changement de mode du capteur avec invalidation des descripteurs.
+ * Retourne le résultat de set_sensor_mode_inx.
+ */
+size_t sensor_reader_set_mode(struct sensor_reader *r, INX_T mode);
+
+/*
+ * Invalidation des descripteurs, à appeler si le mode a été changé sans
+ * passer par sensor_reader_set_mode.
+ */
+void sensor_reader_invalidate(struct sensor_reader *r);
+
+#endif
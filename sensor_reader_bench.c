@@ -0,0 +1,132 @@
+/*
+ * Banc d'essai de la lecture des valeurs d'un capteur.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Compare le nombre de mesures par seconde de get_sensor_value0() et du
+ * lecteur à descripteurs persistants sur le même capteur. Chaque appel à
+ * get_sensor_value0() est instrumenté comme une lecture du lecteur:
+ * histogramme de latence et enregistrement de télémétrie (inactif ici),
+ * pour que l'écart ne mesure que l'accès à sysfs. Les histogrammes des
+ * deux méthodes sont écrits à la fin.
+ *
+ * Matériel demandé:
+ * - 1x EV3 Ultrasonic Sensor, Color Sensor ou Touch Sensor
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <ev3.h>
+#include <ev3_sensor.h>
+
+#include "discovery.h"
+#include "latency.h"
+#include "sensor_reader.h"
+#include "telemetry.h"
+#include "zlog.h"
+
+#define BENCH_SAMPLES 5000
+
+// Variable globale spécifique à zlog
+zlog_category_t *zlog_c;
+
+// Table des périphériques découverts
+struct ev3_device_map devices;
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+  struct sensor_reader reader;
+  double start, sysfs_rate, reader_rate;
+  int i, rc, samples = BENCH_SAMPLES;
+  size_t bytes;
+  uint8_t sn;
+  float value;
+
+  // Variables constantes spécifique à zlog
+  const char *zlog_conf = "/etc/zlog.conf";
+  const char *zlog_cat  = "project";
+
+  if (argc > 1)
+    samples = atoi(argv[1]);
+
+  rc = zlog_init(zlog_conf);
+  if (rc) {
+    printf("L'initialisation de zlog avec '%s' a échoué\n", zlog_conf);
+    return EXIT_FAILURE;
+  }
+
+  zlog_c = zlog_get_category(zlog_cat);
+  if (!zlog_c) {
+    printf("zlog est incapable de retrouver la catégorie '%s'\n", zlog_cat);
+    puts("Impression des messages par zlog est désactivé");
+    zlog_fini();
+  }
+
+  if (discovery_init(&devices, DISCOVERY_SENSORS) != 1) {
+    zlog_fini();
+    return EXIT_FAILURE;
+  }
+
+  // Choix du capteur et d'un mode donnant une valeur qui varie
+  if ((sn = discovery_sensor(&devices, LEGO_EV3_US)) != DESC_LIMIT)
+    set_sensor_mode_inx(sn, LEGO_EV3_US_US_DIST_CM);
+  else if ((sn = discovery_sensor(&devices, LEGO_EV3_COLOR)) != DESC_LIMIT)
+    set_sensor_mode_inx(sn, LEGO_EV3_COLOR_COL_REFLECT);
+  else if ((sn = discovery_sensor(&devices, LEGO_EV3_TOUCH)) == DESC_LIMIT) {
+    zlog_fatal(zlog_c, "Aucun capteur n'a été retrouvé");
+    ev3_uninit();
+    zlog_fini();
+    return EXIT_FAILURE;
+  }
+  zlog_info(zlog_c, "Capteur '%s', %d mesures",
+	    ev3_sensor_type(ev3_sensor[sn].type_inx), samples);
+
+  // Ouverture, lecture et fermeture à chaque mesure
+  start = now();
+  for (i = 0; i < samples; i++) {
+    LATENCY_TIME(bytes, LATENCY_SENSOR, sn, "get_sensor_value0",
+		 get_sensor_value0(sn, &value));
+    if (bytes == 0) {
+      zlog_error(zlog_c, "Echec de get_sensor_value0 à la mesure '%d'", i);
+      break;
+    }
+    telemetry_sensor0(sn, value);
+  }
+  sysfs_rate = i / (now() - start);
+
+  // Descripteurs persistants
+  if (!sensor_reader_open(&reader, sn)) {
+    zlog_error(zlog_c, "Impossible d'ouvrir le lecteur du capteur");
+    ev3_uninit();
+    zlog_fini();
+    return EXIT_FAILURE;
+  }
+  start = now();
+  for (i = 0; i < samples; i++)
+    if (sensor_reader_value0(&reader, &value) == 0) {
+      zlog_error(zlog_c, "Echec de sensor_reader_value0 à la mesure '%d'", i);
+      break;
+    }
+  reader_rate = i / (now() - start);
+  sensor_reader_close(&reader);
+
+  zlog_info(zlog_c, "get_sensor_value0    : %.0f mesures/s", sysfs_rate);
+  zlog_info(zlog_c, "sensor_reader_value0 : %.0f mesures/s (x%.1f)",
+	    reader_rate, reader_rate / sysfs_rate);
+  latency_dump();
+
+  ev3_uninit();
+
+  zlog_fini();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+/*
+ * File circulaire sans verrou à un producteur et un consommateur.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "spsc_ring.h"
+
+int spsc_ring_init(struct spsc_ring *r, size_t capacity, size_t elem_size) {
+  size_t n = 1;
+
+  while (n < capacity)
+    n <<= 1;
+  r->buf = malloc(n * elem_size);
+  if (r->buf == NULL)
+    return 0;
+  r->mask = n - 1;
+  r->elem_size = elem_size;
+  atomic_init(&r->head, 0);
+  atomic_init(&r->tail, 0);
+  atomic_init(&r->drops, 0);
+
+  return 1;
+}
+
+void spsc_ring_destroy(struct spsc_ring *r) {
+  free(r->buf);
+  r->buf = NULL;
+}
+
+int spsc_ring_push(struct spsc_ring *r, const void *elem) {
+  size_t head, tail;
+
+  head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  if (head - tail > r->mask) {
+    atomic_fetch_add_explicit(&r->drops, 1, memory_order_relaxed);
+    return 0;
+  }
+  memcpy(r->buf + (head & r->mask) * r->elem_size, elem, r->elem_size);
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+  return 1;
+}
+
+int spsc_ring_pop(struct spsc_ring *r, void *elem) {
+  return spsc_ring_pop_batch(r, elem, 1) == 1;
+}
+
+size_t spsc_ring_pop_batch(struct spsc_ring *r, void *elems, size_t max) {
+  size_t head, tail, n, i;
+  unsigned char *out = elems;
+
+  tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  head = atomic_load_explicit(&r->head, memory_order_acquire);
+  n = head - tail;
+  if (n > max)
+    n = max;
+  for (i = 0; i < n; i++)
+    memcpy(out + i * r->elem_size,
+	   r->buf + ((tail + i) & r->mask) * r->elem_size, r->elem_size);
+  atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+
+  return n;
+}
+
+size_t spsc_ring_count(struct spsc_ring *r) {
+  return atomic_load_explicit(&r->head, memory_order_acquire) -
+    atomic_load_explicit(&r->tail, memory_order_acquire);
+}
@@ -0,0 +1,60 @@
+/*
+ * File circulaire sans verrou à un producteur et un consommateur.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Les éléments ont une taille fixe et sont copiés dans la file. Seuls les
+ * indices de tête et de queue sont atomiques (32 bits sur la brique, donc
+ * sans verrou même sur l'ARM9). Le producteur ne bloque jamais: si la file
+ * est pleine, l'élément est refusé et compté comme perdu.
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Taille supposée d'une ligne de cache, pour séparer tête et queue
+#define SPSC_RING_CACHE_LINE 64
+
+struct spsc_ring {
+  // Ecrit par le producteur seulement
+  atomic_size_t head;
+  char pad_head[SPSC_RING_CACHE_LINE - sizeof(atomic_size_t)];
+  // Ecrit par le consommateur seulement
+  atomic_size_t tail;
+  char pad_tail[SPSC_RING_CACHE_LINE - sizeof(atomic_size_t)];
+  size_t mask;
+  size_t elem_size;
+  unsigned char *buf;
+  // Eléments refusés car la file était pleine
+  atomic_ulong drops;
+};
+
+/*
+ * Allocation d'une file de 'capacity' éléments de 'elem_size' octets. La
+ * capacité est arrondie à la puissance de deux supérieure.
+ * Retourne 1 en cas de succès, 0 sinon.
+ */
+int spsc_ring_init(struct spsc_ring *r, size_t capacity, size_t elem_size);
+void spsc_ring_destroy(struct spsc_ring *r);
+
+// Côté producteur. Retourne 1 si l'élément a été ajouté, 0 si la file est pleine.
+int spsc_ring_push(struct spsc_ring *r, const void *elem);
+
+// Côté consommateur. Retourne 1 si un élément a été retiré, 0 si la file est vide.
+int spsc_ring_pop(struct spsc_ring *r, void *elem);
+
+// Côté consommateur. Retire au plus 'max' éléments et retourne leur nombre.
+size_t spsc_ring_pop_batch(struct spsc_ring *r, void *elems, size_t max);
+
+// Nombre d'éléments dans la file, approximatif si l'autre côté est actif
+size_t spsc_ring_count(struct spsc_ring *r);
+
+static inline size_t spsc_ring_capacity(const struct spsc_ring *r) {
+  return r->mask + 1;
+}
+
+#endif
@@ -1,156 +1,155 @@
+/*
+ * Arrêt d'urgence des servomoteurs.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Utilisation: stop [coast|brake|hold]
+ *
+ * Une action inconnue est remplacée par l'action par défaut: les
+ * servomoteurs sont tout de même arrêtés, mais le programme échoue.
+ * Les trois servomoteurs sont arrêtés avant toute autre initialisation,
+ * zlog compris, à partir du cache de la découverte. La découverte complète
+ * n'est faite que si le cache est absent ou périmé. Le programme mesure la
+ * durée entre son lancement et l'envoi des commandes, puis jusqu'à l'arrêt
+ * effectif des servomoteurs. Le lancement est la date de création du
+ * processus (/proc/self/stat), à la résolution d'un tic d'horloge, comparée
+ * à CLOCK_BOOTTIME; la durée depuis main est aussi rapportée.
+ *
+ * Matériel demandé:
+ * - 2x EV3 Large Servo Motor / Grand servomoteur EV3
+ * - 1x EV3 Medium Servo Motor / Servomoteur moyen EV3
+ */
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <ev3.h>
-#include <ev3_light.h>
 #include <ev3_port.h>
-#include <ev3_tacho.h>
 
-#define INIT_WAIT 500000
-#define TACHO_MOTORS 3
+#include "fast_stop.h"
+#include "zlog.h"
 
-// Name the tacho motor
-#define TACHO_LEFT 0
-#define TACHO_RIGHT 1
-#define TACHO 2
+#define TACHO_MOTORS 3
+// Attente maximale de l'arrêt effectif
+#define STOP_TIMEOUT_US 2000000L
 
 // Name the sockets according to the sensors name
 #define TACHO_LEFT_PORT OUTPUT_D
 #define TACHO_RIGHT_PORT OUTPUT_A
 #define TACHO_PORT OUTPUT_C
 
-/*
- * Array of sensor sequence numbers.
- */
-uint8_t tacho_sn[TACHO_MOTORS + 1];
+// Variable globale spécifique à zlog
+zlog_category_t *zlog_c;
+
+static long now_us(clockid_t clock) {
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+  return ts.tv_sec * 1000000L + ts.tv_nsec / 1000L;
+}
 
 /*
- * Maximum speed for tacho motor. The maximum speed value gets assigned during
- * initialization. Default is 0.
+ * Date de création du processus en us depuis le démarrage du système, sur
+ * la même base que CLOCK_BOOTTIME. Retourne la date, -1 en cas d'erreur.
  */
-int max_spd = 0;
-
-int init(void) {
-  int i, rc, max_spd_left = 0, max_spd_right = 0;
-  size_t bytes;
-  unsigned char tachos = 0;
-  uint8_t sn;
-
-  for (i = 0; i < TACHO_DESC__LIMIT_; i++)
-    tacho_sn[i] = DESC_LIMIT;
-
-  // Initialisation de la brique intelligente EV3
-  rc = ev3_init();
-  if (rc == 1)
-    zlog_info(zlog_c, "Brique intelligente EV3 trouvée");
-  else {
-    if (rc == 0)
-      zlog_fatal(zlog_c, "Brique intelligente EV3 pas trouvée");
-    else
-      zlog_error(zlog_c, "ev3_init retourne erreur '%d'", rc);
-    return rc;
-  }
-  // Initialisation des ports EV3
-  rc = ev3_port_init();
-  if (rc == -1) {
-    zlog_error(zlog_c, "Erreur durant l'initialisation des ports EV3");
-    ev3_uninit();
-    return rc;
-  } else if (rc != 8)
-    zlog_warn(zlog_c, "'%d/8' ports EV3 retrouvé");
-  else
-    zlog_info(zlog_c, "Tous ports EV3 retrouvé");
-  // Initialisation des servomoteurs
-  rc = ev3_tacho_init();
-  if (rc == -1) {
-    zlog_error(zlog_c, "Erreur durant l'initialisation des servomoteurs EV3");
-    ev3_uninit();
-    return rc;
-  } else
-    zlog_info(zlog_c, "'%d' servomoteurs EV3 retrouvé", rc);
+static long process_start_us(void) {
+  char buf[512], *p;
+  unsigned long long ticks;
+  long hz = sysconf(_SC_CLK_TCK);
+  size_t n;
+  int field;
+  FILE *f = fopen("/proc/self/stat", "r");
+
+  if (f == NULL)
+    return -1;
+  n = fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  buf[n] = '\0';
+  // Le nom du programme peut contenir des espaces, starttime est le 22e champ
+  p = strrchr(buf, ')');
+  if (p == NULL || hz <= 0)
+    return -1;
+  for (field = 2; field < 22 && p != NULL; field++)
+    p = strchr(p + 1, ' ');
+  if (p == NULL || sscanf(p + 1, "%llu", &ticks) != 1)
+    return -1;
+
+  return ticks * 1000000ULL / hz;
+}
+
+int main (int argc, char *argv[]) {
+  static const uint8_t ports[TACHO_MOTORS] = {
+    TACHO_LEFT_PORT, TACHO_RIGHT_PORT, TACHO_PORT
+  };
+  const char *action = argc > 1 ? argv[1] : FAST_STOP_ACTION;
+  struct fast_stop s;
+  long start, launch, sent, stopped;
+  int found, valid, fired = 0, rc = EXIT_SUCCESS;
+
+  // Variables constantes spécifique à zlog
+  const char *zlog_conf = "/etc/zlog.conf";
+  const char *zlog_cat  = "project";
+
   /*
-   * Assurer que les servomoteurs sont mis dans la brique et mettre en
-   * correspondance les numéros de séquence.
+   * Arrêt immédiat; la date de lancement n'est lue dans /proc qu'après
+   * l'envoi des commandes. Les dates sont prises sur CLOCK_BOOTTIME, la base
+   * de la date de création du processus.
    */
-  for (i = 0; i < TACHO_DESC__LIMIT_; i++) {
-    if (ev3_search_tacho_plugged_in(ev3_tacho[i].port, ev3_tacho[i].extport,
-				    &sn, 0)) {
-      if (ev3_tacho[i].type_inx == LEGO_EV3_L_MOTOR) {
-	if (ev3_tacho[i].port == OUTPUT_A) {
-	  tachos |= HAVE_TACHO_LEFT;
-	  TACHO_LEFT_SN = i;
-	  bytes = get_tacho_max_speed(i, &max_spd_left);
-	} else {
-	  tachos |= HAVE_TACHO_RIGHT;
-	  TACHO_RIGHT_SN = i;
-	  bytes = get_tacho_max_speed(i, &max_spd_right);
-	}
-      }
-      if (bytes == 0) {
-	zlog_error(zlog_c, "Impossible de lire la vitesse maximale pour '%s'",
-		   ev3_tacho_type(ev3_tacho[i].type_inx));
-	ev3_uninit();
-	return 0;
-      }
-    } else {
-      zlog_error(zlog_c, "Un des grand servomoteur n'est pas connecté à la brique intelligente EV3");
-      ev3_uninit();
-      return 0;
+  start = now_us(CLOCK_BOOTTIME);
+  valid = fast_stop_action_valid(action);
+  if (!valid)
+    action = FAST_STOP_ACTION;
+  found = fast_stop_open(&s, ports, TACHO_MOTORS, 0);
+  if (s.count > 0)
+    fired = fast_stop_fire(&s, action);
+  sent = now_us(CLOCK_BOOTTIME);
+
+  if (zlog_init(zlog_conf)) {
+    printf("L'initialisation de zlog avec '%s' a échoué\n", zlog_conf);
+  } else {
+    zlog_c = zlog_get_category(zlog_cat);
+    if (!zlog_c) {
+      printf("zlog est incapable de retrouver la catégorie '%s'\n", zlog_cat);
+      puts("Impression des messages par zlog est désactivé");
+      zlog_fini();
     }
   }
-  if (tachos != (HAVE_TACHO_LEFT | HAVE_TACHO_RIGHT)) {
-    zlog_fatal(zlog_c, "Les grand servomoteurs n'ont pas été retrouvé");
-    ev3_uninit();
-    return 0;
+
+  if (!valid) {
+    zlog_error(zlog_c, "Action '%s' inconnue, arrêt '%s' à la place", argv[1],
+	       action);
+    rc = EXIT_FAILURE;
   }
-  /*
-   * Détermination de la vitesse maximale des deux grand servomoteurs. La
-   * vitesse maximale correspond à la plus petite vitesse d'un des deux
-   * servomoteurs.
-   */
-  bytes = multi_set_tacho_command_inx(tacho_sn, TACHO_RESET);
-  if (bytes == 0) {
-    zlog_error(zlog_c, "Impossible d'envoyer la commande 'TACHO_RESET' aux servomoteurs");
-    ev3_uninit();
-    return 0;
+  if (!found || fired < s.count) {
+    zlog_warn(zlog_c, "Cache des servomoteurs absent ou périmé, découverte complète");
+    fast_stop_close(&s);
+    found = fast_stop_open(&s, ports, TACHO_MOTORS, 1);
+    fired = fast_stop_fire(&s, action);
+    sent = now_us(CLOCK_BOOTTIME);
   }
-  max_spd = MIN(max_spd_left, max_spd_right);
-  /*
-   * Indication aux servomoteurs d'interpréter les valeurs positives comme
-   * mouvement en avant.
-   */
-  bytes = multi_set_tacho_polarity_inx(tacho_sn, TACHO_NORMAL);
-  if (bytes == 0) {
-    zlog_error(zlog_c, "Impossible de changer la polarité 'TACHO_NORMAL' pour les servomoteurs");
-    ev3_uninit();
-    return 0;
+  if (!found || fired < TACHO_MOTORS) {
+    zlog_error(zlog_c, "Seulement %d servomoteur(s) sur %d arrêté(s)", fired,
+	       TACHO_MOTORS);
+    rc = EXIT_FAILURE;
   }
-  bytes = multi_set_tacho_duty_cycle_sp(tacho_sn, 0);
-  if (bytes == 0) {
-    zlog_error(zlog_c, "Impossible de changer le rapport cyclique '%d' pour les servomoteurs", 0);
-    ev3_uninit();
-    return 0;
-  }
-
-  return 1;
-}
 
-int main (int argc, char *argv[]) {
-  int condition = 0, color_idx;
-  float color;
-
-  puts("Hello IIUN!");
-
-  if(!init())
-    return EXIT_FAILURE;
+  if (!fast_stop_wait(&s, STOP_TIMEOUT_US))
+    rc = EXIT_FAILURE;
+  stopped = now_us(CLOCK_BOOTTIME);
+  launch = process_start_us();
+  if (launch < 0) {
+    zlog_warn(zlog_c, "Date de lancement illisible, durées mesurées depuis main");
+    launch = start;
+  }
+  zlog_info(zlog_c, "Arrêt '%s' : main après %ld us, commandes envoyées après %ld us, servomoteurs arrêtés après %ld us depuis le lancement",
+	    action, start - launch, sent - launch, stopped - launch);
+  fast_stop_close(&s);
 
-  puts("Arrêter les servomoteurs");
-  // A compléter
-  
-  ev3_uninit();
-    
-  puts("Bye IIUN!");
+  zlog_fini();
 
-  return EXIT_SUCCESS;
+  return rc;
 }
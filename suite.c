@@ -0,0 +1,373 @@
+/*
+ * Suite des tests dans un seul programme.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Utilisation: suite [-l] [-c] [test...]
+ * -l, liste les tests disponibles
+ * -c, relance ensuite les programmes de test séparés et compare leur durée
+ *     totale à celle de la suite
+ *
+ * Les corps des programmes de test (voir suite.h) sont liés dans ce
+ * programme, qui initialise une seule fois zlog, la brique EV3, la
+ * découverte des périphériques, la télémétrie, les histogrammes de latence
+ * et le chien de garde. Sans argument, tous les tests sont lancés; sinon,
+ * seuls les tests nommés, dans l'ordre de la table. Les tests d'un groupe
+ * dont les périphériques n'ont pas été retrouvés sont comptés en échec.
+ * Après un test, le suivant est lancé dès que les périphériques du groupe
+ * sont prêts (voir ready.h) plutôt qu'après une pause fixe; le temps gagné
+ * est rapporté par test et au total.
+ *
+ * Matériel demandé: celui des programmes de test choisis.
+ */
+
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <ev3.h>
+#include <ev3_light.h>
+
+#include "coro.h"
+#include "discovery.h"
+#include "latency.h"
+#include "ready.h"
+#include "suite.h"
+#include "telemetry.h"
+#include "watchdog.h"
+#include "zlog.h"
+
+/*
+ * Pause fixe après un test des servomoteurs, le temps qu'ils s'arrêtent,
+ * remplacée par l'attente de leur arrêt
+ */
+#define SUITE_TACHO_SETTLE_US 1000000
+
+enum suite_group_id {
+  SUITE_COLOR,
+  SUITE_TOUCH,
+  SUITE_ULTRASOUND,
+  SUITE_TACHO,
+  SUITE_PIPELINE,
+  SUITE_GROUPS
+};
+
+struct suite_group {
+  const char *program;
+  unsigned char flags;
+  int (*setup)(struct ev3_device_map *devices);
+  int (*wait)(struct ready_wait *w);
+  void (*teardown)(void);
+  int selected;
+  int ready;
+};
+
+struct suite_test {
+  const char *name;
+  int group;
+  int (*run)(void);
+  // Pause fixe remplacée par l'attente des périphériques, 0 sans attente
+  unsigned int settle_us;
+  // Groupes supplémentaires dont le test a besoin, un bit par groupe
+  unsigned int also;
+  int selected;
+};
+
+// Variable globale spécifique à zlog
+zlog_category_t *zlog_c;
+
+static struct suite_group groups[SUITE_GROUPS] = {
+  [SUITE_COLOR] = { "color_test", DISCOVERY_SENSORS, color_setup,
+		    color_ready, color_teardown },
+  [SUITE_TOUCH] = { "touch_test", DISCOVERY_SENSORS, touch_setup, NULL,
+		    NULL },
+  [SUITE_ULTRASOUND] = { "ultrasound_test", DISCOVERY_SENSORS,
+			 ultrasound_setup, NULL, NULL },
+  [SUITE_TACHO] = { "tacho_test", DISCOVERY_TACHOS, tacho_setup,
+		    tacho_ready, tacho_teardown },
+  [SUITE_PIPELINE] = { "pipeline_test", DISCOVERY_SENSORS | DISCOVERY_TACHOS,
+		       pipeline_setup, NULL, pipeline_teardown },
+};
+
+/*
+ * Test tactile et mesure constante de la distance entrelacés sur un seul
+ * fil par l'ordonnanceur coopératif (voir coro.h). Retourne 1 si les deux
+ * tâches ont réussi, 0 sinon.
+ */
+static int sensor_tasks_test(void) {
+  struct coro_sched s;
+  int touch_rc, continuous_rc;
+
+  coro_sched_init(&s);
+  if (!touch_spawn(&s, &touch_rc) || !continuous_spawn(&s, &continuous_rc))
+    return 0;
+  coro_run(&s);
+  coro_sched_report(&s, "Tâches des capteurs");
+
+  return touch_rc && continuous_rc;
+}
+
+static struct suite_test tests[] = {
+  { "reflected_light_test", SUITE_COLOR, reflected_light_test, 0, 0, 0 },
+  { "ambient_light_test", SUITE_COLOR, ambient_light_test, 0, 0, 0 },
+  { "color_test", SUITE_COLOR, color_test, 0, 0, 0 },
+  { "light_test", SUITE_COLOR, light_test, 0, 0, 0 },
+  { "touch_test", SUITE_TOUCH, touch_test, 0, 0, 0 },
+  { "continuous_test", SUITE_ULTRASOUND, continuous_test, 0, 0, 0 },
+  { "single_test", SUITE_ULTRASOUND, single_test, 0, 0, 0 },
+  { "sensor_tasks_test", SUITE_TOUCH, sensor_tasks_test, 0,
+    1u << SUITE_ULTRASOUND, 0 },
+  { "abs_pos", SUITE_TACHO, abs_pos, SUITE_TACHO_SETTLE_US, 0, 0 },
+  { "rel_pos", SUITE_TACHO, rel_pos, SUITE_TACHO_SETTLE_US, 0, 0 },
+  { "timed_test", SUITE_TACHO, timed_test, SUITE_TACHO_SETTLE_US, 0, 0 },
+  { "ramp_test", SUITE_TACHO, ramp_test, SUITE_TACHO_SETTLE_US, 0, 0 },
+  { "direct_test", SUITE_TACHO, direct_test, SUITE_TACHO_SETTLE_US, 0, 0 },
+  { "sync_test", SUITE_TACHO, sync_test, 0, 0, 0 },
+  { "pipeline_test", SUITE_PIPELINE, pipeline_test, 0, 0, 0 },
+  { "coroutine_test", SUITE_PIPELINE, coroutine_test, 0, 0, 0 },
+};
+
+#define SUITE_TESTS (int) (sizeof(tests) / sizeof(tests[0]))
+
+static long long now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Périphériques du groupe du test et de ses groupes supplémentaires
+ * retrouvés. Retourne 1 s'ils sont tous prêts, 0 sinon.
+ */
+static int test_ready(const struct suite_test *t) {
+  int g;
+
+  if (!groups[t->group].ready)
+    return 0;
+  for (g = 0; g < SUITE_GROUPS; g++)
+    if ((t->also & (1u << g)) && !groups[g].ready)
+      return 0;
+
+  return 1;
+}
+
+/*
+ * Sélection des tests nommés dans 'names'. Tous les tests sont choisis si
+ * 'count' est nul. Retourne 1 si tous les noms sont connus, 0 sinon.
+ */
+static int select_tests(char **names, int count) {
+  int i, j, g, found;
+
+  for (i = 0; i < SUITE_TESTS; i++)
+    tests[i].selected = count == 0;
+  for (j = 0; j < count; j++) {
+    for (i = 0, found = 0; i < SUITE_TESTS; i++)
+      if (strcmp(names[j], tests[i].name) == 0)
+	tests[i].selected = found = 1;
+    if (!found) {
+      fprintf(stderr, "Test inconnu : '%s' (voir suite -l)\n", names[j]);
+      return 0;
+    }
+  }
+  for (i = 0; i < SUITE_TESTS; i++) {
+    if (!tests[i].selected)
+      continue;
+    groups[tests[i].group].selected = 1;
+    for (g = 0; g < SUITE_GROUPS; g++)
+      if (tests[i].also & (1u << g))
+	groups[g].selected = 1;
+  }
+
+  return 1;
+}
+
+/*
+ * Lancement du programme séparé 'program', pris dans le répertoire de la
+ * suite 'dir'. Retourne la durée en ns, -1 en cas d'erreur.
+ */
+static long long run_program(const char *dir, const char *program) {
+  char path[256];
+  long long start = now_ns();
+  pid_t pid;
+  int status;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, program);
+  pid = fork();
+  if (pid < 0)
+    return -1;
+  if (pid == 0) {
+    execl(path, program, (char *) NULL);
+    _exit(127);
+  }
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != EXIT_SUCCESS) {
+    zlog_error(zlog_c, "Le programme '%s' a échoué", path);
+    return -1;
+  }
+
+  return now_ns() - start;
+}
+
+/*
+ * Durée totale des programmes séparés des groupes choisis. Un programme
+ * séparé lance tous ses tests: la comparaison n'est juste que pour des
+ * groupes choisis en entier.
+ */
+static long long run_programs(const char *dir) {
+  long long total = 0, elapsed;
+  int g;
+
+  for (g = 0; g < SUITE_GROUPS; g++) {
+    if (!groups[g].selected)
+      continue;
+    elapsed = run_program(dir, groups[g].program);
+    if (elapsed < 0)
+      return -1;
+    zlog_info(zlog_c, "Programme %-15s : %lld ms", groups[g].program,
+	      elapsed / 1000000);
+    total += elapsed;
+  }
+
+  return total;
+}
+
+int main(int argc, char *argv[]) {
+  static struct ev3_device_map devices;
+  unsigned char flags = 0;
+  long long suite_start, start, elapsed, suite_ns, programs_ns;
+  long long settle_us = 0, saved_us = 0;
+  struct ready_wait w;
+  int i, g, opt, rc, compare = 0, failed = 0, tacho = 0;
+  char path[256], dir[256];
+
+  // Variables constantes spécifique à zlog
+  const char *zlog_conf = "/etc/zlog.conf";
+  const char *zlog_cat  = "project";
+
+  while ((opt = getopt(argc, argv, "lc")) != -1) {
+    switch (opt) {
+    case 'l':
+      for (i = 0; i < SUITE_TESTS; i++)
+	printf("%-20s %s\n", tests[i].name, groups[tests[i].group].program);
+      return EXIT_SUCCESS;
+    case 'c':
+      compare = 1;
+      break;
+    default:
+      fprintf(stderr, "Utilisation: %s [-l] [-c] [test...]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (!select_tests(argv + optind, argc - optind))
+    return EXIT_FAILURE;
+  snprintf(path, sizeof(path), "%s", argv[0]);
+  snprintf(dir, sizeof(dir), "%s", dirname(path));
+
+  suite_start = now_ns();
+  rc = zlog_init(zlog_conf);
+  if (rc) {
+    printf("L'initialisation de zlog avec '%s' a échoué\n", zlog_conf);
+    return EXIT_FAILURE;
+  }
+
+  zlog_c = zlog_get_category(zlog_cat);
+  if (!zlog_c) {
+    printf("zlog est incapable de retrouver la catégorie '%s'\n", zlog_cat);
+    puts("Impression des messages par zlog est désactivé");
+    zlog_fini();
+  }
+
+  zlog_info(zlog_c, "Hello IIUN!");
+
+  latency_start();
+
+  // Une seule découverte pour tous les groupes choisis
+  for (g = 0; g < SUITE_GROUPS; g++)
+    if (groups[g].selected)
+      flags |= groups[g].flags;
+  rc = discovery_init(&devices, flags);
+  if (rc != 1) {
+    zlog_fini();
+    return EXIT_FAILURE;
+  }
+  for (g = 0; g < SUITE_GROUPS; g++)
+    if (groups[g].selected)
+      groups[g].ready = groups[g].setup(&devices);
+  tacho = groups[SUITE_TACHO].ready;
+  telemetry_start_env();
+  // Arrêt des servomoteurs par le démon watchdogd si un test plante
+  if (tacho)
+    watchdog_attach(0);
+
+  // Changer la lumière à rouge
+  set_light(LIT_LEFT, LIT_RED);
+  set_light(LIT_RIGHT, LIT_RED);
+
+  for (i = 0; i < SUITE_TESTS; i++) {
+    if (!tests[i].selected)
+      continue;
+    if (!test_ready(&tests[i])) {
+      zlog_warn(zlog_c, "=== %s : ignoré, périphériques absents ===",
+		tests[i].name);
+      failed++;
+      continue;
+    }
+    zlog_info(zlog_c, "=== %s ===", tests[i].name);
+    start = now_ns();
+    rc = tests[i].run();
+    elapsed = now_ns() - start;
+    if (!rc)
+      failed++;
+    zlog_info(zlog_c, "=== %s : %s en %lld ms ===", tests[i].name,
+	      rc ? "réussi" : "échoué", elapsed / 1000000);
+    if (tests[i].settle_us && groups[tests[i].group].wait != NULL) {
+      if (groups[tests[i].group].wait(&w) < 0)
+	zlog_warn(zlog_c, "Impossible de lire l'état des périphériques de '%s'",
+		  groups[tests[i].group].program);
+      saved_us += ready_report(&w, tests[i].name, tests[i].settle_us);
+      settle_us += tests[i].settle_us;
+    } else if (tests[i].settle_us)
+      usleep(tests[i].settle_us);
+  }
+  if (settle_us > 0)
+    zlog_info(zlog_c, "Attentes : %lld ms au lieu de %lld ms de pauses fixes, %lld ms gagnées",
+	      (settle_us - saved_us) / 1000, settle_us / 1000, saved_us / 1000);
+
+  // Changer la lumière à vert
+  set_light(LIT_LEFT, LIT_GREEN);
+  set_light(LIT_RIGHT, LIT_GREEN);
+
+  for (g = 0; g < SUITE_GROUPS; g++)
+    if (groups[g].ready && groups[g].teardown != NULL)
+      groups[g].teardown();
+
+  if (tacho)
+    watchdog_detach();
+  latency_stop();
+  telemetry_stop();
+  ev3_uninit();
+  suite_ns = now_ns() - suite_start;
+  zlog_info(zlog_c, "Suite : %d échec(s), durée totale %lld ms", failed,
+	    suite_ns / 1000000);
+
+  if (compare) {
+    programs_ns = run_programs(dir);
+    if (programs_ns > 0)
+      zlog_info(zlog_c, "Suite %lld ms, programmes séparés %lld ms, gain %lld ms (%.1f%%)",
+		suite_ns / 1000000, programs_ns / 1000000,
+		(programs_ns - suite_ns) / 1000000,
+		100.0 * (programs_ns - suite_ns) / programs_ns);
+  }
+
+  zlog_info(zlog_c, "Bye IIUN!");
+
+  zlog_fini();
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,69 @@
+/*
+ * Corps des programmes de test, partagés entre les programmes séparés et le
+ * programme 'suite'.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Chaque programme de test compilé avec EV3_SUITE (objets %_suite.o) ne
+ * définit ni main, ni init, ni la catégorie zlog. La découverte des
+ * périphériques est faite une seule fois par le programme 'suite', puis
+ * chaque *_setup retrouve ses périphériques dans la table commune.
+ * Les *_setup retournent 1 si les périphériques sont prêts, 0 sinon. Les
+ * tests retournent 1 en cas de succès, 0 sinon. Les *_ready attendent
+ * que les périphériques soient prêts pour le test suivant (voir ready.h).
+ * Les macros de traitement d'erreur des tests retournent un échec sans
+ * appeler ev3_uninit: seul main libère la brique, une fois tous les tests
+ * passés, pour qu'un test en échec n'empêche pas les suivants.
+ * Les *_spawn ajoutent le corps d'un test comme tâche coopérative à un
+ * ordonnanceur (voir coro.h) pour l'entrelacer avec d'autres; le résultat
+ * du test est écrit dans 'rc' à la fin de la tâche. Ils retournent 1 si la
+ * tâche a été ajoutée, 0 sinon.
+ */
+
+#ifndef SUITE_H
+#define SUITE_H
+
+#include "discovery.h"
+#include "ready.h"
+
+struct coro_sched;
+
+// color_test.c
+int color_setup(struct ev3_device_map *devices);
+int color_ready(struct ready_wait *w);
+void color_teardown(void);
+int reflected_light_test(void);
+int ambient_light_test(void);
+int color_test(void);
+int light_test(void);
+
+// touch_test.c
+int touch_setup(struct ev3_device_map *devices);
+int touch_test(void);
+int touch_spawn(struct coro_sched *s, int *rc);
+
+// ultrasound_test.c
+int ultrasound_setup(struct ev3_device_map *devices);
+int continuous_test(void);
+int continuous_spawn(struct coro_sched *s, int *rc);
+int single_test(void);
+
+// tacho_test.c
+int tacho_setup(struct ev3_device_map *devices);
+int tacho_ready(struct ready_wait *w);
+void tacho_teardown(void);
+int abs_pos(void);
+int rel_pos(void);
+int timed_test(void);
+int ramp_test(void);
+int direct_test(void);
+int sync_test(void);
+
+// pipeline_test.c
+int pipeline_setup(struct ev3_device_map *devices);
+void pipeline_teardown(void);
+int pipeline_test(void);
+int coroutine_test(void);
+
+#endif
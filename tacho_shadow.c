@@ -0,0 +1,182 @@
+/*
+ * Copie des attributs inscriptibles des servomoteurs (registres fantômes).
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <ev3.h>
+#include <ev3_tacho.h>
+
+#include "latency.h"
+#include "tacho_shadow.h"
+#include "zlog.h"
+
+#define BIT(attr) (1u << (attr))
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+static size_t set_stop_action(uint8_t sn, int value) {
+  return set_tacho_stop_action_inx(sn, value);
+}
+
+static size_t set_polarity(uint8_t sn, int value) {
+  return set_tacho_polarity_inx(sn, value);
+}
+
+static const struct {
+  const char *name;
+  size_t (*set)(uint8_t sn, int value);
+} attrs[TACHO_SHADOW_ATTRS] = {
+  [TACHO_SHADOW_DUTY_CYCLE_SP] = { "duty_cycle_sp", set_tacho_duty_cycle_sp },
+  [TACHO_SHADOW_SPEED_SP] = { "speed_sp", set_tacho_speed_sp },
+  [TACHO_SHADOW_POSITION_SP] = { "position_sp", set_tacho_position_sp },
+  [TACHO_SHADOW_TIME_SP] = { "time_sp", set_tacho_time_sp },
+  [TACHO_SHADOW_RAMP_UP_SP] = { "ramp_up_sp", set_tacho_ramp_up_sp },
+  [TACHO_SHADOW_RAMP_DOWN_SP] = { "ramp_down_sp", set_tacho_ramp_down_sp },
+  [TACHO_SHADOW_STOP_ACTION] = { "stop_action", set_stop_action },
+  [TACHO_SHADOW_POLARITY] = { "polarity", set_polarity },
+};
+
+static struct {
+  // Valeurs connues et consignes marquées, par numéro de séquence
+  int value[DESC_LIMIT][TACHO_SHADOW_ATTRS];
+  int staged[DESC_LIMIT][TACHO_SHADOW_ATTRS];
+  unsigned int known[DESC_LIMIT];
+  unsigned int dirty[DESC_LIMIT];
+  // Statistiques
+  unsigned long issued[TACHO_SHADOW_ATTRS];
+  unsigned long suppressed[TACHO_SHADOW_ATTRS];
+  unsigned long failed[TACHO_SHADOW_ATTRS];
+  unsigned long flushes;
+  unsigned long commands;
+} shadow;
+
+// Ecriture dans sysfs et mise à jour de la copie
+static int write_attr(uint8_t sn, int attr, int value) {
+  size_t bytes;
+
+  LATENCY_TIME(bytes, LATENCY_TACHO, sn, attrs[attr].name,
+	       attrs[attr].set(sn, value));
+  if (bytes == 0) {
+    // Valeur du pilote inconnue après un échec
+    shadow.known[sn] &= ~BIT(attr);
+    shadow.failed[attr]++;
+    return 0;
+  }
+  shadow.value[sn][attr] = value;
+  shadow.known[sn] |= BIT(attr);
+  shadow.issued[attr]++;
+
+  return 1;
+}
+
+static int same(uint8_t sn, int attr, int value) {
+  return (shadow.known[sn] & BIT(attr)) && shadow.value[sn][attr] == value;
+}
+
+int tacho_shadow_set(uint8_t sn, int attr, int value) {
+  if (sn >= DESC_LIMIT || attr < 0 || attr >= TACHO_SHADOW_ATTRS)
+    return 0;
+  shadow.dirty[sn] &= ~BIT(attr);
+  if (same(sn, attr, value)) {
+    shadow.suppressed[attr]++;
+    return 1;
+  }
+
+  return write_attr(sn, attr, value);
+}
+
+int tacho_shadow_multi_set(const uint8_t *sn, int attr, int value) {
+  int ok = 1;
+
+  for (; *sn < DESC_LIMIT; sn++)
+    if (!tacho_shadow_set(*sn, attr, value))
+      ok = 0;
+
+  return ok;
+}
+
+void tacho_shadow_stage(uint8_t sn, int attr, int value) {
+  if (sn >= DESC_LIMIT || attr < 0 || attr >= TACHO_SHADOW_ATTRS)
+    return;
+  // Seule la dernière consigne de la période compte
+  if (shadow.dirty[sn] & BIT(attr))
+    shadow.suppressed[attr]++;
+  shadow.staged[sn][attr] = value;
+  shadow.dirty[sn] |= BIT(attr);
+}
+
+int tacho_shadow_flush(void) {
+  unsigned int dirty;
+  int sn, attr, ok = 1;
+
+  shadow.flushes++;
+  for (sn = 0; sn < DESC_LIMIT; sn++) {
+    dirty = shadow.dirty[sn];
+    if (dirty == 0)
+      continue;
+    shadow.dirty[sn] = 0;
+    for (attr = 0; attr < TACHO_SHADOW_ATTRS; attr++) {
+      if (!(dirty & BIT(attr)))
+	continue;
+      if (same(sn, attr, shadow.staged[sn][attr]))
+	shadow.suppressed[attr]++;
+      else if (!write_attr(sn, attr, shadow.staged[sn][attr]))
+	ok = 0;
+    }
+  }
+
+  return ok;
+}
+
+size_t tacho_shadow_command(const uint8_t *sn, uint8_t command) {
+  const uint8_t *s;
+  size_t bytes;
+
+  if (command == TACHO_RESET) {
+    // Consignes d'avant la remise à zéro abandonnées
+    for (s = sn; *s < DESC_LIMIT; s++)
+      shadow.dirty[*s] = 0;
+  } else
+    tacho_shadow_flush();
+  LATENCY_TIME(bytes, LATENCY_TACHOS, sn[0], "command",
+	       multi_set_tacho_command_inx((uint8_t *) sn, command));
+  shadow.commands++;
+  /*
+   * Après une remise à zéro, même en échec partiel, les valeurs du pilote
+   * ne sont plus connues.
+   */
+  if (command == TACHO_RESET)
+    for (s = sn; *s < DESC_LIMIT; s++)
+      tacho_shadow_invalidate(*s);
+
+  return bytes;
+}
+
+void tacho_shadow_invalidate(uint8_t sn) {
+  if (sn >= DESC_LIMIT)
+    return;
+  shadow.known[sn] = 0;
+  shadow.dirty[sn] = 0;
+}
+
+void tacho_shadow_report(void) {
+  unsigned long issued = 0, suppressed = 0;
+  int attr;
+
+  for (attr = 0; attr < TACHO_SHADOW_ATTRS; attr++) {
+    if (shadow.issued[attr] + shadow.suppressed[attr] == 0)
+      continue;
+    zlog_info(zlog_c, "Consigne %-13s : %lu écriture(s), %lu supprimée(s), %lu échec(s)",
+	      attrs[attr].name, shadow.issued[attr], shadow.suppressed[attr],
+	      shadow.failed[attr]);
+    issued += shadow.issued[attr];
+    suppressed += shadow.suppressed[attr];
+  }
+  zlog_info(zlog_c, "Consignes des servomoteurs : %lu écriture(s), %lu supprimée(s) (%.1f %%), %lu lot(s), %lu commande(s)",
+	    issued, suppressed,
+	    issued + suppressed > 0 ? suppressed * 100.0 / (issued + suppressed) : 0.0,
+	    shadow.flushes, shadow.commands);
+}
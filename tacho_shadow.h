@@ -0,0 +1,81 @@
+/*
+ * Copie des attributs inscriptibles des servomoteurs (registres fantômes).
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Chaque attribut de consigne écrit par le programme est gardé en mémoire.
+ * Une écriture de la valeur déjà connue de l'attribut n'atteint pas sysfs;
+ * les autres sont écrites immédiatement (tacho_shadow_set) ou marquées à
+ * écrire (tacho_shadow_stage) puis écrites ensemble une fois par période
+ * de la boucle de commande (tacho_shadow_flush). Seule la dernière valeur
+ * marquée d'un attribut est écrite, et pas du tout si elle est revenue à
+ * la valeur connue.
+ *
+ * Les commandes ne sont jamais supprimées. Elles écrivent d'abord les
+ * consignes marquées, pour qu'une consigne marquée avant une commande la
+ * précède dans sysfs. TACHO_RESET remet les attributs du servomoteur aux
+ * valeurs du pilote: leurs copies sont oubliées, et les consignes marquées
+ * avant la commande sont abandonnées. Les attributs écrits par un autre
+ * processus (stop, watchdogd) ne sont pas vus: tacho_shadow_invalidate
+ * doit être appelé si cela se produit en cours de programme.
+ *
+ * Les compteurs d'écritures émises et supprimées par attribut sont écrits
+ * par tacho_shadow_report. Les copies ne sont pas protégées: un seul fil
+ * doit écrire les consignes des servomoteurs.
+ */
+
+#ifndef TACHO_SHADOW_H
+#define TACHO_SHADOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Attributs inscriptibles copiés
+enum {
+  TACHO_SHADOW_DUTY_CYCLE_SP,
+  TACHO_SHADOW_SPEED_SP,
+  TACHO_SHADOW_POSITION_SP,
+  TACHO_SHADOW_TIME_SP,
+  TACHO_SHADOW_RAMP_UP_SP,
+  TACHO_SHADOW_RAMP_DOWN_SP,
+  TACHO_SHADOW_STOP_ACTION,
+  TACHO_SHADOW_POLARITY,
+  TACHO_SHADOW_ATTRS
+};
+
+/*
+ * Ecriture immédiate de 'value' dans l'attribut 'attr' du servomoteur 'sn',
+ * sauf si c'est déjà sa valeur. Les consignes marquées du même attribut
+ * sont remplacées.
+ * Retourne 1 en cas de succès (écriture supprimée comprise), 0 sinon.
+ */
+int tacho_shadow_set(uint8_t sn, int attr, int value);
+
+// Même écriture pour les servomoteurs 'sn', terminés par DESC_LIMIT
+int tacho_shadow_multi_set(const uint8_t *sn, int attr, int value);
+
+// Marquage de 'value' pour la prochaine tacho_shadow_flush
+void tacho_shadow_stage(uint8_t sn, int attr, int value);
+
+/*
+ * Ecriture de toutes les consignes marquées différentes des valeurs connues.
+ * Retourne 1 en cas de succès, 0 si une écriture a échoué; les consignes
+ * en échec sont oubliées.
+ */
+int tacho_shadow_flush(void);
+
+/*
+ * Commande 'command' aux servomoteurs 'sn', après les consignes marquées.
+ * Retourne le nombre d'octets écrits comme multi_set_tacho_command_inx,
+ * 0 en cas d'erreur.
+ */
+size_t tacho_shadow_command(const uint8_t *sn, uint8_t command);
+
+// Oubli des valeurs connues et des consignes marquées du servomoteur 'sn'
+void tacho_shadow_invalidate(uint8_t sn);
+
+// Impression des écritures émises et supprimées par attribut avec zlog
+void tacho_shadow_report(void);
+
+#endif
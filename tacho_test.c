@@ -4,12 +4,22 @@
  * Auteur: Dorian Burihabwa
  * Auteur: Christian Göttel
  *
+ * 'tacho_test characterise' relève la caractéristique rapport cyclique /
+ * vitesse des deux servomoteurs avant les tests, roues en l'air, et
+ * l'enregistre (voir motor_map.h). Les tests suivants chargent la
+ * caractéristique enregistrée au démarrage.
+ *
+ * Les boucles de commande journalisent par alog (voir alog.h): chaque test
+ * qui en contient démarre le journal asynchrone avant sa boucle, et avant
+ * de passer au temps réel pour que le fil de vidage n'en hérite pas.
+ *
  * Matériel demandé:
  * - 2x EV3 Large Servo Motor / Grand servomoteur EV3
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <ev3.h>
@@ -17,222 +27,247 @@
 #include <ev3_port.h>
 #include <ev3_tacho.h>
 
+#include "alog.h"
+#include "discovery.h"
+#include "drive_sync.h"
+#include "latency.h"
+#include "motion.h"
+#include "motor_map.h"
+#include "odometry.h"
+#include "periodic.h"
+#include "ready.h"
+#include "suite.h"
+#include "tacho_shadow.h"
+#include "telemetry.h"
+#include "watchdog.h"
 #include "zlog.h"
 
-#define GET_TACHO_POSITION(sn,v) do {					\
-    _bytes = get_tacho_position((sn), (v));				\
-    if (_bytes == 0) {							\
-      zlog_error(zlog_project,						\
-		 "Impossible de récupérer la position absolue du servomoteur '%d'", \
-		 (sn));							\
-      ev3_uninit();							\
-      return 1;								\
-    }									\
-  } while(0);
-
 #define GET_TACHO_POSITION_SP(sn,v) do {				\
-    _bytes = get_tacho_position_sp((sn), (v));				\
+    LATENCY_TIME(_bytes, LATENCY_TACHO, (sn), "position_sp",		\
+		 get_tacho_position_sp((sn), (v)));			\
     if (_bytes == 0) {							\
-      zlog_error(zlog_project,						\
+      zlog_error(zlog_c,						\
 		 "Impossible de récupérer la position relative du servomoteur '%d'", \
 		 (sn));							\
-      ev3_uninit();							\
-      return 1;								\
-    }									\
-  } while(0);
-
-#define GET_TACHO_STATE_FALGS(sn,f) do {					\
-    _bytes = get_tacho_state_flags((sn), (f));				\
-    if (_bytes == 0) {							\
-      zlog_error(zlog_project,						\
-		 "Impossible de récupérer les drapeaux des servomoteurs"); \
-      ev3_uninit();							\
-      return 1;								\
+      return 0;								\
     }									\
   } while(0);
 
 #define MULTI_SET_TACHO_COMMAND_INX(sn,c) do {				\
-    _bytes = multi_set_tacho_command_inx((sn), (c));			\
+    _bytes = tacho_shadow_command((sn), (c));				\
     if (_bytes == 0) {							\
-      zlog_error(zlog_project,						\
+      zlog_error(zlog_c,						\
 		 "Impossible d'envoyer la commande '%d' aux servomoteurs", \
 		 (c));							\
-      ev3_uninit();							\
       return 0;								\
     }									\
   } while(0);
 
 #define MULTI_SET_TACHO_DUTY_CYCLE_SP(sn,v) do {			\
-    _bytes = multi_set_tacho_duty_cycle_sp((sn), (v));			\
+    _bytes = tacho_shadow_multi_set((sn), TACHO_SHADOW_DUTY_CYCLE_SP, (v)); \
     if (_bytes == 0) {							\
-      zlog_warn(zlog_project,							\
+      zlog_warn(zlog_c,							\
 		"Impossible de changer le rapport cyclique à '%d' pour le grand servomoteurs", \
 		(v));							\
     }									\
   } while(0);
 
 #define MULTI_SET_TACHO_POSITION_SP(sn,v) do {				\
-    _bytes = multi_set_tacho_position_sp((sn), (v));			\
+    _bytes = tacho_shadow_multi_set((sn), TACHO_SHADOW_POSITION_SP, (v)); \
     if (_bytes == 0) {							\
-      zlog_error(zlog_project,						\
+      zlog_error(zlog_c,						\
 		 "Impossible d'assigner la position relative du servomoteur '%d'", \
 		 (sn));							\
-      ev3_uninit();							\
-      return 1;								\
+      return 0;								\
     }									\
   } while(0);
 
 #define MULTI_SET_TACHO_RAMP_DOWN_SP(sn,v) do {				\
-    _bytes = multi_set_tacho_ramp_down_sp((sn), (v));				\
+    _bytes = tacho_shadow_multi_set((sn), TACHO_SHADOW_RAMP_DOWN_SP, (v)); \
     if (_bytes == 0) {							\
-      zlog_error(zlog_project,						\
+      zlog_error(zlog_c,						\
 		 "Impossible de changer le temps d'accélération '%d' pour les servomoteurs", \
 		 (v));							\
-      ev3_uninit();							\
       return 0;								\
     }									\
   } while(0);
 
-#define MULTI_SET_TACHO_RAMP_UP_SP(sn,v) do {					\
-    _bytes = multi_set_tacho_ramp_up_sp((sn), (v));				\
+#define MULTI_SET_TACHO_RAMP_UP_SP(sn,v) do {				\
+    _bytes = tacho_shadow_multi_set((sn), TACHO_SHADOW_RAMP_UP_SP, (v)); \
     if (_bytes == 0) {							\
-      zlog_error(zlog_project,						\
+      zlog_error(zlog_c,						\
 		 "Impossible de changer le temps d'accélération '%d' pour les servomoteurs", \
 		 (v));							\
-      ev3_uninit();							\
       return 0;								\
     }									\
   } while(0);
 
+#define SET_TACHO_DUTY_CYCLE_SP(sn,v) do {				\
+    _bytes = tacho_shadow_set((sn), TACHO_SHADOW_DUTY_CYCLE_SP, (v));	\
+    if (_bytes == 0) {							\
+      zlog_warn(zlog_c,							\
+		"Impossible de changer le rapport cyclique à '%d' pour le servomoteur '%d'", \
+		(v), (sn));						\
+    }									\
+  } while(0);
+
 #define MULTI_SET_TACHO_SPEED_SP(sn,v) do {				\
-    _bytes = multi_set_tacho_speed_sp((sn), (v));			\
+    _bytes = tacho_shadow_multi_set((sn), TACHO_SHADOW_SPEED_SP, (v));	\
     if (_bytes == 0) {							\
-      zlog_warn(zlog_project,							\
+      zlog_warn(zlog_c,							\
 		"Impossible de changer la vitesse à '%d' pour les servomoteurs", \
 		(v));							\
-      ev3_uninit();							\
       return 0;								\
     }									\
   } while(0);
 
 #define MULTI_SET_TACHO_STOP_ACTION_INX(sn,v) do {			\
-    _bytes = multi_set_tacho_stop_action_inx((sn), (v));		\
+    _bytes = tacho_shadow_multi_set((sn), TACHO_SHADOW_STOP_ACTION, (v)); \
     if (_bytes == 0) {							\
-      zlog_warn(zlog_project,							\
+      zlog_warn(zlog_c,							\
 		"Impossible d'assigner l'action '%d' aux servomoteurs",	\
 		(v));							\
-      ev3_uninit();							\
       return 0;								\
     }									\
   } while(0);
 
 #define MULTI_SET_TACHO_TIME_SP(sn,v) do {				\
-    _bytes = multi_set_tacho_time_sp(tacho_sn, 400);			\
+    _bytes = tacho_shadow_multi_set((sn), TACHO_SHADOW_TIME_SP, (v));	\
     if (_bytes == 0) {							\
-      zlog_error(zlog_project,						\
+      zlog_error(zlog_c,						\
 		 "Impossible d'assigner la durée '%d ms' aux servomoteurs", \
 		 (v));							\
-      ev3_uninit();							\
       return 0;								\
     }									\
   } while(0);
 
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+/*
+ * Paramètres du test constamment: période de la boucle (entre 5 et 10 ms),
+ * durée, rapport cyclique maximal et priorité SCHED_FIFO.
+ */
+#define DIRECT_PERIOD_NS 10000000L
+#define DIRECT_DURATION_MS 4000
+#define DIRECT_DUTY_MAX 60
+#define DIRECT_PRIORITY 50
+// Echéance du chien de garde pendant les boucles de commande
+#define DIRECT_WATCHDOG_MS 100
+
+/*
+ * Paramètres du test d'accélération: déplacement en impulsions, limites du
+ * profil et fenêtre d'observation de chaque déplacement.
+ */
+#define RAMP_DISTANCE 720
+#define RAMP_VMAX 600
+#define RAMP_AMAX 2400
+#define RAMP_JMAX 24000
+#define RAMP_OBSERVE_MS 2500
+// Vitesse de rattrapage de la cible par le micrologiciel après un profil
+#define RAMP_HOLD_SPEED 200
+
+/*
+ * Paramètres de la caractérisation: durée d'établissement de la vitesse
+ * après chaque pas de rapport cyclique, fenêtre de mesure de la vitesse et
+ * échéance du chien de garde.
+ */
+#define CHARACTERISE_SETTLE_MS 300
+#define CHARACTERISE_WINDOW_MS 200
+#define CHARACTERISE_WATCHDOG_MS 1000
+
+/*
+ * Délai maximal d'arrêt des servomoteurs entre deux tests, et pause fixe
+ * qu'il remplace.
+ */
+#define TACHO_READY_TIMEOUT_MS 2000
+#define TACHO_PHASE_US 1000000
+
+// Paramètres du test synchronisé
+#define SYNC_DURATION_MS 3000
+#define SYNC_DUTY 50
 
 // Numéro de séquence des servomoteurs
 #define TACHO_LEFT_SN tacho_sn[0]
 #define TACHO_RIGHT_SN tacho_sn[1]
 
-// Drapeau pour verifier la présence des capteurs
-#define HAVE_TACHO_LEFT 0b1
-#define HAVE_TACHO_RIGHT 0b10
-
+#ifdef EV3_SUITE
+// Catégorie zlog définie par le programme (voir suite.c)
+extern zlog_category_t *zlog_c;
+#else
 // Variable globale spécifique à zlog
 zlog_category_t *zlog_c;
+#endif
 
 // Tableau pour les numéros de séquence des capteurs
-uint8_t tacho_sn[TACHO_DESC__LIMIT_];
+static uint8_t tacho_sn[TACHO_DESC__LIMIT_];
 
 // Variable globale pour les macros
-size_t _bytes;
+static size_t _bytes;
 
 /*
  * Vitesse maximale de servomoteurs. La vitesse maximale est assigné durant
- * l'initialisation. La valeur standard est 0.
+ * l'initialisation. La valeur standard est 0. Elle ne sert plus qu'aux
+ * rampes du micrologiciel; l'anticipation en run-direct passe par les
+ * caractéristiques des servomoteurs.
+ */
+static int max_spd = 0;
+
+/*
+ * Ports et caractéristiques des servomoteurs gauche et droit, pour
+ * l'anticipation en run-direct.
  */
-int max_spd = 0;
+static uint8_t tacho_port[2];
+static struct motor_curve tacho_curve[2];
+
+// Impression de la caractéristique du servomoteur 'k' par zlog
+static void curve_report(int k) {
+  zlog_info(zlog_c, "Servomoteur %s : zone morte %d/%d %%, vitesse maximale %d/%d",
+	    k == 0 ? "gauche" : "droit", tacho_curve[k].deadband[0],
+	    tacho_curve[k].deadband[1], tacho_curve[k].max_speed[0],
+	    tacho_curve[k].max_speed[1]);
+}
 
-int init(void) {
-  int i, rc, max_spd_left = 0, max_spd_right = 0;
+/*
+ * Mise en correspondance et préparation des grands servomoteurs de la table
+ * 'devices'. Retourne 1 si les servomoteurs sont prêts, 0 sinon.
+ */
+int tacho_setup(struct ev3_device_map *devices) {
+  static struct motor_map map;
+  const struct motor_curve *curve;
+  int i, max_spd_left = 0, max_spd_right = 0;
   size_t bytes;
-  unsigned char tachos = 0;
-  uint8_t sn;
-
-  for (i = 0; i < TACHO_DESC__LIMIT_; i++)
-    tacho_sn[i] = DESC_LIMIT;
-
-  // Initialisation de la brique intelligente EV3
-  rc = ev3_init();
-  if (rc == 1)
-    zlog_info(zlog_c, "Brique intelligente EV3 trouvée");
-  else {
-    if (rc == 0)
-      zlog_fatal(zlog_c, "Brique intelligente EV3 pas trouvée");
-    else
-      zlog_error(zlog_c, "ev3_init retourne erreur '%d'", rc);
-    return rc;
-  }
-  // Initialisation des ports EV3
-  rc = ev3_port_init();
-  if (rc == -1) {
-    zlog_error(zlog_c, "Erreur durant l'initialisation des ports EV3");
-    ev3_uninit();
-    return rc;
-  } else if (rc != 8)
-    zlog_warn(zlog_c, "'%d/8' ports EV3 retrouvé");
-  else
-    zlog_info(zlog_c, "Tous ports EV3 retrouvé");
-  // Initialisation des servomoteurs
-  rc = ev3_tacho_init();
-  if (rc == -1) {
-    zlog_error(zlog_c, "Erreur durant l'initialisation des servomoteurs EV3");
-    ev3_uninit();
-    return rc;
-  } else
-    zlog_info(zlog_c, "'%d' servomoteurs EV3 retrouvé", rc);
+
   /*
    * Assurer que les servomoteurs sont mis dans la brique et mettre en
-   * correspondance les numéros de séquence.
+   * correspondance les numéros de séquence. Le servomoteur gauche est branché
+   * sur le port A, le droit est l'autre grand servomoteur. Une table lue du
+   * cache est rafraîchie si un servomoteur manque.
    */
-  for (i = 0; i < TACHO_DESC__LIMIT_; i++) {
-    if (ev3_search_tacho_plugged_in(ev3_tacho[i].port, ev3_tacho[i].extport,
-				    &sn, 0)) {
-      if (ev3_tacho[i].type_inx == LEGO_EV3_L_MOTOR) {
-	if (ev3_tacho[i].port == OUTPUT_A) {
-	  tachos |= HAVE_TACHO_LEFT;
-	  TACHO_LEFT_SN = i;
-	  bytes = get_tacho_max_speed(i, &max_spd_left);
-	} else {
-	  tachos |= HAVE_TACHO_RIGHT;
-	  TACHO_RIGHT_SN = i;
-	  bytes = get_tacho_max_speed(i, &max_spd_right);
-	}
+  do {
+    for (i = 0; i < TACHO_DESC__LIMIT_; i++)
+      tacho_sn[i] = DESC_LIMIT;
+    for (i = 0; i < devices->tacho_count; i++) {
+      if (devices->tacho[i].type_inx != LEGO_EV3_L_MOTOR)
+	continue;
+      if (devices->tacho[i].port == OUTPUT_A) {
+	TACHO_LEFT_SN = devices->tacho[i].sn;
+	tacho_port[0] = devices->tacho[i].port;
+      } else if (TACHO_RIGHT_SN == DESC_LIMIT) {
+	TACHO_RIGHT_SN = devices->tacho[i].sn;
+	tacho_port[1] = devices->tacho[i].port;
       }
-      if (bytes == 0) {
-	zlog_error(zlog_c, "Impossible de lire la vitesse maximale pour '%s'",
-		   ev3_tacho_type(ev3_tacho[i].type_inx));
-	ev3_uninit();
-	return 0;
-      }
-    } else {
-      zlog_error(zlog_c, "Un des grand servomoteur n'est pas connecté à la brique intelligente EV3");
-      ev3_uninit();
-      return 0;
     }
-  }
-  if (tachos != (HAVE_TACHO_LEFT | HAVE_TACHO_RIGHT)) {
+  } while ((TACHO_LEFT_SN == DESC_LIMIT || TACHO_RIGHT_SN == DESC_LIMIT) &&
+	   discovery_refresh(devices) == 1);
+  if (TACHO_LEFT_SN == DESC_LIMIT || TACHO_RIGHT_SN == DESC_LIMIT) {
     zlog_fatal(zlog_c, "Les grand servomoteurs n'ont pas été retrouvé");
-    ev3_uninit();
+    return 0;
+  }
+  if (get_tacho_max_speed(TACHO_LEFT_SN, &max_spd_left) == 0 ||
+      get_tacho_max_speed(TACHO_RIGHT_SN, &max_spd_right) == 0) {
+    zlog_error(zlog_c, "Impossible de lire la vitesse maximale pour '%s'",
+	       ev3_tacho_type(LEGO_EV3_L_MOTOR));
     return 0;
   }
   /*
@@ -240,54 +275,494 @@ int init(void) {
    * vitesse maximale correspond à la plus petite vitesse d'un des deux
    * servomoteurs.
    */
-  bytes = multi_set_tacho_command_inx(tacho_sn, TACHO_RESET);
+  bytes = tacho_shadow_command(tacho_sn, TACHO_RESET);
   if (bytes == 0) {
     zlog_error(zlog_c, "Impossible d'envoyer la commande 'TACHO_RESET' aux servomoteurs");
-    ev3_uninit();
     return 0;
   }
   max_spd = MIN(max_spd_left, max_spd_right);
+  /*
+   * Caractéristiques enregistrées par 'tacho_test characterise', sans
+   * nouvelle mesure; à défaut, courbes linéaires jusqu'à max_speed.
+   */
+  map.count = 0;
+  if (!motor_map_load(&map, NULL))
+    zlog_warn(zlog_c, "Pas de caractéristique des servomoteurs, lancer 'tacho_test characterise'");
+  for (i = 0; i < 2; i++) {
+    curve = motor_map_find(&map, tacho_port[i]);
+    if (curve != NULL)
+      tacho_curve[i] = *curve;
+    else
+      motor_curve_linear(&tacho_curve[i], tacho_port[i],
+			 i == 0 ? max_spd_left : max_spd_right);
+    curve_report(i);
+  }
   /*
    * Indication aux servomoteurs d'interpréter les valeurs positives comme
    * mouvement en avant.
    */
-  bytes = multi_set_tacho_polarity_inx(tacho_sn, TACHO_NORMAL);
-  if (bytes == 0) {
+  if (!tacho_shadow_multi_set(tacho_sn, TACHO_SHADOW_POLARITY, TACHO_NORMAL)) {
     zlog_error(zlog_c, "Impossible de changer la polarité 'TACHO_NORMAL' pour les servomoteurs");
-    ev3_uninit();
     return 0;
   }
-  bytes = multi_set_tacho_duty_cycle_sp(tacho_sn, 0);
-  if (bytes == 0) {
+  if (!tacho_shadow_multi_set(tacho_sn, TACHO_SHADOW_DUTY_CYCLE_SP, 0)) {
     zlog_error(zlog_c, "Impossible de changer le rapport cyclique '%d' pour les servomoteurs", 0);
+    return 0;
+  }
+
+  return 1;
+}
+
+/*
+ * Attente de l'arrêt des servomoteurs, au plus TACHO_READY_TIMEOUT_MS.
+ * Valeurs de retour: voir ready_tachos.
+ */
+int tacho_ready(struct ready_wait *w) {
+  return ready_tachos(tacho_sn, TACHO_READY_TIMEOUT_MS, w);
+}
+
+// Impression des écritures de consignes émises et supprimées
+void tacho_teardown(void) {
+  tacho_shadow_report();
+}
+
+#ifndef EV3_SUITE
+/*
+ * Initialisation de la brique intelligente EV3 et découverte des servomoteurs.
+ * Valeurs de retour: voir discovery_init et tacho_setup.
+ */
+static int init(void) {
+  static struct ev3_device_map devices;
+  int rc;
+
+  rc = discovery_init(&devices, DISCOVERY_TACHOS);
+  if (rc != 1)
+    return rc;
+  if (!tacho_setup(&devices)) {
     ev3_uninit();
     return 0;
   }
 
   return 1;
 }
+#endif
 
-void timed_test(void) {
+// Journal asynchrone des boucles de commande, arrêté par alog_stop
+static void loop_log_start(void) {
+  if (!alog_start(zlog_c, ALOG_CAPACITY))
+    zlog_warn(zlog_c, "Journal asynchrone indisponible, messages des boucles perdus");
+}
 
-  // A compléter
+/*
+ * Lecture des positions des deux grands servomoteurs dans 'position',
+ * appelée depuis les boucles de commande: l'erreur passe par alog.
+ * Retourne 1 en cas de succès, 0 sinon.
+ */
+static int read_positions(int position[2]) {
+  int k;
+
+  for (k = 0; k < 2; k++) {
+    LATENCY_TIME(_bytes, LATENCY_TACHO, tacho_sn[k], "position",
+		 get_tacho_position(tacho_sn[k], &position[k]));
+    if (_bytes == 0) {
+      alog_error("Impossible de récupérer la position absolue du servomoteur '%d'",
+		 tacho_sn[k]);
+      return 0;
+    }
+  }
 
   return 1;
 }
 
-void ramp_test(void) {
+/*
+ * Enregistrement des positions 'position' déjà lues par une boucle de
+ * commande, sans relire sysfs: la vitesse est tirée de l'écart aux
+ * positions 'last' de la période précédente, mises à jour, et l'état est
+ * celui commandé par la boucle.
+ */
+static void record_positions(const int position[2], int last[2]) {
+  int k;
 
-  // A compléter
+  for (k = 0; k < 2; k++) {
+    telemetry_tacho(tacho_sn[k], position[k], (position[k] - last[k]) *
+		    (1000000000L / DIRECT_PERIOD_NS), TACHO_RUNNING);
+    last[k] = position[k];
+  }
+}
+
+/*
+ * Vitesses des deux servomoteurs en impulsions/s, par l'écart de positions
+ * sur CHARACTERISE_WINDOW_MS. Retourne 1 en cas de succès, 0 sinon.
+ */
+static int window_speed(int speed[2]) {
+  int k, before[2], after[2];
+
+  if (!read_positions(before))
+    return 0;
+  usleep(CHARACTERISE_WINDOW_MS * 1000);
+  if (!read_positions(after))
+    return 0;
+  for (k = 0; k < 2; k++)
+    speed[k] = (after[k] - before[k]) * 1000 / CHARACTERISE_WINDOW_MS;
 
   return 1;
 }
 
-void direct_test(void) {
+/*
+ * Balayage du rapport cyclique de 0 à 100 % puis de 0 à -100 % et mesure
+ * des vitesses établies dans 'speed'. Retourne 1 en cas de succès, 0 sinon.
+ */
+static int characterise_sweep(int speed[2][MOTOR_MAP_POINTS]) {
+  int i, k, n, sign, v[2];
+
+  for (sign = 1; sign >= -1; sign -= 2) {
+    for (n = 1; n <= MOTOR_MAP_CENTER; n++) {
+      i = MOTOR_MAP_CENTER + sign * n;
+      MULTI_SET_TACHO_DUTY_CYCLE_SP(tacho_sn, MOTOR_MAP_DUTY(i));
+      usleep(CHARACTERISE_SETTLE_MS * 1000);
+      watchdog_beat();
+      if (!window_speed(v))
+	return 0;
+      for (k = 0; k < 2; k++)
+	speed[k][i] = v[k];
+      alog_debug("Rapport cyclique %4d %% : %d / %d", MOTOR_MAP_DUTY(i),
+		 speed[0][i], speed[1][i]);
+    }
+    // Arrêt avant de changer de sens
+    MULTI_SET_TACHO_DUTY_CYCLE_SP(tacho_sn, 0);
+    usleep(CHARACTERISE_SETTLE_MS * 1000);
+    watchdog_beat();
+  }
+
+  return 1;
+}
+
+/*
+ * Vitesses obtenues par la courbe inversée, sans correction.
+ * Retourne 1 en cas de succès, 0 sinon.
+ */
+static int characterise_check(void) {
+  static const int checks[] = { 100, 300, 600 };
+  int k, n, v[2];
+
+  for (n = 0; n < (int) (sizeof(checks) / sizeof(checks[0])); n++) {
+    for (k = 0; k < 2; k++)
+      SET_TACHO_DUTY_CYCLE_SP(tacho_sn[k],
+			      motor_curve_duty(&tacho_curve[k], checks[n]));
+    usleep(CHARACTERISE_SETTLE_MS * 1000);
+    watchdog_beat();
+    if (!window_speed(v))
+      return 0;
+    zlog_info(zlog_c, "Vitesse visée %d : gauche %d, droit %d", checks[n],
+	      v[0], v[1]);
+  }
+
+  return 1;
+}
+
+/*
+ * Caractérisation des deux servomoteurs, roues en l'air: le rapport cyclique
+ * est balayé de 0 à 100 % puis de 0 à -100 % par pas de MOTOR_MAP_STEP, et
+ * la vitesse établie est mesurée par l'écart de positions. Les courbes
+ * remplacent celles de leur port dans la table enregistrée. Quelques
+ * vitesses sont ensuite demandées par la courbe inversée pour vérification.
+ * Retourne 1 en cas de succès, 0 sinon; les servomoteurs sont arrêtés dans
+ * tous les cas et la table n'est enregistrée qu'en cas de succès.
+ */
+int characterise(void) {
+  static struct motor_map map;
+  int speed[2][MOTOR_MAP_POINTS] = { { 0 } };
+  int k, rc;
+
+  map.count = 0;
+  motor_map_load(&map, NULL);
+  MULTI_SET_TACHO_STOP_ACTION_INX(tacho_sn, TACHO_COAST);
+  MULTI_SET_TACHO_DUTY_CYCLE_SP(tacho_sn, 0);
+  MULTI_SET_TACHO_COMMAND_INX(tacho_sn, TACHO_RUN_DIRECT);
+  watchdog_arm(CHARACTERISE_WATCHDOG_MS);
+  loop_log_start();
+  rc = characterise_sweep(speed);
+  if (rc) {
+    for (k = 0; k < 2; k++) {
+      motor_curve_build(&tacho_curve[k], tacho_port[k], speed[k]);
+      motor_map_put(&map, &tacho_curve[k]);
+      curve_report(k);
+    }
+    rc = characterise_check();
+  }
+  alog_stop();
+
+  MULTI_SET_TACHO_COMMAND_INX(tacho_sn, TACHO_STOP);
+  watchdog_arm(0);
+  if (!rc) {
+    zlog_error(zlog_c, "Caractérisation interrompue, table non enregistrée");
+    return 0;
+  }
+
+  return motor_map_save(&map, NULL);
+}
+
+int timed_test(void) {
 
   // A compléter
 
   return 1;
 }
 
+/*
+ * Déplacement de 'distance' impulsions des deux servomoteurs, commandé par
+ * le micrologiciel (run-to-rel-pos et rampes) si 'profile' est NULL, sinon
+ * par les consignes du profil envoyées à chaque période en run-direct. A la
+ * fin du profil, le maintien de la cible est confié au micrologiciel
+ * (run-to-abs-pos): la correction proportionnelle seule reste alors sous la
+ * zone morte des servomoteurs et ne rattrape pas les dernières impulsions.
+ * Les positions sont suivies pendant RAMP_OBSERVE_MS dans 'track'.
+ * Retourne 1 en cas de succès, 0 sinon; les servomoteurs sont alors arrêtés.
+ */
+static int ramp_run(const struct motion_profile *profile, int distance,
+		    struct motion_track track[2]) {
+  struct periodic loop;
+  int i, k, cycles, rc = 1, start[2], position[2], last[2];
+
+  if (!read_positions(start))
+    return 0;
+  last[0] = start[0];
+  last[1] = start[1];
+  for (k = 0; k < 2; k++)
+    motion_track_init(&track[k], profile, start[k], start[k] + distance,
+		      DIRECT_PERIOD_NS);
+  MULTI_SET_TACHO_STOP_ACTION_INX(tacho_sn, TACHO_HOLD);
+  if (profile == NULL) {
+    // Rampes du micrologiciel: durée de 0 à la vitesse maximale
+    MULTI_SET_TACHO_RAMP_UP_SP(tacho_sn, max_spd * 1000 / RAMP_AMAX);
+    MULTI_SET_TACHO_RAMP_DOWN_SP(tacho_sn, max_spd * 1000 / RAMP_AMAX);
+    MULTI_SET_TACHO_SPEED_SP(tacho_sn, RAMP_VMAX);
+    MULTI_SET_TACHO_POSITION_SP(tacho_sn, distance);
+    MULTI_SET_TACHO_COMMAND_INX(tacho_sn, TACHO_RUN_TO_REL_POS);
+  } else {
+    MULTI_SET_TACHO_DUTY_CYCLE_SP(tacho_sn, 0);
+    MULTI_SET_TACHO_COMMAND_INX(tacho_sn, TACHO_RUN_DIRECT);
+  }
+
+  cycles = RAMP_OBSERVE_MS * 1000000L / DIRECT_PERIOD_NS;
+  watchdog_arm(DIRECT_WATCHDOG_MS);
+  periodic_init(&loop, DIRECT_PERIOD_NS);
+  for (i = 0; i < cycles; i++) {
+    watchdog_beat();
+    if (!read_positions(position)) {
+      rc = 0;
+      break;
+    }
+    for (k = 0; k < 2; k++) {
+      motion_track_step(&track[k], position[k]);
+      if (profile != NULL && i < profile->count)
+	tacho_shadow_stage(tacho_sn[k], TACHO_SHADOW_DUTY_CYCLE_SP,
+			   motion_duty(profile, i, position[k] - start[k],
+				       &tacho_curve[k]));
+    }
+    if (profile != NULL && i == profile->count) {
+      // Fin du profil: cible et maintien par le micrologiciel
+      for (k = 0; k < 2; k++) {
+	tacho_shadow_stage(tacho_sn[k], TACHO_SHADOW_POSITION_SP,
+			   track[k].target);
+	tacho_shadow_stage(tacho_sn[k], TACHO_SHADOW_SPEED_SP,
+			   RAMP_HOLD_SPEED);
+      }
+      if (tacho_shadow_command(tacho_sn, TACHO_RUN_TO_ABS_POS) == 0) {
+	alog_error("Impossible de confier la cible au micrologiciel");
+	rc = 0;
+	break;
+      }
+    } else if (!tacho_shadow_flush())
+      // Les deux rapports cycliques de la période écrits ensemble
+      alog_warn("Impossible de changer les rapports cycliques des servomoteurs");
+    record_positions(position, last);
+    periodic_wait(&loop);
+  }
+
+  MULTI_SET_TACHO_COMMAND_INX(tacho_sn, TACHO_STOP);
+  watchdog_arm(0);
+  MULTI_SET_TACHO_RAMP_UP_SP(tacho_sn, 0);
+  MULTI_SET_TACHO_RAMP_DOWN_SP(tacho_sn, 0);
+
+  return rc;
+}
+
+/*
+ * Même déplacement aller-retour commandé par les rampes du micrologiciel,
+ * puis par un profil trapézoïdal et un profil en S planifiés à l'avance. La
+ * durée jusqu'à la stabilisation, le dépassement et l'erreur de suivi du
+ * profil sont comparés.
+ */
+int ramp_test(void) {
+  static const char *names[3] = { "Micrologiciel", "Trapèze", "Courbe en S" };
+  struct motion_limits limits = { RAMP_VMAX, RAMP_AMAX, 0 };
+  struct motion_profile profiles[3];
+  struct motion_track track[3][2];
+  struct periodic_rt rt;
+  char name[32];
+  int m, k, rc = 1;
+
+  // Les tables sont calculées avant tout déplacement; aller, retour, aller
+  if (!motion_plan(&profiles[1], -RAMP_DISTANCE, &limits, DIRECT_PERIOD_NS))
+    return 0;
+  limits.jmax = RAMP_JMAX;
+  if (!motion_plan(&profiles[2], RAMP_DISTANCE, &limits, DIRECT_PERIOD_NS)) {
+    motion_free(&profiles[1]);
+    return 0;
+  }
+
+  loop_log_start();
+  periodic_enter_rt(&rt, DIRECT_PRIORITY, 1, 0);
+  for (m = 0; m < 3 && rc; m++)
+    rc = ramp_run(m == 0 ? NULL : &profiles[m],
+		  m == 0 ? RAMP_DISTANCE : profiles[m].distance, track[m]);
+  periodic_leave_rt(&rt);
+  alog_stop();
+  for (m = 0; m < 3 && rc; m++)
+    for (k = 0; k < 2; k++) {
+      snprintf(name, sizeof(name), "%s %s", names[m],
+	       k == 0 ? "gauche" : "droite");
+      motion_track_report(&track[m][k], name);
+    }
+  // Rapport par méthode, le pire des deux servomoteurs
+  for (m = 0; m < 3 && rc; m++)
+    zlog_info(zlog_c, "%-13s : stabilisé en %ld ms, dépassement %d impulsions",
+	      names[m], MAX(motion_track_settle_ms(&track[m][0]),
+			    motion_track_settle_ms(&track[m][1])),
+	      MAX(track[m][0].overshoot, track[m][1].overshoot));
+
+  motion_free(&profiles[1]);
+  motion_free(&profiles[2]);
+
+  return rc;
+}
+
+// Boucle de direct_test, dans le fil préparé au temps réel
+static int direct_run(void) {
+  struct periodic loop;
+  int i, cycles, duty, rc = 1, position[2], last[2];
+
+  if (!read_positions(last))
+    return 0;
+  MULTI_SET_TACHO_DUTY_CYCLE_SP(tacho_sn, 0);
+  MULTI_SET_TACHO_COMMAND_INX(tacho_sn, TACHO_RUN_DIRECT);
+
+  cycles = DIRECT_DURATION_MS * 1000000L / DIRECT_PERIOD_NS;
+  watchdog_arm(DIRECT_WATCHDOG_MS);
+  periodic_init(&loop, DIRECT_PERIOD_NS);
+  for (i = 0; i < cycles; i++) {
+    watchdog_beat();
+    duty = 2 * DIRECT_DUTY_MAX * MIN(i, cycles - i) / cycles;
+    if (tacho_shadow_multi_set(tacho_sn, TACHO_SHADOW_DUTY_CYCLE_SP, duty) == 0)
+      alog_warn("Impossible de changer le rapport cyclique à '%d' pour le grand servomoteurs",
+		duty);
+    if (!read_positions(position)) {
+      rc = 0;
+      break;
+    }
+    record_positions(position, last);
+    periodic_wait(&loop);
+  }
+
+  MULTI_SET_TACHO_COMMAND_INX(tacho_sn, TACHO_STOP);
+  watchdog_arm(0);
+  zlog_info(zlog_c, "Positions finales : gauche %d, droite %d", last[0],
+	    last[1]);
+  periodic_report(&loop, "Boucle directe");
+
+  return rc;
+}
+
+/*
+ * Commande directe du rapport cyclique à cadence fixe. Le rapport cyclique
+ * suit un profil triangulaire et les positions sont relues à chaque
+ * période; la gigue et les dépassements de la boucle sont rapportés.
+ */
+int direct_test(void) {
+  struct periodic_rt rt;
+  int rc;
+
+  loop_log_start();
+  periodic_enter_rt(&rt, DIRECT_PRIORITY, 1, 0);
+  rc = direct_run();
+  periodic_leave_rt(&rt);
+  alog_stop();
+
+  return rc;
+}
+
+/*
+ * Ligne droite au même rapport cyclique, régulée ou non par drive_sync.
+ */
+static int sync_run(int closed_loop, const char *name) {
+  struct drive_sync sync;
+  struct periodic loop;
+  struct odometry odo;
+  struct odometry_pose pose;
+  int i, cycles, position[2], last[2], rc = 1;
+
+  MULTI_SET_TACHO_DUTY_CYCLE_SP(tacho_sn, SYNC_DUTY);
+  if (!drive_sync_init(&sync, TACHO_LEFT_SN, TACHO_RIGHT_SN, SYNC_DUTY,
+		       closed_loop)) {
+    zlog_error(zlog_c, "Impossible de lire les positions des servomoteurs");
+    return 0;
+  }
+  odometry_init(&odo, sync.left0, sync.right0);
+  last[0] = sync.left0;
+  last[1] = sync.right0;
+  MULTI_SET_TACHO_COMMAND_INX(tacho_sn, TACHO_RUN_DIRECT);
+
+  cycles = SYNC_DURATION_MS * 1000000L / DIRECT_PERIOD_NS;
+  watchdog_arm(DIRECT_WATCHDOG_MS);
+  periodic_init(&loop, DIRECT_PERIOD_NS);
+  for (i = 0; i < cycles; i++) {
+    watchdog_beat();
+    if (!drive_sync_step(&sync)) {
+      alog_error("Erreur de synchronisation des servomoteurs");
+      rc = 0;
+      break;
+    }
+    // Positions déjà relues par drive_sync_step
+    odometry_update(&odo, sync.left_last, sync.right_last);
+    position[0] = sync.left_last;
+    position[1] = sync.right_last;
+    record_positions(position, last);
+    periodic_wait(&loop);
+  }
+
+  MULTI_SET_TACHO_COMMAND_INX(tacho_sn, TACHO_STOP);
+  watchdog_arm(0);
+  drive_sync_report(&sync, name);
+  odometry_pose(&odo, &pose);
+  zlog_info(zlog_c, "%s : pose x %.1f mm, y %.1f mm, cap %.2f°", name,
+	    ODOMETRY_MM(pose.x), ODOMETRY_MM(pose.y),
+	    ODOMETRY_DEG(pose.heading));
+
+  return rc;
+}
+
+/*
+ * Comparaison de l'erreur de ligne droite en boucle ouverte et avec
+ * synchronisation des deux servomoteurs.
+ */
+int sync_test(void) {
+  struct ready_wait w;
+  int rc;
+
+  loop_log_start();
+  rc = sync_run(0, "Boucle ouverte");
+  if (rc) {
+    if (tacho_ready(&w) < 0)
+      zlog_warn(zlog_c, "Impossible de lire l'état des servomoteurs");
+    ready_report(&w, "Boucle fermée", TACHO_PHASE_US);
+    rc = sync_run(1, "Boucle fermée");
+  }
+  alog_stop();
+
+  return rc;
+}
+
 int rel_pos(void) {
 
   // A compléter
@@ -302,6 +777,16 @@ int abs_pos(void) {
   return 1;
 }
 
+#ifndef EV3_SUITE
+// Attente de l'arrêt des servomoteurs avant le test 'name', au lieu de sleep(1)
+static void phase_wait(const char *name) {
+  struct ready_wait w;
+
+  if (tacho_ready(&w) < 0)
+    zlog_warn(zlog_c, "Impossible de lire l'état des servomoteurs");
+  ready_report(&w, name, TACHO_PHASE_US);
+}
+
 int main (int argc, char *argv[]) {
   int condition = 0, color_idx, rc;
   size_t bytes;
@@ -325,12 +810,29 @@ int main (int argc, char *argv[]) {
   
   zlog_info(zlog_c, "Hello IIUN!");
 
+  latency_start();
+
   if(!init()) {
     zlog_fini();
     return EXIT_FAILURE;
   }
+  telemetry_start_env();
+  // Arrêt des servomoteurs par le démon watchdogd si le test plante
+  watchdog_attach(0);
 
   zlog_info(zlog_c, "Vitesse maximale : %d\n", max_spd);
+
+  if (argc > 1 && strcmp(argv[1], "characterise") == 0) {
+    zlog_info(zlog_c, "=== Caractérisation des servomoteurs ===");
+    if (!characterise()) {
+      watchdog_detach();
+      latency_stop();
+      telemetry_stop();
+      ev3_uninit();
+      zlog_fini();
+      return EXIT_FAILURE;
+    }
+  }
   
   // Set lights to red
   set_light(LIT_LEFT, LIT_RED);
@@ -339,29 +841,37 @@ int main (int argc, char *argv[]) {
   // Test abs pos
   zlog_info(zlog_c, "=== Test abs pos ===");
   abs_pos();
-  sleep(1);
+  phase_wait("Test rel pos");
   // Test rel pos
   zlog_info(zlog_c, "=== Test rel pos ===");
   rel_pos();
-  sleep(1);
+  phase_wait("Test à un");
   // Test à un
   zlog_info(zlog_c, "=== Test à un ===");
   timed_test();
   set_light(LIT_LEFT, LIT_AMBER);
-  sleep(1);
+  phase_wait("Test d'accélération");
   // Test d'accélération
   zlog_info(zlog_c, "=== Test d'accélération ===");
   ramp_test();
   set_light(LIT_LEFT, LIT_AMBER);
-  sleep(1);
+  phase_wait("Test constamment");
   // Test constamment
   zlog_info(zlog_c, "=== Test constamment ===");
   direct_test();
+  phase_wait("Test synchronisé");
+  // Test synchronisé
+  zlog_info(zlog_c, "=== Test synchronisé ===");
+  sync_test();
     
   // Set lights to green
   set_light(LIT_LEFT, LIT_GREEN);
   set_light(LIT_RIGHT, LIT_GREEN);
 
+  tacho_teardown();
+  watchdog_detach();
+  latency_stop();
+  telemetry_stop();
   ev3_uninit();
     
   zlog_info(zlog_c, "Bye IIUN!");
@@ -370,3 +880,4 @@ int main (int argc, char *argv[]) {
 
   return EXIT_SUCCESS;
 }
+#endif
@@ -0,0 +1,244 @@
+/*
+ * Enregistrement binaire de la télémétrie des capteurs et servomoteurs.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <ev3.h>
+#include <ev3_sensor.h>
+#include <ev3_tacho.h>
+
+#include "latency.h"
+#include "telemetry.h"
+#include "zlog.h"
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+static struct {
+  int fd;
+  size_t size;
+  struct telemetry_header *header;
+  struct telemetry_record *records;
+  uint32_t capacity;
+  uint64_t start_ns;
+  atomic_uint next;
+  atomic_ulong drops;
+  // Mode et décimales courants de chaque capteur
+  uint8_t mode[SENSOR_DESC__LIMIT_];
+  int8_t decimals[SENSOR_DESC__LIMIT_];
+} telemetry = { .fd = -1 };
+
+static uint64_t clock_ns(clockid_t clock) {
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void append(uint8_t kind, uint8_t sn, uint8_t inx, uint8_t aux,
+		   int32_t value, int16_t extra) {
+  struct telemetry_record *r;
+  uint64_t t_us;
+  unsigned int i;
+
+  if (telemetry.records == NULL)
+    return;
+  i = atomic_fetch_add_explicit(&telemetry.next, 1, memory_order_relaxed);
+  if (i >= telemetry.capacity) {
+    atomic_fetch_add_explicit(&telemetry.drops, 1, memory_order_relaxed);
+    return;
+  }
+  t_us = (clock_ns(CLOCK_MONOTONIC) - telemetry.start_ns) / 1000;
+  r = &telemetry.records[i];
+  r->t_us = (uint32_t) t_us;
+  r->t_us_hi = (uint8_t) (t_us >> 32);
+  r->sn = sn;
+  r->inx = inx;
+  r->aux = aux;
+  r->value = value;
+  r->extra = extra;
+  // Le type est écrit en dernier: un enregistrement de type 0 est incomplet
+  atomic_thread_fence(memory_order_release);
+  r->kind = kind;
+}
+
+static uint8_t sensor_kind(uint8_t sn) {
+  switch (ev3_sensor[sn].type_inx) {
+  case LEGO_EV3_COLOR:
+    return TELEMETRY_COLOR;
+  case LEGO_EV3_US:
+    return TELEMETRY_US;
+  case LEGO_EV3_TOUCH:
+    return TELEMETRY_TOUCH;
+  default:
+    return TELEMETRY_SENSOR;
+  }
+}
+
+int telemetry_start(const char *path, size_t capacity) {
+  size_t size = sizeof(struct telemetry_header) +
+    capacity * sizeof(struct telemetry_record);
+  void *map;
+  int fd, rc;
+
+  fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    zlog_error(zlog_c, "Impossible de créer le fichier de télémétrie '%s' : %s",
+	       path, strerror(errno));
+    return 0;
+  }
+  // Préallocation pour ne pas allouer de blocs pendant l'enregistrement
+  rc = posix_fallocate(fd, 0, size);
+  if (rc != 0) {
+    zlog_error(zlog_c, "Impossible de préallouer %lu octets pour '%s' : %s",
+	       (unsigned long) size, path, strerror(rc));
+    close(fd);
+    return 0;
+  }
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    zlog_error(zlog_c, "Impossible de projeter '%s' en mémoire : %s",
+	       path, strerror(errno));
+    close(fd);
+    return 0;
+  }
+
+  telemetry.fd = fd;
+  telemetry.size = size;
+  telemetry.header = map;
+  telemetry.capacity = capacity;
+  memset(telemetry.mode, 0, sizeof(telemetry.mode));
+  memset(telemetry.decimals, 0, sizeof(telemetry.decimals));
+  atomic_init(&telemetry.next, 0);
+  atomic_init(&telemetry.drops, 0);
+  memcpy(telemetry.header->magic, TELEMETRY_MAGIC, 4);
+  telemetry.header->version = TELEMETRY_VERSION;
+  telemetry.header->record_size = sizeof(struct telemetry_record);
+  telemetry.header->count = 0;
+  telemetry.header->capacity = capacity;
+  telemetry.header->start_realtime_ns = clock_ns(CLOCK_REALTIME);
+  telemetry.start_ns = clock_ns(CLOCK_MONOTONIC);
+  telemetry.header->start_monotonic_ns = telemetry.start_ns;
+  atomic_thread_fence(memory_order_release);
+  telemetry.records = (struct telemetry_record *) (telemetry.header + 1);
+
+  return 1;
+}
+
+int telemetry_start_env(void) {
+  const char *path = getenv(TELEMETRY_ENV);
+  const char *records = getenv(TELEMETRY_ENV_RECORDS);
+  size_t capacity = TELEMETRY_RECORDS;
+
+  if (path == NULL || *path == '\0')
+    return 0;
+  if (records != NULL && atol(records) > 0)
+    capacity = atol(records);
+  if (!telemetry_start(path, capacity))
+    return 0;
+  zlog_info(zlog_c, "Enregistrement de la télémétrie dans '%s' (%lu mesures au plus)",
+	    path, (unsigned long) capacity);
+
+  return 1;
+}
+
+void telemetry_stop(void) {
+  unsigned long count, drops;
+
+  if (telemetry.records == NULL)
+    return;
+  telemetry.records = NULL;
+  count = telemetry_count();
+  drops = telemetry_drops();
+  telemetry.header->count = count;
+  msync(telemetry.header, telemetry.size, MS_SYNC);
+  munmap(telemetry.header, telemetry.size);
+  telemetry.header = NULL;
+  if (ftruncate(telemetry.fd, sizeof(struct telemetry_header) +
+		count * sizeof(struct telemetry_record)) != 0)
+    zlog_warn(zlog_c, "Impossible de tronquer le fichier de télémétrie : %s",
+	      strerror(errno));
+  close(telemetry.fd);
+  telemetry.fd = -1;
+  zlog_info(zlog_c, "Télémétrie : %lu mesures enregistrées, %lu perdues",
+	    count, drops);
+}
+
+int telemetry_enabled(void) {
+  return telemetry.records != NULL;
+}
+
+void telemetry_mode(uint8_t sn, int mode) {
+  dword decimals = 0;
+
+  if (telemetry.records == NULL || sn >= SENSOR_DESC__LIMIT_)
+    return;
+  get_sensor_decimals(sn, &decimals);
+  telemetry.mode[sn] = mode;
+  telemetry.decimals[sn] = decimals;
+}
+
+void telemetry_decimals(uint8_t sn, int decimals) {
+  if (telemetry.records == NULL || sn >= SENSOR_DESC__LIMIT_)
+    return;
+  telemetry.decimals[sn] = decimals;
+}
+
+void telemetry_sensor(uint8_t sn, int value) {
+  telemetry_sensor_value(sn, 0, value);
+}
+
+void telemetry_sensor_value(uint8_t sn, uint8_t inx, int value) {
+  if (telemetry.records == NULL || sn >= SENSOR_DESC__LIMIT_)
+    return;
+  append(sensor_kind(sn), sn, inx, telemetry.mode[sn], value,
+	 telemetry.decimals[sn]);
+}
+
+void telemetry_sensor0(uint8_t sn, float value) {
+  if (telemetry.records == NULL || sn >= SENSOR_DESC__LIMIT_)
+    return;
+  telemetry_sensor(sn, lroundf(value * powf(10, telemetry.decimals[sn])));
+}
+
+void telemetry_tacho(uint8_t sn, int position, int speed, FLAGS_T state) {
+  append(TELEMETRY_TACHO, sn, 0, state, position, speed);
+}
+
+void telemetry_tacho_sample(uint8_t sn) {
+  int position = 0, speed = 0;
+  FLAGS_T state = 0;
+  size_t bytes;
+
+  if (telemetry.records == NULL)
+    return;
+  LATENCY_TIME(bytes, LATENCY_TACHO, sn, "position",
+	       get_tacho_position(sn, &position));
+  LATENCY_TIME(bytes, LATENCY_TACHO, sn, "speed", get_tacho_speed(sn, &speed));
+  LATENCY_TIME(bytes, LATENCY_TACHO, sn, "state",
+	       get_tacho_state_flags(sn, &state));
+  (void) bytes;
+  telemetry_tacho(sn, position, speed, state);
+}
+
+unsigned long telemetry_count(void) {
+  unsigned int next = atomic_load_explicit(&telemetry.next, memory_order_relaxed);
+
+  return next < telemetry.capacity ? next : telemetry.capacity;
+}
+
+unsigned long telemetry_drops(void) {
+  return atomic_load_explicit(&telemetry.drops, memory_order_relaxed);
+}
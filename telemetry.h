@@ -0,0 +1,129 @@
+/*
+ * Enregistrement binaire de la télémétrie des capteurs et servomoteurs.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Les mesures sont ajoutées comme enregistrements de taille fixe (16 octets)
+ * à un fichier préalloué et projeté en mémoire. Un ajout ne fait aucun appel
+ * système: une réservation atomique de la place, une lecture de l'horloge et
+ * une copie. Plusieurs fils peuvent enregistrer en même temps. Quand le
+ * fichier est plein, les mesures suivantes sont perdues et comptées. A
+ * l'arrêt, le fichier est tronqué aux enregistrements écrits.
+ *
+ * L'enregistrement est activé dans les programmes de test par la variable
+ * d'environnement EV3_TELEMETRY qui donne le chemin du fichier, et
+ * EV3_TELEMETRY_RECORDS qui donne éventuellement le nombre maximal
+ * d'enregistrements. Sans enregistrement actif, les fonctions d'ajout
+ * retournent immédiatement.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ev3.h>
+
+#define TELEMETRY_MAGIC "EV3T"
+// Version 2: indice de la valeur des capteurs, 0 dans la version 1
+#define TELEMETRY_VERSION 2
+#define TELEMETRY_ENV "EV3_TELEMETRY"
+#define TELEMETRY_ENV_RECORDS "EV3_TELEMETRY_RECORDS"
+// 16 Mo, soit plus de 10 heures à 25 mesures par seconde
+#define TELEMETRY_RECORDS (1 << 20)
+
+// Types d'enregistrements; 0 marque la place libre
+#define TELEMETRY_COLOR 1
+#define TELEMETRY_US 2
+#define TELEMETRY_TOUCH 3
+#define TELEMETRY_SENSOR 4
+#define TELEMETRY_TACHO 5
+
+struct telemetry_header {
+  char magic[4];
+  uint16_t version;
+  uint16_t record_size;
+  uint32_t count;
+  uint32_t capacity;
+  uint64_t start_realtime_ns;
+  uint64_t start_monotonic_ns;
+  uint8_t reserved[32];
+};
+
+/*
+ * Capteurs: 'aux' est le mode, 'value' la valeur brute valueN d'indice 'inx'
+ * et 'extra' le nombre de décimales.
+ * Servomoteurs: 'aux' contient les drapeaux d'état, 'value' la position et
+ * 'extra' la vitesse en impulsions par seconde.
+ */
+struct telemetry_record {
+  // Temps depuis le début de l'enregistrement en us, sur 40 bits
+  uint32_t t_us;
+  uint8_t t_us_hi;
+  uint8_t kind;
+  uint8_t sn;
+  uint8_t aux;
+  int32_t value;
+  int16_t extra;
+  uint8_t inx;
+  uint8_t reserved;
+};
+
+/*
+ * Création du fichier 'path' préalloué pour 'capacity' enregistrements et
+ * début de l'enregistrement.
+ * Retourne 1 en cas de succès, 0 sinon.
+ */
+int telemetry_start(const char *path, size_t capacity);
+
+/*
+ * Début de l'enregistrement si EV3_TELEMETRY est définie.
+ * Retourne 1 si l'enregistrement a commencé, 0 sinon.
+ */
+int telemetry_start_env(void);
+
+/*
+ * Fin de l'enregistrement, troncature et fermeture du fichier. Les fils qui
+ * enregistrent doivent être arrêtés avant.
+ */
+void telemetry_stop(void);
+
+// Enregistrement actif
+int telemetry_enabled(void);
+
+// Changement de mode du capteur 'sn', à appeler après set_sensor_mode_inx
+void telemetry_mode(uint8_t sn, int mode);
+
+/*
+ * Décimales du mode du capteur 'sn', relues une fois le mode en place: juste
+ * après set_sensor_mode_inx, sysfs peut encore donner celles de l'ancien.
+ */
+void telemetry_decimals(uint8_t sn, int decimals);
+
+// Mesure brute value0 du capteur 'sn'
+void telemetry_sensor(uint8_t sn, int value);
+
+// Mesure brute valueN d'indice 'inx' du capteur 'sn', pour les modes à
+// plusieurs valeurs comme RGB-RAW
+void telemetry_sensor_value(uint8_t sn, uint8_t inx, int value);
+
+// Mesure value0 du capteur 'sn' mise à l'échelle, comme get_sensor_value0
+void telemetry_sensor0(uint8_t sn, float value);
+
+// Etat du servomoteur 'sn'
+void telemetry_tacho(uint8_t sn, int position, int speed, FLAGS_T state);
+
+/*
+ * Lecture et enregistrement de l'état du servomoteur 'sn', au prix de trois
+ * lectures sysfs. Une boucle de commande qui lit déjà la position appelle
+ * plutôt telemetry_tacho avec ses propres valeurs.
+ */
+void telemetry_tacho_sample(uint8_t sn);
+
+// Enregistrements écrits et perdus depuis le début
+unsigned long telemetry_count(void);
+unsigned long telemetry_drops(void);
+
+#endif
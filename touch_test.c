@@ -8,8 +8,10 @@
  * - 1x EV3 Touch Sensor / Capteur tactile EV3
  */
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <ev3.h>
@@ -17,6 +19,13 @@
 #include <ev3_port.h>
 #include <ev3_sensor.h>
 
+#include "alog.h"
+#include "coro.h"
+#include "discovery.h"
+#include "latency.h"
+#include "suite.h"
+#include "telemetry.h"
+#include "touch_watch.h"
 #include "zlog.h"
 
 /*
@@ -24,116 +33,254 @@
  * et traitement d'erreur.
  */
 #define SET_SENSOR_MODE_INX(sn,m) do {					\
-    _bytes = set_sensor_mode_inx((sn), (m));				\
+    LATENCY_TIME(_bytes, LATENCY_SENSOR, (sn), "mode",			\
+		 set_sensor_mode_inx((sn), (m)));			\
     if (_bytes == 0) {							\
       zlog_error(zlog_c, "Impossible de changer en mode '"#m"' pour le capteur '%s'", ev3_sensor_type(ev3_sensor[(sn)].type_inx)); \
-      ev3_uninit();							\
       return 0;								\
     }									\
+    telemetry_mode((sn), (m));						\
   } while(0);
 
-#define GET_SENSOR_VALUE0(sn,v) do {					\
-    _bytes = get_sensor_value0((sn), (v));				\
+// Valeur brute: le mode TOUCH n'a pas de décimale
+#define GET_SENSOR_VALUE(sn,v) do {					\
+    LATENCY_TIME(_bytes, LATENCY_SENSOR, (sn), "value0",		\
+		 get_sensor_value(0, (sn), (v)));			\
     if (_bytes == 0) {							\
       zlog_error(zlog_c,						\
 		 "Impossible d'assigner une valeur du capteur '%s'",	\
 		 ev3_sensor_type(ev3_sensor[(sn)].type_inx));		\
-      ev3_uninit();							\
       return 0;								\
     }									\
+    telemetry_sensor((sn), *(v));					\
   } while(0);
 
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+/*
+ * Paramètres du test tactile: fréquence de mesure du capteur, période de
+ * lecture et durée de chaque méthode de détection.
+ */
+#define SENSOR_TOUCH_POLL_MS 10U
+#define TOUCH_INTERVAL_US 5000
+#define TOUCH_DURATION_MS 5000
+
 // Numéro de séquence du capteur tactile
 #define SENSOR_TOUCH_SN sensor_sn[0]
 
 // Etats du capteur tactile
-#define SENSOR_TOUCH_PRESSED 1.0
-#define SENSOR_TOUCH_RELEASED 0.0
-
-// Drapeau pour verifier la présence des capteurs
-#define HAVE_SENSOR_TOUCH 0b1
+#define SENSOR_TOUCH_PRESSED 1
+#define SENSOR_TOUCH_RELEASED 0
 
+#ifdef EV3_SUITE
+// Catégorie zlog définie par le programme (voir suite.c)
+extern zlog_category_t *zlog_c;
+#else
 // Variable globale spécifique à zlog
 zlog_category_t *zlog_c;
+#endif
 
 // Tableau pour les numéros de séquence des capteurs
-uint8_t sensor_sn[SENSOR_DESC__LIMIT_];
+static uint8_t sensor_sn[SENSOR_DESC__LIMIT_];
 
 // Variable globale pour les macros
-size_t _bytes;
+static size_t _bytes;
 
-int init(void) {
-  int i, rc;
-  size_t bytes;
-  unsigned char sensors = 0;
+/*
+ * Mise en correspondance du capteur tactile dans la table 'devices'.
+ * Retourne 1 si le capteur a été retrouvé, 0 sinon.
+ */
+int touch_setup(struct ev3_device_map *devices) {
+  dword poll_ms = 0U;
+  int i;
   uint8_t sn;
 
   for (i = 0; i < SENSOR_DESC__LIMIT_; i++)
     sensor_sn[i] = DESC_LIMIT;
 
-  // Initialisation de la brique intelligente EV3
-  rc = ev3_init();
-  if (rc == 1)
-    zlog_info(zlog_c, "Brique intelligente EV3 trouvée");
-  else {
-    if (rc == 0)
-      zlog_fatal(zlog_c, "Brique intelligente EV3 pas trouvée");
-    else
-      zlog_error(zlog_c, "ev3_init retourne erreur '%d'", rc);
-    return rc;
-  }
-  // Initialisation des ports EV3
-  rc = ev3_port_init();
-  if (rc == -1) {
-    zlog_error(zlog_c, "Erreur durant l'initialisation des ports EV3");
-    ev3_uninit();
-    return rc;
-  } else if (rc != 8)
-    zlog_warn(zlog_c, "'%d/8' ports EV3 retrouvé");
-  else
-    zlog_info(zlog_c, "Tous ports EV3 retrouvé");
-  // Initialisation des capteurs EV3
-  rc = ev3_sensor_init();
-  if (rc == -1) {
-    zlog_error(zlog_c, "Erreur durant l'initialisation des capteurs EV3");
-    ev3_uninit();
-    return rc;
-  } else
-    zlog_info(zlog_c, "'%d' capteur(s) EV3 retrouvé", rc);
   /*
-   * Assurer que le capteur de couleur est mis dans la brique et mettre en
+   * Assurer que le capteur tactile est mis dans la brique et mettre en
    * correspondance les numéros de séquence.
    */
-  for (i = 0; i < SENSOR_DESC__LIMIT_; i++)
-    if (ev3_sensor[i].type_inx == LEGO_EV3_TOUCH) {
-      sensors |= HAVE_SENSOR_TOUCH;
-      SENSOR_TOUCH_SN = i;
-      if (ev3_search_sensor_plugged_in(ev3_sensor[i].port, ev3_sensor[i].extport, &sn, 0)) {
-	SET_SENSOR_MODE_INX(sn, LEGO_EV3_TOUCH_TOUCH);
-      } else {
-	zlog_error(zlog_c, "Le capteur tactile n'est pas connecté à la brique intelligente EV3");
-	return 0;
-      }
-      break;
-    }
-
-  if (sensors != HAVE_SENSOR_TOUCH) {
+  sn = discovery_sensor(devices, LEGO_EV3_TOUCH);
+  if (sn == DESC_LIMIT) {
     zlog_fatal(zlog_c, "Le capteur tactile n'a pas été retrouvé");
     return 0;
   }
+  SENSOR_TOUCH_SN = sn;
+  SET_SENSOR_MODE_INX(sn, LEGO_EV3_TOUCH_TOUCH);
+
+  // Changer la fréquence à laquelle le capteur prend des mesures
+  get_sensor_poll_ms(SENSOR_TOUCH_SN, &poll_ms);
+  zlog_info(zlog_c, "Avant : %u", poll_ms);
+  set_sensor_poll_ms(SENSOR_TOUCH_SN, SENSOR_TOUCH_POLL_MS);
+  get_sensor_poll_ms(SENSOR_TOUCH_SN, &poll_ms);
+  zlog_info(zlog_c, "Après : %u", poll_ms);
 
   return 1;
 }
 
-int touch_test(void) {
+#ifndef EV3_SUITE
+/*
+ * Initialisation de la brique intelligente EV3 et découverte des capteurs.
+ * Valeurs de retour: voir discovery_init et touch_setup.
+ */
+static int init(void) {
+  static struct ev3_device_map devices;
+  int rc;
+
+  rc = discovery_init(&devices, DISCOVERY_SENSORS);
+  if (rc != 1)
+    return rc;
+  if (!touch_setup(&devices)) {
+    ev3_uninit();
+    return 0;
+  }
 
-  // A compléter
-  
   return 1;
 }
+#endif
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static long thread_cpu_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000L + ts.tv_nsec / 1000L;
+}
 
+// Lecture de l'état du capteur tactile. Retourne 1 en cas de succès, 0 sinon.
+static int read_touch(int *value) {
+  GET_SENSOR_VALUE(SENSOR_TOUCH_SN, value);
+
+  return 1;
+}
+
+/*
+ * Etat de la tâche du test tactile, gardé d'une reprise à l'autre (voir
+ * coro.h).
+ */
+struct touch_task {
+  struct coro coro;
+  struct touch_watch watch;
+  uint64_t end;
+  uint64_t latency_sum;
+  uint64_t latency_max;
+  long cpu_start;
+  long polling_cpu;
+  int presses;
+  int events;
+  int last;
+  int *rc;
+};
+
+static struct touch_task touch_task;
+
+/*
+ * Détection des appuis par lecture périodique avec get_sensor_value, puis
+ * par notification des fronts, à la même période de lecture. Les deux
+ * méthodes sont comparées en temps processeur et la latence entre la
+ * lecture ayant vu le front et la reprise de la tâche est mesurée. La
+ * tâche attend la notification par CORO_WAIT_FD: l'ordonnanceur dort sur
+ * le descripteur, sans réveil périodique. Entrelacée avec d'autres tâches,
+ * le temps processeur du fil comprend aussi le leur.
+ */
+static int touch_run(struct coro *c, void *arg) {
+  struct touch_task *t = arg;
+  struct touch_event e;
+  uint64_t latency;
+  long watch_cpu;
+  int value;
+
+  CORO_BEGIN(c);
+  // Lecture périodique
+  zlog_info(zlog_c, "Attente active pendant %d ms", TOUCH_DURATION_MS);
+  t->presses = t->events = t->last = 0;
+  t->latency_sum = t->latency_max = 0;
+  t->cpu_start = thread_cpu_us();
+  t->end = now_ns() + TOUCH_DURATION_MS * 1000000ULL;
+  while (now_ns() < t->end) {
+    if (!read_touch(&value)) {
+      *t->rc = 0;
+      CORO_EXIT(c);
+    }
+    if (value == SENSOR_TOUCH_PRESSED && !t->last)
+      t->presses++;
+    t->last = value == SENSOR_TOUCH_PRESSED;
+    CORO_SLEEP_US(c, TOUCH_INTERVAL_US);
+  }
+  t->polling_cpu = thread_cpu_us() - t->cpu_start;
+  zlog_info(zlog_c, "Attente active : %d appui(s), %ld us de processeur",
+	    t->presses, t->polling_cpu);
+
+  // Notification des fronts
+  if (!touch_watch_start(&t->watch, SENSOR_TOUCH_SN, TOUCH_INTERVAL_US,
+			 NULL, NULL)) {
+    zlog_error(zlog_c, "Impossible de surveiller le capteur tactile");
+    *t->rc = 0;
+    CORO_EXIT(c);
+  }
+  zlog_info(zlog_c, "Notification des fronts pendant %d ms", TOUCH_DURATION_MS);
+  // Les fronts sont journalisés sans bloquer la boucle de notification
+  alog_start(zlog_c, ALOG_CAPACITY);
+  t->presses = 0;
+  t->cpu_start = thread_cpu_us();
+  t->end = now_ns() + TOUCH_DURATION_MS * 1000000ULL;
+  while (now_ns() < t->end) {
+    CORO_WAIT_FD(c, touch_watch_fd(&t->watch), t->end);
+    while (touch_watch_next(&t->watch, &e)) {
+      latency = now_ns() - e.t_ns;
+      t->latency_sum += latency;
+      t->latency_max = MAX(t->latency_max, latency);
+      t->events++;
+      if (e.pressed)
+	t->presses++;
+      alog_info("%s (notifié après %lu us)",
+		e.pressed ? "Appui" : "Relâchement",
+		(unsigned long) (latency / 1000));
+    }
+  }
+  watch_cpu = thread_cpu_us() - t->cpu_start + touch_watch_cpu_us(&t->watch);
+  touch_watch_stop(&t->watch);
+  alog_stop();
+
+  zlog_info(zlog_c, "Notification : %d appui(s), %ld us de processeur",
+	    t->presses, watch_cpu);
+  if (t->events > 0)
+    zlog_info(zlog_c, "Latence de notification : moyenne %lu us, maximum %lu us, plus %d us au plus entre l'appui et la lecture",
+	      (unsigned long) (t->latency_sum / t->events / 1000),
+	      (unsigned long) (t->latency_max / 1000), TOUCH_INTERVAL_US);
+  *t->rc = 1;
+  CORO_END(c);
+}
+
+int touch_spawn(struct coro_sched *s, int *rc) {
+  touch_task.rc = rc;
+  *rc = 0;
+
+  return coro_spawn(s, &touch_task.coro, "Tactile", touch_run, &touch_task);
+}
+
+int touch_test(void) {
+  struct coro_sched s;
+  int rc;
+
+  coro_sched_init(&s);
+  if (!touch_spawn(&s, &rc))
+    return 0;
+  coro_run(&s);
+
+  return rc;
+}
+
+#ifndef EV3_SUITE
 int main (int argc, char *argv[]) {
-  dword poll_ms = 0U;
   int rc;
 
   // Variables constantes spécifique à zlog
@@ -155,22 +302,18 @@ int main (int argc, char *argv[]) {
   
   zlog_info(zlog_c, "Hello IIUN!");
 
+  latency_start();
+
   if(!init()) {
     zlog_fini();
     return EXIT_FAILURE;
   }
+  telemetry_start_env();
 
   // Changer la lumière à rouge
   set_light(LIT_LEFT, LIT_RED);
   set_light(LIT_RIGHT, LIT_RED);
 
-  // Changer la fréquence à laquelle le capteur prend des mesures
-  get_sensor_poll_ms(SENSOR_TOUCH_SN, &poll_ms);
-  zlog_info(zlog_c, "Avant : %u", poll_ms);
-  set_sensor_poll_ms(SENSOR_TOUCH_SN, 250U);
-  get_sensor_poll_ms(SENSOR_TOUCH_SN, &poll_ms);
-  zlog_info(zlog_c, "Après : %u", poll_ms);
-
   // Test tactile
   zlog_info(zlog_c, "=== Test tactile ===");
   touch_test();
@@ -181,9 +324,12 @@ int main (int argc, char *argv[]) {
 
   zlog_info(zlog_c, "Bye IIUN!");
   
+  latency_stop();
+  telemetry_stop();
   ev3_uninit();
 
   zlog_fini();
   
   return EXIT_SUCCESS;
 }
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Notification des appuis et relâchements du capteur tactile.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <ev3.h>
+#include <ev3_sensor.h>
+
+#include "touch_watch.h"
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *watch_thread(void *arg) {
+  struct touch_watch *w = arg;
+  struct touch_event e;
+  struct timespec next;
+  uint64_t one = 1;
+  int value;
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (atomic_load_explicit(&w->running, memory_order_relaxed)) {
+    if (sensor_reader_value(&w->reader, 0, &value) != 0) {
+      atomic_fetch_add_explicit(&w->reads, 1, memory_order_relaxed);
+      value = value != 0;
+      if (value != w->state) {
+	w->state = value;
+	e.t_ns = now_ns();
+	e.pressed = value;
+	atomic_fetch_add_explicit(&w->edges, 1, memory_order_relaxed);
+	if (spsc_ring_push(&w->events, &e))
+	  write(w->efd, &one, sizeof(one));
+	if (w->callback)
+	  w->callback(&e, w->arg);
+      }
+    }
+
+    next.tv_nsec += w->interval_us * 1000L;
+    while (next.tv_nsec >= 1000000000L) {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+      ;
+  }
+
+  return NULL;
+}
+
+int touch_watch_start(struct touch_watch *w, uint8_t sn,
+		      unsigned int interval_us, touch_callback callback,
+		      void *arg) {
+  int value;
+
+  if (!sensor_reader_open(&w->reader, sn))
+    return 0;
+  if (!spsc_ring_init(&w->events, TOUCH_WATCH_EVENTS,
+		      sizeof(struct touch_event))) {
+    sensor_reader_close(&w->reader);
+    return 0;
+  }
+  w->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (w->efd < 0) {
+    spsc_ring_destroy(&w->events);
+    sensor_reader_close(&w->reader);
+    return 0;
+  }
+  // L'état initial ne produit pas d'événement
+  w->state = sensor_reader_value(&w->reader, 0, &value) != 0 && value != 0;
+  w->interval_us = interval_us;
+  w->callback = callback;
+  w->arg = arg;
+  atomic_init(&w->reads, 0);
+  atomic_init(&w->edges, 0);
+  atomic_init(&w->running, 1);
+  if (pthread_create(&w->thread, NULL, watch_thread, w) != 0) {
+    close(w->efd);
+    spsc_ring_destroy(&w->events);
+    sensor_reader_close(&w->reader);
+    return 0;
+  }
+  if (pthread_getcpuclockid(w->thread, &w->cpu_clock) != 0)
+    w->cpu_clock = -1;
+
+  return 1;
+}
+
+void touch_watch_stop(struct touch_watch *w) {
+  atomic_store(&w->running, 0);
+  pthread_join(w->thread, NULL);
+  close(w->efd);
+  spsc_ring_destroy(&w->events);
+  sensor_reader_close(&w->reader);
+}
+
+int touch_watch_fd(const struct touch_watch *w) {
+  return w->efd;
+}
+
+int touch_watch_next(struct touch_watch *w, struct touch_event *e) {
+  uint64_t count;
+
+  /*
+   * Le compteur de l'eventfd est remis à zéro avant de vider la file: un
+   * événement poussé ensuite le réarme par sa propre écriture et aucun
+   * réveil n'est perdu.
+   */
+  read(w->efd, &count, sizeof(count));
+
+  return spsc_ring_pop(&w->events, e);
+}
+
+long touch_watch_cpu_us(const struct touch_watch *w) {
+  struct timespec ts;
+
+  if (w->cpu_clock == (clockid_t) -1 || clock_gettime(w->cpu_clock, &ts) != 0)
+    return -1;
+  return ts.tv_sec * 1000000L + ts.tv_nsec / 1000L;
+}
@@ -0,0 +1,77 @@
+/*
+ * Notification des appuis et relâchements du capteur tactile.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * La classe lego-sensor ne signale pas les changements de 'value0' par
+ * poll(), il faut donc lire l'attribut. Un fil de surveillance le relit
+ * avec le lecteur à descripteurs persistants (un seul pread par lecture) et
+ * ne signale que les fronts: chaque appui ou relâchement est horodaté,
+ * placé dans une file sans verrou et signalé par un eventfd utilisable avec
+ * poll/epoll, ou par une fonction de rappel.
+ */
+
+#ifndef TOUCH_WATCH_H
+#define TOUCH_WATCH_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "sensor_reader.h"
+#include "spsc_ring.h"
+
+// Nombre d'événements en attente avant perte
+#define TOUCH_WATCH_EVENTS 32
+
+struct touch_event {
+  // Horodatage CLOCK_MONOTONIC de la lecture ayant vu le front
+  uint64_t t_ns;
+  // 1 pour un appui, 0 pour un relâchement
+  int pressed;
+};
+
+/*
+ * Fonction de rappel, appelée depuis le fil de surveillance. Elle doit
+ * rendre la main rapidement.
+ */
+typedef void (*touch_callback)(const struct touch_event *e, void *arg);
+
+struct touch_watch {
+  struct sensor_reader reader;
+  struct spsc_ring events;
+  pthread_t thread;
+  clockid_t cpu_clock;
+  atomic_int running;
+  unsigned int interval_us;
+  int efd;
+  int state;
+  touch_callback callback;
+  void *arg;
+  // Statistiques du fil de surveillance
+  atomic_ulong reads;
+  atomic_ulong edges;
+};
+
+/*
+ * Démarrage de la surveillance du capteur tactile 'sn', lu toutes les
+ * 'interval_us'. 'callback' peut être NULL.
+ * Retourne 1 en cas de succès, 0 sinon.
+ */
+int touch_watch_start(struct touch_watch *w, uint8_t sn,
+		      unsigned int interval_us, touch_callback callback,
+		      void *arg);
+void touch_watch_stop(struct touch_watch *w);
+
+// Descripteur lisible (POLLIN) tant que des événements sont en attente
+int touch_watch_fd(const struct touch_watch *w);
+
+// Retrait d'un événement sans bloquer. Retourne 0 s'il n'y en a pas.
+int touch_watch_next(struct touch_watch *w, struct touch_event *e);
+
+// Temps processeur consommé par le fil de surveillance en microsecondes
+long touch_watch_cpu_us(const struct touch_watch *w);
+
+#endif
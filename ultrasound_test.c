@@ -17,6 +17,13 @@
 #include <ev3_port.h>
 #include <ev3_sensor.h>
 
+#include "coro.h"
+#include "discovery.h"
+#include "latency.h"
+#include "suite.h"
+#include "telemetry.h"
+#include "us_filter.h"
+#include "us_sampler.h"
 #include "zlog.h"
 
 /*
@@ -24,109 +31,178 @@
  * et traitement d'erreur.
  */
 #define SET_SENSOR_MODE_INX(sn,m) do {					\
-    _bytes = set_sensor_mode_inx((sn), (m));				\
+    LATENCY_TIME(_bytes, LATENCY_SENSOR, (sn), "mode",			\
+		 set_sensor_mode_inx((sn), (m)));			\
     if (_bytes == 0) {							\
       zlog_error(zlog_c, "Impossible de changer en mode '"#m"' pour le capteur '%s'", ev3_sensor_type(ev3_sensor[(sn)].type_inx)); \
-      ev3_uninit();							\
       return 0;								\
     }									\
+    telemetry_mode((sn), (m));						\
   } while(0);
 
-#define GET_SENSOR_VALUE0(sn,v) do {					\
-    _bytes = get_sensor_value0((sn), (v));				\
-    if (_bytes == 0) {							\
-      zlog_error(zlog_c,						\
-		 "Impossible d'assigner une valeur du capteur '%s'",	\
-		 ev3_sensor_type(ev3_sensor[(sn)].type_inx));		\
-      ev3_uninit();							\
-      return 0;								\
-    }									\
-  } while(0);
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+// Paramètres du test constamment
+#define CONTINUOUS_PERIOD_US 20000
+#define CONTINUOUS_CAPACITY 64
+#define CONTINUOUS_DURATION_MS 5000
+#define CONTINUOUS_REPORT_MS 250
+#define CONTINUOUS_WINDOW 5
 
 // Numéro de séquence du capteur à ultrasons
 #define SENSOR_ULTRASOUND_SN sensor_sn[0]
 
-// Drapeau pour verifier la présence des capteurs
-#define HAVE_SENSOR_ULTRASOUND 0b1
-
+#ifdef EV3_SUITE
+// Catégorie zlog définie par le programme (voir suite.c)
+extern zlog_category_t *zlog_c;
+#else
 // Variable globale spécifique à zlog
 zlog_category_t *zlog_c;
+#endif
 
 // Tableau pour les numéros de séquence des capteurs
-uint8_t sensor_sn[SENSOR_DESC__LIMIT_];
+static uint8_t sensor_sn[SENSOR_DESC__LIMIT_];
 
 // Variable globale pour les macros
-size_t _bytes;
+static size_t _bytes;
 
-int init(void) {
-  int i, rc;
-  size_t bytes;
-  unsigned char sensors = 0;
+/*
+ * Mise en correspondance du capteur à ultrasons dans la table 'devices'.
+ * Retourne 1 si le capteur a été retrouvé, 0 sinon.
+ */
+int ultrasound_setup(struct ev3_device_map *devices) {
+  int i;
   uint8_t sn;
 
   for (i = 0; i < SENSOR_DESC__LIMIT_; i++)
     sensor_sn[i] = DESC_LIMIT;
 
-  // Initialisation de la brique intelligente EV3
-  rc = ev3_init();
-  if (rc == 1)
-    zlog_info(zlog_c, "Brique intelligente EV3 trouvée");
-  else {
-    if (rc == 0)
-      zlog_fatal(zlog_c, "Brique intelligente EV3 pas trouvée");
-    else
-      zlog_error(zlog_c, "ev3_init retourne erreur '%d'", rc);
-    return rc;
-  }
-  // Initialisation des ports EV3
-  rc = ev3_port_init();
-  if (rc == -1) {
-    zlog_error(zlog_c, "Erreur durant l'initialisation des ports EV3");
-    ev3_uninit();
-    return rc;
-  } else if (rc != 8)
-    zlog_warn(zlog_c, "'%d/8' ports EV3 retrouvé");
-  else
-    zlog_info(zlog_c, "Tous ports EV3 retrouvé");
-  // Initialisation des capteurs EV3
-  rc = ev3_sensor_init();
-  if (rc == -1) {
-    zlog_error(zlog_c, "Erreur durant l'initialisation des capteurs EV3");
-    ev3_uninit();
-    return rc;
-  } else
-    zlog_info(zlog_c, "'%d' capteur(s) EV3 retrouvé", rc);
   /*
-   * Assurer que le capteur de couleur est mis dans la brique et mettre en
+   * Assurer que le capteur à ultrasons est mis dans la brique et mettre en
    * correspondance les numéros de séquence.
    */
-  for (i = 0; i < SENSOR_DESC__LIMIT_; i++)
-    if (ev3_sensor[i].type_inx == LEGO_EV3_US) {
-      sensors |= HAVE_SENSOR_ULTRASOUND;
-      SENSOR_ULTRASOUND_SN = i;
-      if (ev3_search_sensor_plugged_in(ev3_sensor[i].port, ev3_sensor[i].extport, &sn, 0)) {
-	SET_SENSOR_MODE_INX(sn, LEGO_EV3_US_US_LISTEN);
-      } else {
-	zlog_error(zlog_c, "Le capteur à ultrasons n'est pas connecté à la brique intelligente EV3");
-	return 0;
-      }
-      break;
-    }
-
-  if (sensors != HAVE_SENSOR_ULTRASOUND) {
+  sn = discovery_sensor(devices, LEGO_EV3_US);
+  if (sn == DESC_LIMIT) {
     zlog_fatal(zlog_c, "Le capteur à ultrasons n'a pas été retrouvé");
     return 0;
   }
+  SENSOR_ULTRASOUND_SN = sn;
+  SET_SENSOR_MODE_INX(sn, LEGO_EV3_US_US_LISTEN);
 
   return 1;
 }
 
-int continuous_test(void) {
+#ifndef EV3_SUITE
+/*
+ * Initialisation de la brique intelligente EV3 et découverte des capteurs.
+ * Valeurs de retour: voir discovery_init et ultrasound_setup.
+ */
+static int init(void) {
+  static struct ev3_device_map devices;
+  int rc;
+
+  rc = discovery_init(&devices, DISCOVERY_SENSORS);
+  if (rc != 1)
+    return rc;
+  if (!ultrasound_setup(&devices)) {
+    ev3_uninit();
+    return 0;
+  }
 
-  // A compléter
-  
   return 1;
 }
+#endif
+
+/*
+ * Etat de la tâche de mesure constante, gardé d'une reprise à l'autre (voir
+ * coro.h).
+ */
+struct continuous_task {
+  struct coro coro;
+  struct us_sampler sampler;
+  struct us_filter filter;
+  struct us_filtered filtered;
+  int t;
+  int have;
+  int *rc;
+};
+
+static struct continuous_task continuous_task;
+
+/*
+ * Mesure constante de la distance. Le fil d'échantillonnage lit le capteur
+ * et la tâche ne fait que consulter la dernière mesure et le lot de mesures
+ * accumulées, sans jamais attendre sysfs. Entre deux rapports, la tâche rend
+ * la main à l'ordonnanceur.
+ */
+static int continuous_run(struct coro *c, void *arg) {
+  struct continuous_task *k = arg;
+  struct us_sample latest, batch[CONTINUOUS_CAPACITY];
+  size_t i, n;
+  int min, max;
+
+  CORO_BEGIN(c);
+  us_filter_init(&k->filter, CONTINUOUS_WINDOW, 1);
+  k->have = 0;
+
+  if (!us_sampler_start(&k->sampler, SENSOR_ULTRASOUND_SN,
+			CONTINUOUS_PERIOD_US, CONTINUOUS_CAPACITY)) {
+    zlog_error(zlog_c, "Impossible de démarrer l'échantillonnage du capteur à ultrasons");
+    *k->rc = 0;
+    CORO_EXIT(c);
+  }
+
+  for (k->t = 0; k->t < CONTINUOUS_DURATION_MS; k->t += CONTINUOUS_REPORT_MS) {
+    CORO_SLEEP_US(c, CONTINUOUS_REPORT_MS * 1000);
+    n = us_sampler_batch(&k->sampler, batch, CONTINUOUS_CAPACITY);
+    if (!us_sampler_latest(&k->sampler, &latest)) {
+      zlog_warn(zlog_c, "Aucune mesure du capteur à ultrasons disponible");
+      continue;
+    }
+    min = max = latest.distance_mm;
+    for (i = 0; i < n; i++) {
+      min = MIN(min, batch[i].distance_mm);
+      max = MAX(max, batch[i].distance_mm);
+      k->have |= us_filter_update(&k->filter, batch[i].t_ns,
+				  batch[i].distance_mm, &k->filtered);
+    }
+    zlog_info(zlog_c, "Distance : %d mm (âge %ld us), %u mesures entre %d et %d mm",
+	      latest.distance_mm, us_sample_age_us(&latest), (unsigned int) n,
+	      min, max);
+    if (k->have)
+      zlog_info(zlog_c, "Distance filtrée : %d mm, %d mm/s%s",
+		k->filtered.distance_mm, k->filtered.rate_mm_s,
+		k->filtered.confident ? "" : " (peu fiable)");
+  }
+
+  zlog_info(zlog_c, "%lu mesures, %lu erreurs, %lu perdues",
+	    atomic_load(&k->sampler.samples), atomic_load(&k->sampler.errors),
+	    us_sampler_drops(&k->sampler));
+  us_sampler_stop(&k->sampler);
+  *k->rc = 1;
+  CORO_END(c);
+}
+
+int continuous_spawn(struct coro_sched *s, int *rc) {
+  continuous_task.rc = rc;
+  *rc = 0;
+
+  return coro_spawn(s, &continuous_task.coro, "Ultrasons", continuous_run,
+		    &continuous_task);
+}
+
+int continuous_test(void) {
+  struct coro_sched s;
+  int rc;
+
+  coro_sched_init(&s);
+  if (!continuous_spawn(&s, &rc))
+    return 0;
+  coro_run(&s);
+
+  return rc;
+}
 
 int single_test(void) {
 
@@ -135,6 +211,7 @@ int single_test(void) {
   return 1;
 }
 
+#ifndef EV3_SUITE
 int main(int argc, char *argv[]) {
   int rc;
   size_t bytes;
@@ -157,10 +234,13 @@ int main(int argc, char *argv[]) {
   
   zlog_info(zlog_c, "Hello IIUN!");
 
+  latency_start();
+
   if(!init()) {
     zlog_fini();
     return EXIT_FAILURE;
   }
+  telemetry_start_env();
 
   // Changer la lumière à rouge
   set_light(LIT_LEFT, LIT_RED);
@@ -183,9 +263,12 @@ int main(int argc, char *argv[]) {
   
   zlog_info(zlog_c, "Bye IIUN!");
 
+  latency_stop();
+  telemetry_stop();
   ev3_uninit();
 
   zlog_fini();
 
   return EXIT_SUCCESS;
 }
+#endif
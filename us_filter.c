@@ -0,0 +1,190 @@
+/*
+ * Filtrage en continu des distances du capteur à ultrasons.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "us_filter.h"
+
+#define FRAC 8
+
+/*
+ * Médiane glissante à deux tas. heap[0] est la médiane, heap[-1], heap[-2],
+ * ... forment un tas max des valeurs inférieures et heap[1], heap[2], ...
+ * un tas min des valeurs supérieures; le parent de i est i / 2. Les tas
+ * contiennent les indices des mesures dans 'data', et 'pos' donne la
+ * position de chaque mesure dans les tas pour remplacer la plus ancienne.
+ */
+#define MIN_COUNT(f) (((f)->count - 1) / 2)
+#define MAX_COUNT(f) ((f)->count / 2)
+
+static int less(const struct us_filter *f, int i, int j) {
+  return f->data[f->heap[i]] < f->data[f->heap[j]];
+}
+
+// Echange des positions i et j si heap[i] < heap[j]
+static int exchange(struct us_filter *f, int i, int j) {
+  int t;
+
+  if (!less(f, i, j))
+    return 0;
+  t = f->heap[i];
+  f->heap[i] = f->heap[j];
+  f->heap[j] = t;
+  f->pos[f->heap[i]] = i;
+  f->pos[f->heap[j]] = j;
+
+  return 1;
+}
+
+static void min_sort_down(struct us_filter *f, int i) {
+  for (; i <= MIN_COUNT(f); i *= 2) {
+    if (i > 1 && i < MIN_COUNT(f) && less(f, i + 1, i))
+      i++;
+    if (!exchange(f, i, i / 2))
+      break;
+  }
+}
+
+static void max_sort_down(struct us_filter *f, int i) {
+  for (; i >= -MAX_COUNT(f); i *= 2) {
+    if (i < -1 && i > -MAX_COUNT(f) && less(f, i, i - 1))
+      i--;
+    if (!exchange(f, i / 2, i))
+      break;
+  }
+}
+
+// Remontée dans le tas min; retourne 1 si la valeur est devenue la médiane
+static int min_sort_up(struct us_filter *f, int i) {
+  while (i > 0 && exchange(f, i, i / 2))
+    i /= 2;
+  return i == 0;
+}
+
+static int max_sort_up(struct us_filter *f, int i) {
+  while (i < 0 && exchange(f, i / 2, i))
+    i /= 2;
+  return i == 0;
+}
+
+// Remplacement de la plus ancienne mesure par 'value'
+static void median_insert(struct us_filter *f, int value) {
+  int full = f->count == f->window;
+  int p = f->pos[f->next];
+  int old = f->data[f->next];
+
+  f->data[f->next] = value;
+  f->next = (f->next + 1) % f->window;
+  if (!full)
+    f->count++;
+
+  if (p > 0) {
+    if (full && old < value)
+      min_sort_down(f, p * 2);
+    else if (min_sort_up(f, p))
+      max_sort_down(f, -1);
+  } else if (p < 0) {
+    if (full && value < old)
+      max_sort_down(f, p * 2);
+    else if (max_sort_up(f, p))
+      min_sort_down(f, 1);
+  } else {
+    if (MAX_COUNT(f))
+      max_sort_down(f, -1);
+    if (MIN_COUNT(f))
+      min_sort_down(f, 1);
+  }
+}
+
+void us_filter_init(struct us_filter *f, int window, int smooth) {
+  int i;
+
+  memset(f, 0, sizeof(*f));
+  if (window < 1)
+    window = 1;
+  if (window > US_FILTER_WINDOW_MAX)
+    window = US_FILTER_WINDOW_MAX;
+  f->window = window;
+  f->smooth = smooth;
+  f->heap = f->heap_buf + window / 2;
+  // Positions initiales alternées autour de la médiane
+  for (i = window - 1; i >= 0; i--) {
+    f->pos[i] = ((i + 1) / 2) * ((i & 1) ? -1 : 1);
+    f->heap[f->pos[i]] = i;
+  }
+}
+
+int us_filter_median(const struct us_filter *f) {
+  int v;
+
+  if (f->count == 0)
+    return -1;
+  v = f->data[f->heap[0]];
+  if ((f->count & 1) == 0)
+    v = (v + f->data[f->heap[-1]]) / 2;
+
+  return v;
+}
+
+int us_filter_update(struct us_filter *f, uint64_t t_ns, int distance_mm,
+		     struct us_filtered *out) {
+  int32_t z, predicted, residual, dt_us;
+  int gated = 0;
+
+  if (distance_mm <= 0 || distance_mm >= US_FILTER_NO_ECHO_MM) {
+    f->misses++;
+  } else {
+    f->misses = 0;
+    median_insert(f, distance_mm);
+    z = us_filter_median(f) << FRAC;
+
+    if (!f->started) {
+      f->x = z;
+      f->v = 0;
+      f->started = 1;
+    } else {
+      dt_us = (int32_t) ((t_ns - f->t_ns) / 1000);
+      if (dt_us <= 0)
+	dt_us = 1;
+      predicted = f->x + (int32_t) ((int64_t) f->v * dt_us / 1000000);
+      residual = z - predicted;
+      if (!f->smooth) {
+	f->v = (int32_t) ((int64_t) (z - f->x) * 1000000 / dt_us);
+	f->x = z;
+      } else if (abs(residual) > (US_FILTER_GATE_MM << FRAC) &&
+		 f->rejects < US_FILTER_MAX_REJECTS) {
+	// Médiane incohérente: la prédiction est gardée
+	f->x = predicted;
+	f->rejects++;
+	gated = 1;
+      } else if (f->rejects >= US_FILTER_MAX_REJECTS &&
+		 abs(residual) > (US_FILTER_GATE_MM << FRAC)) {
+	// Ecart persistant: la distance a vraiment changé
+	f->x = z;
+	f->v = 0;
+	f->rejects = 0;
+      } else {
+	f->x = predicted + residual * US_FILTER_ALPHA / 256;
+	f->v += (int32_t) ((int64_t) residual * US_FILTER_BETA / 256 *
+			   1000000 / dt_us);
+	f->rejects = 0;
+      }
+    }
+    f->t_ns = t_ns;
+  }
+
+  if (!f->started)
+    return 0;
+  out->t_ns = t_ns;
+  out->distance_mm = f->x >> FRAC;
+  out->rate_mm_s = f->v >> FRAC;
+  out->confident = f->misses < US_FILTER_MAX_MISSES && !gated &&
+    f->rejects == 0 && f->count > f->window / 2;
+
+  return 1;
+}
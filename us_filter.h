@@ -0,0 +1,86 @@
+/*
+ * Filtrage en continu des distances du capteur à ultrasons.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Chaque mesure passe par trois étages, sans allocation et en entiers:
+ * - les absences d'écho (2550 mm) et valeurs nulles sont écartées,
+ * - une médiane glissante sur une fenêtre configurable, tenue dans deux
+ *   tas autour de la médiane (mise à jour en O(log n)), élimine les pics
+ *   isolés et les échos multiples,
+ * - un filtre alpha-bêta optionnel lisse la médiane et estime la vitesse
+ *   de rapprochement. Une médiane trop éloignée de la prédiction est
+ *   ignorée, sauf si l'écart persiste: c'est alors un vrai changement de
+ *   distance et le filtre repart de la médiane.
+ *
+ * La sortie est la distance filtrée, sa dérivée et un indicateur de
+ * confiance: fenêtre assez remplie, écho présent et médiane cohérente avec
+ * la prédiction.
+ */
+
+#ifndef US_FILTER_H
+#define US_FILTER_H
+
+#include <stdint.h>
+
+#define US_FILTER_WINDOW_MAX 31
+// Valeur rendue par le capteur en l'absence d'écho
+#define US_FILTER_NO_ECHO_MM 2550
+// Gains du filtre alpha-bêta en 256èmes
+#define US_FILTER_ALPHA 96
+#define US_FILTER_BETA 16
+// Ecart toléré entre la médiane et la prédiction
+#define US_FILTER_GATE_MM 150
+// Médianes écartées de suite avant de repartir de la médiane
+#define US_FILTER_MAX_REJECTS 3
+// Absences d'écho de suite avant de perdre la confiance
+#define US_FILTER_MAX_MISSES 3
+
+struct us_filter {
+  int window;
+  int smooth;
+  // Médiane glissante: mesures en ordre d'arrivée, position de chaque
+  // mesure dans les tas, et tas (max < 0, médiane en 0, min > 0)
+  int data[US_FILTER_WINDOW_MAX];
+  int pos[US_FILTER_WINDOW_MAX];
+  int heap_buf[US_FILTER_WINDOW_MAX];
+  int *heap;
+  int count;
+  int next;
+  // Filtre alpha-bêta: distance en mm et vitesse en mm/s, 8 bits de fraction
+  int started;
+  uint64_t t_ns;
+  int32_t x;
+  int32_t v;
+  int rejects;
+  int misses;
+};
+
+struct us_filtered {
+  uint64_t t_ns;
+  int distance_mm;
+  // Dérivée de la distance, négative quand un obstacle se rapproche
+  int rate_mm_s;
+  int confident;
+};
+
+/*
+ * Préparation d'un filtre à médiane sur 'window' mesures (tronquée à
+ * US_FILTER_WINDOW_MAX), suivie d'un lissage alpha-bêta si 'smooth'.
+ */
+void us_filter_init(struct us_filter *f, int window, int smooth);
+
+/*
+ * Ajout de la mesure 'distance_mm' prise à 't_ns' (CLOCK_MONOTONIC) et
+ * sortie filtrée dans 'out'.
+ * Retourne 1 si une distance est disponible, 0 tant qu'aucune mesure
+ * valide n'a été reçue.
+ */
+int us_filter_update(struct us_filter *f, uint64_t t_ns, int distance_mm,
+		     struct us_filtered *out);
+
+// Médiane de la fenêtre courante, ou -1 si elle est vide
+int us_filter_median(const struct us_filter *f);
+
+#endif
@@ -0,0 +1,252 @@
+/*
+ * Banc d'essai du filtre des distances du capteur à ultrasons.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Des traces synthétiques dont la vraie distance est connue (bruit seul,
+ * rapprochement, pics d'absence d'écho et d'échos multiples, saut de
+ * distance) passent par la médiane seule et par la médiane suivie du
+ * filtre alpha-bêta. Pour chacune sont donnés l'erreur quadratique moyenne
+ * et maximale, le nombre de sorties à plus de 100 mm de la vérité, l'erreur
+ * sur la vitesse et la part des sorties jugées fiables. Le débit du filtre
+ * est mesuré à part. Le programme échoue si le filtre est moins précis que
+ * les mesures brutes, si une erreur quadratique moyenne dépasse la borne
+ * de sa trace, si la sortie n'a pas rejoint la nouvelle distance d'un saut
+ * après window / 2 + 1 mesures (plus US_FILTER_MAX_REJECTS médianes
+ * écartées pour l'alpha-bêta) ou si une sortie jugée fiable de
+ * l'alpha-bêta est à plus de US_FILTER_GATE_MM de la vérité, hors des
+ * window / 2 premières mesures d'un saut où la médiane n'a pas bougé. Seul
+ * l'alpha-bêta compare la médiane à une prédiction: la confiance de la
+ * médiane seule ne dit que si la fenêtre est assez remplie.
+ *
+ * Matériel demandé: aucun
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "us_filter.h"
+#include "zlog.h"
+
+#define TRACE_SAMPLES 1000
+#define TRACE_PERIOD_US 20000
+#define FILTER_WINDOW 5
+#define THROUGHPUT_SAMPLES 1000000
+#define OFF_MM 100
+
+// Variable globale spécifique à zlog
+zlog_category_t *zlog_c;
+
+struct trace {
+  const char *name;
+  // Bornes de l'erreur quadratique moyenne de la médiane et de l'alpha-bêta
+  double max_rms[2];
+  // Mesure du saut, ou -1
+  int step;
+  int truth[TRACE_SAMPLES];
+  int rate[TRACE_SAMPLES];
+  int raw[TRACE_SAMPLES];
+};
+
+struct result {
+  double rms;
+  // Mesures depuis le saut jusqu'à la première d'une suite à moins de
+  // OFF_MM de la vérité jusqu'à la fin, comprise
+  int recovery;
+  // Plus grande erreur d'une sortie jugée fiable, hors des window / 2
+  // mesures d'un saut que la médiane ne peut pas encore voir
+  double confident_max;
+};
+
+static unsigned int seed = 2024;
+
+static int rnd(int n) {
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) % n;
+}
+
+static long long now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Trace de distance d0 + rate * t, avec un saut à 'step_mm' à mi-parcours
+ * si non nul, un bruit de ±noise mm et 'spikes' % de pics.
+ */
+static void make_trace(struct trace *t, const char *name, int d0, int rate,
+		       int step_mm, int noise, int spikes, double median_rms,
+		       double smooth_rms) {
+  int i, d;
+
+  t->name = name;
+  t->max_rms[0] = median_rms;
+  t->max_rms[1] = smooth_rms;
+  t->step = step_mm ? TRACE_SAMPLES / 2 : -1;
+  for (i = 0; i < TRACE_SAMPLES; i++) {
+    d = d0 + (int) ((long long) rate * i * TRACE_PERIOD_US / 1000000);
+    if (step_mm && i >= TRACE_SAMPLES / 2)
+      d = step_mm;
+    t->truth[i] = d;
+    t->rate[i] = step_mm ? 0 : rate;
+    t->raw[i] = d + rnd(2 * noise + 1) - noise;
+    if (rnd(100) < spikes)
+      t->raw[i] = rnd(2) ? US_FILTER_NO_ECHO_MM : 2 * d;
+  }
+}
+
+/*
+ * Passage de la trace dans un filtre; 'raw' compare directement les mesures
+ * brutes. Les erreurs sont rendues dans 'r'.
+ */
+static void evaluate(const struct trace *t, int window, int smooth, int raw,
+		     const char *label, struct result *r) {
+  struct us_filter f;
+  struct us_filtered out;
+  double err, sq = 0, rate_sq = 0, max = 0;
+  int i, n = 0, off = 0, confident = 0, settled = -1;
+
+  r->confident_max = 0;
+
+  us_filter_init(&f, window, smooth);
+  for (i = 0; i < TRACE_SAMPLES; i++) {
+    if (raw) {
+      out.distance_mm = t->raw[i];
+      out.rate_mm_s = t->rate[i];
+      out.confident = 1;
+    } else if (!us_filter_update(&f, (uint64_t) i * TRACE_PERIOD_US * 1000,
+				 t->raw[i], &out))
+      continue;
+    err = out.distance_mm - t->truth[i];
+    sq += err * err;
+    rate_sq += (double) (out.rate_mm_s - t->rate[i]) * (out.rate_mm_s - t->rate[i]);
+    if (fabs(err) > max)
+      max = fabs(err);
+    if (fabs(err) > OFF_MM)
+      off++;
+    if (fabs(err) > OFF_MM || i < t->step)
+      settled = -1;
+    else if (settled < 0)
+      settled = i;
+    if (out.confident)
+      confident++;
+    if (out.confident && fabs(err) > r->confident_max &&
+	(t->step < 0 || i < t->step || i >= t->step + window / 2))
+      r->confident_max = fabs(err);
+    n++;
+  }
+  r->rms = sqrt(sq / n);
+  r->recovery = t->step < 0 ? 0 : settled < 0 ? TRACE_SAMPLES : settled - t->step + 1;
+  zlog_info(zlog_c, "%-13s %-10s : RMS %6.1f mm, max %5.0f mm, %3d hors %d mm, vitesse RMS %6.0f mm/s, %3d%% fiables, %4.0f mm au pire si fiable",
+	    t->name, label, r->rms, max, off, OFF_MM,
+	    raw ? 0.0 : sqrt(rate_sq / n), 100 * confident / n, r->confident_max);
+  if (t->step >= 0)
+    zlog_info(zlog_c, "%-13s %-10s : saut rejoint en %d mesure(s)",
+	      t->name, label, r->recovery);
+}
+
+/*
+ * Vérification d'un étage de filtre ('smooth' pour l'alpha-bêta) contre
+ * les mesures brutes et les bornes de la trace.
+ * Retourne 1 en cas de succès, 0 sinon.
+ */
+static int check(const struct trace *t, const struct result *raw,
+		 const struct result *r, int smooth, const char *label) {
+  int recovery = FILTER_WINDOW / 2 + 1 + (smooth ? US_FILTER_MAX_REJECTS : 0);
+  int ok = 1;
+
+  if (r->rms > raw->rms) {
+    zlog_error(zlog_c, "%s, %s : le filtre est moins précis que les mesures brutes",
+	       t->name, label);
+    ok = 0;
+  }
+  if (r->rms > t->max_rms[smooth]) {
+    zlog_error(zlog_c, "%s, %s : RMS de %.1f mm au-delà de %.1f mm",
+	       t->name, label, r->rms, t->max_rms[smooth]);
+    ok = 0;
+  }
+  if (r->recovery > recovery) {
+    zlog_error(zlog_c, "%s, %s : saut rejoint en %d mesures au lieu de %d",
+	       t->name, label, r->recovery, recovery);
+    ok = 0;
+  }
+  if (smooth && r->confident_max > US_FILTER_GATE_MM) {
+    zlog_error(zlog_c, "%s, %s : sortie fiable à %.0f mm de la vérité",
+	       t->name, label, r->confident_max);
+    ok = 0;
+  }
+
+  return ok;
+}
+
+static void throughput(int smooth, const char *label) {
+  struct us_filter f;
+  struct us_filtered out;
+  long long start, ns;
+  int i, sink = 0;
+
+  us_filter_init(&f, FILTER_WINDOW, smooth);
+  start = now_ns();
+  for (i = 0; i < THROUGHPUT_SAMPLES; i++)
+    if (us_filter_update(&f, (uint64_t) i * TRACE_PERIOD_US * 1000,
+			 500 + rnd(200), &out))
+      sink += out.distance_mm;
+  ns = now_ns() - start;
+  zlog_info(zlog_c, "Débit %-10s : %.0f mesures/s, %.1f ns/mesure (%d)",
+	    label, THROUGHPUT_SAMPLES * 1e9 / ns, (double) ns / THROUGHPUT_SAMPLES,
+	    sink & 1);
+}
+
+int main(int argc, char *argv[]) {
+  static struct trace traces[4];
+  struct result raw, median, smooth;
+  int i, rc, failed = 0;
+
+  (void) argc;
+  (void) argv;
+
+  // Variables constantes spécifique à zlog
+  const char *zlog_conf = "/etc/zlog.conf";
+  const char *zlog_cat  = "project";
+
+  rc = zlog_init(zlog_conf);
+  if (rc) {
+    printf("L'initialisation de zlog avec '%s' a échoué\n", zlog_conf);
+    return EXIT_FAILURE;
+  }
+
+  zlog_c = zlog_get_category(zlog_cat);
+  if (!zlog_c) {
+    printf("zlog est incapable de retrouver la catégorie '%s'\n", zlog_cat);
+    zlog_fini();
+    return EXIT_FAILURE;
+  }
+
+  make_trace(&traces[0], "Bruit", 800, 0, 0, 15, 0, 9, 8);
+  make_trace(&traces[1], "Rapprochement", 1500, -60, 0, 15, 0, 10, 8);
+  make_trace(&traces[2], "Pics", 1500, -60, 0, 15, 10, 10, 9);
+  make_trace(&traces[3], "Saut", 1200, 0, 400, 15, 10, 50, 80);
+
+  zlog_info(zlog_c, "Fenêtre de %d mesures, période de %d ms",
+	    FILTER_WINDOW, TRACE_PERIOD_US / 1000);
+  for (i = 0; i < 4; i++) {
+    evaluate(&traces[i], FILTER_WINDOW, 0, 1, "brut", &raw);
+    evaluate(&traces[i], FILTER_WINDOW, 0, 0, "médiane", &median);
+    evaluate(&traces[i], FILTER_WINDOW, 1, 0, "alpha-bêta", &smooth);
+    if (!check(&traces[i], &raw, &median, 0, "médiane") ||
+	!check(&traces[i], &raw, &smooth, 1, "alpha-bêta"))
+      failed = 1;
+  }
+
+  throughput(0, "médiane");
+  throughput(1, "alpha-bêta");
+
+  zlog_fini();
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
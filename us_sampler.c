@@ -0,0 +1,125 @@
+/*
+ * Echantillonnage du capteur à ultrasons en arrière-plan.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <errno.h>
+#include <time.h>
+
+#include <ev3.h>
+#include <ev3_sensor.h>
+
+#include "ready.h"
+#include "us_sampler.h"
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void publish(struct us_sampler *s, const struct us_sample *sample) {
+  unsigned int seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+
+  // Compteur impair pendant l'écriture
+  atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  s->latest = *sample;
+  atomic_store_explicit(&s->seq, seq + 2, memory_order_release);
+}
+
+static void *sampler_thread(void *arg) {
+  struct us_sampler *s = arg;
+  struct us_sample sample;
+  struct timespec next;
+  int value;
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (atomic_load_explicit(&s->running, memory_order_relaxed)) {
+    // Dixièmes de cm, soit des mm, quelles que soient les décimales du mode
+    if (sensor_reader_value_fixed(&s->reader, 1, &value) == 0)
+      atomic_fetch_add_explicit(&s->errors, 1, memory_order_relaxed);
+    else {
+      sample.t_ns = now_ns();
+      sample.distance_mm = value;
+      publish(s, &sample);
+      spsc_ring_push(&s->ring, &sample);
+      atomic_fetch_add_explicit(&s->samples, 1, memory_order_relaxed);
+    }
+
+    next.tv_nsec += s->period_us * 1000L;
+    while (next.tv_nsec >= 1000000000L) {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+      ;
+  }
+
+  return NULL;
+}
+
+int us_sampler_start(struct us_sampler *s, uint8_t sn, unsigned int period_us,
+		     size_t capacity) {
+  if (!sensor_reader_open(&s->reader, sn))
+    return 0;
+  // Pas de mesure de l'ancien mode dans le tampon
+  if (ready_sensor_mode(&s->reader, LEGO_EV3_US_US_DIST_CM,
+			US_SAMPLER_READY_MS, NULL) < 0)
+    goto fail;
+  if (!spsc_ring_init(&s->ring, capacity, sizeof(struct us_sample)))
+    goto fail;
+  s->period_us = period_us;
+  atomic_init(&s->seq, 0);
+  atomic_init(&s->samples, 0);
+  atomic_init(&s->errors, 0);
+  atomic_init(&s->running, 1);
+  if (pthread_create(&s->thread, NULL, sampler_thread, s) != 0) {
+    spsc_ring_destroy(&s->ring);
+    goto fail;
+  }
+
+  return 1;
+
+ fail:
+  sensor_reader_close(&s->reader);
+
+  return 0;
+}
+
+void us_sampler_stop(struct us_sampler *s) {
+  atomic_store(&s->running, 0);
+  pthread_join(s->thread, NULL);
+  spsc_ring_destroy(&s->ring);
+  sensor_reader_close(&s->reader);
+}
+
+int us_sampler_latest(struct us_sampler *s, struct us_sample *out) {
+  unsigned int seq;
+
+  do {
+    seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+    if (seq == 0)
+      return 0;
+    *out = s->latest;
+    atomic_thread_fence(memory_order_acquire);
+  } while ((seq & 1) ||
+	   seq != atomic_load_explicit(&s->seq, memory_order_relaxed));
+
+  return 1;
+}
+
+size_t us_sampler_batch(struct us_sampler *s, struct us_sample *out, size_t max) {
+  return spsc_ring_pop_batch(&s->ring, out, max);
+}
+
+unsigned long us_sampler_drops(struct us_sampler *s) {
+  return atomic_load_explicit(&s->ring.drops, memory_order_relaxed);
+}
+
+long us_sample_age_us(const struct us_sample *sample) {
+  return (long) ((now_ns() - sample->t_ns) / 1000);
+}
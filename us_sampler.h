@@ -0,0 +1,69 @@
+/*
+ * Echantillonnage du capteur à ultrasons en arrière-plan.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Un fil dédié lit la distance (mode US-DIST-CM) à période fixe et pousse
+ * des mesures horodatées dans une file sans verrou. Le code de commande
+ * récupère la dernière mesure ou un lot de mesures sans jamais attendre
+ * sysfs, et l'âge de chaque mesure permet de juger de sa fraîcheur.
+ */
+
+#ifndef US_SAMPLER_H
+#define US_SAMPLER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "sensor_reader.h"
+#include "spsc_ring.h"
+
+// Délai maximal d'attente de la première distance après le changement de mode
+#define US_SAMPLER_READY_MS 100
+
+struct us_sample {
+  // Horodatage CLOCK_MONOTONIC de la fin de la lecture, en nanosecondes
+  uint64_t t_ns;
+  // Distance en millimètres (US-DIST-CM lu en virgule fixe à une décimale)
+  int distance_mm;
+};
+
+struct us_sampler {
+  struct sensor_reader reader;
+  struct spsc_ring ring;
+  pthread_t thread;
+  atomic_int running;
+  unsigned int period_us;
+  // Dernière mesure protégée par un compteur de séquence
+  atomic_uint seq;
+  struct us_sample latest;
+  // Statistiques du fil d'échantillonnage
+  atomic_ulong samples;
+  atomic_ulong errors;
+};
+
+/*
+ * Passage du capteur 'sn' en mode US-DIST-CM, attente de la première
+ * distance (voir ready_sensor_mode) et démarrage du fil d'échantillonnage
+ * avec une période de 'period_us' et une file de 'capacity' mesures.
+ * Retourne 1 en cas de succès, 0 sinon.
+ */
+int us_sampler_start(struct us_sampler *s, uint8_t sn, unsigned int period_us,
+		     size_t capacity);
+void us_sampler_stop(struct us_sampler *s);
+
+// Dernière mesure. Retourne 0 si aucune mesure n'a encore été faite.
+int us_sampler_latest(struct us_sampler *s, struct us_sample *out);
+
+// Retire au plus 'max' mesures de la file, dans l'ordre, et retourne leur nombre
+size_t us_sampler_batch(struct us_sampler *s, struct us_sample *out, size_t max);
+
+// Mesures perdues parce que la file était pleine
+unsigned long us_sampler_drops(struct us_sampler *s);
+
+// Age d'une mesure en microsecondes
+long us_sample_age_us(const struct us_sample *sample);
+
+#endif
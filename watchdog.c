@@ -0,0 +1,95 @@
+/*
+ * Chien de garde des servomoteurs: côté programme surveillé.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "watchdog.h"
+#include "zlog.h"
+
+// Catégorie zlog définie par le programme
+extern zlog_category_t *zlog_c;
+
+struct watchdog_slot *watchdog_self;
+
+static struct watchdog_shm *shm;
+static int sock = -1;
+
+int watchdog_attach(unsigned int timeout_ms) {
+  struct sockaddr_un addr;
+  struct watchdog_hello hello = { getpid(), timeout_ms };
+  int32_t slot = -1;
+  int fd;
+
+  sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0)
+    return 0;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", WATCHDOG_SOCKET);
+  if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+    zlog_warn(zlog_c, "Pas de chien de garde, les servomoteurs ne seront pas arrêtés en cas de plantage");
+    goto fail;
+  }
+
+  fd = open(WATCHDOG_SHM, O_RDWR);
+  if (fd < 0)
+    goto fail;
+  shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED || shm->magic != WATCHDOG_MAGIC)
+    goto fail;
+
+  if (send(sock, &hello, sizeof(hello), MSG_NOSIGNAL) != sizeof(hello) ||
+      read(sock, &slot, sizeof(slot)) != sizeof(slot) || slot < 0 ||
+      slot >= WATCHDOG_CLIENTS) {
+    zlog_warn(zlog_c, "Le chien de garde a refusé l'inscription");
+    goto fail;
+  }
+  watchdog_self = &shm->slot[slot];
+  zlog_info(zlog_c, "Inscrit auprès du chien de garde, échéance %u ms",
+	    timeout_ms);
+
+  return 1;
+
+ fail:
+  if (shm != NULL && shm != MAP_FAILED)
+    munmap(shm, sizeof(*shm));
+  shm = NULL;
+  close(sock);
+  sock = -1;
+
+  return 0;
+}
+
+void watchdog_arm(unsigned int timeout_ms) {
+  if (watchdog_self == NULL)
+    return;
+  // Un battement d'abord, pour que l'échéance parte de maintenant
+  watchdog_beat();
+  atomic_store_explicit(&watchdog_self->timeout_ms, timeout_ms,
+			memory_order_release);
+}
+
+void watchdog_detach(void) {
+  char bye = WATCHDOG_BYE;
+
+  if (watchdog_self == NULL)
+    return;
+  if (send(sock, &bye, 1, MSG_NOSIGNAL) != 1)
+    zlog_warn(zlog_c, "Désinscription du chien de garde impossible");
+  close(sock);
+  sock = -1;
+  watchdog_self = NULL;
+  munmap(shm, sizeof(*shm));
+  shm = NULL;
+}
@@ -0,0 +1,95 @@
+/*
+ * Chien de garde des servomoteurs: côté programme surveillé.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Le démon watchdogd arrête tous les servomoteurs quand un programme
+ * inscrit se termine sans s'être désinscrit (plantage, signal) ou, si une
+ * échéance est armée, quand ses battements de coeur cessent plus longtemps
+ * que l'échéance.
+ *
+ * L'inscription passe par une socket Unix que le programme garde ouverte:
+ * le noyau la ferme à la mort du processus, ce que le démon voit tout de
+ * suite. Les battements sont un compteur dans une case de mémoire partagée
+ * avec le démon; watchdog_beat() n'est qu'une lecture de CLOCK_MONOTONIC
+ * (vDSO) et deux écritures en mémoire, sans appel système, et convient à
+ * une boucle à 1 kHz. L'instant du dernier battement permet au démon de
+ * mesurer son retard de détection depuis le battement lui-même, et non
+ * depuis le moment où il l'a vu.
+ */
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+
+#define WATCHDOG_SOCKET "/tmp/ev3_watchdog.sock"
+#define WATCHDOG_SHM "/dev/shm/ev3_watchdog"
+#define WATCHDOG_MAGIC 0x44573345 // "EV3W"
+#define WATCHDOG_CLIENTS 8
+
+// Case d'un programme inscrit, seule sur sa ligne de cache
+struct watchdog_slot {
+  atomic_uint beat;
+  // Echéance en millisecondes, 0 si seule la fin du programme est surveillée
+  atomic_uint timeout_ms;
+  // Instant CLOCK_MONOTONIC du dernier battement en ns, 0 avant le premier
+  atomic_ullong beat_ns;
+  char pad[64 - 2 * sizeof(atomic_uint) - sizeof(atomic_ullong)];
+};
+
+struct watchdog_shm {
+  uint32_t magic;
+  uint32_t clients;
+  char pad[56];
+  struct watchdog_slot slot[WATCHDOG_CLIENTS];
+};
+
+// Demande d'inscription et réponse (numéro de case, -1 si tout est pris)
+struct watchdog_hello {
+  int32_t pid;
+  uint32_t timeout_ms;
+};
+
+// Octet envoyé au démon avant de se désinscrire
+#define WATCHDOG_BYE 'D'
+
+// Case du programme, nulle s'il n'est pas inscrit
+extern struct watchdog_slot *watchdog_self;
+
+/*
+ * Inscription auprès du démon avec l'échéance 'timeout_ms' (0 pour ne
+ * surveiller que la fin du programme).
+ * Retourne 1 si le démon a accepté, 0 sinon; watchdog_beat() et
+ * watchdog_arm() sont alors sans effet.
+ */
+int watchdog_attach(unsigned int timeout_ms);
+
+/*
+ * Changement de l'échéance, p.ex. armée le temps d'une boucle de commande
+ * et désarmée (0) pendant les attentes longues.
+ */
+void watchdog_arm(unsigned int timeout_ms);
+
+static inline void watchdog_beat(void) {
+  struct timespec ts;
+  unsigned int beat;
+
+  if (watchdog_self == NULL)
+    return;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  atomic_store_explicit(&watchdog_self->beat_ns,
+			ts.tv_sec * 1000000000ULL + ts.tv_nsec,
+			memory_order_relaxed);
+  // Un seul écrivain par case: pas besoin d'incrément atomique
+  beat = atomic_load_explicit(&watchdog_self->beat, memory_order_relaxed);
+  atomic_store_explicit(&watchdog_self->beat, beat + 1, memory_order_release);
+}
+
+// Désinscription: la fin du programme ne déclenche plus l'arrêt
+void watchdog_detach(void);
+
+#endif
@@ -0,0 +1,336 @@
+/*
+ * Chien de garde des servomoteurs.
+ *
+ * Auteur: Dorian Burihabwa
+ * Auteur: Christian Göttel
+ *
+ * Utilisation: watchdogd [coast|brake|hold]
+ *
+ * Démon résident auquel s'inscrivent les programmes de test (voir
+ * watchdog.h). Les attributs d'arrêt des servomoteurs sont ouverts au
+ * démarrage (voir fast_stop.h), de sorte qu'un arrêt ne coûte que deux
+ * pwrite par servomoteur. Les échéances sont vérifiées toutes les
+ * WATCHDOG_CHECK_MS; un programme est donc déclaré bloqué au plus
+ * WATCHDOG_CHECK_MS après son échéance. Pour chaque arrêt, le retard de
+ * détection et la durée de l'arrêt sont journalisés, et leurs maxima sont
+ * rapportés à la fin du démon (SIGINT ou SIGTERM). Le retard d'un blocage
+ * est compté depuis l'instant du dernier battement écrit par le programme
+ * plus l'échéance. L'instant de la fin d'un programme n'est pas connu: son
+ * retard est compté depuis le dernier battement, une borne supérieure
+ * rapportée à part.
+ *
+ * Matériel demandé:
+ * - les servomoteurs à arrêter, sur n'importe quel port
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <ev3.h>
+#include <ev3_port.h>
+
+#include "fast_stop.h"
+#include "periodic.h"
+#include "watchdog.h"
+#include "zlog.h"
+
+// Période de vérification des échéances
+#define WATCHDOG_CHECK_MS 2
+// Priorité temps réel, au-dessus des boucles de commande
+#define WATCHDOG_PRIORITY 60
+
+struct client {
+  int fd;
+  int pid;
+  unsigned int beat;
+  unsigned int timeout_ms;
+  long long change_ns;
+  int tripped;
+};
+
+// Variable globale spécifique à zlog
+zlog_category_t *zlog_c;
+
+static volatile sig_atomic_t stop;
+static struct watchdog_shm *shm;
+static struct client clients[WATCHDOG_CLIENTS];
+static struct fast_stop motors;
+static const uint8_t ports[] = { OUTPUT_A, OUTPUT_B, OUTPUT_C, OUTPUT_D };
+static const char *action = FAST_STOP_ACTION;
+
+// Statistiques des arrêts
+static unsigned long trips;
+static long long max_detect_ns, max_exit_ns, max_stop_ns;
+
+static long long now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void on_signal(int sig) {
+  (void) sig;
+  stop = 1;
+}
+
+/*
+ * Arrêt des servomoteurs pour le programme 'c'. 'detect_ns' est le retard
+ * entre l'échéance dépassée et sa détection ou, pour la fin du programme
+ * ('exited'), le temps depuis le dernier battement, -1 sans battement.
+ */
+static void trip(struct client *c, const char *reason, long long detect_ns,
+		 int exited) {
+  long long start = now_ns(), stop_ns;
+  int fired;
+
+  fired = fast_stop_fire(&motors, action);
+  if (fired < motors.count || motors.count == 0) {
+    // Servomoteurs rebranchés: nouvelle découverte
+    fast_stop_close(&motors);
+    fast_stop_open(&motors, ports, sizeof(ports), 1);
+    fired = fast_stop_fire(&motors, action);
+  }
+  stop_ns = now_ns() - start;
+
+  trips++;
+  if (exited && detect_ns > max_exit_ns)
+    max_exit_ns = detect_ns;
+  else if (!exited && detect_ns > max_detect_ns)
+    max_detect_ns = detect_ns;
+  if (stop_ns > max_stop_ns)
+    max_stop_ns = stop_ns;
+  if (detect_ns < 0)
+    zlog_warn(zlog_c, "Programme %d %s : %d servomoteur(s) arrêté(s), arrêt en %lld us",
+	      c->pid, reason, fired, stop_ns / 1000);
+  else
+    zlog_warn(zlog_c, "Programme %d %s : %d servomoteur(s) arrêté(s), détection %s%lld us, arrêt en %lld us",
+	      c->pid, reason, fired, exited ? "<= " : "+", detect_ns / 1000,
+	      stop_ns / 1000);
+}
+
+static void release(struct client *c) {
+  close(c->fd);
+  c->fd = -1;
+}
+
+static void accept_client(int listener) {
+  struct watchdog_hello hello;
+  struct client *c = NULL;
+  int32_t slot = -1;
+  int fd, i;
+
+  fd = accept(listener, NULL, NULL);
+  if (fd < 0)
+    return;
+  if (read(fd, &hello, sizeof(hello)) != sizeof(hello)) {
+    close(fd);
+    return;
+  }
+  for (i = 0; i < WATCHDOG_CLIENTS && c == NULL; i++)
+    if (clients[i].fd < 0) {
+      c = &clients[i];
+      slot = i;
+    }
+  if (c != NULL) {
+    c->fd = fd;
+    c->pid = hello.pid;
+    c->beat = atomic_load_explicit(&shm->slot[slot].beat, memory_order_relaxed);
+    c->timeout_ms = hello.timeout_ms;
+    c->change_ns = now_ns();
+    c->tripped = 0;
+    atomic_store_explicit(&shm->slot[slot].beat_ns, 0, memory_order_relaxed);
+    atomic_store_explicit(&shm->slot[slot].timeout_ms, hello.timeout_ms,
+			  memory_order_release);
+    zlog_info(zlog_c, "Programme %d inscrit, échéance %u ms", c->pid,
+	      hello.timeout_ms);
+  } else
+    zlog_warn(zlog_c, "Programme %d refusé, plus de case libre", hello.pid);
+  if (send(fd, &slot, sizeof(slot), MSG_NOSIGNAL) != sizeof(slot) || c == NULL) {
+    if (c != NULL)
+      c->fd = -1;
+    close(fd);
+  }
+}
+
+// Message ou fermeture de la socket d'un programme
+static void client_event(struct client *c) {
+  unsigned long long beat_ns;
+  char bye;
+
+  if (read(c->fd, &bye, 1) == 1 && bye == WATCHDOG_BYE) {
+    zlog_info(zlog_c, "Programme %d désinscrit", c->pid);
+  } else {
+    beat_ns = atomic_load_explicit(&shm->slot[c - clients].beat_ns,
+				   memory_order_relaxed);
+    trip(c, "terminé sans se désinscrire",
+	 beat_ns > 0 ? now_ns() - (long long) beat_ns : -1, 1);
+  }
+  release(c);
+}
+
+// Vérification des échéances des programmes inscrits
+static void check(long long now) {
+  struct watchdog_slot *s;
+  struct client *c;
+  unsigned int beat, timeout;
+  unsigned long long beat_ns;
+  long long late;
+  int i;
+
+  for (i = 0; i < WATCHDOG_CLIENTS; i++) {
+    c = &clients[i];
+    if (c->fd < 0)
+      continue;
+    s = &shm->slot[i];
+    beat = atomic_load_explicit(&s->beat, memory_order_acquire);
+    timeout = atomic_load_explicit(&s->timeout_ms, memory_order_acquire);
+    if (beat != c->beat || timeout != c->timeout_ms) {
+      c->beat = beat;
+      c->timeout_ms = timeout;
+      c->change_ns = now;
+      c->tripped = 0;
+      continue;
+    }
+    if (timeout == 0 || c->tripped)
+      continue;
+    // Depuis le dernier battement, ou depuis son observation sans battement
+    beat_ns = atomic_load_explicit(&s->beat_ns, memory_order_relaxed);
+    late = now - (beat_ns > 0 ? (long long) beat_ns : c->change_ns) -
+      timeout * 1000000LL;
+    if (late > 0) {
+      trip(c, "bloqué", late, 0);
+      c->tripped = 1;
+    }
+  }
+}
+
+static int open_shm(void) {
+  int fd;
+
+  fd = open(WATCHDOG_SHM, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0 || ftruncate(fd, sizeof(*shm)) != 0) {
+    zlog_fatal(zlog_c, "Impossible de créer '%s' : %s", WATCHDOG_SHM,
+	       strerror(errno));
+    return 0;
+  }
+  shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED)
+    return 0;
+  shm->clients = WATCHDOG_CLIENTS;
+  shm->magic = WATCHDOG_MAGIC;
+
+  return 1;
+}
+
+static int open_socket(void) {
+  struct sockaddr_un addr;
+  int fd;
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", WATCHDOG_SOCKET);
+  unlink(WATCHDOG_SOCKET);
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+      listen(fd, WATCHDOG_CLIENTS) != 0) {
+    zlog_fatal(zlog_c, "Impossible d'écouter sur '%s' : %s", WATCHDOG_SOCKET,
+	       strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+int main(int argc, char *argv[]) {
+  struct pollfd pfd[WATCHDOG_CLIENTS + 1];
+  struct client *owner[WATCHDOG_CLIENTS + 1];
+  int i, n, listener;
+
+  // Variables constantes spécifique à zlog
+  const char *zlog_conf = "/etc/zlog.conf";
+  const char *zlog_cat  = "project";
+
+  if (zlog_init(zlog_conf)) {
+    printf("L'initialisation de zlog avec '%s' a échoué\n", zlog_conf);
+    return EXIT_FAILURE;
+  }
+
+  zlog_c = zlog_get_category(zlog_cat);
+  if (!zlog_c) {
+    printf("zlog est incapable de retrouver la catégorie '%s'\n", zlog_cat);
+    puts("Impression des messages par zlog est désactivé");
+    zlog_fini();
+  }
+
+  if (argc > 1)
+    action = argv[1];
+  if (!fast_stop_action_valid(action)) {
+    zlog_error(zlog_c, "Action '%s' inconnue, 'coast', 'brake' ou 'hold' attendue",
+	       action);
+    zlog_fini();
+    return EXIT_FAILURE;
+  }
+  for (i = 0; i < WATCHDOG_CLIENTS; i++)
+    clients[i].fd = -1;
+  if (!fast_stop_open(&motors, ports, sizeof(ports), 0) && motors.count == 0)
+    fast_stop_open(&motors, ports, sizeof(ports), 1);
+  if (motors.count == 0)
+    zlog_warn(zlog_c, "Aucun servomoteur trouvé, nouvelle découverte au premier arrêt");
+  if (!open_shm() || (listener = open_socket()) < 0) {
+    zlog_fini();
+    return EXIT_FAILURE;
+  }
+  periodic_setup_rt(WATCHDOG_PRIORITY, 1, -1);
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+  zlog_info(zlog_c, "Chien de garde prêt : %d servomoteur(s), arrêt '%s', vérification toutes les %d ms",
+	    motors.count, action, WATCHDOG_CHECK_MS);
+
+  while (!stop) {
+    pfd[0].fd = listener;
+    pfd[0].events = POLLIN;
+    for (i = 0, n = 1; i < WATCHDOG_CLIENTS; i++)
+      if (clients[i].fd >= 0) {
+	pfd[n].fd = clients[i].fd;
+	pfd[n].events = POLLIN;
+	owner[n++] = &clients[i];
+      }
+    if (poll(pfd, n, WATCHDOG_CHECK_MS) > 0) {
+      for (i = 1; i < n; i++)
+	if (pfd[i].revents)
+	  client_event(owner[i]);
+      if (pfd[0].revents & POLLIN)
+	accept_client(listener);
+    }
+    check(now_ns());
+  }
+
+  zlog_info(zlog_c, "Chien de garde : %lu arrêt(s), détection d'un blocage +%lld us au pire, d'une fin <= %lld us au pire (depuis le dernier battement), arrêt en %lld us au pire",
+	    trips, max_detect_ns / 1000, max_exit_ns / 1000, max_stop_ns / 1000);
+  close(listener);
+  unlink(WATCHDOG_SOCKET);
+  fast_stop_close(&motors);
+  munmap(shm, sizeof(*shm));
+  unlink(WATCHDOG_SHM);
+
+  zlog_fini();
+
+  return EXIT_SUCCESS;
+}